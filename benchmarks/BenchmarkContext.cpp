@@ -0,0 +1,219 @@
+#include "BenchmarkContext.h"
+
+#include <sofa/core/visual/VisualParams.h>
+
+#include <QtGui/private/qrhinull_p.h>
+#if QT_CONFIG(opengl)
+# include <QOffscreenSurface>
+# include <QtGui/private/qrhigles2_p.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+std::atomic<std::size_t> s_allocationCount{ 0 };
+std::atomic<std::size_t> s_allocatedBytes{ 0 };
+}
+
+// Count every allocation of the program
+void* operator new(std::size_t size)
+{
+    s_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    s_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace sofa::rhi::benchmarks
+{
+
+std::size_t AllocationCounter::count()
+{
+    return s_allocationCount.load(std::memory_order_relaxed);
+}
+
+std::size_t AllocationCounter::bytes()
+{
+    return s_allocatedBytes.load(std::memory_order_relaxed);
+}
+
+BenchmarkContext::BenchmarkContext(const BenchmarkOptions& options)
+    : m_options(options)
+{
+    if (m_options.backend == QRhi::OpenGLES2)
+    {
+#if QT_CONFIG(opengl)
+        m_fallbackSurface.reset(QRhiGles2InitParams::newFallbackSurface());
+        QRhiGles2InitParams oglInitParams;
+        oglInitParams.fallbackSurface = m_fallbackSurface.get();
+        m_rhi.reset(QRhi::create(QRhi::OpenGLES2, &oglInitParams));
+#endif // QT_CONFIG(opengl)
+    }
+    else
+    {
+        QRhiNullInitParams nullInitParams;
+        m_rhi.reset(QRhi::create(QRhi::Null, &nullInitParams));
+    }
+
+    if (!m_rhi)
+    {
+        std::fprintf(stderr, "Failed to create the QRhi backend\n");
+        return;
+    }
+
+    const QSize outputSize(1280, 720);
+    m_texture = m_rhi->newTexture(QRhiTexture::RGBA8, outputSize, 1, QRhiTexture::RenderTarget);
+    m_texture->build();
+    m_depthStencil = m_rhi->newRenderBuffer(QRhiRenderBuffer::DepthStencil, outputSize, 1);
+    m_depthStencil->build();
+
+    QRhiTextureRenderTargetDescription rtDesc({ m_texture });
+    rtDesc.setDepthStencilBuffer(m_depthStencil);
+    m_renderTarget = m_rhi->newTextureRenderTarget(rtDesc);
+    m_rpDesc.reset(m_renderTarget->newCompatibleRenderPassDescriptor());
+    m_renderTarget->setRenderPassDescriptor(m_rpDesc.get());
+    m_renderTarget->build();
+
+    m_viewport = QRhiViewport(0, 0, float(outputSize.width()), float(outputSize.height()));
+
+    m_drawTool = std::make_unique<DrawToolRHI>(m_rhi, m_rpDesc);
+    sofa::core::visual::VisualParams::defaultInstance()->drawTool() = m_drawTool.get();
+}
+
+BenchmarkContext::~BenchmarkContext()
+{
+    sofa::core::visual::VisualParams::defaultInstance()->drawTool() = nullptr;
+    m_drawTool.reset();
+
+    if (m_renderTarget)
+    {
+        delete m_renderTarget;
+        m_rpDesc.reset();
+        delete m_depthStencil;
+        delete m_texture;
+    }
+}
+
+bool BenchmarkContext::isSelected(const std::string& name) const
+{
+    return m_options.filter.empty() || name.find(m_options.filter) != std::string::npos;
+}
+
+double BenchmarkContext::renderFrame(const RecordFunction& record, const DrawFunction& draw)
+{
+    using clock = std::chrono::steady_clock;
+
+    QRhiCommandBuffer* cb = nullptr;
+    if (m_rhi->beginOffscreenFrame(&cb) != QRhi::FrameOpSuccess)
+        return 0.0;
+
+    QRhiResourceUpdateBatch* updates = m_rhi->nextResourceUpdateBatch();
+    auto vparams = sofa::core::visual::VisualParams::defaultInstance();
+    m_drawTool->beginFrame(vparams, updates, cb, m_viewport);
+
+    auto begin = clock::now();
+    if (record)
+        record(updates);
+    auto elapsed = clock::now() - begin;
+
+    cb->beginPass(m_renderTarget, Qt::gray, { 1.0f, 0 }, updates);
+
+    begin = clock::now();
+    if (draw)
+        draw(cb, m_viewport);
+    m_drawTool->executeCommands();
+    elapsed += clock::now() - begin;
+
+    cb->endPass();
+    m_drawTool->endFrame();
+    m_rhi->endOffscreenFrame();
+
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+void BenchmarkContext::warmUp(const RecordFunction& record, const DrawFunction& draw)
+{
+    renderFrame(record, draw);
+}
+
+BenchmarkResult BenchmarkContext::run(const std::string& name, std::size_t primitivesPerFrame, const RecordFunction& record, const DrawFunction& draw)
+{
+    const int frames = std::max(1, m_options.frames);
+
+    double totalTime = 0.0;
+    std::size_t totalUploadedBytes = 0;
+    std::size_t totalAllocations = 0;
+    std::size_t totalAllocatedBytes = 0;
+
+    for (int i = 0; i < frames; i++)
+    {
+        // the allocations done by QRhi in begin/endFrame are counted too, they are part of the frame cost
+        const std::size_t allocationsBefore = AllocationCounter::count();
+        const std::size_t bytesBefore = AllocationCounter::bytes();
+
+        totalTime += renderFrame(record, draw);
+
+        totalAllocations += AllocationCounter::count() - allocationsBefore;
+        totalAllocatedBytes += AllocationCounter::bytes() - bytesBefore;
+
+        const auto& frameStatistics = m_drawTool->getFrameStatistics();
+        totalUploadedBytes += frameStatistics.drawToolUploadedBytes + frameStatistics.modelUploadedBytes;
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.primitivesPerFrame = primitivesPerFrame;
+    result.nsPerFrame = totalTime / frames;
+    result.nsPerPrimitive = primitivesPerFrame > 0 ? result.nsPerFrame / double(primitivesPerFrame) : 0.0;
+    result.bytesPerFrame = totalUploadedBytes / frames;
+    result.allocationsPerFrame = double(totalAllocations) / frames;
+    result.allocatedBytesPerFrame = double(totalAllocatedBytes) / frames;
+
+    return result;
+}
+
+void printResults(const std::vector<BenchmarkResult>& results)
+{
+    std::printf("%-40s %12s %12s %14s %14s %12s %16s\n",
+        "benchmark", "primitives", "ns/prim", "us/frame", "bytes/frame", "allocs/frame", "alloc bytes/frame");
+    for (const auto& result : results)
+    {
+        std::printf("%-40s %12zu %12.2f %14.2f %14zu %12.1f %16.0f\n",
+            result.name.c_str(), result.primitivesPerFrame, result.nsPerPrimitive, result.nsPerFrame * 1e-3,
+            result.bytesPerFrame, result.allocationsPerFrame, result.allocatedBytesPerFrame);
+    }
+}
+
+} // namespace sofa::rhi::benchmarks
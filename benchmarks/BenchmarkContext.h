@@ -0,0 +1,91 @@
+#pragma once
+
+#include <SofaRHI/DrawToolRHI.h>
+#include <SofaRHI/RHIUtils.h>
+
+#include <QtGui/private/qrhi_p.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class QOffscreenSurface;
+
+namespace sofa::rhi::benchmarks
+{
+
+/// Number of calls to operator new (and allocated bytes) since the beginning of the program
+struct AllocationCounter
+{
+    static std::size_t count();
+    static std::size_t bytes();
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::size_t primitivesPerFrame;
+    double nsPerPrimitive;
+    double nsPerFrame;
+    std::size_t bytesPerFrame; // uploaded to the GPU (from the frame statistics)
+    double allocationsPerFrame;
+    double allocatedBytesPerFrame;
+};
+
+struct BenchmarkOptions
+{
+    QRhi::Implementation backend = QRhi::Null;
+    std::size_t size = 10000; // number of primitives (or vertices) per frame
+    int frames = 100;
+    std::string filter; // run only the benchmarks whose name contains it
+};
+
+/// Owns a QRhi rendering in an offscreen texture, and a DrawToolRHI set as the default one
+class BenchmarkContext
+{
+public:
+    using RecordFunction = std::function<void(QRhiResourceUpdateBatch*)>;
+    using DrawFunction = std::function<void(QRhiCommandBuffer*, const QRhiViewport&)>;
+
+    BenchmarkContext(const BenchmarkOptions& options);
+    ~BenchmarkContext();
+
+    bool isValid() const { return m_rhi != nullptr; }
+    const BenchmarkOptions& getOptions() const { return m_options; }
+
+    QRhiPtr getRHI() { return m_rhi; }
+    QRhiRenderPassDescriptorPtr getRenderPassDescriptor() { return m_rpDesc; }
+    DrawToolRHI* getDrawTool() { return m_drawTool.get(); }
+
+    /// Render one frame (not measured), e.g to initialize resources
+    void warmUp(const RecordFunction& record, const DrawFunction& draw = {});
+
+    /// Render getOptions().frames frames, measuring the time spent in record(), draw() and DrawToolRHI::executeCommands()
+    /// record() is called outside of the render pass (resource updates), draw() inside
+    BenchmarkResult run(const std::string& name, std::size_t primitivesPerFrame, const RecordFunction& record, const DrawFunction& draw = {});
+
+    bool isSelected(const std::string& name) const;
+
+private:
+    // returns the measured time in nanoseconds
+    double renderFrame(const RecordFunction& record, const DrawFunction& draw);
+
+    BenchmarkOptions m_options;
+    std::unique_ptr<QOffscreenSurface> m_fallbackSurface;
+    QRhiPtr m_rhi;
+    QRhiTexture* m_texture = nullptr;
+    QRhiRenderBuffer* m_depthStencil = nullptr;
+    QRhiTextureRenderTarget* m_renderTarget = nullptr;
+    QRhiRenderPassDescriptorPtr m_rpDesc;
+    std::unique_ptr<DrawToolRHI> m_drawTool;
+    QRhiViewport m_viewport;
+};
+
+void runDrawToolRHIBenchmarks(BenchmarkContext& context, std::vector<BenchmarkResult>& results);
+void runRHIModelBenchmarks(BenchmarkContext& context, std::vector<BenchmarkResult>& results);
+
+void printResults(const std::vector<BenchmarkResult>& results);
+
+} // namespace sofa::rhi::benchmarks
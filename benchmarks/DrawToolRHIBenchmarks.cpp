@@ -0,0 +1,132 @@
+#include "BenchmarkContext.h"
+
+#include <sofa/type/RGBAColor.h>
+#include <sofa/type/Vec.h>
+
+#include <algorithm>
+#include <random>
+
+namespace sofa::rhi::benchmarks
+{
+
+namespace
+{
+
+using sofa::type::Vector3;
+using sofa::type::RGBAColor;
+
+std::vector<Vector3> generatePoints(std::size_t number)
+{
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+    std::vector<Vector3> points(number);
+    for (auto& point : points)
+        point = Vector3(distribution(generator), distribution(generator), distribution(generator));
+
+    return points;
+}
+
+// DrawToolRHI does not resize its buffers (a batch which does not fit is not drawn): the number of primitives of a benchmark
+// is limited to what they hold, given the bytes of vertices, indices (32 bits at worst) and instances of each primitive (0 if none)
+std::size_t fitInDrawToolBuffers(std::size_t size, std::size_t vertexByteSize, std::size_t indexByteSize, std::size_t instanceByteSize = 0)
+{
+    std::size_t number = size;
+    if (vertexByteSize > 0)
+        number = std::min(number, std::size_t(DrawToolRHI::INITIAL_VERTEX_BUFFER_SIZE) / vertexByteSize);
+    // the offset of each batch of indices is aligned on 4 bytes
+    if (indexByteSize > 0)
+        number = std::min(number, std::size_t(DrawToolRHI::INITIAL_INDEX_BUFFER_SIZE - 3) / indexByteSize);
+    if (instanceByteSize > 0)
+        number = std::min(number, std::size_t(DrawToolRHI::INITIAL_INSTANCE_BUFFER_SIZE) / instanceByteSize);
+    return std::max<std::size_t>(1, number);
+}
+
+// bytes of a vertex in the DrawToolRHI buffers: float position, float normal (triangles only) and float color
+constexpr std::size_t COLORED_VERTEX_BYTES = 3 * sizeof(float) + 4 * sizeof(float);
+constexpr std::size_t LIT_VERTEX_BYTES = COLORED_VERTEX_BYTES + 3 * sizeof(float);
+constexpr std::size_t INDEX_BYTES = sizeof(quint32);
+
+} // namespace
+
+void runDrawToolRHIBenchmarks(BenchmarkContext& context, std::vector<BenchmarkResult>& results)
+{
+    DrawToolRHI* drawTool = context.getDrawTool();
+    const std::size_t size = context.getOptions().size;
+    const RGBAColor color = RGBAColor::white();
+
+    // make sure the pipelines and buffers are created before measuring
+    context.warmUp({});
+
+    const auto addBenchmark = [&](const std::string& name, std::size_t primitives, const BenchmarkContext::RecordFunction& record)
+    {
+        if (!context.isSelected(name))
+            return;
+        context.warmUp(record);
+        results.push_back(context.run(name, primitives, record));
+    };
+
+    {
+        const std::size_t pointNumber = fitInDrawToolBuffers(size, COLORED_VERTEX_BYTES, INDEX_BYTES);
+        const auto points = generatePoints(pointNumber);
+        addBenchmark("DrawToolRHI::drawPoints", pointNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            drawTool->drawPoints(points, 1.0f, color);
+        });
+    }
+    {
+        const std::size_t lineNumber = fitInDrawToolBuffers(size, 2 * COLORED_VERTEX_BYTES, 2 * INDEX_BYTES);
+        const auto points = generatePoints(lineNumber * 2);
+        addBenchmark("DrawToolRHI::drawLines", lineNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            drawTool->drawLines(points, 1.0f, color);
+        });
+    }
+    {
+        const std::size_t triangleNumber = fitInDrawToolBuffers(size, 3 * LIT_VERTEX_BYTES, 3 * INDEX_BYTES);
+        const auto points = generatePoints(triangleNumber * 3);
+        addBenchmark("DrawToolRHI::drawTriangles", triangleNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            drawTool->drawTriangles(points, color);
+        });
+    }
+    {
+        // 2 triangles per quad
+        const std::size_t quadNumber = fitInDrawToolBuffers(size, 4 * LIT_VERTEX_BYTES, 6 * INDEX_BYTES);
+        const auto points = generatePoints(quadNumber * 4);
+        addBenchmark("DrawToolRHI::drawQuads", quadNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            drawTool->drawQuads(points, color);
+        });
+    }
+    {
+        // 6 quads (24 vertices) per hexahedron
+        const std::size_t hexahedronNumber = fitInDrawToolBuffers(size, 24 * LIT_VERTEX_BYTES, 36 * INDEX_BYTES);
+        const auto points = generatePoints(hexahedronNumber * 8);
+        addBenchmark("DrawToolRHI::drawHexahedra", hexahedronNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            drawTool->drawHexahedra(points, color);
+        });
+    }
+    {
+        // one instance of the same sphere mesh per point
+        const std::size_t sphereNumber = fitInDrawToolBuffers(size, 0, 0, 3 * sizeof(float));
+        const auto points = generatePoints(sphereNumber);
+        addBenchmark("DrawToolRHI::drawSpheres", sphereNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            drawTool->drawSpheres(points, 0.01f, color);
+        });
+    }
+    {
+        // one call per cylinder, which is how components use it (a batch each: 85 vertices and 96 triangles with 16 sectors)
+        const std::size_t cylinderNumber = fitInDrawToolBuffers(std::max<std::size_t>(1, size / 10), 85 * LIT_VERTEX_BYTES, 96 * 3 * INDEX_BYTES + 3);
+        const auto points = generatePoints(cylinderNumber * 2);
+        addBenchmark("DrawToolRHI::drawCylinder", cylinderNumber, [&](QRhiResourceUpdateBatch*)
+        {
+            for (std::size_t i = 0; i < cylinderNumber; i++)
+                drawTool->drawCylinder(points[2 * i], points[2 * i + 1], 0.01f, color);
+        });
+    }
+}
+
+} // namespace sofa::rhi::benchmarks
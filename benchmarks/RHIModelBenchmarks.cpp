@@ -0,0 +1,111 @@
+#include "BenchmarkContext.h"
+
+#include <SofaRHI/RHIModel.h>
+
+#include <sofa/simulation/Node.h>
+#include <sofa/simulation/Simulation.h>
+#include <sofa/helper/accessor.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sofa::rhi::benchmarks
+{
+
+namespace
+{
+
+// Regular grid of (at least) vertexNumber vertices in the XY plane
+void generateGrid(RHIModel* model, std::size_t vertexNumber)
+{
+    const std::size_t side = std::max<std::size_t>(2, std::size_t(std::ceil(std::sqrt(double(vertexNumber)))));
+
+    auto positions = sofa::helper::getWriteOnlyAccessor(model->m_positions);
+    auto triangles = sofa::helper::getWriteOnlyAccessor(model->m_triangles);
+    positions.resize(side * side);
+    triangles.clear();
+
+    for (std::size_t j = 0; j < side; j++)
+    {
+        for (std::size_t i = 0; i < side; i++)
+        {
+            positions[j * side + i] = RHIModel::Coord(float(i) / float(side), float(j) / float(side), 0.0f);
+        }
+    }
+    for (std::size_t j = 0; j < side - 1; j++)
+    {
+        for (std::size_t i = 0; i < side - 1; i++)
+        {
+            const auto v0 = sofa::Index(j * side + i);
+            const auto v1 = v0 + 1;
+            const auto v2 = v0 + sofa::Index(side);
+            const auto v3 = v2 + 1;
+            triangles.push_back({ v0, v1, v3 });
+            triangles.push_back({ v0, v3, v2 });
+        }
+    }
+}
+
+} // namespace
+
+void runRHIModelBenchmarks(BenchmarkContext& context, std::vector<BenchmarkResult>& results)
+{
+    const std::string uploadName = "RHIModel::upload positions";
+    const std::string commandsName = "RHIModel::commands";
+    if (!context.isSelected(uploadName) && !context.isSelected(commandsName))
+        return;
+
+    auto root = sofa::simulation::getSimulation()->createNewGraph("root");
+    auto model = sofa::core::objectmodel::New<RHIModel>();
+    model->setName("benchmarkModel");
+    generateGrid(model.get(), context.getOptions().size);
+    root->addObject(model);
+
+    model->init();
+    model->initVisual();
+    if (!model->initGraphicResources(context.getRHI(), context.getRenderPassDescriptor()))
+        return;
+
+    const std::size_t vertexNumber = model->m_positions.getValue().size();
+
+    const BenchmarkContext::DrawFunction draw = [&](QRhiCommandBuffer* cb, const QRhiViewport& viewport)
+    {
+        model->updateGraphicCommands(cb, viewport);
+        context.getDrawTool()->submitDrawQueue();
+    };
+
+    // first upload of the whole mesh
+    context.warmUp([&](QRhiResourceUpdateBatch* batch) { model->updateGraphicResources(batch); }, draw);
+
+    if (context.isSelected(uploadName))
+    {
+        // deform the mesh at each frame, as a mapping would, then upload it
+        float time = 0.0f;
+        results.push_back(context.run(uploadName, vertexNumber, [&](QRhiResourceUpdateBatch* batch)
+        {
+            {
+                auto positions = sofa::helper::getWriteAccessor(model->m_positions);
+                time += 0.01f;
+                for (std::size_t i = 0; i < positions.size(); i++)
+                    positions[i][2] = std::sin(time + positions[i][0]);
+            }
+            model->modified = true;
+            model->updateVisual();
+            model->updateGraphicResources(batch);
+        }, draw));
+    }
+
+    if (context.isSelected(commandsName))
+    {
+        // nothing changes: only the camera and the commands
+        results.push_back(context.run(commandsName, vertexNumber, [&](QRhiResourceUpdateBatch* batch)
+        {
+            model->updateGraphicResources(batch);
+        }, draw));
+    }
+
+    root->removeObject(model);
+    sofa::simulation::getSimulation()->unload(root);
+}
+
+} // namespace sofa::rhi::benchmarks
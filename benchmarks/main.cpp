@@ -0,0 +1,81 @@
+#include "BenchmarkContext.h"
+
+#include <SofaSimulationGraph/init.h>
+#include <SofaSimulationGraph/DAGSimulation.h>
+
+#include <QGuiApplication>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace sofa::rhi::benchmarks;
+
+namespace
+{
+
+void printUsage(const char* program)
+{
+    std::printf("Usage: %s [--backend null|ogl] [--size N] [--frames F] [--filter NAME]\n", program);
+    std::printf("  --backend  QRhi backend used to render offscreen (default: null)\n");
+    std::printf("  --size     number of primitives (or vertices for RHIModel) per frame, within the DrawToolRHI buffers (default: 10000)\n");
+    std::printf("  --frames   number of measured frames per benchmark (default: 100)\n");
+    std::printf("  --filter   only run the benchmarks whose name contains NAME\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (arg == "--backend" && hasValue)
+        {
+            const std::string backend = argv[++i];
+            options.backend = (backend == "ogl") ? QRhi::OpenGLES2 : QRhi::Null;
+        }
+        else if (arg == "--size" && hasValue)
+            options.size = std::size_t(std::strtoull(argv[++i], nullptr, 10));
+        else if (arg == "--frames" && hasValue)
+            options.frames = std::atoi(argv[++i]);
+        else if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else
+        {
+            printUsage(argv[0]);
+            return (arg == "--help" || arg == "-h") ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // the Null backend does not need any window system
+    if (options.backend == QRhi::Null && std::getenv("QT_QPA_PLATFORM") == nullptr)
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+
+    sofa::simulation::graph::init();
+    sofa::simulation::setSimulation(new sofa::simulation::graph::DAGSimulation());
+
+    std::vector<BenchmarkResult> results;
+    {
+        BenchmarkContext context(options);
+        if (!context.isValid())
+            return EXIT_FAILURE;
+
+        runDrawToolRHIBenchmarks(context, results);
+        runRHIModelBenchmarks(context, results);
+    }
+
+    std::printf("backend: %s, size: %zu, frames: %d\n",
+        options.backend == QRhi::Null ? "null" : "ogl", options.size, options.frames);
+    printResults(results);
+
+    sofa::simulation::graph::cleanup();
+
+    return EXIT_SUCCESS;
+}
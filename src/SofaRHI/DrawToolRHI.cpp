@@ -1,26 +1,134 @@
 #include <SofaRHI/DrawToolRHI.h>
 #include <SofaRHI/RHIUtils.h>
+#include <SofaRHI/RHIShaderVariants.h>
+#include <SofaRHI/RHIUniformBlocks.h>
+#include <SofaRHI/RHITracer.h>
+#include <SofaRHI/RHIVertexQuantization.h>
 
 #include <sofa/core/visual/VisualParams.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <SofaRHI/RHIMeshGenerator.inl>
 
 
 namespace sofa::rhi
 {
 
+namespace
+{
+// Tiles of the viewport (first column and row, last column and row, from the bottom left) covered by the projection of
+// the box around the range of the light; false if it is out of the view. All the tiles if the range is infinite, or if
+// the box crosses the plane of the camera.
+bool computeLightTiles(const QMatrix4x4& viewProjectionMatrix, const RHILight::Description& light, std::array<std::size_t, 4>& tiles)
+{
+    tiles = { 0, 0, LIGHT_TILE_COLUMNS - 1, LIGHT_TILE_ROWS - 1 };
+    if (light.position[3] == 0.0f || light.range <= 0.0f)
+        return true;
+
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (int corner = 0; corner < 8; corner++)
+    {
+        const QVector4D position(light.position[0] + ((corner & 1) ? light.range : -light.range),
+            light.position[1] + ((corner & 2) ? light.range : -light.range),
+            light.position[2] + ((corner & 4) ? light.range : -light.range), 1.0f);
+        const QVector4D clipPosition = viewProjectionMatrix * position;
+        if (clipPosition.w() <= 0.0f)
+            return true;
+        minX = std::min(minX, clipPosition.x() / clipPosition.w());
+        maxX = std::max(maxX, clipPosition.x() / clipPosition.w());
+        minY = std::min(minY, clipPosition.y() / clipPosition.w());
+        maxY = std::max(maxY, clipPosition.y() / clipPosition.w());
+    }
+    if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+        return false;
+
+    const auto toTile = [](float ndc, std::size_t count)
+    {
+        return std::min(std::size_t(std::max(0.0f, (ndc + 1.0f) * 0.5f * float(count))), count - 1);
+    };
+    tiles = { toTile(minX, LIGHT_TILE_COLUMNS), toTile(minY, LIGHT_TILE_ROWS), toTile(maxX, LIGHT_TILE_COLUMNS), toTile(maxY, LIGHT_TILE_ROWS) };
+    return true;
+}
+
+// View-projection matrix (OpenGL clip space) of the shadow map of a directional or spot light, covering the sphere around
+// the bounding box of the scene (center, radius)
+QMatrix4x4 computeShadowMatrix(const RHILight::Description& light, const QVector3D& center, float radius)
+{
+    const bool directional = light.position[3] == 0.0f;
+    const QVector3D direction = directional ? -QVector3D(light.position[0], light.position[1], light.position[2])
+                                            : QVector3D(light.spotDirection[0], light.spotDirection[1], light.spotDirection[2]);
+    const QVector3D up = std::abs(direction.y()) > 0.99f ? QVector3D(1.0f, 0.0f, 0.0f) : QVector3D(0.0f, 1.0f, 0.0f);
+
+    QMatrix4x4 projection, view;
+    if (directional)
+    {
+        const QVector3D eye = center - direction * radius;
+        view.lookAt(eye, center, up);
+        projection.ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+    }
+    else
+    {
+        const QVector3D eye(light.position[0], light.position[1], light.position[2]);
+        float farPlane = eye.distanceToPoint(center) + radius;
+        if (light.range > 0.0f)
+            farPlane = std::min(farPlane, light.range);
+        const float nearPlane = std::max(farPlane * 0.001f, 1e-4f);
+        const float fov = std::min(2.0f * std::acos(std::max(light.spotCutoffCosine, 0.0f)) * 180.0f / 3.14159265f, 170.0f);
+        view.lookAt(eye, eye + direction, up);
+        projection.perspective(fov, 1.0f, nearPlane, farPlane);
+    }
+    return projection * view;
+}
+} // namespace
+
 DrawToolRHI::DrawToolRHI(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc)
     : m_rhi(rhi)
     , m_rpDesc(rpDesc)
 {
+    // pages are created on demand
+    // positions and normals are updated at each step, texture coordinates and indices with the topology
+    // (a Dynamic buffer has a copy per frame in flight, e.g 2 with Vulkan, and QRhi applies each update to all of them:
+    // a range written only when it changes stays valid in the frames still in flight)
+    m_vertexArena = std::make_unique<RHIBufferArena>(m_rhi, std::vector<RHIBufferArena::Stream>{
+        { QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, 3 * sizeof(float) },
+        { QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, 3 * sizeof(float) },
+        { QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, 2 * sizeof(float) }
+    }, ARENA_VERTEX_PAGE_CAPACITY);
+    m_quantizedVertexArena = std::make_unique<RHIBufferArena>(m_rhi, std::vector<RHIBufferArena::Stream>{
+        { QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, sizeof(RHIVertexQuantization::Position) },
+        { QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, sizeof(RHIVertexQuantization::Normal) },
+        { QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer, 2 * sizeof(float) }
+    }, ARENA_VERTEX_PAGE_CAPACITY);
+    m_indexArena = std::make_unique<RHIBufferArena>(m_rhi, std::vector<RHIBufferArena::Stream>{
+        { QRhiBuffer::Static, QRhiBuffer::IndexBuffer, sizeof(quint32) }
+    }, ARENA_INDEX_PAGE_CAPACITY);
+    m_index16Arena = std::make_unique<RHIBufferArena>(m_rhi, std::vector<RHIBufferArena::Stream>{
+        { QRhiBuffer::Static, QRhiBuffer::IndexBuffer, sizeof(quint16) }
+    }, ARENA_INDEX_PAGE_CAPACITY);
+    m_textureCache = std::make_unique<RHITextureCache>(m_rhi);
+    // before the first frame: the RHIModels bind it when they are initialized
+    m_lightUniformBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, LightUniform::paddedSize);
+    if (!m_lightUniformBuffer->build())
+    {
+        msg_error("DrawToolRHI") << "Problem while building light uniform buffer";
+    }
 }
 
 void DrawToolRHI::initRHI()
 {
+    // at the first frame, or before with the warm-up of the viewers
+    if (m_bHasInit)
+        return;
+    m_bHasInit = true;
+
     //create buffers (large enough to try to not resize them if necessary)
     m_vertexBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, INITIAL_VERTEX_BUFFER_SIZE);
     m_indexBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::IndexBuffer, INITIAL_INDEX_BUFFER_SIZE);
-    m_cameraUniformBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, utils::MATRIX4_SIZE + utils::VEC3_SIZE);
+    m_cameraUniformBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, CameraUniform::paddedSize);
     m_instanceBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, INITIAL_INSTANCE_BUFFER_SIZE);
 
     // error handling??
@@ -59,7 +167,7 @@ void DrawToolRHI::initRHI()
     const QRhiShaderResourceBinding::StageFlags commonVisibility = QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage;
     m_triangleSrb = m_rhi->newShaderResourceBindings();
     m_triangleSrb->setBindings({
-                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE + utils::VEC3_SIZE)
+                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, CameraUniform::paddedSize)
         });
     if (!m_triangleSrb->build())
     {
@@ -69,7 +177,7 @@ void DrawToolRHI::initRHI()
 
     m_lineSrb = m_rhi->newShaderResourceBindings();
     m_lineSrb->setBindings({
-                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE + utils::VEC3_SIZE)
+                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, CameraUniform::paddedSize)
         });
     if (!m_lineSrb->build())
     {
@@ -79,7 +187,7 @@ void DrawToolRHI::initRHI()
 
     m_pointSrb = m_rhi->newShaderResourceBindings();
     m_pointSrb->setBindings({
-                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE + utils::VEC3_SIZE)
+                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, CameraUniform::paddedSize)
         });
     if (!m_pointSrb->build())
     {
@@ -89,7 +197,7 @@ void DrawToolRHI::initRHI()
 
     m_instancedTriangleSrb = m_rhi->newShaderResourceBindings();
     m_instancedTriangleSrb->setBindings({
-                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE + utils::VEC3_SIZE)
+                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, CameraUniform::paddedSize)
         });
     if (!m_instancedTriangleSrb->build())
     {
@@ -102,11 +210,11 @@ void DrawToolRHI::initRHI()
     m_pointPipeline = m_rhi->newGraphicsPipeline();
     m_instancedTrianglePipeline = m_rhi->newGraphicsPipeline();
 
-    QShader vs = utils::loadShader(":/shaders/gl/phong_color.vert.qsb");
-    QShader fs = utils::loadShader(":/shaders/gl/phong_color.frag.qsb");
-    QShader vs_nonormal = utils::loadShader(":/shaders/gl/simple_color.vert.qsb");
-    QShader fs_nonormal = utils::loadShader(":/shaders/gl/simple_color.frag.qsb");
-    QShader vs_instanced = utils::loadShader(":/shaders/gl/phong_color_instanced.vert.qsb");
+    QShader vs = RHIShaderVariants::load("phong.vert", RHIShaderVariants::VERTEX_COLOR);
+    QShader fs = RHIShaderVariants::load("phong.frag", RHIShaderVariants::VERTEX_COLOR);
+    QShader vs_nonormal = RHIShaderVariants::load("simple_color.vert", RHIShaderVariants::NONE);
+    QShader fs_nonormal = RHIShaderVariants::load("simple_color.frag", RHIShaderVariants::NONE);
+    QShader vs_instanced = RHIShaderVariants::load("phong.vert", RHIShaderVariants::VERTEX_COLOR | RHIShaderVariants::INSTANCED);
     if (!vs.isValid())
     {
         msg_error("DrawToolRHI") << "Problem while vs shader";
@@ -122,6 +230,12 @@ void DrawToolRHI::initRHI()
         msg_error("DrawToolRHI") << "Problem while vs_instanced shader";
         //return or exit, abort, exception, etc.
     }
+    // the camera buffer is written with the layout of CameraUniform
+    for (const QShader& shader : { vs, fs, vs_nonormal, vs_instanced })
+    {
+        if (shader.isValid())
+            layout::matchesShader<CameraUniform>(shader, 0, "DrawToolRHI");
+    }
 
     m_trianglePipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
     m_linePipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs_nonormal }, { QRhiShaderStage::Fragment, fs_nonormal } });
@@ -247,16 +361,26 @@ void DrawToolRHI::initRHI()
 
 void DrawToolRHI::beginFrame(core::visual::VisualParams* vparams, QRhiResourceUpdateBatch* rub, QRhiCommandBuffer* cb, const QRhiViewport& viewport)
 {
-    if (!m_bHasInit)
-    {
-        //init things
-        initRHI(); 
-        m_bHasInit = true;
-    }
+    //init things
+    initRHI();
     m_currentCB = cb;
     m_currentRUB = rub;
     m_currentViewport = viewport;
 
+    // before the RHIModels allocate and upload their ranges
+    m_vertexArena->compact();
+    m_quantizedVertexArena->compact();
+    m_indexArena->compact();
+    m_index16Arena->compact();
+    m_drawQueue.clear();
+
+    // reset the counters but keep the high-water marks
+    utils::FrameStatistics frameStatistics;
+    frameStatistics.drawToolVertexBufferHighWaterMark = m_frameStatistics.drawToolVertexBufferHighWaterMark;
+    frameStatistics.drawToolIndexBufferHighWaterMark = m_frameStatistics.drawToolIndexBufferHighWaterMark;
+    frameStatistics.drawToolInstanceBufferHighWaterMark = m_frameStatistics.drawToolInstanceBufferHighWaterMark;
+    m_frameStatistics = frameStatistics;
+
     // reset buffers ... or not
     m_vertexInputData[VertexInputData::PrimitiveType::POINT].resize(0);
     m_vertexInputData[VertexInputData::PrimitiveType::LINE].resize(0);
@@ -278,9 +402,13 @@ void DrawToolRHI::beginFrame(core::visual::VisualParams* vparams, QRhiResourceUp
     const auto inverseModelViewMatrix = qModelViewMatrix.inverted();
 
     const type::Vec3f cameraPosition{ inverseModelViewMatrix.data()[3], inverseModelViewMatrix.data()[7], inverseModelViewMatrix.data()[11] }; // or 12 13 14 if transposed
-    const QMatrix4x4 mvpMatrix = m_correctionMatrix.transposed() * qProjectionMatrix.transposed() * qModelViewMatrix.transposed();
-    m_currentRUB->updateDynamicBuffer(m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE, mvpMatrix.constData());
-    m_currentRUB->updateDynamicBuffer(m_cameraUniformBuffer, utils::MATRIX4_SIZE, utils::VEC3_SIZE, cameraPosition.data());
+    m_viewProjectionMatrix = qProjectionMatrix.transposed() * qModelViewMatrix.transposed();
+    const QMatrix4x4 mvpMatrix = m_correctionMatrix.transposed() * m_viewProjectionMatrix;
+    CameraUniform camera;
+    camera.setData<CameraUniform::MVP_MATRIX>(mvpMatrix.constData());
+    camera.setData<CameraUniform::CAMERA_POSITION>(cameraPosition.data());
+    camera.update(m_currentRUB, m_cameraUniformBuffer);
+    m_frameStatistics.drawToolUploadedBytes += CameraUniform::paddedSize;
 
     if (!m_cameraUniformBuffer->build())
     {
@@ -288,24 +416,162 @@ void DrawToolRHI::beginFrame(core::visual::VisualParams* vparams, QRhiResourceUp
     }
 }
 
+RHIShadowMaps* DrawToolRHI::initShadowMaps()
+{
+#if SOFARHI_ENABLE_SHADOWS
+    if (!m_bShadowMapsCreated)
+    {
+        m_bShadowMapsCreated = true;
+        m_shadowMaps = std::make_unique<RHIShadowMaps>(m_rhi);
+        if (!m_shadowMaps->isValid())
+            m_shadowMaps.reset();
+    }
+#endif // SOFARHI_ENABLE_SHADOWS
+    return m_shadowMaps.get();
+}
+
+bool DrawToolRHI::renderShadowMaps(QRhiCommandBuffer* cb, QRhiResourceUpdateBatch* updates)
+{
+    return m_shadowMaps && m_shadowMaps->render(cb, updates, m_drawQueue, m_frameStatistics);
+}
+
+void DrawToolRHI::updateLights(const std::vector<RHILight::Description>& lights, const sofa::type::BoundingBox& sceneBBox)
+{
+    // the buffer keeps the last update, nothing to do while the scene has no lights
+    if (lights.empty() && m_lightCount == 0)
+        return;
+
+    if (lights.size() > MAX_LIGHTS && lights.size() != m_lightCount)
+    {
+        msg_warning("DrawToolRHI") << lights.size() << " lights in the scene, only the first " << MAX_LIGHTS << " are shading the RHIModels";
+    }
+    m_lightCount = lights.size();
+    const std::size_t lightCount = std::min(lights.size(), MAX_LIGHTS);
+
+    LightUniform lightUniform;
+    std::array<quint32, LIGHT_TILE_COUNT> tileMasks{};
+    for (std::size_t i = 0; i < lightCount; i++)
+    {
+        const RHILight::Description& light = lights[i];
+        lightUniform.setElement<LightUniform::LIGHT_POSITION>(i, std::array<float, 4>{ light.position[0], light.position[1], light.position[2], light.position[3] });
+        lightUniform.setElement<LightUniform::LIGHT_COLOR>(i, std::array<float, 4>{ light.color[0], light.color[1], light.color[2], 1.0f });
+        lightUniform.setElement<LightUniform::LIGHT_SPOT>(i, std::array<float, 4>{ light.spotDirection[0], light.spotDirection[1], light.spotDirection[2], light.spotCutoffCosine });
+        lightUniform.setElement<LightUniform::LIGHT_ATTENUATION>(i, std::array<float, 4>{ light.attenuation, light.spotExponent, light.range, 0.0f });
+
+        std::array<std::size_t, 4> tiles;
+        if (!computeLightTiles(m_viewProjectionMatrix, light, tiles))
+            continue;
+        for (std::size_t row = tiles[1]; row <= tiles[3]; row++)
+            for (std::size_t column = tiles[0]; column <= tiles[2]; column++)
+                tileMasks[row * LIGHT_TILE_COLUMNS + column] |= quint32(1) << i;
+    }
+    updateShadows(lights, lightCount, sceneBBox, lightUniform);
+    for (std::size_t i = 0; i < LIGHT_TILE_COUNT / 4; i++)
+        lightUniform.setElement<LightUniform::TILE_MASKS>(i, std::array<quint32, 4>{ tileMasks[4 * i], tileMasks[4 * i + 1], tileMasks[4 * i + 2], tileMasks[4 * i + 3] });
+
+    // the tiles are from the bottom left of the viewport, gl_FragCoord is from the top left if y is down in the framebuffer
+    lightUniform.set<LightUniform::LIGHT_INFO>(std::array<quint32, 4>{ quint32(lightCount), quint32(LIGHT_TILE_COLUMNS), quint32(LIGHT_TILE_ROWS), m_rhi->isYUpInFramebuffer() ? 1u : 0u });
+    lightUniform.set<LightUniform::VIEWPORT>(m_currentViewport.viewport());
+
+    lightUniform.update(m_currentRUB, m_lightUniformBuffer);
+    m_frameStatistics.drawToolUploadedBytes += LightUniform::paddedSize;
+}
+
+void DrawToolRHI::updateShadows(const std::vector<RHILight::Description>& lights, std::size_t lightCount, const sofa::type::BoundingBox& sceneBBox, LightUniform& lightUniform)
+{
+    for (std::size_t i = 0; i < MAX_LIGHTS; i++)
+        lightUniform.setElement<LightUniform::LIGHT_SHADOW>(i, std::array<float, 4>{ -1.0f, 0.0f, 0.0f, 0.0f });
+
+    RHIShadowMaps* shadowMaps = m_shadowMaps.get();
+    if (!shadowMaps)
+        return;
+
+    std::vector<QMatrix4x4> matrices;
+    std::vector<std::size_t> shadowLights;
+    if (sceneBBox.isValid())
+    {
+        const auto& minBBox = sceneBBox.minBBox();
+        const auto& maxBBox = sceneBBox.maxBBox();
+        const QVector3D center(float(minBBox[0] + maxBBox[0]) * 0.5f, float(minBBox[1] + maxBBox[1]) * 0.5f, float(minBBox[2] + maxBBox[2]) * 0.5f);
+        const float radius = std::max(0.5f * QVector3D(float(maxBBox[0] - minBBox[0]), float(maxBBox[1] - minBBox[1]), float(maxBBox[2] - minBBox[2])).length(), 1e-3f);
+        for (std::size_t i = 0; i < lightCount; i++)
+        {
+            // no shadows for the point lights
+            if (lights[i].shadows && (lights[i].position[3] == 0.0f || lights[i].spotCutoffCosine >= 0.0f))
+                shadowLights.push_back(i);
+        }
+        if (shadowLights.size() > MAX_SHADOW_MAPS && shadowLights.size() != m_shadowLightCount)
+        {
+            msg_warning("DrawToolRHI") << shadowLights.size() << " lights are casting shadows, only the first " << MAX_SHADOW_MAPS << " have a shadow map";
+        }
+        m_shadowLightCount = shadowLights.size();
+        shadowLights.resize(std::min(shadowLights.size(), MAX_SHADOW_MAPS));
+        for (std::size_t i : shadowLights)
+            matrices.push_back(computeShadowMatrix(lights[i], center, radius));
+    }
+    // the maps are rendered again only if the lights or the scene have moved
+    shadowMaps->setMatrices(matrices, m_currentRUB);
+
+    for (std::size_t map = 0; map < shadowLights.size(); map++)
+    {
+        const int mapIndex = int(map);
+        lightUniform.setElement<LightUniform::LIGHT_SHADOW>(shadowLights[map], std::array<float, 4>{ float(map), lights[shadowLights[map]].shadowFactor, 0.0f, 0.0f });
+        const QMatrix4x4 textureMatrix = shadowMaps->getTextureMatrix(mapIndex);
+        std::array<float, 16> matrix;
+        std::copy(textureMatrix.constData(), textureMatrix.constData() + 16, matrix.begin());
+        lightUniform.setElement<LightUniform::SHADOW_MATRIX>(map, matrix);
+        lightUniform.setElement<LightUniform::SHADOW_RECT>(map, shadowMaps->getTextureRect(mapIndex));
+    }
+}
+
 void DrawToolRHI::endFrame()
 {
     m_currentRUB = nullptr;
     m_currentCB = nullptr;
 
+    m_frameStatistics.drawToolVertexBufferHighWaterMark = std::max(m_frameStatistics.drawToolVertexBufferHighWaterMark, sofa::Size(m_currentVertexBufferByteSize));
+    m_frameStatistics.drawToolIndexBufferHighWaterMark = std::max(m_frameStatistics.drawToolIndexBufferHighWaterMark, sofa::Size(m_currentIndexBufferByteSize));
+    m_frameStatistics.drawToolInstanceBufferHighWaterMark = std::max(m_frameStatistics.drawToolInstanceBufferHighWaterMark, sofa::Size(m_currentInstanceBufferByteSize));
+
     m_currentVertexBufferByteSize = 0;
     m_currentIndexBufferByteSize = 0;
     m_currentInstanceBufferByteSize = 0;
 }
 
+void DrawToolRHI::submitDrawQueue(RHIDrawQueue::Pass pass)
+{
+    m_drawQueue.submit(m_currentCB, pass, m_frameStatistics);
+}
+
+QRhiGraphicsPipeline* DrawToolRHI::getSharedPipeline(const std::string& name) const
+{
+    const auto it = m_sharedPipelines.find(name);
+    return it != m_sharedPipelines.end() ? it->second : nullptr;
+}
+
+void DrawToolRHI::addSharedPipeline(const std::string& name, QRhiGraphicsPipeline* pipeline)
+{
+    m_sharedPipelines[name] = pipeline;
+}
+
 void DrawToolRHI::executeCommands()
 {
-    m_currentCB->setGraphicsPipeline(m_trianglePipeline);
-    m_currentCB->setShaderResources(m_triangleSrb);
-    m_currentCB->setViewport(m_currentViewport);
+    SOFARHI_TRACE_SCOPE("DrawToolRHI::executeCommands");
+
+    // only the pipelines of the primitive types drawn in this frame are bound
+    const auto bindPipeline = [this](VertexInputData::PrimitiveType type, QRhiGraphicsPipeline* pipeline, QRhiShaderResourceBindings* srb)
+    {
+        if (m_vertexInputData[type].empty())
+            return;
+        m_currentCB->setGraphicsPipeline(pipeline);
+        m_currentCB->setShaderResources(srb);
+        m_currentCB->setViewport(m_currentViewport);
+        m_frameStatistics.pipelineBinds++;
+    };
 
     // TODO: more automatic ? aka link between type and pipeline
     //Triangle
+    bindPipeline(VertexInputData::PrimitiveType::TRIANGLE, m_trianglePipeline, m_triangleSrb);
     for (auto &vertexInput : m_vertexInputData[VertexInputData::PrimitiveType::TRIANGLE])
     {
         const QRhiCommandBuffer::VertexInput vbindings[] = {
@@ -313,42 +579,40 @@ void DrawToolRHI::executeCommands()
             { vertexInput.attributesInfo[1].buffer, quint32(vertexInput.attributesInfo[1].offset) },
             { vertexInput.attributesInfo[2].buffer, quint32(vertexInput.attributesInfo[2].offset) }
         };
-        m_currentCB->setVertexInput(0, 3, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, QRhiCommandBuffer::IndexUInt32);
+        m_currentCB->setVertexInput(0, 3, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, vertexInput.indexFormat);
         m_currentCB->drawIndexed(vertexInput.nbPrimitive * 3);
+        m_frameStatistics.drawCalls++;
+        m_frameStatistics.triangles += vertexInput.nbPrimitive;
     }
 
     ////Line
-    m_currentCB->setGraphicsPipeline(m_linePipeline);
-    m_currentCB->setShaderResources(m_lineSrb);
-    m_currentCB->setViewport(m_currentViewport);
+    bindPipeline(VertexInputData::PrimitiveType::LINE, m_linePipeline, m_lineSrb);
     for (auto& vertexInput : m_vertexInputData[VertexInputData::PrimitiveType::LINE])
     {
         const QRhiCommandBuffer::VertexInput vbindings[] = {
             { vertexInput.attributesInfo[0].buffer, quint32(vertexInput.attributesInfo[0].offset) },
             { vertexInput.attributesInfo[1].buffer, quint32(vertexInput.attributesInfo[1].offset) }
         };
-        m_currentCB->setVertexInput(0, 2, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, QRhiCommandBuffer::IndexUInt32);
+        m_currentCB->setVertexInput(0, 2, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, vertexInput.indexFormat);
         m_currentCB->drawIndexed(vertexInput.nbPrimitive * 2);
+        m_frameStatistics.drawCalls++;
     }
 
     ////Point
-    m_currentCB->setGraphicsPipeline(m_pointPipeline);
-    m_currentCB->setShaderResources(m_pointSrb);
-    m_currentCB->setViewport(m_currentViewport);
+    bindPipeline(VertexInputData::PrimitiveType::POINT, m_pointPipeline, m_pointSrb);
     for (auto& vertexInput : m_vertexInputData[VertexInputData::PrimitiveType::POINT])
     {
         const QRhiCommandBuffer::VertexInput vbindings[] = {
             { vertexInput.attributesInfo[0].buffer, quint32(vertexInput.attributesInfo[0].offset) },
             { vertexInput.attributesInfo[1].buffer, quint32(vertexInput.attributesInfo[1].offset) }
         };
-        m_currentCB->setVertexInput(0, 2, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, QRhiCommandBuffer::IndexUInt32);
+        m_currentCB->setVertexInput(0, 2, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, vertexInput.indexFormat);
         m_currentCB->drawIndexed(vertexInput.nbPrimitive);
+        m_frameStatistics.drawCalls++;
     }
 
     ////Instanced triangles
-    m_currentCB->setGraphicsPipeline(m_instancedTrianglePipeline);
-    m_currentCB->setShaderResources(m_instancedTriangleSrb);
-    m_currentCB->setViewport(m_currentViewport);
+    bindPipeline(VertexInputData::PrimitiveType::INSTANCE_TRIANGLE, m_instancedTrianglePipeline, m_instancedTriangleSrb);
     for (auto& vertexInput : m_vertexInputData[VertexInputData::PrimitiveType::INSTANCE_TRIANGLE])
     {
         const QRhiCommandBuffer::VertexInput vbindings[] = {
@@ -357,8 +621,10 @@ void DrawToolRHI::executeCommands()
             { vertexInput.attributesInfo[2].buffer, quint32(vertexInput.attributesInfo[2].offset) },
             { vertexInput.instanceAttributesInfo[0].buffer, quint32(vertexInput.instanceAttributesInfo[0].offset) },
         };
-        m_currentCB->setVertexInput(0, 4, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, QRhiCommandBuffer::IndexUInt32);
+        m_currentCB->setVertexInput(0, 4, vbindings, vertexInput.indexInfo.buffer, vertexInput.indexInfo.offset, vertexInput.indexFormat);
         m_currentCB->drawIndexed(vertexInput.nbPrimitive * 3, vertexInput.nbInstance);
+        m_frameStatistics.drawCalls++;
+        m_frameStatistics.triangles += vertexInput.nbPrimitive * vertexInput.nbInstance;
 
     }
 }
@@ -377,32 +643,78 @@ void DrawToolRHI::convertVecAToVecB(const A& vecA, B& vecB)
 }
 
 
+bool DrawToolRHI::fitsInBuffers(std::size_t vertexByteSize, std::size_t indexNumber, std::size_t instanceByteSize)
+{
+    // indices on 32 bits at worst, after the alignment of their offset
+    const std::size_t indexByteSize = indexNumber * sizeof(quint32) + 3;
+    if (std::size_t(m_currentVertexBufferByteSize) + vertexByteSize <= std::size_t(m_vertexBuffer->size())
+        && std::size_t(m_currentIndexBufferByteSize) + indexByteSize <= std::size_t(m_indexBuffer->size())
+        && std::size_t(m_currentInstanceBufferByteSize) + instanceByteSize <= std::size_t(m_instanceBuffer->size()))
+        return true;
+
+    if (!m_bHasWarnedCapacity)
+    {
+        msg_warning("DrawToolRHI") << "The primitives drawn in a frame exceed the buffers of the DrawTool ("
+            << INITIAL_VERTEX_BUFFER_SIZE << " bytes of vertices, " << INITIAL_INDEX_BUFFER_SIZE << " bytes of indices, "
+            << INITIAL_INSTANCE_BUFFER_SIZE << " bytes of instances), the ones beyond are not drawn";
+        m_bHasWarnedCapacity = true;
+    }
+    return false;
+}
+
+template<typename Index>
+DrawToolRHI::VertexInputData::MemoryInfo DrawToolRHI::uploadIndices(const Index* indices, std::size_t indexNumber, std::size_t vertexNumber, QRhiCommandBuffer::IndexFormat& indexFormat)
+{
+    static_assert(sizeof(Index) == sizeof(quint32), "32-bit indices are uploaded as they are");
+
+    // the offset of an index buffer has to be aligned on 4 bytes with some graphics APIs
+    const int startIndexOffset = (m_currentIndexBufferByteSize + 3) & ~3;
+    int indexByteSize = 0;
+    indexFormat = getIndexFormat(vertexNumber);
+    if (indexFormat == QRhiCommandBuffer::IndexUInt16)
+    {
+        m_indices16.resize(indexNumber);
+        std::transform(indices, indices + indexNumber, m_indices16.begin(), [](Index index) { return quint16(index); });
+        indexByteSize = int(indexNumber * sizeof(quint16));
+        m_currentRUB->updateDynamicBuffer(m_indexBuffer, startIndexOffset, indexByteSize, m_indices16.data());
+    }
+    else
+    {
+        indexByteSize = int(indexNumber * sizeof(quint32));
+        m_currentRUB->updateDynamicBuffer(m_indexBuffer, startIndexOffset, indexByteSize, indices);
+    }
+
+    m_currentIndexBufferByteSize = startIndexOffset + indexByteSize;
+    m_frameStatistics.drawToolUploadedBytes += indexByteSize;
+
+    return { m_indexBuffer, startIndexOffset, indexByteSize };
+}
+
 void DrawToolRHI::internalDrawPoints(const std::vector<Vector3>& points, float size, const std::vector<RGBAColor>& colors)
 {
     ///////////// Resources
     std::vector <Vector3f> pointsF, normalF;
     convertVecAToVecB(points, pointsF);
 
-    //TODO: check buffer size and resize if necessary
     int startVertexOffset = m_currentVertexBufferByteSize;
 
     int positionsBufferByteSize = int(pointsF.size() * sizeof(pointsF[0]));
     int colorsBufferByteSize = int(colors.size() * sizeof(colors[0]));
+    if (!fitsInBuffers(std::size_t(positionsBufferByteSize) + colorsBufferByteSize, points.size()))
+        return;
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset, positionsBufferByteSize, pointsF.data());
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset + positionsBufferByteSize, colorsBufferByteSize, colors.data());
 
     m_currentVertexBufferByteSize += positionsBufferByteSize + colorsBufferByteSize;
+    m_frameStatistics.drawToolUploadedBytes += positionsBufferByteSize + colorsBufferByteSize;
 
-    int startIndexOffset = m_currentIndexBufferByteSize;
     auto nbPoints = points.size();
     std::vector<sofa::Index> indices;
     indices.resize(points.size());
     for (sofa::Index i = 0; i < indices.size(); i++)
         indices[i] = i;
-    int pointByteSize = int(nbPoints * sizeof(int));
-    m_currentRUB->updateDynamicBuffer(m_indexBuffer, startIndexOffset, pointByteSize, indices.data());
-
-    m_currentIndexBufferByteSize += pointByteSize;
+    QRhiCommandBuffer::IndexFormat indexFormat;
+    const auto indexInfo = uploadIndices(indices.data(), indices.size(), points.size(), indexFormat);
 
 
     ///////////// Commands
@@ -412,8 +724,8 @@ void DrawToolRHI::internalDrawPoints(const std::vector<Vector3>& points, float s
             {m_vertexBuffer, startVertexOffset + positionsBufferByteSize, colorsBufferByteSize}
         } ,
         {},
-        {m_indexBuffer, startIndexOffset, pointByteSize},
-        VertexInputData::PrimitiveType::POINT, int(nbPoints)
+        indexInfo,
+        VertexInputData::PrimitiveType::POINT, int(nbPoints), 1, indexFormat
     });
 }
 
@@ -423,22 +735,21 @@ void DrawToolRHI::internalDrawLines(const std::vector<Vector3>& points, const st
     std::vector <Vector3f> pointsF;
     convertVecAToVecB(points, pointsF);
 
-    //TODO: check buffer size and resize if necessary
     int startVertexOffset = m_currentVertexBufferByteSize;
 
     int positionsBufferByteSize = int(pointsF.size() * sizeof(pointsF[0]));
     int colorsBufferByteSize = int(colors.size() * sizeof(colors[0]));
+    if (!fitsInBuffers(std::size_t(positionsBufferByteSize) + colorsBufferByteSize, index.size() * 2))
+        return;
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset, positionsBufferByteSize, pointsF.data());
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset + positionsBufferByteSize, colorsBufferByteSize, colors.data());
 
     m_currentVertexBufferByteSize += positionsBufferByteSize + colorsBufferByteSize;
+    m_frameStatistics.drawToolUploadedBytes += positionsBufferByteSize + colorsBufferByteSize;
 
-    int startIndexOffset = m_currentIndexBufferByteSize;
     int nbLines = int(index.size());
-    int lineByteSize = int(nbLines * sizeof(index[0]));
-    m_currentRUB->updateDynamicBuffer(m_indexBuffer, startIndexOffset, lineByteSize, index.data());
-
-    m_currentIndexBufferByteSize += lineByteSize;
+    QRhiCommandBuffer::IndexFormat indexFormat;
+    const auto indexInfo = uploadIndices(index.empty() ? nullptr : &index[0][0], index.size() * 2, points.size(), indexFormat);
 
     ///////////// Commands
     m_vertexInputData[VertexInputData::PrimitiveType::LINE].push_back(VertexInputData{
@@ -447,8 +758,8 @@ void DrawToolRHI::internalDrawLines(const std::vector<Vector3>& points, const st
           {m_vertexBuffer, startVertexOffset + positionsBufferByteSize, colorsBufferByteSize}
         }} ,
         {} ,
-        {m_indexBuffer, startIndexOffset, lineByteSize},
-        VertexInputData::PrimitiveType::LINE, nbLines
+        indexInfo,
+        VertexInputData::PrimitiveType::LINE, nbLines, 1, indexFormat
         });
 }
 
@@ -459,24 +770,23 @@ void DrawToolRHI::internalDrawTriangles(const std::vector<Vector3>& points, cons
     convertVecAToVecB(points, pointsF);
     convertVecAToVecB(normal, normalF);
 
-    //TODO: check buffer size and resize if necessary
     int startVertexOffset = m_currentVertexBufferByteSize;
 
     int positionsBufferByteSize = int(pointsF.size() * sizeof(pointsF[0]));
     int normalsBufferByteSize = int(normalF.size() * sizeof(normalF[0]));
     int colorsBufferByteSize = int(colors.size() * sizeof(colors[0]));
+    if (!fitsInBuffers(std::size_t(positionsBufferByteSize) + normalsBufferByteSize + colorsBufferByteSize, index.size() * 3))
+        return;
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset, positionsBufferByteSize, pointsF.data());
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset + positionsBufferByteSize, normalsBufferByteSize, normalF.data());
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset + positionsBufferByteSize + normalsBufferByteSize, colorsBufferByteSize, colors.data());
 
     m_currentVertexBufferByteSize += positionsBufferByteSize + normalsBufferByteSize + colorsBufferByteSize;
+    m_frameStatistics.drawToolUploadedBytes += positionsBufferByteSize + normalsBufferByteSize + colorsBufferByteSize;
 
-    int startIndexOffset = m_currentIndexBufferByteSize;
     int nbTriangles = int(index.size());
-    int triangleByteSize = int(nbTriangles * sizeof(index[0]));
-    m_currentRUB->updateDynamicBuffer(m_indexBuffer, startIndexOffset, triangleByteSize, index.data());
-    
-    m_currentIndexBufferByteSize += triangleByteSize;
+    QRhiCommandBuffer::IndexFormat indexFormat;
+    const auto indexInfo = uploadIndices(index.empty() ? nullptr : &index[0][0], index.size() * 3, points.size(), indexFormat);
 
     ///////////// Commands
     m_vertexInputData[VertexInputData::PrimitiveType::TRIANGLE].push_back(VertexInputData {
@@ -486,8 +796,8 @@ void DrawToolRHI::internalDrawTriangles(const std::vector<Vector3>& points, cons
             {m_vertexBuffer, startVertexOffset + positionsBufferByteSize + normalsBufferByteSize, colorsBufferByteSize}
         } ,
         {} ,
-        {m_indexBuffer, startIndexOffset, triangleByteSize},
-        VertexInputData::PrimitiveType::TRIANGLE, nbTriangles
+        indexInfo,
+        VertexInputData::PrimitiveType::TRIANGLE, nbTriangles, 1, indexFormat
     });
 
 
@@ -501,27 +811,28 @@ void DrawToolRHI::internalDrawInstancedTriangles(const std::vector<Vector3>& poi
     convertVecAToVecB(points, pointsF);
     convertVecAToVecB(normal, normalF);
 
-    //TODO: check buffer size and resize if necessary
     int startVertexOffset = m_currentVertexBufferByteSize;
     int positionsBufferByteSize = int(pointsF.size() * sizeof(pointsF[0]));
     int normalsBufferByteSize = int(normalF.size() * sizeof(normalF[0]));
     int colorsBufferByteSize = int(colors.size() * sizeof(colors[0]));
+    if (!fitsInBuffers(std::size_t(positionsBufferByteSize) + normalsBufferByteSize + colorsBufferByteSize, index.size() * 3, transforms.size() * sizeof(transforms[0])))
+        return;
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset, positionsBufferByteSize, pointsF.data());
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset + positionsBufferByteSize, normalsBufferByteSize, normalF.data());
     m_currentRUB->updateDynamicBuffer(m_vertexBuffer, startVertexOffset + positionsBufferByteSize + normalsBufferByteSize, colorsBufferByteSize, colors.data());
     m_currentVertexBufferByteSize += positionsBufferByteSize + normalsBufferByteSize + colorsBufferByteSize;
+    m_frameStatistics.drawToolUploadedBytes += positionsBufferByteSize + normalsBufferByteSize + colorsBufferByteSize;
 
     int startInstanceOffset = m_currentInstanceBufferByteSize;
     int nbInstances = int(transforms.size());
     int transformsBufferByteSize = int(transforms.size()) * sizeof(transforms[0]);
     m_currentRUB->updateDynamicBuffer(m_instanceBuffer, startInstanceOffset, transformsBufferByteSize, transforms.data());
     m_currentInstanceBufferByteSize += transformsBufferByteSize;
+    m_frameStatistics.drawToolUploadedBytes += transformsBufferByteSize;
 
-    int startIndexOffset = m_currentIndexBufferByteSize;
     int nbTriangles = int(index.size());
-    int triangleByteSize = int(nbTriangles * sizeof(index[0]));
-    m_currentRUB->updateDynamicBuffer(m_indexBuffer, startIndexOffset, triangleByteSize, index.data());
-    m_currentIndexBufferByteSize += triangleByteSize;
+    QRhiCommandBuffer::IndexFormat indexFormat;
+    const auto indexInfo = uploadIndices(index.empty() ? nullptr : &index[0][0], index.size() * 3, points.size(), indexFormat);
 
     ///////////// Commands
     m_vertexInputData[VertexInputData::PrimitiveType::INSTANCE_TRIANGLE].push_back(
@@ -534,10 +845,11 @@ void DrawToolRHI::internalDrawInstancedTriangles(const std::vector<Vector3>& poi
         {
             {m_instanceBuffer, startInstanceOffset, transformsBufferByteSize}
         },
-        {m_indexBuffer, startIndexOffset, triangleByteSize},
+        indexInfo,
         VertexInputData::PrimitiveType::INSTANCE_TRIANGLE, 
         nbTriangles,
-        nbInstances
+        nbInstances,
+        indexFormat
     });
 
 
@@ -1,12 +1,23 @@
 #pragma once
 
+#include <SofaRHI/RHIUtils.h>
+#include <SofaRHI/RHIBufferArena.h>
+#include <SofaRHI/RHIDrawQueue.h>
+#include <SofaRHI/RHILight.h>
+#include <SofaRHI/RHIShadowMaps.h>
+#include <SofaRHI/RHITextureCache.h>
+
 #include <sofa/helper/visual/DrawTool.h>
 
 #include <sofa/core/visual/DisplayFlags.h>
 #include <sofa/type/Mat.h>
+#include <sofa/type/BoundingBox.h>
 
 #include <array>
+#include <map>
+#include <memory>
 #include <stack>
+#include <string>
 
 #include <QtGui/private/qrhi_p.h>
 
@@ -18,6 +29,8 @@ namespace sofa::core::visual
 namespace sofa::rhi
 {
 
+struct LightUniform;
+
 class DrawToolRHI : public sofa::helper::visual::DrawTool
 {
     using Inherited = sofa::helper::visual::DrawTool;
@@ -57,6 +70,7 @@ class DrawToolRHI : public sofa::helper::visual::DrawTool
         PrimitiveType primitiveType;
         int nbPrimitive;
         int nbInstance = 1;
+        QRhiCommandBuffer::IndexFormat indexFormat = QRhiCommandBuffer::IndexUInt32;
     };
     
 public:
@@ -245,6 +259,11 @@ public:
     {
         return m_currentRUB;
     }
+    // when the current batch has been consumed by a pass (e.g the compute pass)
+    void setResourceUpdateBatch(QRhiResourceUpdateBatch* rub)
+    {
+        m_currentRUB = rub;
+    }
     QRhiCommandBuffer* getCommandBuffer()
     {
         return m_currentCB;
@@ -254,6 +273,106 @@ public:
         return m_currentViewport;
     }
 
+    // Counters of the current (or last, if called after endFrame()) frame
+    utils::FrameStatistics& getFrameStatistics()
+    {
+        return m_frameStatistics;
+    }
+
+    // Buffers of the primitives drawn in a frame (not resized): a batch which does not fit in them is not drawn
+    static constexpr int INITIAL_VERTEX_BUFFER_SIZE{ 1000000 * 10 * sizeof(float) }; //large enough for 1M vertices (position + normal + color)
+    static constexpr int INITIAL_INDEX_BUFFER_SIZE{ 1000000 * 3 * sizeof(unsigned int) }; //large enough for 1M triangles
+    static constexpr int INITIAL_INSTANCE_BUFFER_SIZE{ 1000000 * 3 * sizeof(float) }; //1M instance of vec3 (translation...)
+
+    // Buffers shared by the RHIModels
+    enum VertexStream : std::size_t
+    {
+        POSITION_STREAM = 0,
+        NORMAL_STREAM = 1,
+        TEXCOORD_STREAM = 2
+    };
+    // same streams with quantized positions (8 bytes) and normals (4 bytes), see RHIVertexQuantization
+    RHIBufferArena* getVertexArena(bool quantized = false)
+    {
+        return quantized ? m_quantizedVertexArena.get() : m_vertexArena.get();
+    }
+    // textures of the image files, shared by the RHIModels
+    RHITextureCache* getTextureCache()
+    {
+        return m_textureCache.get();
+    }
+    // one arena per index format (16-bit indices for the models with less than 65535 vertices)
+    RHIBufferArena* getIndexArena(QRhiCommandBuffer::IndexFormat format = QRhiCommandBuffer::IndexUInt32)
+    {
+        return format == QRhiCommandBuffer::IndexUInt16 ? m_index16Arena.get() : m_indexArena.get();
+    }
+    // 0xFFFF is kept free: it restarts the primitive with some backends
+    static QRhiCommandBuffer::IndexFormat getIndexFormat(std::size_t vertexNumber)
+    {
+        return vertexNumber < 0xFFFF ? QRhiCommandBuffer::IndexUInt16 : QRhiCommandBuffer::IndexUInt32;
+    }
+
+    // Draws of the RHIModels, submitted sorted by submitDrawQueue()
+    RHIDrawQueue& getDrawQueue()
+    {
+        return m_drawQueue;
+    }
+    void submitDrawQueue(RHIDrawQueue::Pass pass = RHIDrawQueue::Pass::MAIN);
+
+    // Render pass of the weighted blended transparency target, null if the transparency is not order-independent
+    void setTransparencyRenderPassDescriptor(QRhiRenderPassDescriptor* rpDesc)
+    {
+        m_transparencyRpDesc = rpDesc;
+    }
+    QRhiRenderPassDescriptor* getTransparencyRenderPassDescriptor() const
+    {
+        return m_transparencyRpDesc;
+    }
+
+    // Depth-only pass of the opaque RHIModels at the beginning of the main pass, which is then shaded with an Equal depth test
+    void setDepthPrepass(bool enable)
+    {
+        m_bDepthPrepass = enable;
+    }
+    bool hasDepthPrepass() const
+    {
+        return m_bDepthPrepass;
+    }
+
+    // Pipelines shared by the groups of the RHIModels rendered the same way
+    // (a pipeline can be used with any srb whose layout is compatible with the one it was built with)
+    QRhiGraphicsPipeline* getSharedPipeline(const std::string& name) const;
+    void addSharedPipeline(const std::string& name, QRhiGraphicsPipeline* pipeline);
+    std::size_t getSharedPipelineCount() const
+    {
+        return m_sharedPipelines.size();
+    }
+
+    // Lights of the scene (a LightUniform) for the RHIModels shading with them, to update at each frame after beginFrame()
+    // (with the view and the viewport of the frame, the masks of the tiles of the viewport they may shade are computed)
+    // The shadow maps of the lights casting shadows cover the bounding box of the scene
+    void updateLights(const std::vector<RHILight::Description>& lights, const sofa::type::BoundingBox& sceneBBox);
+    QRhiBuffer* getLightUniformBuffer() const
+    {
+        return m_lightUniformBuffer;
+    }
+
+    // Shadow maps of the lights, created by the first RHIModel receiving shadows (null if they are not compiled or not supported)
+    RHIShadowMaps* initShadowMaps();
+    RHIShadowMaps* getShadowMaps() const
+    {
+        return m_shadowMaps.get();
+    }
+    // when a shadow caster has changed
+    void invalidateShadowMaps()
+    {
+        if (m_shadowMaps)
+            m_shadowMaps->invalidate();
+    }
+    // Render the shadow maps if needed (SHADOW pass of the draw queue), after the RHIModels have been drawn and before
+    // the other passes; true if the pass has consumed the current batch
+    bool renderShadowMaps(QRhiCommandBuffer* cb, QRhiResourceUpdateBatch* updates);
+
     void beginFrame(core::visual::VisualParams*  vparams, QRhiResourceUpdateBatch* rub, QRhiCommandBuffer* cb,  const QRhiViewport& viewport);
     void endFrame();
     void executeCommands();
@@ -266,6 +385,14 @@ private:
     using Vector3f = std::array<float, 3>;
     template<typename A, typename B>
     static void convertVecAToVecB(const A& vecA, B& vecB);
+    // upload the indices of a batch in the index buffer, with 16 bits if it has few vertices
+    // false (and a warning, once) if a batch of these sizes does not fit in what remains of the buffers of the frame
+    bool fitsInBuffers(std::size_t vertexByteSize, std::size_t indexNumber, std::size_t instanceByteSize = 0);
+    template<typename Index>
+    VertexInputData::MemoryInfo uploadIndices(const Index* indices, std::size_t indexNumber, std::size_t vertexNumber, QRhiCommandBuffer::IndexFormat& indexFormat);
+
+    // shadow maps of the lights (LIGHT_SHADOW, SHADOW_MATRIX, SHADOW_RECT)
+    void updateShadows(const std::vector<RHILight::Description>& lights, std::size_t lightCount, const sofa::type::BoundingBox& sceneBBox, LightUniform& lightUniform);
 
     void internalDrawPoints(const std::vector<Vector3> &points, float size, const std::vector<RGBAColor>& colors);
     void internalDrawLines(const std::vector<Vector3> &points, const std::vector< Vec2i > &index, float size, const std::vector<RGBAColor>& colors);
@@ -290,8 +417,12 @@ private:
     QRhiBuffer* m_vertexBuffer;
     QRhiBuffer* m_indexBuffer;
     QRhiBuffer* m_instanceBuffer;
+    QRhiBuffer* m_lightUniformBuffer = nullptr;
+    std::size_t m_lightCount = 0; // in the scene at the last update
+    std::size_t m_shadowLightCount = 0; // lights casting shadows at the last update
 
     QMatrix4x4 m_correctionMatrix;
+    QMatrix4x4 m_viewProjectionMatrix; // of the current frame, without the correction
     QRhiCommandBuffer* m_currentCB = nullptr;
     QRhiViewport m_currentViewport;
     QRhiResourceUpdateBatch* m_currentRUB = nullptr;
@@ -299,11 +430,26 @@ private:
     int m_currentVertexBufferByteSize = 0;
     int m_currentIndexBufferByteSize = 0;
     int m_currentInstanceBufferByteSize = 0;
+    bool m_bHasWarnedCapacity = false;
+    std::vector<quint16> m_indices16; // conversion of the indices of the current batch
     std::map<VertexInputData::PrimitiveType, std::vector<VertexInputData> > m_vertexInputData;
 
-    static constexpr int INITIAL_VERTEX_BUFFER_SIZE{ 1000000 * 10 * sizeof(float) }; //large enough for 1M vertices (position + normal + color)
-    static constexpr int INITIAL_INDEX_BUFFER_SIZE{ 1000000 * 3 * sizeof(unsigned int) }; //large enough for 1M triangles
-    static constexpr int INITIAL_INSTANCE_BUFFER_SIZE{ 1000000 * 3 * sizeof(float) }; //1M instance of vec3 (translation...)
+    utils::FrameStatistics m_frameStatistics;
+
+    std::unique_ptr<RHIBufferArena> m_vertexArena;
+    std::unique_ptr<RHIBufferArena> m_quantizedVertexArena;
+    std::unique_ptr<RHIBufferArena> m_indexArena;
+    std::unique_ptr<RHIBufferArena> m_index16Arena;
+    std::unique_ptr<RHITextureCache> m_textureCache;
+    std::unique_ptr<RHIShadowMaps> m_shadowMaps;
+    bool m_bShadowMapsCreated = false;
+    RHIDrawQueue m_drawQueue;
+    QRhiRenderPassDescriptor* m_transparencyRpDesc = nullptr;
+    bool m_bDepthPrepass = false;
+    std::map<std::string, QRhiGraphicsPipeline*> m_sharedPipelines;
+
+    static constexpr quint32 ARENA_VERTEX_PAGE_CAPACITY{ 1 << 18 }; // 256K vertices (8MB) per page
+    static constexpr quint32 ARENA_INDEX_PAGE_CAPACITY{ 1 << 20 }; // 1M indices (4MB, or 2MB with 16 bits) per page
 
 };
 
@@ -0,0 +1,400 @@
+#include <SofaRHI/RHIBarycentricMapping.h>
+#include <SofaRHI/RHIShaderVariants.h>
+#include <SofaRHI/RHIUniformBlocks.h>
+#include <SofaRHI/RHIModel.h>
+#include <SofaRHI/RHITracer.h>
+
+#include <sofa/core/ObjectFactory.h>
+#include <sofa/helper/accessor.h>
+#include <SofaBaseTopology/SparseGridTopology.h>
+#include <SofaBaseTopology/RegularGridTopology.h>
+
+#include <algorithm>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// local_size_x of the compute shader
+constexpr quint32 COMPUTE_LOCAL_GROUP_SIZE = 256;
+
+// same order as the nodes of the hexahedra of the grids
+constexpr int HEXAHEDRON_NODES[RHIBarycentricMapping::NODE_NUMBER][3] = {
+    { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+    { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 }
+};
+
+template<class GridTopology>
+sofa::Index findCube(GridTopology* grid, const sofa::type::Vector3& position, SReal& fx, SReal& fy, SReal& fz)
+{
+    auto cube = grid->findCube(position, fx, fy, fz);
+    if (cube == decltype(cube)(-1))
+        cube = grid->findNearestCube(position, fx, fy, fz);
+    return sofa::Index(cube);
+}
+} // namespace
+
+int RHIBarycentricMappingClass = core::RegisterObject("Barycentric mapping from a hexahedral grid onto a RHIModel, computed with compute shaders")
+    .add< RHIBarycentricMapping >()
+;
+
+RHIBarycentricMapping::RHIBarycentricMapping()
+    : Inherit()
+    , d_updateCPUPositions(initData(&d_updateCPUPositions, false, "updateCPUPositions", "Also apply the mapping on the CPU when it is computed on the GPU (bounding box, picking, etc)"))
+{
+}
+
+void RHIBarycentricMapping::init()
+{
+    m_model = dynamic_cast<RHIModel*>(this->toModel.get());
+    if (m_model == nullptr)
+    {
+        msg_warning() << "The output is not a RHIModel, the mapping will be applied on the CPU.";
+    }
+
+    // before Inherit::init(), which applies the mapping
+    if (!computeWeights())
+    {
+        d_componentState.setValue(sofa::core::objectmodel::ComponentState::Invalid);
+        return;
+    }
+
+    Inherit::init();
+
+    d_componentState.setValue(sofa::core::objectmodel::ComponentState::Valid);
+}
+
+bool RHIBarycentricMapping::computeWeights()
+{
+    if (this->fromModel == nullptr || this->toModel == nullptr)
+    {
+        msg_error() << "Input or output not found.";
+        return false;
+    }
+
+    auto* topology = this->fromModel->getContext()->getMeshTopology();
+    auto* sparseGrid = dynamic_cast<sofa::component::topology::SparseGridTopology*>(topology);
+    auto* regularGrid = dynamic_cast<sofa::component::topology::RegularGridTopology*>(topology);
+    if (sparseGrid == nullptr && regularGrid == nullptr)
+    {
+        msg_error() << "Only works with a SparseGridTopology or a RegularGridTopology as input topology.";
+        return false;
+    }
+
+    const auto& outPositions = this->toModel->read(sofa::core::ConstVecCoordId::position())->getValue();
+    m_indices.assign(outPositions.size() * NODE_NUMBER, 0);
+    m_weights.assign(outPositions.size() * NODE_NUMBER, 0.0f);
+
+    unsigned int outsideNumber = 0;
+    for (std::size_t i = 0; i < outPositions.size(); i++)
+    {
+        const sofa::type::Vector3 position(outPositions[i][0], outPositions[i][1], outPositions[i][2]);
+        SReal f[3] = { 0.0, 0.0, 0.0 };
+        const sofa::Index cube = sparseGrid ? findCube(sparseGrid, position, f[0], f[1], f[2]) : findCube(regularGrid, position, f[0], f[1], f[2]);
+        if (cube == sofa::InvalidID)
+        {
+            outsideNumber++;
+            continue;
+        }
+
+        // trilinear weights
+        const auto& hexahedron = topology->getHexahedron(cube);
+        for (unsigned int k = 0; k < NODE_NUMBER; k++)
+        {
+            float weight = 1.0f;
+            for (int d = 0; d < 3; d++)
+            {
+                weight *= float(HEXAHEDRON_NODES[k][d] ? f[d] : 1.0 - f[d]);
+            }
+            m_indices[i * NODE_NUMBER + k] = quint32(hexahedron[k]);
+            m_weights[i * NODE_NUMBER + k] = weight;
+        }
+    }
+
+    if (outsideNumber > 0)
+    {
+        msg_warning() << outsideNumber << " vertices could not be mapped (no hexahedron found).";
+    }
+
+    return true;
+}
+
+void RHIBarycentricMapping::apply(const sofa::core::MechanicalParams* /*mparams*/, OutDataVecCoord& dOut, const InDataVecCoord& dIn)
+{
+    if (m_model && m_model->hasGpuPositions())
+    {
+        // uploaded and mapped on the GPU
+        m_needUpdateInputs = true;
+        if (!d_updateCPUPositions.getValue())
+            return;
+    }
+
+    const auto& in = dIn.getValue();
+    auto out = sofa::helper::getWriteOnlyAccessor(dOut);
+    const std::size_t outSize = std::min(out.size(), m_weights.size() / NODE_NUMBER);
+    for (std::size_t i = 0; i < outSize; i++)
+    {
+        OutCoord position;
+        for (unsigned int k = 0; k < NODE_NUMBER; k++)
+        {
+            position += in[m_indices[i * NODE_NUMBER + k]] * m_weights[i * NODE_NUMBER + k];
+        }
+        out[i] = position;
+    }
+}
+
+void RHIBarycentricMapping::applyJ(const sofa::core::MechanicalParams* /*mparams*/, OutDataVecDeriv& dOut, const InDataVecDeriv& dIn)
+{
+    const auto& in = dIn.getValue();
+    auto out = sofa::helper::getWriteOnlyAccessor(dOut);
+    const std::size_t outSize = std::min(out.size(), m_weights.size() / NODE_NUMBER);
+    for (std::size_t i = 0; i < outSize; i++)
+    {
+        OutDeriv velocity;
+        for (unsigned int k = 0; k < NODE_NUMBER; k++)
+        {
+            velocity += in[m_indices[i * NODE_NUMBER + k]] * m_weights[i * NODE_NUMBER + k];
+        }
+        out[i] = velocity;
+    }
+}
+
+void RHIBarycentricMapping::applyJT(const sofa::core::MechanicalParams* /*mparams*/, InDataVecDeriv& dOut, const OutDataVecDeriv& dIn)
+{
+    const auto& in = dIn.getValue();
+    auto out = sofa::helper::getWriteAccessor(dOut);
+    const std::size_t inSize = std::min(in.size(), m_weights.size() / NODE_NUMBER);
+    for (std::size_t i = 0; i < inSize; i++)
+    {
+        for (unsigned int k = 0; k < NODE_NUMBER; k++)
+        {
+            out[m_indices[i * NODE_NUMBER + k]] += in[i] * m_weights[i * NODE_NUMBER + k];
+        }
+    }
+}
+
+void RHIBarycentricMapping::applyJT(const sofa::core::ConstraintParams* /*cparams*/, InDataMatrixDeriv& /*dOut*/, const OutDataMatrixDeriv& /*dIn*/)
+{
+    // visual mapping: no constraint to map
+}
+
+bool RHIBarycentricMapping::initComputeResources(QRhiPtr rhi)
+{
+    if (m_model == nullptr || m_weights.empty())
+        return false;
+
+    m_shader = RHIShaderVariants::load("barycentric_mapping.comp", RHIShaderVariants::NONE);
+    if (!m_shader.isValid())
+    {
+        msg_warning() << "Compute shader for the mapping is not available, the mapping will be applied on the CPU.";
+        return false;
+    }
+    layout::matchesShader<BarycentricMappingUniform>(m_shader, 0, "barycentric_mapping.comp");
+
+    const int vertexNumber = int(m_weights.size() / NODE_NUMBER);
+    m_uniformBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, BarycentricMappingUniform::paddedSize);
+    m_inputBuffer = rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::StorageBuffer, 4); // cannot be empty at creation
+    m_indexBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, int(vertexNumber * NODE_NUMBER * sizeof(quint32)));
+    m_weightBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, int(vertexNumber * NODE_NUMBER * sizeof(float)));
+    m_positionIndexBuffer = rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::StorageBuffer, 4); // cannot be empty at creation
+    for (auto* buffer : { m_uniformBuffer, m_inputBuffer, m_indexBuffer, m_weightBuffer, m_positionIndexBuffer })
+    {
+        if (!buffer->build())
+        {
+            msg_error() << "Problem while building compute buffers";
+            return false;
+        }
+    }
+
+    // the bindings need the output buffer of the RHIModel, which may not be initialized yet
+    m_rhi = rhi;
+
+    return true;
+}
+
+bool RHIBarycentricMapping::initComputePipeline()
+{
+    m_bindings = m_rhi->newShaderResourceBindings();
+    m_bindings->setBindings({
+        QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::ComputeStage, m_uniformBuffer),
+        QRhiShaderResourceBinding::bufferLoad(1, QRhiShaderResourceBinding::ComputeStage, m_inputBuffer),
+        QRhiShaderResourceBinding::bufferLoad(2, QRhiShaderResourceBinding::ComputeStage, m_indexBuffer),
+        QRhiShaderResourceBinding::bufferLoad(3, QRhiShaderResourceBinding::ComputeStage, m_weightBuffer),
+        QRhiShaderResourceBinding::bufferStore(4, QRhiShaderResourceBinding::ComputeStage, m_model->getComputePositionBuffer()),
+        QRhiShaderResourceBinding::bufferLoad(5, QRhiShaderResourceBinding::ComputeStage, m_positionIndexBuffer)
+    });
+    if (!m_bindings->build())
+    {
+        msg_error() << "Problem while building compute bindings";
+        return false;
+    }
+
+    m_pipeline = m_rhi->newComputePipeline();
+    m_pipeline->setShaderResourceBindings(m_bindings);
+    m_pipeline->setShaderStage({ QRhiShaderStage::Compute, m_shader });
+    if (!m_pipeline->build())
+    {
+        msg_error() << "Problem while building compute pipeline";
+        return false;
+    }
+
+    return true;
+}
+
+sofa::Size RHIBarycentricMapping::updatePositionIndices(QRhiResourceUpdateBatch* batch)
+{
+    // the vertices of the RHIModel are its positions, unless the loader duplicated some of them
+    const bool duplicatedVertices = m_model->hasDuplicatedVertices();
+    const auto& vertPosIdx = m_model->getVertexPositionIndices();
+    if (duplicatedVertices == m_bDuplicatedVertices && (!duplicatedVertices || vertPosIdx.getCounter() == m_positionIndicesCounter))
+        return 0;
+
+    m_bDuplicatedVertices = duplicatedVertices;
+    m_positionIndicesCounter = vertPosIdx.getCounter();
+
+    const quint32 positionNumber = quint32(m_weights.size() / NODE_NUMBER);
+    if (duplicatedVertices)
+    {
+        const auto& indices = vertPosIdx.getValue();
+        m_positionIndices.resize(indices.size());
+        for (std::size_t i = 0; i < indices.size(); i++)
+        {
+            if (quint32(indices[i]) >= positionNumber)
+            {
+                msg_error() << "Vertex " << i << " refers to the position " << indices[i] << " which is not mapped (" << positionNumber << " positions), the mapping will be applied on the CPU.";
+                m_model->setGpuPositions(false);
+                m_bComputeFailed = true;
+                return 0;
+            }
+            m_positionIndices[i] = quint32(indices[i]);
+        }
+    }
+    else
+    {
+        m_positionIndices.resize(positionNumber);
+        for (quint32 i = 0; i < positionNumber; i++)
+        {
+            m_positionIndices[i] = i;
+        }
+    }
+
+    const int indexSize = int(m_positionIndices.size() * sizeof(quint32));
+    if (m_positionIndexBuffer->size() != std::max(indexSize, 4))
+    {
+        m_positionIndexBuffer->setSize(std::max(indexSize, 4));
+        if (!m_positionIndexBuffer->build())
+        {
+            msg_error() << "Problem while building position index buffer";
+        }
+    }
+    if (indexSize > 0)
+        batch->uploadStaticBuffer(m_positionIndexBuffer, 0, indexSize, m_positionIndices.data());
+
+    BarycentricMappingUniform counts;
+    counts.set<BarycentricMappingUniform::VERTEX_COUNT>(quint32(m_positionIndices.size()));
+    counts.update(batch, m_uniformBuffer);
+
+    m_needDispatch = true;
+    return sofa::Size(BarycentricMappingUniform::paddedSize + indexSize);
+}
+
+void RHIBarycentricMapping::updateComputeResources(QRhiResourceUpdateBatch* batch)
+{
+    if (m_rhi == nullptr || m_bComputeFailed || batch == nullptr)
+        return;
+
+    // the RHIModel computes its normals from the mapped positions
+    if (!m_model->hasGpuNormals())
+        return;
+
+    utils::TraceScope traceScope("RHIBarycentricMapping::updateComputeResources");
+    traceScope.setLabel(this->getName());
+
+    sofa::Size uploadedBytes = 0;
+    if (m_pipeline == nullptr)
+    {
+        if (!initComputePipeline())
+        {
+            m_bComputeFailed = true;
+            return;
+        }
+
+        // uploaded once
+        batch->uploadStaticBuffer(m_indexBuffer, m_indices.data());
+        batch->uploadStaticBuffer(m_weightBuffer, m_weights.data());
+        uploadedBytes += sofa::Size(m_indexBuffer->size() + m_weightBuffer->size());
+    }
+
+    // and when the loader (or a topological change) duplicates the vertices
+    uploadedBytes += updatePositionIndices(batch);
+    if (m_bComputeFailed)
+        return;
+
+    if (!m_model->hasGpuPositions())
+    {
+        m_model->setGpuPositions(true);
+        m_needUpdateInputs = true;
+    }
+
+    if (m_needUpdateInputs)
+    {
+        const auto& inPositions = this->fromModel->read(sofa::core::ConstVecCoordId::position())->getValue();
+        m_inputPositions.resize(inPositions.size());
+        for (std::size_t i = 0; i < inPositions.size(); i++)
+        {
+            m_inputPositions[i] = sofa::type::Vec3f(float(inPositions[i][0]), float(inPositions[i][1]), float(inPositions[i][2]));
+        }
+
+        const int inputSize = int(m_inputPositions.size() * sizeof(m_inputPositions[0]));
+        if (m_inputBuffer->size() != std::max(inputSize, 4))
+        {
+            m_inputBuffer->setSize(std::max(inputSize, 4));
+            if (!m_inputBuffer->build())
+            {
+                msg_error() << "Problem while building input buffer";
+            }
+        }
+        if (inputSize > 0)
+            batch->uploadStaticBuffer(m_inputBuffer, 0, inputSize, m_inputPositions.data());
+
+        uploadedBytes += sofa::Size(inputSize);
+        m_needUpdateInputs = false;
+        m_needDispatch = true;
+    }
+
+    traceScope.addArg("bytesUploaded", uploadedBytes);
+}
+
+void RHIBarycentricMapping::updateComputeCommands(QRhiCommandBuffer* cb)
+{
+    if (m_pipeline == nullptr || !m_model->hasGpuPositions())
+        return;
+
+    // the output buffer is rebuilt by the RHIModel when its topology changes
+    const int outputBufferSize = m_model->getComputePositionBuffer()->size();
+    if (outputBufferSize != m_outputBufferSize)
+    {
+        m_outputBufferSize = outputBufferSize;
+        m_needDispatch = true;
+    }
+
+    // one output position per vertex of the RHIModel
+    const quint32 vertexNumber = quint32(m_positionIndices.size());
+    if (!m_needDispatch || vertexNumber == 0 || outputBufferSize < int(vertexNumber * 3 * sizeof(float)))
+        return;
+
+    utils::TraceScope traceScope("RHIBarycentricMapping::updateComputeCommands");
+    traceScope.setLabel(this->getName());
+
+    cb->setComputePipeline(m_pipeline);
+    cb->setShaderResources();
+    cb->dispatch(int((vertexNumber + COMPUTE_LOCAL_GROUP_SIZE - 1) / COMPUTE_LOCAL_GROUP_SIZE), 1, 1);
+
+    // normals from the new positions
+    m_model->dispatchNormals(cb);
+
+    m_needDispatch = false;
+}
+
+} // namespace sofa::rhi
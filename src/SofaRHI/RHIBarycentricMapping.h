@@ -0,0 +1,79 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <SofaRHI/RHIComputeModel.h>
+#include <sofa/core/Mapping.h>
+#include <sofa/defaulttype/VecTypes.h>
+
+namespace sofa::rhi
+{
+
+class RHIModel;
+
+/// Barycentric mapping from a hexahedral grid (SparseGridTopology or RegularGridTopology) onto a RHIModel,
+/// computed with a compute shader: weights and hexahedra are uploaded once, then only the positions of the DOFs at each step.
+/// The vertices duplicated by the loader (seams of the texture coordinates) gather their mapped position through RHIModel::getVertexPositionIndices().
+/// The RHIModel positions and normals stay on the GPU (see RHIModel::setGpuPositions()).
+/// Without compute support, the mapping is applied on the CPU like a BarycentricMapping.
+class SOFA_SOFARHI_API RHIBarycentricMapping : public sofa::core::Mapping<sofa::defaulttype::Vec3Types, sofa::defaulttype::Vec3Types>, public RHIComputeModel
+{
+public:
+    SOFA_CLASS(RHIBarycentricMapping, SOFA_TEMPLATE2(sofa::core::Mapping, sofa::defaulttype::Vec3Types, sofa::defaulttype::Vec3Types));
+
+    using Inherit = sofa::core::Mapping<sofa::defaulttype::Vec3Types, sofa::defaulttype::Vec3Types>;
+
+    /// 8 nodes for a hexahedron (trilinear weights)
+    static constexpr unsigned int NODE_NUMBER = 8;
+
+    void init() override;
+
+    // Mapping API
+    void apply(const sofa::core::MechanicalParams* mparams, OutDataVecCoord& out, const InDataVecCoord& in) override;
+    void applyJ(const sofa::core::MechanicalParams* mparams, OutDataVecDeriv& out, const InDataVecDeriv& in) override;
+    void applyJT(const sofa::core::MechanicalParams* mparams, InDataVecDeriv& out, const OutDataVecDeriv& in) override;
+    void applyJT(const sofa::core::ConstraintParams* cparams, InDataMatrixDeriv& out, const OutDataMatrixDeriv& in) override;
+
+    // RHIComputeModel API
+    bool initComputeResources(QRhiPtr rhi) override;
+    void updateComputeResources(QRhiResourceUpdateBatch* batch) override;
+    void updateComputeCommands(QRhiCommandBuffer* cb) override;
+
+    Data<bool> d_updateCPUPositions; ///< Also apply the mapping on the CPU when it is computed on the GPU (bounding box, picking, etc)
+
+protected:
+    RHIBarycentricMapping();
+    ~RHIBarycentricMapping() override = default;
+
+    bool computeWeights();
+    bool initComputePipeline();
+    sofa::Size updatePositionIndices(QRhiResourceUpdateBatch* batch);
+
+    // for each output vertex, NODE_NUMBER input indices and weights
+    std::vector<quint32> m_indices;
+    std::vector<float> m_weights;
+    // for each vertex of the RHIModel, the index of its mapped position
+    std::vector<quint32> m_positionIndices;
+    int m_positionIndicesCounter = -1;
+    bool m_bDuplicatedVertices = false;
+
+    RHIModel* m_model = nullptr;
+
+    QRhiPtr m_rhi;
+    bool m_bComputeFailed = false;
+    bool m_needUpdateInputs = true;
+    bool m_needDispatch = false;
+    int m_outputBufferSize = 0;
+    std::vector<sofa::type::Vec3f> m_inputPositions;
+
+    QRhiBuffer* m_uniformBuffer = nullptr;
+    QRhiBuffer* m_inputBuffer = nullptr;
+    QRhiBuffer* m_indexBuffer = nullptr;
+    QRhiBuffer* m_weightBuffer = nullptr;
+    QRhiBuffer* m_positionIndexBuffer = nullptr;
+    QRhiShaderResourceBindings* m_bindings = nullptr;
+    QRhiComputePipeline* m_pipeline = nullptr;
+    QShader m_shader;
+};
+
+} // namespace sofa::rhi
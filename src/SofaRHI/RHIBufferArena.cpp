@@ -0,0 +1,200 @@
+#include <SofaRHI/RHIBufferArena.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+#include <algorithm>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// a page is compacted if its free space is split in more blocks than that...
+constexpr std::size_t COMPACTION_MIN_FREE_BLOCKS = 8;
+// ... and if its largest free block is smaller than this fraction of its free space
+constexpr double COMPACTION_MAX_LARGEST_BLOCK_RATIO = 0.5;
+}
+
+RHIBufferArena::RHIBufferArena(QRhiPtr rhi, const std::vector<Stream>& streams, quint32 pageCapacity)
+    : m_rhi(rhi)
+    , m_streams(streams)
+    , m_pageCapacity(pageCapacity)
+{
+}
+
+RHIBufferArena::~RHIBufferArena()
+{
+    for (auto& page : m_pages)
+    {
+        for (auto* buffer : page.buffers)
+        {
+            delete buffer;
+        }
+    }
+}
+
+bool RHIBufferArena::createPage(quint32 capacity)
+{
+    Page page;
+    page.capacity = capacity;
+    for (const auto& stream : m_streams)
+    {
+        QRhiBuffer* buffer = m_rhi->newBuffer(stream.type, stream.usage, int(capacity * stream.elementSize));
+        if (!buffer->build())
+        {
+            msg_error("RHIBufferArena") << "Problem while building a buffer of " << capacity * stream.elementSize << " bytes";
+            delete buffer;
+            for (auto* createdBuffer : page.buffers)
+                delete createdBuffer;
+            return false;
+        }
+        page.buffers.push_back(buffer);
+    }
+    page.freeBlocks[0] = capacity;
+    m_pages.push_back(std::move(page));
+
+    return true;
+}
+
+RHIBufferArena::Allocation RHIBufferArena::allocate(quint32 count)
+{
+    Allocation allocation;
+    if (count == 0)
+        return allocation;
+
+    // best fit among all the pages
+    int bestPage = -1;
+    std::map<quint32, quint32>::iterator bestBlock;
+    for (int p = 0; p < int(m_pages.size()); p++)
+    {
+        auto& freeBlocks = m_pages[p].freeBlocks;
+        for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+        {
+            if (it->second >= count && (bestPage < 0 || it->second < bestBlock->second))
+            {
+                bestPage = p;
+                bestBlock = it;
+            }
+        }
+    }
+
+    if (bestPage < 0)
+    {
+        // larger ranges get their own page
+        if (!createPage(std::max(m_pageCapacity, count)))
+            return allocation;
+        bestPage = int(m_pages.size()) - 1;
+        bestBlock = m_pages.back().freeBlocks.begin();
+    }
+
+    Page& page = m_pages[bestPage];
+    const quint32 first = bestBlock->first;
+    const quint32 remaining = bestBlock->second - count;
+    page.freeBlocks.erase(bestBlock);
+    if (remaining > 0)
+        page.freeBlocks[first + count] = remaining;
+    page.allocatedElements += count;
+
+    allocation.page = bestPage;
+    allocation.first = first;
+    allocation.count = count;
+    allocation.generation = page.generation;
+
+    return allocation;
+}
+
+void RHIBufferArena::free(Allocation& allocation)
+{
+    if (isValid(allocation))
+    {
+        Page& page = m_pages[allocation.page];
+        auto it = page.freeBlocks.emplace(allocation.first, allocation.count).first;
+
+        // coalesce with the next block, then with the previous one
+        auto next = std::next(it);
+        if (next != page.freeBlocks.end() && it->first + it->second == next->first)
+        {
+            it->second += next->second;
+            page.freeBlocks.erase(next);
+        }
+        if (it != page.freeBlocks.begin())
+        {
+            auto previous = std::prev(it);
+            if (previous->first + previous->second == it->first)
+            {
+                previous->second += it->second;
+                page.freeBlocks.erase(it);
+            }
+        }
+
+        page.allocatedElements -= allocation.count;
+        m_bHasFreed = true;
+    }
+
+    allocation = Allocation();
+}
+
+bool RHIBufferArena::isValid(const Allocation& allocation) const
+{
+    return !allocation.isNull()
+        && allocation.page < int(m_pages.size())
+        && m_pages[allocation.page].generation == allocation.generation;
+}
+
+QRhiBuffer* RHIBufferArena::getBuffer(const Allocation& allocation, std::size_t stream) const
+{
+    if (allocation.isNull())
+        return nullptr;
+
+    return m_pages[allocation.page].buffers[stream];
+}
+
+void RHIBufferArena::compact()
+{
+    if (!m_bHasFreed)
+        return;
+
+    for (auto& page : m_pages)
+    {
+        if (page.freeBlocks.size() < COMPACTION_MIN_FREE_BLOCKS)
+            continue;
+
+        quint32 freeElements = 0;
+        quint32 largestBlock = 0;
+        for (const auto& block : page.freeBlocks)
+        {
+            freeElements += block.second;
+            largestBlock = std::max(largestBlock, block.second);
+        }
+
+        if (largestBlock < freeElements * COMPACTION_MAX_LARGEST_BLOCK_RATIO)
+        {
+            page.freeBlocks.clear();
+            page.freeBlocks[0] = page.capacity;
+            page.allocatedElements = 0;
+            page.generation++;
+        }
+    }
+
+    m_bHasFreed = false;
+}
+
+RHIBufferArena::Statistics RHIBufferArena::getStatistics() const
+{
+    quint32 elementSize = 0;
+    for (const auto& stream : m_streams)
+        elementSize += stream.elementSize;
+
+    Statistics statistics;
+    statistics.pageNumber = sofa::Size(m_pages.size());
+    for (const auto& page : m_pages)
+    {
+        statistics.capacityBytes += page.capacity * elementSize;
+        statistics.allocatedBytes += page.allocatedElements * elementSize;
+        statistics.freeBlockNumber += sofa::Size(page.freeBlocks.size());
+    }
+
+    return statistics;
+}
+
+} // namespace sofa::rhi
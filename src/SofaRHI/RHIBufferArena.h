@@ -0,0 +1,83 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <SofaRHI/RHIUtils.h>
+
+#include <map>
+#include <vector>
+
+namespace sofa::rhi
+{
+
+/// Sub-allocate ranges of elements (vertices, indices) in a few large buffers ("pages") shared by all the RHIModels.
+/// A page has one buffer per stream (e.g positions, normals, texture coordinates) and an element has the same index in each of them,
+/// so a range can be drawn with the same bindings as its neighbours (firstIndex/vertexOffset of the draw call).
+/// Free ranges are kept in a free-list per page, coalesced when freed.
+class SOFA_SOFARHI_API RHIBufferArena
+{
+public:
+    struct Stream
+    {
+        QRhiBuffer::Type type;
+        QRhiBuffer::UsageFlags usage;
+        quint32 elementSize; // in bytes
+    };
+
+    struct Allocation
+    {
+        int page{ -1 };
+        quint32 first{ 0 }; // in elements
+        quint32 count{ 0 };
+        quint32 generation{ 0 }; // of the page when allocated
+
+        bool isNull() const { return page < 0; }
+    };
+
+    struct Statistics
+    {
+        sofa::Size pageNumber{ 0 };
+        sofa::Size capacityBytes{ 0 };
+        sofa::Size allocatedBytes{ 0 };
+        sofa::Size freeBlockNumber{ 0 };
+    };
+
+    RHIBufferArena(QRhiPtr rhi, const std::vector<Stream>& streams, quint32 pageCapacity);
+    ~RHIBufferArena();
+
+    /// Return a null allocation if count is 0 or if the buffers cannot be created
+    Allocation allocate(quint32 count);
+    /// Give back the range (if still valid) and reset the allocation
+    void free(Allocation& allocation);
+    /// False if the page of the allocation has been compacted since: the range has to be allocated (and uploaded) again
+    bool isValid(const Allocation& allocation) const;
+
+    QRhiBuffer* getBuffer(const Allocation& allocation, std::size_t stream) const;
+    quint32 getByteOffset(const Allocation& allocation, std::size_t stream) const { return allocation.first * m_streams[stream].elementSize; }
+
+    /// Reset the pages whose free space is fragmented (only if something has been freed since the last call).
+    /// All their allocations become invalid: their owners allocate them again, contiguously this time.
+    void compact();
+
+    Statistics getStatistics() const;
+
+private:
+    struct Page
+    {
+        std::vector<QRhiBuffer*> buffers; // one per stream
+        quint32 capacity{ 0 };
+        quint32 allocatedElements{ 0 };
+        std::map<quint32, quint32> freeBlocks; // first -> count, sorted by first for the coalescing
+        quint32 generation{ 0 };
+    };
+
+    bool createPage(quint32 capacity);
+
+    QRhiPtr m_rhi;
+    std::vector<Stream> m_streams;
+    quint32 m_pageCapacity;
+    std::vector<Page> m_pages;
+    bool m_bHasFreed = false;
+};
+
+} // namespace sofa::rhi
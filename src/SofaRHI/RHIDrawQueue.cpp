@@ -0,0 +1,173 @@
+#include <SofaRHI/RHIDrawQueue.h>
+
+#include <SofaRHI/RHITracer.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// key layout, from the most significant bits:
+// pass (3) | transparent (1) | opaque: pipeline (16) | srb (16) | depth (24)
+//                            | transparent: inverted depth (24) | pipeline (16) | srb (16)
+constexpr int PASS_SHIFT = 61;
+constexpr int TRANSPARENT_SHIFT = 60;
+constexpr quint64 DEPTH_MASK = 0xFFFFFF;
+
+// positive floats keep their order when read as integers: keep the 24 most significant bits (after the sign)
+quint64 quantizeDepth(float depth)
+{
+    depth = std::max(depth, 0.0f);
+    quint32 bits = 0;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return (bits >> 7) & DEPTH_MASK;
+}
+
+bool sameVertexInput(const RHIDrawQueue::DrawPacket& a, const RHIDrawQueue::DrawPacket& b)
+{
+    return a.indexBuffer == b.indexBuffer
+        && a.indexFormat == b.indexFormat
+        && a.vertexBindingCount == b.vertexBindingCount
+        && std::equal(a.vertexBindings.begin(), a.vertexBindings.begin() + a.vertexBindingCount, b.vertexBindings.begin());
+}
+} // namespace
+
+quint16 RHIDrawQueue::getID(std::unordered_map<const void*, quint16>& ids, const void* resource)
+{
+    auto it = ids.find(resource);
+    if (it != ids.end())
+        return it->second;
+
+    // resources are rarely destroyed: start again when all the ids are used
+    if (ids.size() > 0xFFFF)
+        ids.clear();
+
+    const quint16 id = quint16(ids.size());
+    ids.emplace(resource, id);
+    return id;
+}
+
+void RHIDrawQueue::add(Pass pass, bool transparent, float depth, const DrawPacket& packet)
+{
+    const quint64 pipelineID = getID(m_pipelineIDs, packet.pipeline);
+    const quint64 srbID = getID(m_srbIDs, packet.srb);
+    const quint64 quantizedDepth = quantizeDepth(depth);
+
+    quint64 key = (quint64(pass) << PASS_SHIFT);
+    if (transparent)
+    {
+        key |= (quint64(1) << TRANSPARENT_SHIFT);
+        key |= (DEPTH_MASK - quantizedDepth) << 36; // back-to-front
+        key |= pipelineID << 20;
+        key |= srbID << 4;
+    }
+    else
+    {
+        key |= pipelineID << 44;
+        key |= srbID << 28;
+        key |= quantizedDepth << 4; // front-to-back
+    }
+
+    m_keys.push_back(key);
+    m_packets.push_back(packet);
+    m_bSorted = false;
+}
+
+void RHIDrawQueue::clear()
+{
+    m_packets.clear();
+    m_keys.clear();
+    m_bSorted = false;
+}
+
+void RHIDrawQueue::sort()
+{
+    const std::size_t packetNumber = m_packets.size();
+    m_sortedItems.resize(packetNumber);
+    m_sortBuffer.resize(packetNumber);
+    for (std::size_t i = 0; i < packetNumber; i++)
+    {
+        m_sortedItems[i] = { m_keys[i], quint32(i) };
+    }
+
+    // one pass per byte, skipped if all the keys have the same value for this byte
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        std::array<std::size_t, 256> counts{};
+        for (const auto& item : m_sortedItems)
+        {
+            counts[(item.first >> shift) & 0xFF]++;
+        }
+        if (counts[(m_sortedItems.front().first >> shift) & 0xFF] == packetNumber)
+            continue;
+
+        std::size_t offset = 0;
+        for (auto& count : counts)
+        {
+            const std::size_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+        for (const auto& item : m_sortedItems)
+        {
+            m_sortBuffer[counts[(item.first >> shift) & 0xFF]++] = item;
+        }
+        m_sortedItems.swap(m_sortBuffer);
+    }
+
+    m_bSorted = true;
+}
+
+void RHIDrawQueue::submit(QRhiCommandBuffer* cb, Pass pass, utils::FrameStatistics& frameStatistics)
+{
+    if (m_packets.empty())
+        return;
+
+    SOFARHI_TRACE_SCOPE("RHIDrawQueue::submit");
+
+    if (!m_bSorted)
+        sort();
+
+    // the packets of a pass are contiguous (most significant bits of the keys)
+    const auto passBegin = std::lower_bound(m_sortedItems.begin(), m_sortedItems.end(), quint64(pass) << PASS_SHIFT,
+        [](const std::pair<quint64, quint32>& item, quint64 key) { return item.first < key; });
+    const auto passEnd = std::lower_bound(passBegin, m_sortedItems.end(), (quint64(pass) + 1) << PASS_SHIFT,
+        [](const std::pair<quint64, quint32>& item, quint64 key) { return item.first < key; });
+
+    const DrawPacket* previous = nullptr;
+    for (auto it = passBegin; it != passEnd; ++it)
+    {
+        const DrawPacket& packet = m_packets[it->second];
+
+        // the shader resources and the vertex input are set again after a pipeline change
+        const bool pipelineChanged = previous == nullptr || previous->pipeline != packet.pipeline;
+        if (pipelineChanged)
+        {
+            cb->setGraphicsPipeline(packet.pipeline);
+            frameStatistics.pipelineBinds++;
+        }
+        if (pipelineChanged || previous->srb != packet.srb)
+        {
+            cb->setShaderResources(packet.srb);
+        }
+        if (previous == nullptr || !(previous->viewport == packet.viewport))
+        {
+            cb->setViewport(packet.viewport);
+        }
+        if (pipelineChanged || !sameVertexInput(*previous, packet))
+        {
+            cb->setVertexInput(0, packet.vertexBindingCount, packet.vertexBindings.data(), packet.indexBuffer, 0, packet.indexFormat);
+        }
+
+        cb->drawIndexed(packet.indexCount, 1, packet.firstIndex, packet.vertexOffset);
+        frameStatistics.drawCalls++;
+        frameStatistics.triangles += packet.indexCount / 3;
+
+        previous = &packet;
+    }
+}
+
+} // namespace sofa::rhi
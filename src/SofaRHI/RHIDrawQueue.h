@@ -0,0 +1,70 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <SofaRHI/RHIUtils.h>
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+namespace sofa::rhi
+{
+
+/// Indexed draws of the whole frame, recorded in any order (e.g scene graph order) and submitted sorted by a 64-bit key:
+/// pass, then opaque before transparent, then pipeline and shader resources (opaque, front-to-back inside them)
+/// or depth (transparent, back-to-front), so that redundant pipeline/srb/viewport/vertex input changes can be skipped.
+class SOFA_SOFARHI_API RHIDrawQueue
+{
+public:
+    /// Each pass is submitted separately (see submit())
+    enum class Pass : quint8
+    {
+        MAIN = 0,
+        TRANSPARENCY_DEPTH, // depth of the opaque draws in the weighted blended transparency target
+        TRANSPARENCY_ACCUMULATION, // transparent draws in the weighted blended transparency target
+        DEPTH_PREPASS, // depth of the opaque draws (positions only), before the main pass in the same render pass
+        SHADOW // depth of the shadow casters in the shadow maps (positions only), recorded only when the maps are invalidated
+    };
+
+    static constexpr int MAX_VERTEX_BINDINGS = 4;
+
+    struct DrawPacket
+    {
+        QRhiGraphicsPipeline* pipeline = nullptr;
+        QRhiShaderResourceBindings* srb = nullptr;
+        QRhiViewport viewport;
+        std::array<QRhiCommandBuffer::VertexInput, MAX_VERTEX_BINDINGS> vertexBindings;
+        int vertexBindingCount = 0;
+        QRhiBuffer* indexBuffer = nullptr;
+        QRhiCommandBuffer::IndexFormat indexFormat = QRhiCommandBuffer::IndexUInt32;
+        quint32 indexCount = 0;
+        quint32 firstIndex = 0;
+        qint32 vertexOffset = 0;
+    };
+
+    /// depth: distance to the camera (e.g of the center of the bounding box), clamped to 0
+    void add(Pass pass, bool transparent, float depth, const DrawPacket& packet);
+    void clear();
+    bool empty() const { return m_packets.empty(); }
+
+    /// Record the packets of a pass, sorted (the queue is sorted once per frame)
+    void submit(QRhiCommandBuffer* cb, Pass pass, utils::FrameStatistics& frameStatistics);
+
+private:
+    quint16 getID(std::unordered_map<const void*, quint16>& ids, const void* resource);
+    void sort();
+
+    std::vector<DrawPacket> m_packets;
+    std::vector<quint64> m_keys;
+    // (key, packet index), sorted with a LSD radix sort
+    std::vector<std::pair<quint64, quint32> > m_sortedItems;
+    std::vector<std::pair<quint64, quint32> > m_sortBuffer;
+    bool m_bSorted = false;
+
+    // small ids for the keys, kept between frames
+    std::unordered_map<const void*, quint16> m_pipelineIDs;
+    std::unordered_map<const void*, quint16> m_srbIDs;
+};
+
+} // namespace sofa::rhi
@@ -0,0 +1,180 @@
+#include <SofaRHI/RHIGpuProfiler.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+#include <QtGui/private/qrhiprofiler_p.h>
+#if QT_CONFIG(opengl)
+# include <QOpenGLTimerQuery>
+#endif
+
+namespace sofa::rhi
+{
+
+RHIGpuProfiler::RHIGpuProfiler(QRhiPtr rhi)
+    : m_rhi(rhi)
+{
+#if QT_CONFIG(opengl)
+    m_bUseTimerQueries = (m_rhi->backend() == QRhi::OpenGLES2);
+#endif
+}
+
+RHIGpuProfiler::~RHIGpuProfiler()
+{
+    releaseQueries();
+}
+
+void RHIGpuProfiler::setEnabled(bool enabled)
+{
+    if (m_bEnabled == enabled)
+        return;
+
+    m_bEnabled = enabled;
+    if (!m_bEnabled)
+    {
+        releaseQueries();
+        m_timings = utils::GpuTimings{};
+    }
+}
+
+void RHIGpuProfiler::releaseQueries()
+{
+#if QT_CONFIG(opengl)
+    bool hasQueries = false;
+    for (const auto& slotQueries : m_queries)
+        for (const auto* query : slotQueries)
+            hasQueries |= (query != nullptr);
+
+    if (!hasQueries)
+        return;
+
+    // the queries belong to the GL context of the QRhi
+    m_rhi->makeThreadLocalNativeContextCurrent();
+    for (auto& slotQueries : m_queries)
+    {
+        for (auto& query : slotQueries)
+        {
+            delete query;
+            query = nullptr;
+        }
+    }
+#endif // QT_CONFIG(opengl)
+    for (auto& slotRecorded : m_recorded)
+        slotRecorded.fill(false);
+}
+
+void RHIGpuProfiler::beginFrame()
+{
+    if (!m_bEnabled)
+        return;
+
+    m_currentSlot = (m_currentSlot + 1) % FRAME_LATENCY;
+
+    if (m_bUseTimerQueries)
+    {
+        resolveSlot(m_currentSlot);
+        m_recorded[m_currentSlot].fill(false);
+    }
+    else
+    {
+        // only the whole frame is measured by the backend (if supported)
+        const auto gpuTimes = m_rhi->profiler()->currentGpuFrameTimes();
+        if (gpuTimes.avgTime > 0.0f)
+        {
+            m_timings.valid = true;
+            m_timings.perPass = false;
+            m_timings.frame = double(gpuTimes.avgTime);
+        }
+        else if (!m_bHasWarned)
+        {
+            msg_info("RHIGpuProfiler") << "GPU timings are not (yet) available with this graphics API.";
+            m_bHasWarned = true;
+        }
+    }
+}
+
+bool RHIGpuProfiler::resolveSlot(int slot)
+{
+#if QT_CONFIG(opengl)
+    const auto& recorded = m_recorded[slot];
+    const auto& queries = m_queries[slot];
+
+    bool hasRecorded = false;
+    for (int i = 0; i < MARKER_NUMBER; i++)
+    {
+        if (!recorded[i])
+            continue;
+        hasRecorded = true;
+        // never wait for the GPU: drop this frame if one of the results is not there yet
+        if (!queries[i]->isResultAvailable())
+            return false;
+    }
+    if (!hasRecorded)
+        return false;
+
+    std::array<quint64, MARKER_NUMBER> timestamps{};
+    for (int i = 0; i < MARKER_NUMBER; i++)
+    {
+        if (recorded[i])
+            timestamps[i] = queries[i]->waitForTimestamp(); // available, so does not block
+    }
+
+    const auto duration = [&](Marker begin, Marker end) -> double
+    {
+        const int b = static_cast<int>(begin);
+        const int e = static_cast<int>(end);
+        if (!recorded[b] || !recorded[e] || timestamps[e] < timestamps[b])
+            return 0.0;
+        return double(timestamps[e] - timestamps[b]) * 1e-6; // ns to ms
+    };
+
+    m_timings.valid = true;
+    m_timings.perPass = true;
+    m_timings.computePass = duration(Marker::COMPUTE_BEGIN, Marker::COMPUTE_END);
+    m_timings.models = duration(Marker::RENDER_BEGIN, Marker::MODELS_END);
+    m_timings.drawTool = duration(Marker::MODELS_END, Marker::RENDER_END);
+    m_timings.renderPass = duration(Marker::RENDER_BEGIN, Marker::RENDER_END);
+    m_timings.frame = recorded[static_cast<int>(Marker::COMPUTE_BEGIN)] ?
+        duration(Marker::COMPUTE_BEGIN, Marker::RENDER_END) : m_timings.renderPass;
+
+    return true;
+#else
+    SOFA_UNUSED(slot);
+    return false;
+#endif // QT_CONFIG(opengl)
+}
+
+void RHIGpuProfiler::mark(QRhiCommandBuffer* cb, Marker marker)
+{
+    if (!m_bEnabled || !m_bUseTimerQueries)
+        return;
+
+#if QT_CONFIG(opengl)
+    const int markerID = static_cast<int>(marker);
+    auto& query = m_queries[m_currentSlot][markerID];
+
+    // on OpenGL, beginExternal() flushes the commands recorded so far and makes the context current
+    // so the timestamp is really taken at this point of the pass
+    cb->beginExternal();
+    if (query == nullptr)
+    {
+        query = new QOpenGLTimerQuery();
+        if (!query->create())
+        {
+            msg_warning("RHIGpuProfiler") << "Timer queries are not supported by this OpenGL context, GPU profiling is disabled.";
+            delete query;
+            query = nullptr;
+            cb->endExternal();
+            m_bUseTimerQueries = false;
+            return;
+        }
+    }
+    query->recordTimestamp();
+    m_recorded[m_currentSlot][markerID] = true;
+    cb->endExternal();
+#else
+    SOFA_UNUSED(cb);
+    SOFA_UNUSED(marker);
+#endif // QT_CONFIG(opengl)
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+#include <SofaRHI/RHIUtils.h>
+
+#include <QtGui/private/qrhi_p.h>
+
+#include <array>
+
+class QOpenGLTimerQuery;
+
+namespace sofa::rhi
+{
+
+/// Measure the GPU time spent in the passes of a frame, without stalling the CPU:
+/// timestamps are resolved FRAME_LATENCY frames later, and dropped if still not available.
+/// Per-pass timings are only available with OpenGL (timer queries recorded between beginExternal/endExternal);
+/// with the other backends, only the whole frame time is given (by the QRhiProfiler, if the backend supports it).
+class SOFA_SOFARHI_API RHIGpuProfiler
+{
+public:
+    enum class Marker : int
+    {
+        COMPUTE_BEGIN = 0,
+        COMPUTE_END,
+        RENDER_BEGIN,
+        MODELS_END, // RHIModels have been drawn, DrawToolRHI commands follow
+        RENDER_END,
+        COUNT
+    };
+
+    RHIGpuProfiler(QRhiPtr rhi);
+    ~RHIGpuProfiler();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_bEnabled; }
+
+    /// To call after QRhi::beginFrame(), resolves the timestamps of the frame recorded FRAME_LATENCY frames ago
+    void beginFrame();
+    /// Record a timestamp, must be called inside a (compute or render) pass
+    void mark(QRhiCommandBuffer* cb, Marker marker);
+
+    /// Last resolved timings
+    const utils::GpuTimings& getTimings() const { return m_timings; }
+
+private:
+    bool resolveSlot(int slot);
+    void releaseQueries();
+
+    static constexpr int FRAME_LATENCY{ 3 };
+    static constexpr int MARKER_NUMBER{ static_cast<int>(Marker::COUNT) };
+
+    QRhiPtr m_rhi;
+    bool m_bEnabled = false;
+    bool m_bUseTimerQueries = false;
+    bool m_bHasWarned = false;
+    int m_currentSlot = 0;
+    utils::GpuTimings m_timings;
+
+    std::array<std::array<QOpenGLTimerQuery*, MARKER_NUMBER>, FRAME_LATENCY> m_queries{};
+    std::array<std::array<bool, MARKER_NUMBER>, FRAME_LATENCY> m_recorded{};
+};
+
+} // namespace sofa::rhi
@@ -13,6 +13,8 @@ public:
     virtual bool initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc) = 0;
     virtual void updateGraphicResources(QRhiResourceUpdateBatch* batch) = 0;
     virtual void updateGraphicCommands(QRhiCommandBuffer* cb, const QRhiViewport& viewport) = 0;
+    /// Build now what would be built when first needed (e.g the pipelines of the optional passes), after initGraphicResources()
+    virtual void warmUpGraphicResources() {}
 };
 
 
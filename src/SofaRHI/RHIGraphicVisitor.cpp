@@ -32,6 +32,23 @@ void RHIGraphicInitResourcesVisitor::processObject(simulation::Node* /*node*/, c
     }
 }
 
+sofa::simulation::Visitor::Result RHIGraphicWarmUpResourcesVisitor::processNodeTopDown(simulation::Node* node)
+{
+    for_each(this, node, node->object, &RHIGraphicWarmUpResourcesVisitor::processObject);
+
+    return RESULT_CONTINUE;
+}
+
+void RHIGraphicWarmUpResourcesVisitor::processObject(simulation::Node* /*node*/, core::objectmodel::BaseObject* o)
+{
+    RHIGraphicModel* rgm = dynamic_cast<RHIGraphicModel*>(o);
+
+    if (rgm) // RHIGraphicModel
+    {
+        rgm->warmUpGraphicResources();
+    }
+}
+
 
 sofa::simulation::Visitor::Result RHIGraphicUpdateResourcesVisitor::processNodeTopDown(simulation::Node* node)
 {
@@ -114,6 +131,7 @@ void RHIGraphicUpdateCommandsVisitor::processObject(simulation::Node* /*node*/,
         QRhiCommandBuffer* cb = m_rhiDrawTool->getCommandBuffer();
         const QRhiViewport& viewport = m_rhiDrawTool->getViewport();
 
+        m_rhiDrawTool->getFrameStatistics().visitedModels++;
         rvm->updateGraphicCommands(cb, viewport);
     }
     else // other than RHIGraphicModel
@@ -58,6 +58,18 @@ public:
 
 };
 
+class SOFA_SOFARHI_API RHIGraphicWarmUpResourcesVisitor : public RHIGraphicVisitor
+{
+public:
+    RHIGraphicWarmUpResourcesVisitor(core::visual::VisualParams* params)
+        : RHIGraphicVisitor(params) {}
+
+    Result processNodeTopDown(simulation::Node* node) override;
+    void processObject(simulation::Node* /*node*/, core::objectmodel::BaseObject* o) override;
+
+    const char* getClassName() const override { return "RHIGraphicWarmUpResourcesVisitor"; }
+};
+
 class SOFA_SOFARHI_API RHIGraphicUpdateResourcesVisitor : public RHIGraphicVisitor
 {
 public:
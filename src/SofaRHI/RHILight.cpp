@@ -0,0 +1,93 @@
+#include <SofaRHI/RHILight.h>
+
+#include <sofa/core/ObjectFactory.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sofa::rhi
+{
+
+int RHIDirectionalLightClass = core::RegisterObject("Directional light shading the RHIModels")
+    .add< RHIDirectionalLight >()
+;
+
+int RHIPositionalLightClass = core::RegisterObject("Point light shading the RHIModels")
+    .add< RHIPositionalLight >()
+;
+
+int RHISpotLightClass = core::RegisterObject("Spot light shading the RHIModels")
+    .add< RHISpotLight >()
+;
+
+namespace
+{
+constexpr float PI{ 3.14159265358979323846f };
+
+sofa::type::Vec3f normalizedOr(const sofa::type::Vec3f& v, const sofa::type::Vec3f& fallback)
+{
+    const float norm = v.norm();
+    return norm > 0.0f ? v / norm : fallback;
+}
+} // namespace
+
+RHILight::RHILight()
+    : d_color(initData(&d_color, sofa::type::Vec3f(1.0f, 1.0f, 1.0f), "color", "Color of the light"))
+    , d_shadowsEnabled(initData(&d_shadowsEnabled, false, "shadowsEnabled", "Cast the shadows of the RHIModels (directional and spot lights only)"))
+    , d_shadowFactor(initData(&d_shadowFactor, 1.0f, "shadowFactor", "Darkness of the shadows, from 0 (none) to 1 (black)"))
+{
+}
+
+RHIDirectionalLight::RHIDirectionalLight()
+    : d_direction(initData(&d_direction, sofa::type::Vec3f(0.0f, 0.0f, -1.0f), "direction", "Direction of the light"))
+{
+}
+
+RHILight::Description RHIDirectionalLight::getDescription() const
+{
+    Description description;
+    const auto towardsLight = -normalizedOr(d_direction.getValue(), { 0.0f, 0.0f, -1.0f });
+    description.position = { towardsLight[0], towardsLight[1], towardsLight[2], 0.0f };
+    description.color = d_color.getValue();
+    description.shadows = d_shadowsEnabled.getValue();
+    description.shadowFactor = std::clamp(d_shadowFactor.getValue(), 0.0f, 1.0f);
+    return description;
+}
+
+RHIPositionalLight::RHIPositionalLight()
+    : d_position(initData(&d_position, sofa::type::Vec3f(0.0f, 0.0f, 0.0f), "position", "Position of the light"))
+    , d_attenuation(initData(&d_attenuation, 0.0f, "attenuation", "Linear attenuation with the distance (0: none). Attenuated lights only shade the pixels they reach"))
+{
+}
+
+RHILight::Description RHIPositionalLight::getDescription() const
+{
+    Description description;
+    const auto& position = d_position.getValue();
+    description.position = { position[0], position[1], position[2], 1.0f };
+    description.color = d_color.getValue();
+    description.attenuation = std::max(0.0f, d_attenuation.getValue());
+    // where the attenuation is below 1/256
+    description.range = description.attenuation > 0.0f ? 255.0f / description.attenuation : 0.0f;
+    return description;
+}
+
+RHISpotLight::RHISpotLight()
+    : d_direction(initData(&d_direction, sofa::type::Vec3f(0.0f, 0.0f, -1.0f), "direction", "Direction of the spot"))
+    , d_cutoff(initData(&d_cutoff, 30.0f, "cutoff", "Half angle of the cone (degrees)"))
+    , d_exponent(initData(&d_exponent, 1.0f, "exponent", "Concentration of the light in the cone"))
+{
+}
+
+RHILight::Description RHISpotLight::getDescription() const
+{
+    Description description = RHIPositionalLight::getDescription();
+    description.spotDirection = normalizedOr(d_direction.getValue(), { 0.0f, 0.0f, -1.0f });
+    description.spotCutoffCosine = std::cos(std::clamp(d_cutoff.getValue(), 0.0f, 90.0f) * PI / 180.0f);
+    description.spotExponent = std::max(0.0f, d_exponent.getValue());
+    description.shadows = d_shadowsEnabled.getValue();
+    description.shadowFactor = std::clamp(d_shadowFactor.getValue(), 0.0f, 1.0f);
+    return description;
+}
+
+} // namespace sofa::rhi
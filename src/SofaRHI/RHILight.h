@@ -0,0 +1,86 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <sofa/core/objectmodel/BaseObject.h>
+#include <sofa/type/Vec.h>
+
+namespace sofa::rhi
+{
+
+/// Light of the scene, shading the RHIModels (see DrawToolRHI::updateLights()).
+/// Without any light in the scene, the RHIModels are lit by a white light at the camera.
+/// The lights of SofaOpenglVisual are replaced by these ones (same names and data) by the RHI viewers.
+class SOFA_SOFARHI_API RHILight : public sofa::core::objectmodel::BaseObject
+{
+public:
+    SOFA_ABSTRACT_CLASS(RHILight, sofa::core::objectmodel::BaseObject);
+
+    /// As read by the shaders (see LightUniform), in world space
+    struct Description
+    {
+        sofa::type::Vec4f position; // w = 0: direction towards the light
+        sofa::type::Vec3f color;
+        sofa::type::Vec3f spotDirection;
+        float spotCutoffCosine = -1.0f; // -1: not a spot
+        float spotExponent = 0.0f;
+        float attenuation = 0.0f; // linear: 1 / (1 + attenuation * distance)
+        float range = 0.0f; // distance beyond which the light is ignored, 0 = infinite
+        bool shadows = false; // casts shadows (see RHIShadowMaps), directional and spot lights only
+        float shadowFactor = 1.0f;
+    };
+
+    virtual Description getDescription() const = 0;
+
+    Data<sofa::type::Vec3f> d_color; ///< Color of the light
+    Data<bool> d_shadowsEnabled; ///< Cast the shadows of the RHIModels
+    Data<float> d_shadowFactor; ///< Darkness of the shadows
+
+protected:
+    RHILight();
+    ~RHILight() override = default;
+};
+
+class SOFA_SOFARHI_API RHIDirectionalLight : public RHILight
+{
+public:
+    SOFA_CLASS(RHIDirectionalLight, RHILight);
+
+    Description getDescription() const override;
+
+    Data<sofa::type::Vec3f> d_direction; ///< Direction of the light
+
+protected:
+    RHIDirectionalLight();
+};
+
+class SOFA_SOFARHI_API RHIPositionalLight : public RHILight
+{
+public:
+    SOFA_CLASS(RHIPositionalLight, RHILight);
+
+    Description getDescription() const override;
+
+    Data<sofa::type::Vec3f> d_position; ///< Position of the light
+    Data<float> d_attenuation; ///< Linear attenuation with the distance
+
+protected:
+    RHIPositionalLight();
+};
+
+class SOFA_SOFARHI_API RHISpotLight : public RHIPositionalLight
+{
+public:
+    SOFA_CLASS(RHISpotLight, RHIPositionalLight);
+
+    Description getDescription() const override;
+
+    Data<sofa::type::Vec3f> d_direction; ///< Direction of the spot
+    Data<float> d_cutoff; ///< Half angle of the cone (degrees)
+    Data<float> d_exponent; ///< Concentration of the light in the cone
+
+protected:
+    RHISpotLight();
+};
+
+} // namespace sofa::rhi
@@ -0,0 +1,135 @@
+#include <SofaRHI/RHIMeshCache.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <cstring>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// Header, then the sections (16-byte aligned). In the layout of the machine: the cache is not meant to be shared.
+struct Header
+{
+    char magic[8];
+    quint32 version;
+    quint32 flags;
+    char hash[20];
+    quint32 vertexNumber;
+    quint32 indexNumber;
+    quint32 triangleNumber;
+    quint32 groupNumber;
+    quint32 padding;
+    quint64 positionsOffset;
+    quint64 normalsOffset;
+    quint64 textureCoordsOffset;
+    quint64 vertexRemapOffset;
+    quint64 indicesOffset;
+    quint64 groupsOffset;
+};
+constexpr char MAGIC[8] = { 'S', 'R', 'H', 'I', 'M', 'S', 'H', '\0' };
+constexpr quint32 VERSION = 1;
+constexpr quint32 FLAG_VERTEX_REMAP = 1;
+constexpr quint64 ALIGNMENT = 16;
+constexpr int HASH_SIZE = 20;
+
+quint64 alignOffset(quint64 offset)
+{
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+} // namespace
+
+RHIMeshCache::RHIMeshCache(const std::string& filename, const QByteArray& hash)
+    : m_file(QString::fromStdString(filename))
+{
+    if (hash.size() != HASH_SIZE || !m_file.open(QIODevice::ReadOnly) || m_file.size() < qint64(sizeof(Header)))
+        return;
+    const quint64 fileSize = quint64(m_file.size());
+    const uchar* data = m_file.map(0, m_file.size());
+    if (data == nullptr)
+        return;
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+        || std::memcmp(header.hash, hash.constData(), HASH_SIZE) != 0)
+        return;
+
+    // a truncated file is only an outdated cache
+    const auto fits = [fileSize](quint64 offset, quint64 size) { return offset % ALIGNMENT == 0 && offset + size <= fileSize; };
+    const bool remapped = (header.flags & FLAG_VERTEX_REMAP) != 0;
+    if (!fits(header.positionsOffset, quint64(header.vertexNumber) * sizeof(sofa::type::Vec3f))
+        || !fits(header.normalsOffset, quint64(header.vertexNumber) * sizeof(sofa::type::Vec3f))
+        || !fits(header.textureCoordsOffset, quint64(header.vertexNumber) * sizeof(sofa::type::Vec2f))
+        || (remapped && !fits(header.vertexRemapOffset, quint64(header.vertexNumber) * sizeof(quint32)))
+        || !fits(header.indicesOffset, quint64(header.indexNumber) * sizeof(quint32))
+        || !fits(header.groupsOffset, quint64(header.groupNumber) * sizeof(Group))
+        || header.indexNumber % 3 != 0 || header.triangleNumber * 3 > header.indexNumber)
+        return;
+
+    m_content.vertexNumber = header.vertexNumber;
+    m_content.positions = reinterpret_cast<const sofa::type::Vec3f*>(data + header.positionsOffset);
+    m_content.normals = reinterpret_cast<const sofa::type::Vec3f*>(data + header.normalsOffset);
+    m_content.textureCoords = reinterpret_cast<const sofa::type::Vec2f*>(data + header.textureCoordsOffset);
+    m_content.vertexRemap = remapped ? reinterpret_cast<const quint32*>(data + header.vertexRemapOffset) : nullptr;
+    m_content.indexNumber = header.indexNumber;
+    m_content.indices = reinterpret_cast<const quint32*>(data + header.indicesOffset);
+    m_content.triangleNumber = header.triangleNumber;
+    m_content.groupNumber = header.groupNumber;
+    m_content.groups = reinterpret_cast<const Group*>(data + header.groupsOffset);
+    m_bValid = true;
+}
+
+// the cache is only an optimization: the caller only reports the errors
+bool RHIMeshCache::write(const std::string& filename, const QByteArray& hash, const Content& content)
+{
+    if (hash.size() != HASH_SIZE)
+        return false;
+
+    const QString path = QString::fromStdString(filename);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.flags = content.vertexRemap != nullptr ? FLAG_VERTEX_REMAP : 0;
+    std::memcpy(header.hash, hash.constData(), HASH_SIZE);
+    header.vertexNumber = content.vertexNumber;
+    header.indexNumber = content.indexNumber;
+    header.triangleNumber = content.triangleNumber;
+    header.groupNumber = content.groupNumber;
+
+    const quint64 vertexNumber = content.vertexNumber;
+    header.positionsOffset = alignOffset(sizeof(header));
+    header.normalsOffset = alignOffset(header.positionsOffset + vertexNumber * sizeof(sofa::type::Vec3f));
+    header.textureCoordsOffset = alignOffset(header.normalsOffset + vertexNumber * sizeof(sofa::type::Vec3f));
+    header.vertexRemapOffset = alignOffset(header.textureCoordsOffset + vertexNumber * sizeof(sofa::type::Vec2f));
+    header.indicesOffset = alignOffset(header.vertexRemapOffset + (content.vertexRemap != nullptr ? vertexNumber * sizeof(quint32) : 0));
+    header.groupsOffset = alignOffset(header.indicesOffset + quint64(content.indexNumber) * sizeof(quint32));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const char padding[ALIGNMENT] = {};
+    const auto writeSection = [&file, &padding](quint64 offset, const void* section, quint64 size)
+    {
+        file.write(padding, qint64(offset - quint64(file.pos())));
+        if (size > 0)
+            file.write(static_cast<const char*>(section), qint64(size));
+    };
+    writeSection(header.positionsOffset, content.positions, vertexNumber * sizeof(sofa::type::Vec3f));
+    writeSection(header.normalsOffset, content.normals, vertexNumber * sizeof(sofa::type::Vec3f));
+    writeSection(header.textureCoordsOffset, content.textureCoords, vertexNumber * sizeof(sofa::type::Vec2f));
+    if (content.vertexRemap != nullptr)
+        writeSection(header.vertexRemapOffset, content.vertexRemap, vertexNumber * sizeof(quint32));
+    writeSection(header.indicesOffset, content.indices, quint64(content.indexNumber) * sizeof(quint32));
+    writeSection(header.groupsOffset, content.groups, quint64(content.groupNumber) * sizeof(Group));
+
+    return file.commit();
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <sofa/type/Vec.h>
+
+#include <QByteArray>
+#include <QFile>
+
+#include <string>
+
+namespace sofa::rhi
+{
+
+/// GPU-ready data of a RHIModel (see RHIModel::d_meshCache) in a file memory-mapped by the next runs:
+/// float streams in the order of the uploaded vertices, triangulated (and optimized) indices and group ranges.
+/// The file is only used if it has the version of the code and the hash of the data of the model it was written from.
+class SOFA_SOFARHI_API RHIMeshCache
+{
+public:
+    struct Group
+    {
+        quint32 firstTriangle;
+        quint32 triangleNumber;
+        qint32 materialID;
+        quint32 textured;
+    };
+
+    struct Content
+    {
+        quint32 vertexNumber = 0;
+        const sofa::type::Vec3f* positions = nullptr;
+        const sofa::type::Vec3f* normals = nullptr;
+        const sofa::type::Vec2f* textureCoords = nullptr;
+        const quint32* vertexRemap = nullptr; // uploaded vertex -> vertex of the model, null if not remapped
+        quint32 indexNumber = 0;
+        const quint32* indices = nullptr; // triangles, then the quads split in two triangles
+        quint32 triangleNumber = 0; // not coming from quads
+        quint32 groupNumber = 0;
+        const Group* groups = nullptr;
+    };
+
+    /// Map the file if it matches the hash (SHA-1 of the data of the model)
+    RHIMeshCache(const std::string& filename, const QByteArray& hash);
+
+    bool isValid() const { return m_bValid; }
+    /// Pointers into the mapping, valid as long as this object
+    const Content& getContent() const { return m_content; }
+
+    static bool write(const std::string& filename, const QByteArray& hash, const Content& content);
+
+private:
+    QFile m_file;
+    Content m_content;
+    bool m_bValid = false;
+};
+
+} // namespace sofa::rhi
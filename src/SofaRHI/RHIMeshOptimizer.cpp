@@ -0,0 +1,319 @@
+#include <SofaRHI/RHIMeshOptimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// scoring of Forsyth's algorithm (values of the article)
+constexpr int FORSYTH_CACHE_SIZE = 32;
+constexpr float CACHE_DECAY_POWER = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+constexpr float VALENCE_BOOST_SCALE = 2.0f;
+constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+float vertexScore(int cachePosition, quint32 remainingValence)
+{
+    // no triangle left to draw with it
+    if (remainingValence == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // the vertices of the last triangle get a fixed score, so that the next one does not use them in the same order
+        if (cachePosition < 3)
+        {
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            const float scaler = 1.0f / float(FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - float(cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    // favour the vertices with few triangles left, to finish them instead of leaving lone triangles
+    score += VALENCE_BOOST_SCALE * std::pow(float(remainingValence), -VALENCE_BOOST_POWER);
+    return score;
+}
+} // namespace
+
+float RHIMeshOptimizer::computeACMR(const quint32* indices, std::size_t indexCount, std::size_t vertexCount, int cacheSize)
+{
+    const std::size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return 0.0f;
+
+    // a vertex is still in the FIFO if less than cacheSize vertices have been added since it was
+    std::vector<quint32> cacheTimes(vertexCount, 0);
+    quint32 time = quint32(cacheSize) + 1;
+    std::size_t misses = 0;
+    for (std::size_t i = 0; i < triangleCount * 3; i++)
+    {
+        const quint32 vertex = indices[i];
+        if (vertex >= vertexCount)
+            continue;
+
+        if (time - cacheTimes[vertex] > quint32(cacheSize))
+        {
+            cacheTimes[vertex] = time++;
+            misses++;
+        }
+    }
+
+    return float(misses) / float(triangleCount);
+}
+
+void RHIMeshOptimizer::optimizeVertexCache(quint32* indices, std::size_t indexCount, std::size_t vertexCount)
+{
+    const std::size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // triangles around each vertex (the first remainingValence[v] ones are not emitted yet)
+    std::vector<quint32> offsets(vertexCount + 1, 0);
+    for (std::size_t i = 0; i < triangleCount * 3; i++)
+    {
+        if (indices[i] >= vertexCount)
+            return;
+        offsets[indices[i] + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<quint32> adjacency(triangleCount * 3);
+    std::vector<quint32> remainingValence(vertexCount, 0);
+    for (std::size_t t = 0; t < triangleCount; t++)
+    {
+        for (std::size_t k = 0; k < 3; k++)
+        {
+            const quint32 vertex = indices[t * 3 + k];
+            adjacency[offsets[vertex] + remainingValence[vertex]++] = quint32(t);
+        }
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (std::size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScores[v] = vertexScore(-1, remainingValence[v]);
+    }
+
+    const auto triangleScore = [&](std::size_t t)
+    {
+        return vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    };
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    std::size_t bestTriangle = 0;
+    for (std::size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScores[t] = triangleScore(t);
+        if (triangleScores[t] > triangleScores[bestTriangle])
+            bestTriangle = t;
+    }
+
+    std::vector<quint32> output;
+    output.reserve(triangleCount * 3);
+    std::vector<quint32> cache;
+    std::vector<quint32> newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    std::size_t nextTriangle = 0; // when no triangle around the cache is left
+
+    constexpr std::size_t NO_TRIANGLE = std::numeric_limits<std::size_t>::max();
+    while (bestTriangle != NO_TRIANGLE)
+    {
+        const quint32* triangle = indices + bestTriangle * 3;
+        emitted[bestTriangle] = true;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // remove it from the triangles left around its vertices
+        for (std::size_t k = 0; k < 3; k++)
+        {
+            const quint32 vertex = triangle[k];
+            const auto begin = adjacency.begin() + offsets[vertex];
+            const auto end = begin + remainingValence[vertex];
+            const auto it = std::find(begin, end, quint32(bestTriangle));
+            if (it != end)
+            {
+                std::iter_swap(it, end - 1);
+                remainingValence[vertex]--;
+            }
+        }
+
+        // the vertices of the triangle go first in the cache, then the previous ones
+        newCache.clear();
+        for (std::size_t k = 0; k < 3; k++)
+        {
+            if (std::find(newCache.begin(), newCache.end(), triangle[k]) == newCache.end())
+                newCache.push_back(triangle[k]);
+        }
+        for (const quint32 vertex : cache)
+        {
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                newCache.push_back(vertex);
+        }
+
+        // the vertices pushed out of the cache get their score without position
+        for (std::size_t i = 0; i < newCache.size(); i++)
+        {
+            const quint32 vertex = newCache[i];
+            cachePositions[vertex] = i < std::size_t(FORSYTH_CACHE_SIZE) ? int(i) : -1;
+            vertexScores[vertex] = vertexScore(cachePositions[vertex], remainingValence[vertex]);
+        }
+
+        // only the triangles around these vertices have a new score: the best one of them is the next one
+        bestTriangle = NO_TRIANGLE;
+        float bestScore = -1.0f;
+        for (const quint32 vertex : newCache)
+        {
+            for (quint32 j = offsets[vertex]; j < offsets[vertex] + remainingValence[vertex]; j++)
+            {
+                const quint32 t = adjacency[j];
+                triangleScores[t] = triangleScore(t);
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cache.assign(newCache.begin(), newCache.begin() + std::min(newCache.size(), std::size_t(FORSYTH_CACHE_SIZE)));
+
+        if (bestTriangle == NO_TRIANGLE)
+        {
+            while (nextTriangle < triangleCount && emitted[nextTriangle])
+                nextTriangle++;
+            if (nextTriangle < triangleCount)
+                bestTriangle = nextTriangle;
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void RHIMeshOptimizer::optimizeOverdraw(quint32* indices, std::size_t indexCount, const sofa::type::Vec3f* positions, std::size_t vertexCount, float threshold)
+{
+    const std::size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2)
+        return;
+
+    // clusters start where the cache restarts (the 3 vertices of the triangle are missing)
+    std::vector<std::size_t> clusterStarts;
+    std::vector<quint32> cacheTimes(vertexCount, 0);
+    quint32 time = quint32(ACMR_CACHE_SIZE) + 1;
+    for (std::size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (std::size_t k = 0; k < 3; k++)
+        {
+            const quint32 vertex = indices[t * 3 + k];
+            if (vertex >= vertexCount)
+                return;
+            if (time - cacheTimes[vertex] > quint32(ACMR_CACHE_SIZE))
+            {
+                cacheTimes[vertex] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+            clusterStarts.push_back(t);
+    }
+    if (clusterStarts.size() < 2)
+        return;
+    clusterStarts.push_back(triangleCount);
+
+    const auto triangleCentroid = [&](std::size_t t)
+    {
+        return (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+    };
+
+    sofa::type::Vec3f meshCentroid;
+    for (std::size_t t = 0; t < triangleCount; t++)
+    {
+        meshCentroid += triangleCentroid(t);
+    }
+    meshCentroid /= float(triangleCount);
+
+    // clusters facing outwards are more likely to hide the others
+    const std::size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<float> clusterSortKeys(clusterCount, 0.0f);
+    for (std::size_t c = 0; c < clusterCount; c++)
+    {
+        sofa::type::Vec3f normal;
+        sofa::type::Vec3f centroid;
+        float area = 0.0f;
+        for (std::size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const auto& a = positions[indices[t * 3]];
+            const auto& b = positions[indices[t * 3 + 1]];
+            const auto& d = positions[indices[t * 3 + 2]];
+            const sofa::type::Vec3f triangleNormal = sofa::type::cross(b - a, d - a); // twice the area
+            const float triangleArea = triangleNormal.norm();
+            normal += triangleNormal;
+            centroid += triangleCentroid(t) * triangleArea;
+            area += triangleArea;
+        }
+        const float normalLength = normal.norm();
+        if (area > 0.0f && normalLength > 0.0f)
+            clusterSortKeys[c] = sofa::type::dot((centroid / area) - meshCentroid, normal / normalLength);
+    }
+
+    std::vector<std::size_t> clusterOrder(clusterCount);
+    std::iota(clusterOrder.begin(), clusterOrder.end(), std::size_t(0));
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](std::size_t a, std::size_t b) { return clusterSortKeys[a] > clusterSortKeys[b]; });
+
+    std::vector<quint32> output;
+    output.reserve(triangleCount * 3);
+    for (const std::size_t c : clusterOrder)
+    {
+        output.insert(output.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+    }
+
+    // the clusters are cut where the cache restarts anyway, but keep the order if it still costs too much
+    if (computeACMR(output.data(), output.size(), vertexCount) > computeACMR(indices, triangleCount * 3, vertexCount) * threshold)
+        return;
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+std::vector<quint32> RHIMeshOptimizer::optimizeVertexFetch(quint32* indices, std::size_t indexCount, std::size_t vertexCount)
+{
+    constexpr quint32 UNUSED = std::numeric_limits<quint32>::max();
+
+    std::vector<quint32> remap;
+    remap.reserve(vertexCount);
+    std::vector<quint32> newVertices(vertexCount, UNUSED);
+    for (std::size_t i = 0; i < indexCount; i++)
+    {
+        const quint32 vertex = indices[i];
+        if (vertex >= vertexCount)
+            continue;
+
+        if (newVertices[vertex] == UNUSED)
+        {
+            newVertices[vertex] = quint32(remap.size());
+            remap.push_back(vertex);
+        }
+        indices[i] = newVertices[vertex];
+    }
+
+    // the vertex count does not change
+    for (std::size_t vertex = 0; vertex < vertexCount; vertex++)
+    {
+        if (newVertices[vertex] == UNUSED)
+            remap.push_back(quint32(vertex));
+    }
+
+    return remap;
+}
+
+} // namespace sofa::rhi
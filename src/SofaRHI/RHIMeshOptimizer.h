@@ -0,0 +1,37 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <sofa/type/Vec.h>
+
+#include <QtGlobal>
+
+#include <vector>
+
+namespace sofa::rhi
+{
+
+/// Reordering of indexed triangle lists (3 indices per triangle), done once when the topology changes:
+/// triangles for the post-transform vertex cache and for the overdraw, then vertices in the order they are fetched.
+class SOFA_SOFARHI_API RHIMeshOptimizer
+{
+public:
+    /// Size of the simulated FIFO cache for the ACMR (small enough to be pessimistic on recent GPUs)
+    static constexpr int ACMR_CACHE_SIZE = 16;
+
+    /// Average cache miss ratio: vertex shader invocations per triangle with a FIFO cache (0.5 at best, 3 at worst)
+    static float computeACMR(const quint32* indices, std::size_t indexCount, std::size_t vertexCount, int cacheSize = ACMR_CACHE_SIZE);
+
+    /// Reorder the triangles to reuse the vertices of the cache (Forsyth, "Linear-speed vertex cache optimisation")
+    static void optimizeVertexCache(quint32* indices, std::size_t indexCount, std::size_t vertexCount);
+
+    /// Reorder clusters of triangles (cut where the cache restarts) so that the ones facing outwards are drawn first,
+    /// unless the ACMR gets worse than threshold times the current one (e.g after optimizeVertexCache())
+    static void optimizeOverdraw(quint32* indices, std::size_t indexCount, const sofa::type::Vec3f* positions, std::size_t vertexCount, float threshold = 1.05f);
+
+    /// Renumber the vertices in the order of their first use, the unused ones at the end.
+    /// Return the remap table: new vertex -> old vertex
+    static std::vector<quint32> optimizeVertexFetch(quint32* indices, std::size_t indexCount, std::size_t vertexCount);
+};
+
+} // namespace sofa::rhi
@@ -8,6 +8,17 @@
 #include <sofa/helper/system/FileRepository.h>
 #include <SofaRHI/DrawToolRHI.h>
 #include <SofaRHI/RHIUtils.h>
+#include <SofaRHI/RHITracer.h>
+#include <SofaRHI/RHIMeshOptimizer.h>
+#include <SofaRHI/RHIVertexQuantization.h>
+#include <SofaRHI/RHIUniformBlocks.h>
+#include <SofaRHI/RHILight.h>
+
+#include <QCryptographicHash>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
 
 namespace sofa::rhi
 {
@@ -16,30 +27,326 @@ using sofa::type::RGBAColor;
 using namespace sofa;
 using namespace sofa::component::visualmodel;
 
+namespace
+{
+// of the LightUniform in phong.frag, after the camera, the material and the diffuse texture, then the shadow maps
+constexpr int LIGHT_BINDING = 3;
+constexpr int SHADOW_MAP_BINDING = 4;
+
+std::array<float, 4> toArray(const sofa::type::RGBAColor& color)
+{
+    return { color.r(), color.g(), color.b(), color.a() };
+}
+
+MaterialUniform getMaterialUniform(const sofa::type::Material& loaderMaterial)
+{
+    MaterialUniform material;
+    material.set<MaterialUniform::AMBIENT>(toArray(loaderMaterial.ambient));
+    material.set<MaterialUniform::DIFFUSE>(toArray(loaderMaterial.diffuse));
+    material.set<MaterialUniform::SPECULAR>(toArray(loaderMaterial.specular));
+    material.set<MaterialUniform::SHININESS>(std::array<float, 4>{ loaderMaterial.shininess, 0.0f, 0.0f, 0.0f });
+    return material;
+}
+
+template<class Container>
+void addToHash(QCryptographicHash& hash, const Container& container)
+{
+    hash.addData(reinterpret_cast<const char*>(container.data()), int(container.size() * sizeof(container[0])));
+}
+} // namespace
+
 ///// RHI Mesh
-RHIGroup::RHIGroup(const utils::BufferInfo& bufferInfo, int materialID)
-    : m_bufferInfo(bufferInfo)
-    , m_materialID(materialID)
+RHIGroup::RHIGroup(sofa::Size firstTriangle, sofa::Size triangleNumber, int materialID)
+    : m_materialID(materialID)
+    , m_firstTriangle(firstTriangle)
+    , m_triangleNumber(triangleNumber)
 {
 
 }
 
-void RHIGroup::addDrawCommand(QRhiCommandBuffer* cb, const QRhiCommandBuffer::VertexInput* vbindings)
+RHIDrawQueue::DrawPacket RHIGroup::createDrawPacket(const RHIDrawInput& input) const
+{
+    // the index buffer is bound at its beginning, the range of the group is given by the draw call
+    RHIDrawQueue::DrawPacket packet;
+    packet.vertexBindingCount = 3;
+    std::copy(input.vertexBindings, input.vertexBindings + 3, packet.vertexBindings.begin());
+    packet.indexBuffer = input.indexBuffer;
+    packet.indexFormat = input.indexFormat;
+    packet.indexCount = m_triangleNumber * 3;
+    packet.firstIndex = input.firstIndex + m_firstTriangle * 3;
+    packet.vertexOffset = input.vertexOffset;
+
+    return packet;
+}
+
+///// RHI Rendering
+std::string RHIRendering::getPipelineName() const
 {
-    cb->setVertexInput(0, 3, vbindings, m_bufferInfo.buffer, m_bufferInfo.offset, QRhiCommandBuffer::IndexUInt32);
-    cb->drawIndexed(m_bufferInfo.size * 3);
+    std::string name = getRenderingName();
+    if (m_bQuantizedVertices)
+        name += "/quantized";
+    if (m_bLights)
+        name += "/lights";
+    if (m_bShadows)
+        name += "/shadows";
+    return name;
+}
+
+QShader RHIRendering::loadVertexShader() const
+{
+    const QShader shader = RHIShaderVariants::load("phong.vert", m_bQuantizedVertices ? RHIShaderVariants::QUANTIZED : RHIShaderVariants::NONE);
+    // the camera buffer is a QuantizedCameraUniform, whose beginning is a CameraUniform
+    if (shader.isValid())
+    {
+        if (m_bQuantizedVertices)
+            layout::matchesShader<QuantizedCameraUniform>(shader, 0, "phong.vert (QUANTIZED)");
+        else
+            layout::matchesShader<CameraUniform>(shader, 0, "phong.vert");
+    }
+    return shader;
+}
+
+QShader RHIRendering::loadFragmentShader(RHIShaderVariants::Features features) const
+{
+    if (m_bLights)
+        features |= RHIShaderVariants::LIGHTS;
+    if (m_bShadows)
+        features |= RHIShaderVariants::SHADOWS;
+    const QShader shader = RHIShaderVariants::load("phong.frag", features);
+    if (shader.isValid() && m_bLights)
+        layout::matchesShader<LightUniform>(shader, LIGHT_BINDING, "phong.frag (LIGHTS)");
+    return shader;
+}
+
+void RHIRendering::addLightBinding(std::vector<QRhiShaderResourceBinding>& bindings, DrawToolRHI* drawTool) const
+{
+    if (m_bLights)
+        bindings.push_back(QRhiShaderResourceBinding::uniformBuffer(LIGHT_BINDING, QRhiShaderResourceBinding::FragmentStage, drawTool->getLightUniformBuffer(), 0, int(LightUniform::paddedSize)));
+    if (m_bShadows)
+    {
+        const RHIShadowMaps* shadowMaps = drawTool->getShadowMaps();
+        bindings.push_back(QRhiShaderResourceBinding::sampledTexture(SHADOW_MAP_BINDING, QRhiShaderResourceBinding::FragmentStage, shadowMaps->getTexture(), shadowMaps->getSampler()));
+    }
+}
+
+QRhiVertexInputLayout RHIRendering::getVertexInputLayout() const
+{
+    QRhiVertexInputLayout inputLayout;
+    if (m_bQuantizedVertices)
+    {
+        // high and low bytes of the 16-bit positions, octahedral normal, 2 floats uv
+        inputLayout.setBindings({
+            { sizeof(RHIVertexQuantization::Position) },
+            { sizeof(RHIVertexQuantization::Normal) },
+            { 2 * sizeof(float) }
+            });
+        inputLayout.setAttributes({
+            { 0, 0, QRhiVertexInputAttribute::UNormByte4, 0 },
+            { 0, 3, QRhiVertexInputAttribute::UNormByte4, 4 },
+            { 1, 1, QRhiVertexInputAttribute::UNormByte4, 0 },
+            { 2, 2, QRhiVertexInputAttribute::Float2, 0 }
+            });
+        return inputLayout;
+    }
+
+    inputLayout.setBindings({
+        { 3 * sizeof(float) } ,
+        { 3 * sizeof(float) } ,
+        { 2 * sizeof(float) }
+        }); // 3 floats vertex + 3 floats normal + 2 floats uv
+    inputLayout.setAttributes({
+        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },
+        { 1, 1, QRhiVertexInputAttribute::Float3, 0 },
+        { 2, 2, QRhiVertexInputAttribute::Float2, 0 }
+        });
+    return inputLayout;
+}
+
+bool RHIRendering::initTransparencyPipelines(QRhiPtr rhi, QRhiRenderPassDescriptor* rpDesc, DrawToolRHI* drawTool)
+{
+    if (m_bHasInitTransparency)
+        return m_transparencyAccumulationPipeline != nullptr;
+    m_bHasInitTransparency = true;
+
+    if (m_pipeline == nullptr)
+        return false;
+
+    const std::string depthName = getPipelineName() + "/transparencyDepth";
+    const std::string accumulationName = getPipelineName() + "/transparencyAccumulation";
+    m_transparencyDepthPipeline = drawTool->getSharedPipeline(depthName);
+    m_transparencyAccumulationPipeline = drawTool->getSharedPipeline(accumulationName);
+    if (m_transparencyDepthPipeline && m_transparencyAccumulationPipeline)
+        return true;
+
+    const QShader accumulationShader = loadFragmentShader(getAccumulationFragmentFeatures() | RHIShaderVariants::OIT);
+    if (!accumulationShader.isValid())
+    {
+        msg_warning("RHIRendering") << "Transparency shader not found (compiled with SOFARHI_ENABLE_OIT?), transparent groups are blended in the main pass";
+        m_transparencyDepthPipeline = nullptr;
+        m_transparencyAccumulationPipeline = nullptr;
+        return false;
+    }
+    layout::matchesShader<MaterialUniform>(accumulationShader, 1, "phong.frag (OIT)");
+
+    // same as the main pipeline, but for the two color targets of the transparency
+    const auto createVariant = [&](const QShader& fs, const QRhiGraphicsPipeline::TargetBlend& accumulationBlend, const QRhiGraphicsPipeline::TargetBlend& coverageBlend, bool depthWrite)
+    {
+        QRhiGraphicsPipeline* pipeline = rhi->newGraphicsPipeline();
+        pipeline->setShaderStages({ m_pipeline->cbeginShaderStages()[0], { QRhiShaderStage::Fragment, fs } });
+        pipeline->setVertexInputLayout(m_pipeline->vertexInputLayout());
+        pipeline->setShaderResourceBindings(m_srb);
+        pipeline->setRenderPassDescriptor(rpDesc);
+        pipeline->setTopology(m_pipeline->topology());
+        pipeline->setDepthTest(true);
+        pipeline->setDepthWrite(depthWrite);
+        pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
+        pipeline->setTargetBlends({ accumulationBlend, coverageBlend });
+        if (!pipeline->build())
+        {
+            msg_error("RHIRendering") << "Problem while building transparency pipeline";
+            delete pipeline;
+            return static_cast<QRhiGraphicsPipeline*>(nullptr);
+        }
+        return pipeline;
+    };
+
+    if (m_transparencyDepthPipeline == nullptr)
+    {
+        // opaque draws only write their depth
+        QRhiGraphicsPipeline::TargetBlend noColor;
+        noColor.colorWrite = QRhiGraphicsPipeline::ColorMask();
+        m_transparencyDepthPipeline = createVariant(m_pipeline->cbeginShaderStages()[1].shader(), noColor, noColor, true);
+        if (m_transparencyDepthPipeline)
+            drawTool->addSharedPipeline(depthName, m_transparencyDepthPipeline);
+    }
+    if (m_transparencyAccumulationPipeline == nullptr)
+    {
+        // sum of the weighted colors, and 1 - product of the (1 - alpha); tested against the opaque depth but not written
+        QRhiGraphicsPipeline::TargetBlend additive;
+        additive.enable = true;
+        additive.srcColor = QRhiGraphicsPipeline::One;
+        additive.dstColor = QRhiGraphicsPipeline::One;
+        additive.srcAlpha = QRhiGraphicsPipeline::One;
+        additive.dstAlpha = QRhiGraphicsPipeline::One;
+        QRhiGraphicsPipeline::TargetBlend coverage;
+        coverage.enable = true;
+        coverage.srcColor = QRhiGraphicsPipeline::One;
+        coverage.dstColor = QRhiGraphicsPipeline::OneMinusSrcAlpha;
+        coverage.srcAlpha = QRhiGraphicsPipeline::One;
+        coverage.dstAlpha = QRhiGraphicsPipeline::OneMinusSrcAlpha;
+        m_transparencyAccumulationPipeline = createVariant(accumulationShader, additive, coverage, false);
+        if (m_transparencyAccumulationPipeline)
+            drawTool->addSharedPipeline(accumulationName, m_transparencyAccumulationPipeline);
+    }
+
+    if (m_transparencyDepthPipeline == nullptr || m_transparencyAccumulationPipeline == nullptr)
+    {
+        m_transparencyDepthPipeline = nullptr;
+        m_transparencyAccumulationPipeline = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool RHIRendering::initDepthPrepassPipeline(QRhiPtr rhi, DrawToolRHI* drawTool)
+{
+    if (m_bHasInitDepthPrepass)
+        return m_depthEqualPipeline != nullptr;
+    m_bHasInitDepthPrepass = true;
+
+    if (m_pipeline == nullptr)
+        return false;
+
+    const std::string depthEqualName = getPipelineName() + "/depthEqual";
+    m_depthEqualPipeline = drawTool->getSharedPipeline(depthEqualName);
+    if (m_depthEqualPipeline)
+        return true;
+
+    // same as the main pipeline, the depth has already been written by the pre-pass
+    QRhiGraphicsPipeline* pipeline = rhi->newGraphicsPipeline();
+    pipeline->setShaderStages(m_pipeline->cbeginShaderStages(), m_pipeline->cendShaderStages());
+    pipeline->setVertexInputLayout(m_pipeline->vertexInputLayout());
+    pipeline->setShaderResourceBindings(m_srb);
+    pipeline->setRenderPassDescriptor(m_pipeline->renderPassDescriptor());
+    pipeline->setTopology(m_pipeline->topology());
+    pipeline->setTargetBlends(m_pipeline->cbeginTargetBlends(), m_pipeline->cendTargetBlends());
+    pipeline->setDepthTest(true);
+    pipeline->setDepthWrite(false);
+    pipeline->setDepthOp(QRhiGraphicsPipeline::Equal);
+    if (!pipeline->build())
+    {
+        msg_error("RHIRendering") << "Problem while building depth equal pipeline";
+        delete pipeline;
+        return false;
+    }
+
+    m_depthEqualPipeline = pipeline;
+    drawTool->addSharedPipeline(depthEqualName, m_depthEqualPipeline);
+    return true;
+}
+
+void RHIRendering::addDrawPacket(RHIDrawQueue& queue, const QRhiViewport& viewport, const RHIDrawInput& input, float depth, const RHIDrawPasses& passes)
+{
+    auto packet = m_rhigroup.createDrawPacket(input);
+    packet.srb = m_srb;
+    packet.viewport = viewport;
+
+    if (passes.transparency && m_transparencyAccumulationPipeline != nullptr)
+    {
+        if (m_bTransparent)
+        {
+            // order-independent: only sorted to share the bindings
+            packet.pipeline = m_transparencyAccumulationPipeline;
+            queue.add(RHIDrawQueue::Pass::TRANSPARENCY_ACCUMULATION, false, 0.0f, packet);
+            return;
+        }
+
+        packet.pipeline = m_transparencyDepthPipeline;
+        queue.add(RHIDrawQueue::Pass::TRANSPARENCY_DEPTH, false, depth, packet);
+    }
+
+    if (!m_bTransparent && passes.depthPrepassPipeline != nullptr && m_depthEqualPipeline != nullptr)
+    {
+        auto prepassPacket = packet;
+        prepassPacket.pipeline = passes.depthPrepassPipeline;
+        prepassPacket.srb = passes.depthPrepassSrb;
+        prepassPacket.vertexBindingCount = 1; // positions
+        queue.add(RHIDrawQueue::Pass::DEPTH_PREPASS, false, depth, prepassPacket);
+
+        packet.pipeline = m_depthEqualPipeline;
+        queue.add(RHIDrawQueue::Pass::MAIN, false, depth, packet);
+        return;
+    }
+
+    packet.pipeline = m_pipeline;
+    queue.add(RHIDrawQueue::Pass::MAIN, m_bTransparent, depth, packet);
+}
+
+void RHIRendering::addShadowPacket(RHIDrawQueue& queue, const RHIDrawInput& input, const RHIShadowMaps& shadowMaps, int map)
+{
+    if (m_bTransparent)
+        return;
+
+    auto packet = m_rhigroup.createDrawPacket(input);
+    packet.pipeline = shadowMaps.getPipeline();
+    packet.srb = shadowMaps.getShaderResourceBindings(map);
+    packet.viewport = shadowMaps.getViewport(map);
+    packet.vertexBindingCount = 1; // positions
+    queue.add(RHIDrawQueue::Pass::SHADOW, false, 0.0f, packet);
 }
 
 ///// RHI Phong Group
-bool RHIPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial)
+bool RHIPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial)
 {
-    m_materialBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, int(utils::PHONG_MATERIAL_SIZE));
+    m_materialBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, int(MaterialUniform::paddedSize));
 
     m_srb = rhi->newShaderResourceBindings();
     std::vector<QRhiShaderResourceBinding> wholeBindings;
     wholeBindings.resize(globalBindings.size());
     std::copy(globalBindings.begin(), globalBindings.end(), wholeBindings.begin());
-    wholeBindings.push_back(QRhiShaderResourceBinding::uniformBuffer(int(globalBindings.size()), QRhiShaderResourceBinding::FragmentStage, m_materialBuffer, 0, int(utils::PHONG_MATERIAL_SIZE)));
+    wholeBindings.push_back(QRhiShaderResourceBinding::uniformBuffer(int(globalBindings.size()), QRhiShaderResourceBinding::FragmentStage, m_materialBuffer, 0, int(MaterialUniform::paddedSize)));
+    addLightBinding(wholeBindings, drawTool);
     m_srb->setBindings(wholeBindings.begin(), wholeBindings.end());
 
     if (!m_srb->build())
@@ -48,13 +355,17 @@ bool RHIPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPt
         return false;
     }
 
+    // the pipeline is shared by all the groups rendered this way
+    m_pipeline = drawTool->getSharedPipeline(getPipelineName());
+    if (m_pipeline)
+        return true;
+
     // Triangle Pipeline 
     //const int secondUbufOffset = rhi->ubufAligned(4 * sizeof(float));
     //std::cout << "4 * sizeof(float) " << 4 * sizeof(float) << std::endl;
     //std::cout << "ubufAlignment " << secondUbufOffset << std::endl;
-    m_pipeline = rhi->newGraphicsPipeline();
-    QShader vs = utils::loadShader(":/shaders/gl/phong.vert.qsb");
-    QShader fs = utils::loadShader(":/shaders/gl/phong.frag.qsb");
+    QShader vs = loadVertexShader();
+    QShader fs = loadFragmentShader(RHIShaderVariants::NONE);
     if (!vs.isValid())
     {
         msg_error("RHIPhongRendering") << "Problem while vs shader";
@@ -65,54 +376,42 @@ bool RHIPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPt
         msg_error("RHIPhongRendering") << "Problem while fs shader";
         return false;
     }
-
-    m_pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
-    QRhiVertexInputLayout inputLayout;
-    inputLayout.setBindings({
-        { 3 * sizeof(float) } ,
-        { 3 * sizeof(float) } ,
-        { 2 * sizeof(float) } 
-        }); // 3 floats vertex + 3 floats normal + 2 floats uv
-    inputLayout.setAttributes({
-        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },
-        { 1, 1, QRhiVertexInputAttribute::Float3, 0 },
-        { 2, 2, QRhiVertexInputAttribute::Float2, 0 }
-        });
-    m_pipeline->setVertexInputLayout(inputLayout);
-    m_pipeline->setShaderResourceBindings(m_srb);
-    m_pipeline->setRenderPassDescriptor(rpDesc.get());
-    m_pipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
-    m_pipeline->setDepthTest(true);
-    m_pipeline->setDepthWrite(true);
-    m_pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
-    m_pipeline->setStencilTest(false);
+    layout::matchesShader<MaterialUniform>(fs, int(globalBindings.size()), "phong.frag");
+
+    QRhiGraphicsPipeline* pipeline = rhi->newGraphicsPipeline();
+    pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+    pipeline->setVertexInputLayout(getVertexInputLayout());
+    pipeline->setShaderResourceBindings(m_srb);
+    pipeline->setRenderPassDescriptor(rpDesc.get());
+    pipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
+    pipeline->setDepthTest(true);
+    pipeline->setDepthWrite(true);
+    pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
+    pipeline->setStencilTest(false);
     QRhiGraphicsPipeline::TargetBlend premulAlphaBlend;
     premulAlphaBlend.enable = true;
     QVarLengthArray<QRhiGraphicsPipeline::TargetBlend, 4> rtblends;
     int colorAttCount = 1; // for later use
     for (int i = 0; i < colorAttCount; ++i)
         rtblends << premulAlphaBlend;
-    m_pipeline->setTargetBlends(rtblends.cbegin(), rtblends.cend());
+    pipeline->setTargetBlends(rtblends.cbegin(), rtblends.cend());
     //m_pipeline->setCullMode(QRhiGraphicsPipeline::None);
 
-    if (!m_pipeline->build())
+    if (!pipeline->build())
     {
         msg_error("RHIPhongRendering") << "Problem while building pipeline";
+        delete pipeline;
         return false;
     }
+    m_pipeline = pipeline;
+    drawTool->addSharedPipeline(getPipelineName(), m_pipeline);
 
     return true;
 }
 void RHIPhongRendering::updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial)
 {
-    utils::PhongMaterial material = {
-            { loaderMaterial.ambient.r(), loaderMaterial.ambient.g(),loaderMaterial.ambient.b(), loaderMaterial.ambient.a()},
-            { loaderMaterial.diffuse.r(), loaderMaterial.diffuse.g(),loaderMaterial.diffuse.b(), loaderMaterial.diffuse.a()},
-            { loaderMaterial.specular.r(), loaderMaterial.specular.g(),loaderMaterial.specular.b(), loaderMaterial.specular.a()},
-            { loaderMaterial.shininess, 0.0f , 0.0f, 0.0f}
-    };
-
-    batch->updateDynamicBuffer(m_materialBuffer, 0, utils::PHONG_MATERIAL_SIZE, &material);
+    getMaterialUniform(loaderMaterial).update(batch, m_materialBuffer);
+    m_bTransparent = loaderMaterial.useDiffuse && loaderMaterial.diffuse.a() < 1.0f;
 
     if (!m_materialBuffer->build())
     {
@@ -121,7 +420,7 @@ void RHIPhongRendering::updateRHIResources(QRhiResourceUpdateBatch* batch, const
 }
 
 ///// RHI Textured Phong Group
-bool RHIDiffuseTexturedPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial)
+bool RHIDiffuseTexturedPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial)
 {
     //load image
     std::string textureFilename(loaderMaterial.textureFilename);
@@ -132,43 +431,26 @@ bool RHIDiffuseTexturedPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderP
         return false;
     }
 
-    m_diffuseImage = QImage(QLatin1String(textureFilename.c_str())).convertToFormat(QImage::Format_RGBA8888);
-    if (m_diffuseImage.isNull())
-    {
-        msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while reading diffuse image " << textureFilename;
-        return false;
-    }
-    m_diffuseImage = m_diffuseImage.mirrored(false, true); // seems texcoord are upside down
-    // create texture and sampler 
-    QRhiTexture::Flags texFlags = 0;
-    if (m_bMipMap)
-        texFlags |= QRhiTexture::MipMapped;
-    if (m_bAutoGenMipMap)
-        texFlags |= QRhiTexture::UsedWithGenerateMips;
-
-    m_diffuseTexture = rhi->newTexture(QRhiTexture::RGBA8, QSize(m_diffuseImage.width(), m_diffuseImage.height()), 1, texFlags);
-    if (!m_diffuseTexture->build())
+    // decoded by a worker thread, the texture is updated in place once it is ready
+    RHITextureCache::SamplerSettings samplerSettings;
+    samplerSettings.mipmap = m_bMipMap;
+    m_diffuseTexture = drawTool->getTextureCache()->acquire(textureFilename, samplerSettings);
+    if (!m_diffuseTexture)
     {
-        msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while building diffuse texture";
-        return false;
-    }
-    m_diffuseSampler = rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, m_bMipMap ? QRhiSampler::Linear : QRhiSampler::None,
-        QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge);
-    if (!m_diffuseSampler->build())
-    {
-        msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while building diffuse sampler";
+        msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while creating diffuse texture " << textureFilename;
         return false;
     }
     
-    m_materialBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, int(utils::PHONG_MATERIAL_SIZE));
+    m_materialBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, int(MaterialUniform::paddedSize));
 
     m_srb = rhi->newShaderResourceBindings();
     const QRhiShaderResourceBinding::StageFlags commonVisibility = QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage;
     std::vector<QRhiShaderResourceBinding> wholeBindings;
     wholeBindings.resize(globalBindings.size());
     std::copy(globalBindings.begin(), globalBindings.end(), wholeBindings.begin());
-    wholeBindings.push_back(QRhiShaderResourceBinding::uniformBuffer(int(globalBindings.size()), QRhiShaderResourceBinding::FragmentStage, m_materialBuffer, 0, int(utils::PHONG_MATERIAL_SIZE)));
-    wholeBindings.push_back(QRhiShaderResourceBinding::sampledTexture(int(globalBindings.size()+1), QRhiShaderResourceBinding::FragmentStage, m_diffuseTexture, m_diffuseSampler));
+    wholeBindings.push_back(QRhiShaderResourceBinding::uniformBuffer(int(globalBindings.size()), QRhiShaderResourceBinding::FragmentStage, m_materialBuffer, 0, int(MaterialUniform::paddedSize)));
+    wholeBindings.push_back(QRhiShaderResourceBinding::sampledTexture(int(globalBindings.size()+1), QRhiShaderResourceBinding::FragmentStage, m_diffuseTexture->getTexture(), m_diffuseTexture->getSampler()));
+    addLightBinding(wholeBindings, drawTool);
     m_srb->setBindings(wholeBindings.begin(), wholeBindings.end());
 
     if (!m_srb->build())
@@ -177,13 +459,17 @@ bool RHIDiffuseTexturedPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderP
         return false;
     }
 
+    // the pipeline is shared by all the groups rendered this way
+    m_pipeline = drawTool->getSharedPipeline(getPipelineName());
+    if (m_pipeline)
+        return true;
+
     // Triangle Pipeline 
     //const int secondUbufOffset = rhi->ubufAligned(4 * sizeof(float));
     //std::cout << "4 * sizeof(float) " << 4 * sizeof(float) << std::endl;
     //std::cout << "ubufAlignment " << secondUbufOffset << std::endl;
-    m_pipeline = rhi->newGraphicsPipeline();
-    QShader vs = utils::loadShader(":/shaders/gl/phong.vert.qsb");
-    QShader fs = utils::loadShader(":/shaders/gl/phong_diffuse_texture.frag.qsb");
+    QShader vs = loadVertexShader();
+    QShader fs = loadFragmentShader(RHIShaderVariants::DIFFUSE_TEXTURE);
     if (!vs.isValid())
     {
         msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while vs shader";
@@ -194,78 +480,54 @@ bool RHIDiffuseTexturedPhongRendering::initRHIResources(QRhiPtr rhi, QRhiRenderP
         msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while fs shader";
         return false;
     }
-
-    m_pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
-    QRhiVertexInputLayout inputLayout;
-    inputLayout.setBindings({
-        { 3 * sizeof(float) } ,
-        { 3 * sizeof(float) } ,
-        { 2 * sizeof(float) }
-        }); // 3 floats vertex + 3 floats normal + 2 floats uv
-    inputLayout.setAttributes({
-        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },
-        { 1, 1, QRhiVertexInputAttribute::Float3, 0 },
-        { 2, 2, QRhiVertexInputAttribute::Float2, 0 }
-        });
-    m_pipeline->setVertexInputLayout(inputLayout);
-    m_pipeline->setShaderResourceBindings(m_srb);
-    m_pipeline->setRenderPassDescriptor(rpDesc.get());
-    m_pipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
-    m_pipeline->setDepthTest(true);
-    m_pipeline->setDepthWrite(true);
-    m_pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
-    m_pipeline->setStencilTest(false);
+    layout::matchesShader<MaterialUniform>(fs, int(globalBindings.size()), "phong.frag");
+
+    QRhiGraphicsPipeline* pipeline = rhi->newGraphicsPipeline();
+    pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+    pipeline->setVertexInputLayout(getVertexInputLayout());
+    pipeline->setShaderResourceBindings(m_srb);
+    pipeline->setRenderPassDescriptor(rpDesc.get());
+    pipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
+    pipeline->setDepthTest(true);
+    pipeline->setDepthWrite(true);
+    pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
+    pipeline->setStencilTest(false);
     //m_pipeline->setCullMode(QRhiGraphicsPipeline::None);
 
-    if (!m_pipeline->build())
+    if (!pipeline->build())
     {
         msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while building pipeline";
+        delete pipeline;
         return false;
     }
+    m_pipeline = pipeline;
+    drawTool->addSharedPipeline(getPipelineName(), m_pipeline);
 
     return true;
 }
 void RHIDiffuseTexturedPhongRendering::updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial)
 {
-    utils::PhongMaterial material = {
-            { loaderMaterial.ambient.r(), loaderMaterial.ambient.g(),loaderMaterial.ambient.b(), loaderMaterial.ambient.a()},
-            { loaderMaterial.diffuse.r(), loaderMaterial.diffuse.g(),loaderMaterial.diffuse.b(), loaderMaterial.diffuse.a()},
-            { loaderMaterial.specular.r(), loaderMaterial.specular.g(),loaderMaterial.specular.b(), loaderMaterial.specular.a()},
-            { loaderMaterial.shininess, 0.0f , 0.0f, 0.0f}
-    };
-
-    batch->updateDynamicBuffer(m_materialBuffer, 0, utils::PHONG_MATERIAL_SIZE, &material);
+    getMaterialUniform(loaderMaterial).update(batch, m_materialBuffer);
+    m_bTransparent = loaderMaterial.useDiffuse && loaderMaterial.diffuse.a() < 1.0f;
 
     if (!m_materialBuffer->build())
     {
         msg_error("RHIDiffuseTexturedPhongRendering") << "Problem while building material uniform buffer";
     }
-
-    if (!m_diffuseImage.isNull())
-    {
-        // TODO
-        if (m_bMipMap)
-        {
-
-        }
-        else
-        {
-            batch->uploadTexture(m_diffuseTexture, m_diffuseImage);
-        }
-    }
 }
 
 
 ///// RHI Wireframe Group
-bool RHIWireframeRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial)
+bool RHIWireframeRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial)
 {
-    m_materialBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, int(utils::PHONG_MATERIAL_SIZE));
+    m_materialBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, int(MaterialUniform::paddedSize));
 
     m_srb = rhi->newShaderResourceBindings();
     std::vector<QRhiShaderResourceBinding> wholeBindings;
     wholeBindings.resize(globalBindings.size());
     std::copy(globalBindings.begin(), globalBindings.end(), wholeBindings.begin());
-    wholeBindings.push_back(QRhiShaderResourceBinding::uniformBuffer(int(globalBindings.size()), QRhiShaderResourceBinding::FragmentStage, m_materialBuffer, 0, int(utils::PHONG_MATERIAL_SIZE)));
+    wholeBindings.push_back(QRhiShaderResourceBinding::uniformBuffer(int(globalBindings.size()), QRhiShaderResourceBinding::FragmentStage, m_materialBuffer, 0, int(MaterialUniform::paddedSize)));
+    addLightBinding(wholeBindings, drawTool);
     m_srb->setBindings(wholeBindings.begin(), wholeBindings.end());
 
     if (!m_srb->build())
@@ -274,10 +536,14 @@ bool RHIWireframeRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescript
         return false;
     }
 
+    // the pipeline is shared by all the groups rendered this way
+    m_pipeline = drawTool->getSharedPipeline(getPipelineName());
+    if (m_pipeline)
+        return true;
+
     // Line Pipeline 
-    m_pipeline = rhi->newGraphicsPipeline();
-    QShader vs = utils::loadShader(":/shaders/gl/phong.vert.qsb"); // just use the phong one...
-    QShader fs = utils::loadShader(":/shaders/gl/phong.frag.qsb");
+    QShader vs = loadVertexShader(); // just use the phong one...
+    QShader fs = loadFragmentShader(RHIShaderVariants::NONE);
     if (!vs.isValid())
     {
         msg_error("RHIPhongRendering") << "Problem while vs shader";
@@ -288,47 +554,35 @@ bool RHIWireframeRendering::initRHIResources(QRhiPtr rhi, QRhiRenderPassDescript
         msg_error("RHIPhongRendering") << "Problem while fs shader";
         return false;
     }
-
-    m_pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
-    QRhiVertexInputLayout inputLayout;
-    inputLayout.setBindings({
-        { 3 * sizeof(float) } ,
-        { 3 * sizeof(float) } ,
-        { 2 * sizeof(float) }
-        }); // 3 floats vertex + 3 floats normal + 2 floats uv
-    inputLayout.setAttributes({
-        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },
-        { 1, 1, QRhiVertexInputAttribute::Float3, 0 },
-        { 2, 2, QRhiVertexInputAttribute::Float2, 0 }
-        });
-    m_pipeline->setVertexInputLayout(inputLayout);
-    m_pipeline->setShaderResourceBindings(m_srb);
-    m_pipeline->setRenderPassDescriptor(rpDesc.get());
-    m_pipeline->setTopology(QRhiGraphicsPipeline::Topology::Lines);
-    m_pipeline->setDepthTest(true);
-    m_pipeline->setDepthWrite(true);
-    m_pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
-    m_pipeline->setStencilTest(false);
+    layout::matchesShader<MaterialUniform>(fs, int(globalBindings.size()), "phong.frag");
+
+    QRhiGraphicsPipeline* pipeline = rhi->newGraphicsPipeline();
+    pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+    pipeline->setVertexInputLayout(getVertexInputLayout());
+    pipeline->setShaderResourceBindings(m_srb);
+    pipeline->setRenderPassDescriptor(rpDesc.get());
+    pipeline->setTopology(QRhiGraphicsPipeline::Topology::Lines);
+    pipeline->setDepthTest(true);
+    pipeline->setDepthWrite(true);
+    pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
+    pipeline->setStencilTest(false);
     //m_pipeline->setCullMode(QRhiGraphicsPipeline::None);
 
-    if (!m_pipeline->build())
+    if (!pipeline->build())
     {
         msg_error("RHIPhongRendering") << "Problem while building pipeline";
+        delete pipeline;
         return false;
     }
+    m_pipeline = pipeline;
+    drawTool->addSharedPipeline(getPipelineName(), m_pipeline);
 
     return true;
 }
 void RHIWireframeRendering::updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial)
 {
-    utils::PhongMaterial material = {
-            { loaderMaterial.ambient.r(), loaderMaterial.ambient.g(),loaderMaterial.ambient.b(), loaderMaterial.ambient.a()},
-            { loaderMaterial.diffuse.r(), loaderMaterial.diffuse.g(),loaderMaterial.diffuse.b(), loaderMaterial.diffuse.a()},
-            { loaderMaterial.specular.r(), loaderMaterial.specular.g(),loaderMaterial.specular.b(), loaderMaterial.specular.a()},
-            { loaderMaterial.shininess, 0.0f , 0.0f, 0.0f}
-    };
-
-    batch->updateDynamicBuffer(m_materialBuffer, 0, utils::PHONG_MATERIAL_SIZE, &material);
+    getMaterialUniform(loaderMaterial).update(batch, m_materialBuffer);
+    m_bTransparent = loaderMaterial.useDiffuse && loaderMaterial.diffuse.a() < 1.0f;
 
     if (!m_materialBuffer->build())
     {
@@ -339,12 +593,35 @@ void RHIWireframeRendering::updateRHIResources(QRhiResourceUpdateBatch* batch, c
 ///// RHI Model
 RHIModel::RHIModel()
     : InheritedVisual()
+    , d_gpuNormals(initData(&d_gpuNormals, true, "gpuNormals", "Compute the vertex normals with compute shaders (if available) instead of the CPU"))
+    , d_optimizeIndices(initData(&d_optimizeIndices, false, "optimizeIndices", "Reorder the triangles of each group for the vertex cache and the overdraw, and the vertices in their order of use, when the topology changes (ACMR logged with printLog)"))
+    , d_mipmaps(initData(&d_mipmaps, true, "mipmaps", "Sample the textures with mipmaps, generated by the GPU (or the CPU if it cannot) when the images are loaded"))
+    , d_quantizeVertices(initData(&d_quantizeVertices, false, "quantizeVertices", "Upload 16-bit positions relative to the bounding box and octahedral normals instead of floats, read when the RHI resources are created (needs the CMake option SOFARHI_ENABLE_QUANTIZED_VERTICES, disables the GPU normals and the depth pre-pass of the model)"))
+    , d_meshCache(initData(&d_meshCache, std::string(), "meshCache", "File of the GPU-ready data of the model (float streams, triangulated and optimized indices, groups): memory-mapped and uploaded at init if the data of the model have not changed, written otherwise (empty to disable)"))
+    , d_castShadows(initData(&d_castShadows, true, "castShadows", "Draw the opaque groups of the model in the shadow maps of the lights, rendered again only when a caster has moved or changed (not with quantizeVertices)"))
 {
 }
 
 void RHIModel::init() 
 {
     InheritedVisual::init();
+
+    m_textureCoordsTracker.trackData(m_vtexcoords);
+    m_optimizeIndicesTracker.trackData(d_optimizeIndices);
+    m_shadowCasterTracker.trackData(m_positions);
+}
+
+void RHIModel::cleanup()
+{
+    if (m_drawTool)
+    {
+        m_drawTool->getVertexArena(m_bQuantizedVertices)->free(m_vertexAllocation);
+        m_drawTool->getIndexArena(m_indexFormat)->free(m_indexAllocation);
+        if (m_bCastingShadows)
+            m_drawTool->invalidateShadowMaps();
+    }
+
+    InheritedVisual::cleanup();
 }
 
 
@@ -396,32 +673,79 @@ void RHIModel::handleTopologyChange()
 
 }
 
-void RHIModel::updateVertexBuffer(QRhiResourceUpdateBatch* batch, bool updateAll)
+namespace
+{
+// allocate the range again if its size has changed or if its page has been compacted
+// return true if the data has to be uploaded again
+bool reallocate(RHIBufferArena* arena, RHIBufferArena::Allocation& allocation, quint32 count)
+{
+    if (arena->isValid(allocation) && allocation.count == count)
+        return false;
+
+    arena->free(allocation);
+    allocation = arena->allocate(count);
+    return true;
+}
+} // namespace
+
+void RHIModel::updateVertexBuffer(QRhiResourceUpdateBatch* batch)
 {
     const auto& vertices = this->getVertices();
     const auto& vnormals = this->getVnormals();
-    const auto& vtexcoords = this->getVtexcoords();
 
-    int positionsBufferSize = int(vertices.size() * sizeof(vertices[0]));
+    // float streams of the mesh cache, as long as the data have not changed since it was read
+    const RHIMeshCache::Content* cached = m_meshCache ? &m_meshCache->getContent() : nullptr;
+
+    // positions computed on the GPU are in their own buffer
+    int positionsBufferSize = m_bGpuPositions ? 0 : int(vertices.size() * sizeof(vertices[0]));
+    // vertices in the order of the optimized indices (never with GPU positions or normals)
+    const bool remapped = m_vertexRemap.size() == vertices.size();
     //TODO: Check finally if double or float has an impact on rendering
     //convert vertices to float if needed
     const void* ptrVertices = reinterpret_cast<const void*>(vertices.data());
     type::vector<sofa::type::Vec3f> fVertices;
-    if (std::is_same<DataTypes::Real, float>::value == false)
+    if (!m_bGpuPositions && cached && !m_meshCacheTracker.hasChanged(m_positions))
+    {
+        ptrVertices = reinterpret_cast<const void*>(cached->positions);
+        positionsBufferSize = int(cached->vertexNumber * sizeof(cached->positions[0]));
+    }
+    else if (!m_bGpuPositions && (remapped || std::is_same<DataTypes::Real, float>::value == false))
     {
-        for (const auto& v : vertices)
+        fVertices.resize(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); i++)
         {
-            fVertices.push_back(sofa::type::Vec3f(v[0], v[1], v[2]));
+            const auto& v = vertices[remapped ? m_vertexRemap[i] : i];
+            fVertices[i] = sofa::type::Vec3f(v[0], v[1], v[2]);
         }
         ptrVertices = reinterpret_cast<const void*>(fVertices.data());
         positionsBufferSize = int(vertices.size() * sizeof(fVertices[0]));
     }
 
-    int normalsBufferSize = int(vnormals.size() * sizeof(vnormals[0]));
+    // normals computed on the GPU are in their own buffer
+    int normalsBufferSize = m_bGpuNormals ? 0 : int(vnormals.size() * sizeof(vnormals[0]));
     //convert normals to float if needed
     const void* ptrNormals = reinterpret_cast<const void*>(vnormals.data());
     type::vector<sofa::type::Vec3f> fNormals;
-    if (std::is_same<DataTypes::Real, float>::value == false)
+    if (!m_bGpuNormals && cached && !m_meshCacheTracker.hasChanged(m_vnormals))
+    {
+        ptrNormals = reinterpret_cast<const void*>(cached->normals);
+        normalsBufferSize = int(cached->vertexNumber * sizeof(cached->normals[0]));
+    }
+    else if (!m_bGpuNormals && remapped)
+    {
+        fNormals.resize(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); i++)
+        {
+            if (m_vertexRemap[i] < vnormals.size())
+            {
+                const auto& n = vnormals[m_vertexRemap[i]];
+                fNormals[i] = sofa::type::Vec3f(n[0], n[1], n[2]);
+            }
+        }
+        ptrNormals = reinterpret_cast<const void*>(fNormals.data());
+        normalsBufferSize = int(fNormals.size() * sizeof(fNormals[0]));
+    }
+    else if (!m_bGpuNormals && std::is_same<DataTypes::Real, float>::value == false)
     {
         for (const auto& n : vnormals)
         {
@@ -431,60 +755,308 @@ void RHIModel::updateVertexBuffer(QRhiResourceUpdateBatch* batch, bool updateAll
         normalsBufferSize = int(vnormals.size() * sizeof(fNormals[0]));
     }
 
-    int textureCoordsBufferSize = int(vtexcoords.size() * sizeof(vtexcoords[0]));
+    // quantized streams (never with GPU positions or normals): encoded from the float data
+    std::vector<RHIVertexQuantization::Position> quantizedPositions;
+    std::vector<RHIVertexQuantization::Normal> quantizedNormals;
+    if (m_bQuantizedVertices)
+    {
+        const auto* fPositions = reinterpret_cast<const sofa::type::Vec3f*>(ptrVertices);
+        quantizedPositions.resize(positionsBufferSize / sizeof(sofa::type::Vec3f));
+        RHIVertexQuantization::computeDequantization(fPositions, quantizedPositions.size(), m_dequantizationOffset, m_dequantizationScale);
+        RHIVertexQuantization::quantizePositions(fPositions, quantizedPositions.size(), m_dequantizationOffset, m_dequantizationScale, quantizedPositions.data());
+        ptrVertices = reinterpret_cast<const void*>(quantizedPositions.data());
+        positionsBufferSize = int(quantizedPositions.size() * sizeof(quantizedPositions[0]));
+
+        quantizedNormals.resize(normalsBufferSize / sizeof(sofa::type::Vec3f));
+        RHIVertexQuantization::encodeNormals(reinterpret_cast<const sofa::type::Vec3f*>(ptrNormals), quantizedNormals.size(), quantizedNormals.data());
+        ptrNormals = reinterpret_cast<const void*>(quantizedNormals.data());
+        normalsBufferSize = int(quantizedNormals.size() * sizeof(quantizedNormals[0]));
+    }
+
+    // only the data changing at each step is in the dynamic streams of the shared buffers
+    // (do not write past the range of the model if there are more normals than vertices)
+    RHIBufferArena* arena = m_drawTool->getVertexArena(m_bQuantizedVertices);
+    positionsBufferSize = std::min(positionsBufferSize, int(m_vertexAllocation.count * (m_bQuantizedVertices ? sizeof(RHIVertexQuantization::Position) : sizeof(sofa::type::Vec3f))));
+    normalsBufferSize = std::min(normalsBufferSize, int(m_vertexAllocation.count * (m_bQuantizedVertices ? sizeof(RHIVertexQuantization::Normal) : sizeof(sofa::type::Vec3f))));
+
+    if (positionsBufferSize > 0)
+        batch->updateDynamicBuffer(arena->getBuffer(m_vertexAllocation, DrawToolRHI::POSITION_STREAM), int(arena->getByteOffset(m_vertexAllocation, DrawToolRHI::POSITION_STREAM)), positionsBufferSize, ptrVertices);
+    if (normalsBufferSize > 0)
+        batch->updateDynamicBuffer(arena->getBuffer(m_vertexAllocation, DrawToolRHI::NORMAL_STREAM), int(arena->getByteOffset(m_vertexAllocation, DrawToolRHI::NORMAL_STREAM)), normalsBufferSize, ptrNormals);
+    m_uploadedBytes += positionsBufferSize + normalsBufferSize;
+}
+
+void RHIModel::updateTextureCoordsBuffer(QRhiResourceUpdateBatch* batch)
+{
+    const auto& vertices = this->getVertices();
+    const auto& vtexcoords = this->getVtexcoords();
 
-    //2 cases: or we update everything on the GPU
-    // or the mesh just moves and just needs to update position-related data
-    if(updateAll || m_vertexPositionBuffer->size() == 0)
+    // the pipelines always read texture coordinates
+    const void* ptrTextureCoords = reinterpret_cast<const void*>(vtexcoords.data());
+    int textureCoordsBufferSize = int(vtexcoords.size() * sizeof(vtexcoords[0]));
+    VecTexCoord emptyTextureCoords;
+    if (m_meshCache && !m_meshCacheTracker.hasChanged(m_vtexcoords))
     {
-        m_vertexPositionBuffer->setSize(positionsBufferSize + normalsBufferSize + textureCoordsBufferSize);
-        batch->updateDynamicBuffer(m_vertexPositionBuffer, 0, positionsBufferSize, ptrVertices);
-        batch->updateDynamicBuffer(m_vertexPositionBuffer, positionsBufferSize, normalsBufferSize, ptrNormals);
-        batch->updateDynamicBuffer(m_vertexPositionBuffer, positionsBufferSize + normalsBufferSize, textureCoordsBufferSize, vtexcoords.data());
-        
-        if (!m_vertexPositionBuffer->build())
+        const auto& cached = m_meshCache->getContent();
+        ptrTextureCoords = reinterpret_cast<const void*>(cached.textureCoords);
+        textureCoordsBufferSize = int(cached.vertexNumber * sizeof(cached.textureCoords[0]));
+    }
+    else if (m_vertexRemap.size() == vertices.size())
+    {
+        // in the order of the optimized indices
+        emptyTextureCoords.resize(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); i++)
         {
-            msg_error() << "Problem while building vertex buffer";
+            if (m_vertexRemap[i] < vtexcoords.size())
+                emptyTextureCoords[i] = vtexcoords[m_vertexRemap[i]];
         }
+        ptrTextureCoords = reinterpret_cast<const void*>(emptyTextureCoords.data());
+        textureCoordsBufferSize = int(emptyTextureCoords.size() * sizeof(emptyTextureCoords[0]));
     }
-    else
+    else if (vtexcoords.size() < vertices.size())
     {
-        //assert that the size is good, etc
-        batch->updateDynamicBuffer(m_vertexPositionBuffer, 0, positionsBufferSize, ptrVertices);
-        batch->updateDynamicBuffer(m_vertexPositionBuffer, positionsBufferSize, normalsBufferSize, ptrNormals);
+        emptyTextureCoords.resize(vertices.size());
+        std::copy(vtexcoords.begin(), vtexcoords.end(), emptyTextureCoords.begin());
+        ptrTextureCoords = reinterpret_cast<const void*>(emptyTextureCoords.data());
+        textureCoordsBufferSize = int(emptyTextureCoords.size() * sizeof(emptyTextureCoords[0]));
     }
 
-    m_positionsBufferSize = positionsBufferSize;
-    m_normalsBufferSize = normalsBufferSize;
-    m_textureCoordsBufferSize = textureCoordsBufferSize;
+    RHIBufferArena* arena = m_drawTool->getVertexArena(m_bQuantizedVertices);
+    textureCoordsBufferSize = std::min(textureCoordsBufferSize, int(m_vertexAllocation.count * sizeof(vtexcoords[0])));
+    if (textureCoordsBufferSize > 0)
+        batch->uploadStaticBuffer(arena->getBuffer(m_vertexAllocation, DrawToolRHI::TEXCOORD_STREAM), int(arena->getByteOffset(m_vertexAllocation, DrawToolRHI::TEXCOORD_STREAM)), textureCoordsBufferSize, ptrTextureCoords);
+    m_uploadedBytes += textureCoordsBufferSize;
 }
 
 void RHIModel::updateIndexBuffer(QRhiResourceUpdateBatch* batch)
 {
     const auto& triangles = this->getTriangles();
     const auto& quads = this->getQuads();
-    //convert to triangles
+    //convert to triangles (already done in the optimized indices)
     VecVisualTriangle quadTriangles;
-    for (const auto& q : quads)
+    if (m_optimizedIndices.empty())
     {
-        quadTriangles.push_back({ q[0], q[1], q[2] });
-        quadTriangles.push_back({ q[2], q[3], q[0] });
+        for (const auto& q : quads)
+        {
+            quadTriangles.push_back({ q[0], q[1], q[2] });
+            quadTriangles.push_back({ q[2], q[3], q[0] });
+        }
     }
 
     int triangleSize = int(triangles.size() * sizeof(triangles[0]));
-    int quadTrianglesSize = int(quadTriangles.size() * sizeof(quadTriangles[0]));
-
-    m_indexTriangleBuffer->setSize(triangleSize + quadTrianglesSize);
-    batch->updateDynamicBuffer(m_indexTriangleBuffer, 0, triangleSize, triangles.data());
-    batch->updateDynamicBuffer(m_indexTriangleBuffer, triangleSize, quadTrianglesSize, quadTriangles.data());
+    int quadTrianglesSize = int(2 * quads.size() * sizeof(triangles[0]));
+
+    // static: only uploaded when the topology changes
+    // indices are relative to the first vertex of the model (vertex offset or binding offsets when drawing)
+    RHIBufferArena* arena = m_drawTool->getIndexArena(m_indexFormat);
+    QRhiBuffer* indexBuffer = arena->getBuffer(m_indexAllocation, 0);
+    const int offset = int(arena->getByteOffset(m_indexAllocation, 0));
+    if (m_indexFormat == QRhiCommandBuffer::IndexUInt16)
+    {
+        // converted when uploading: half the memory and bandwidth
+        std::vector<quint16> indices16;
+        indices16.reserve((triangles.size() + 2 * quads.size()) * 3);
+        if (!m_optimizedIndices.empty())
+        {
+            std::transform(m_optimizedIndices.begin(), m_optimizedIndices.end(), std::back_inserter(indices16), [](quint32 index) { return quint16(index); });
+        }
+        else
+        {
+            for (const auto* faces : { &triangles, &quadTriangles })
+            {
+                for (const auto& t : *faces)
+                    indices16.insert(indices16.end(), { quint16(t[0]), quint16(t[1]), quint16(t[2]) });
+            }
+        }
+        triangleSize /= 2;
+        quadTrianglesSize /= 2;
+        if (!indices16.empty())
+            batch->uploadStaticBuffer(indexBuffer, offset, int(indices16.size() * sizeof(quint16)), indices16.data());
+    }
+    else if (!m_optimizedIndices.empty())
+    {
+        batch->uploadStaticBuffer(indexBuffer, offset, triangleSize + quadTrianglesSize, m_optimizedIndices.data());
+    }
+    else
+    {
+        if (triangleSize > 0)
+            batch->uploadStaticBuffer(indexBuffer, offset, triangleSize, triangles.data());
+        if (quadTrianglesSize > 0)
+            batch->uploadStaticBuffer(indexBuffer, offset + triangleSize, quadTrianglesSize, quadTriangles.data());
+    }
 
     m_triangleNumber = int(triangles.size());
-    m_quadTriangleNumber = int(quadTriangles.size());
+    m_quadTriangleNumber = int(2 * quads.size());
+    m_uploadedBytes += triangleSize + quadTrianglesSize;
+}
+
+void RHIModel::updateIndexOptimization()
+{
+    if (m_bIndexOptimizationValid)
+        return;
+    m_bIndexOptimizationValid = true;
+    m_optimizedIndices.clear();
+    m_vertexRemap.clear();
+
+    // the mesh cache has the same indices (optimized or not), computed from the same data
+    if (m_meshCache)
+    {
+        const auto& cached = m_meshCache->getContent();
+        m_optimizedIndices.assign(cached.indices, cached.indices + cached.indexNumber);
+        if (cached.vertexRemap)
+            m_vertexRemap.assign(cached.vertexRemap, cached.vertexRemap + cached.vertexNumber);
+        return;
+    }
+
+    if (!d_optimizeIndices.getValue())
+        return;
+
+    SOFARHI_TRACE_SCOPE("RHIModel::updateIndexOptimization");
 
-    if (!m_indexTriangleBuffer->build())
+    const auto& vertices = this->getVertices();
+    const auto& triangles = this->getTriangles();
+    const auto& quads = this->getQuads();
+    const std::size_t vertexNumber = vertices.size();
+
+    // same layout as the index buffer: triangles, then the quads split in two triangles
+    m_optimizedIndices.reserve((triangles.size() + 2 * quads.size()) * 3);
+    for (const auto& t : triangles)
     {
-        msg_error() << "Problem while building index buffer";
+        m_optimizedIndices.insert(m_optimizedIndices.end(), { quint32(t[0]), quint32(t[1]), quint32(t[2]) });
     }
+    for (const auto& q : quads)
+    {
+        m_optimizedIndices.insert(m_optimizedIndices.end(), { quint32(q[0]), quint32(q[1]), quint32(q[2]), quint32(q[2]), quint32(q[3]), quint32(q[0]) });
+    }
+    if (std::any_of(m_optimizedIndices.begin(), m_optimizedIndices.end(), [vertexNumber](quint32 index) { return index >= vertexNumber; }))
+    {
+        msg_warning() << "Indices out of the vertices, they are not optimized.";
+        m_optimizedIndices.clear();
+        return;
+    }
+
+    const float acmrBefore = RHIMeshOptimizer::computeACMR(m_optimizedIndices.data(), m_optimizedIndices.size(), vertexNumber);
+
+    type::vector<sofa::type::Vec3f> positions(vertexNumber);
+    for (std::size_t i = 0; i < vertexNumber; i++)
+    {
+        positions[i] = sofa::type::Vec3f(float(vertices[i][0]), float(vertices[i][1]), float(vertices[i][2]));
+    }
+
+    // triangles are only moved inside the range of their group (the groups of the wireframe are the same)
+    std::vector<std::pair<sofa::Size, sofa::Size> > ranges;
+    for (const auto& renderGroup : m_renderGroups)
+    {
+        ranges.emplace_back(renderGroup->getFirstTriangle(), renderGroup->getTriangleNumber());
+    }
+    std::sort(ranges.begin(), ranges.end());
+    sofa::Size rangeEnd = 0;
+    for (const auto& range : ranges)
+    {
+        if (range.first < rangeEnd || (range.first + range.second) * 3 > m_optimizedIndices.size())
+            continue; // overlapping groups
+        rangeEnd = range.first + range.second;
+
+        quint32* groupIndices = m_optimizedIndices.data() + range.first * 3;
+        RHIMeshOptimizer::optimizeVertexCache(groupIndices, range.second * 3, vertexNumber);
+        RHIMeshOptimizer::optimizeOverdraw(groupIndices, range.second * 3, positions.data(), vertexNumber);
+    }
+
+    // the compute passes read and write the vertices in the order of the model
+    if (!m_bGpuNormals && !m_bGpuPositions)
+        m_vertexRemap = RHIMeshOptimizer::optimizeVertexFetch(m_optimizedIndices.data(), m_optimizedIndices.size(), vertexNumber);
+
+    const float acmrAfter = RHIMeshOptimizer::computeACMR(m_optimizedIndices.data(), m_optimizedIndices.size(), vertexNumber);
+    msg_info() << "Optimized indices: ACMR " << acmrBefore << " -> " << acmrAfter << " (" << m_optimizedIndices.size() / 3 << " triangles"
+        << (m_vertexRemap.empty() ? ", vertices not remapped)" : ")");
+}
+
+QByteArray RHIModel::computeMeshCacheHash() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    addToHash(hash, this->getVertices());
+    addToHash(hash, this->getVnormals());
+    addToHash(hash, this->getVtexcoords());
+    addToHash(hash, this->getTriangles());
+    addToHash(hash, this->getQuads());
+    for (const auto& group : this->groups.getValue())
+    {
+        addToHash(hash, std::array<int, 5>{ int(group.tri0), int(group.nbt), int(group.quad0), int(group.nbq), group.materialId });
+    }
+    // the renderings of the groups
+    for (const auto& material : this->materials.getValue())
+    {
+        addToHash(hash, std::array<int, 1>{ material.useTexture ? 1 : 0 });
+        addToHash(hash, material.textureFilename);
+    }
+    addToHash(hash, this->texturename.getValue());
+    // the order of the indices and of the vertices (see updateIndexOptimization())
+    addToHash(hash, std::array<int, 2>{ d_optimizeIndices.getValue() ? 1 : 0, (m_bGpuNormals || m_bGpuPositions) ? 1 : 0 });
+    return hash.result();
+}
+
+void RHIModel::writeMeshCache()
+{
+    SOFARHI_TRACE_SCOPE("RHIModel::writeMeshCache");
+
+    const auto& vertices = this->getVertices();
+    const auto& vnormals = this->getVnormals();
+    const auto& vtexcoords = this->getVtexcoords();
+    const auto& triangles = this->getTriangles();
+    const auto& quads = this->getQuads();
+    const std::size_t vertexNumber = vertices.size();
+    const bool remapped = m_vertexRemap.size() == vertexNumber;
+
+    // the streams as uploaded without the cache, in floats (quantized at the upload if needed)
+    type::vector<sofa::type::Vec3f> positions(vertexNumber);
+    type::vector<sofa::type::Vec3f> normals(vertexNumber);
+    VecTexCoord textureCoords(vertexNumber);
+    for (std::size_t i = 0; i < vertexNumber; i++)
+    {
+        const std::size_t vertex = remapped ? m_vertexRemap[i] : i;
+        positions[i] = sofa::type::Vec3f(float(vertices[vertex][0]), float(vertices[vertex][1]), float(vertices[vertex][2]));
+        if (vertex < vnormals.size())
+            normals[i] = sofa::type::Vec3f(float(vnormals[vertex][0]), float(vnormals[vertex][1]), float(vnormals[vertex][2]));
+        if (vertex < vtexcoords.size())
+            textureCoords[i] = vtexcoords[vertex];
+    }
+
+    std::vector<quint32> indices = m_optimizedIndices;
+    if (indices.empty())
+    {
+        indices.reserve((triangles.size() + 2 * quads.size()) * 3);
+        for (const auto& t : triangles)
+        {
+            indices.insert(indices.end(), { quint32(t[0]), quint32(t[1]), quint32(t[2]) });
+        }
+        for (const auto& q : quads)
+        {
+            indices.insert(indices.end(), { quint32(q[0]), quint32(q[1]), quint32(q[2]), quint32(q[2]), quint32(q[3]), quint32(q[0]) });
+        }
+    }
+
+    std::vector<RHIMeshCache::Group> groups;
+    for (const auto& renderGroup : m_renderGroups)
+    {
+        const bool textured = std::dynamic_pointer_cast<RHIDiffuseTexturedPhongRendering>(renderGroup) != nullptr;
+        groups.push_back({ quint32(renderGroup->getFirstTriangle()), quint32(renderGroup->getTriangleNumber()), qint32(renderGroup->getMaterialID()), textured ? 1u : 0u });
+    }
+
+    RHIMeshCache::Content content;
+    content.vertexNumber = quint32(vertexNumber);
+    content.positions = positions.data();
+    content.normals = normals.data();
+    content.textureCoords = textureCoords.data();
+    content.vertexRemap = remapped ? m_vertexRemap.data() : nullptr;
+    content.indexNumber = quint32(indices.size());
+    content.indices = indices.data();
+    content.triangleNumber = quint32(triangles.size());
+    content.groupNumber = quint32(groups.size());
+    content.groups = groups.data();
+    if (RHIMeshCache::write(d_meshCache.getValue(), m_meshCacheHash, content))
+        msg_info() << "Mesh cache written in " << d_meshCache.getValue();
+    else
+        msg_warning() << "Problem while writing the mesh cache " << d_meshCache.getValue();
 }
 
 void RHIModel::updateCameraUniformBuffer(QRhiResourceUpdateBatch* batch)
@@ -507,8 +1079,17 @@ void RHIModel::updateCameraUniformBuffer(QRhiResourceUpdateBatch* batch)
 
     const type::Vec3f cameraPosition{ inverseModelViewMatrix.data()[3], inverseModelViewMatrix.data()[7], inverseModelViewMatrix.data()[11] }; // or 12 13 14 if transposed
     const QMatrix4x4 mvpMatrix = m_correctionMatrix.transposed() * qProjectionMatrix.transposed() * qModelViewMatrix.transposed();
-    batch->updateDynamicBuffer(m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE, mvpMatrix.constData());
-    batch->updateDynamicBuffer(m_cameraUniformBuffer, utils::MATRIX4_SIZE, utils::VEC3_SIZE, cameraPosition.data());
+    // the shaders without quantization only declare the beginning of the block
+    QuantizedCameraUniform camera;
+    camera.setData<QuantizedCameraUniform::MVP_MATRIX>(mvpMatrix.constData());
+    camera.setData<QuantizedCameraUniform::CAMERA_POSITION>(cameraPosition.data());
+    if (m_bQuantizedVertices)
+    {
+        camera.set<QuantizedCameraUniform::DEQUANTIZATION_OFFSET>(std::array<float, 4>{ m_dequantizationOffset[0], m_dequantizationOffset[1], m_dequantizationOffset[2], 0.0f });
+        camera.set<QuantizedCameraUniform::DEQUANTIZATION_SCALE>(std::array<float, 4>{ m_dequantizationScale[0], m_dequantizationScale[1], m_dequantizationScale[2], 0.0f });
+    }
+    camera.update(batch, m_cameraUniformBuffer);
+    m_uploadedBytes += QuantizedCameraUniform::paddedSize;
 
     if (!m_cameraUniformBuffer->build())
     {
@@ -517,6 +1098,85 @@ void RHIModel::updateCameraUniformBuffer(QRhiResourceUpdateBatch* batch)
 
 }
 
+bool RHIModel::initDepthPrepass()
+{
+    if (m_bHasInitDepthPrepass)
+        return m_depthPrepassPipeline != nullptr;
+    m_bHasInitDepthPrepass = true;
+
+    QRhiPtr rhi = m_drawTool->getRHI();
+
+    // the matrix is the first member of the camera uniform buffer
+    m_depthPrepassSrb = rhi->newShaderResourceBindings();
+    m_depthPrepassSrb->setBindings({
+        QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::VertexStage, m_cameraUniformBuffer, 0, MatrixUniform::paddedSize)
+    });
+    if (!m_depthPrepassSrb->build())
+    {
+        msg_error("RHIModel") << "Problem while building depth pre-pass srb";
+        return false;
+    }
+
+    // the pipeline is shared by all the models
+    m_depthPrepassPipeline = m_drawTool->getSharedPipeline("RHIDepthPrepass");
+    if (m_depthPrepassPipeline)
+        return true;
+
+    const QShader vs = RHIShaderVariants::load("simple_matrix.vert", RHIShaderVariants::NONE);
+    const QShader fs = RHIShaderVariants::load("simple.frag", RHIShaderVariants::NONE);
+    if (!vs.isValid() || !fs.isValid())
+    {
+        msg_error("RHIModel") << "Problem while loading depth pre-pass shaders";
+        return false;
+    }
+    layout::matchesShader<MatrixUniform>(vs, 0, "simple_matrix.vert");
+
+    QRhiGraphicsPipeline* pipeline = rhi->newGraphicsPipeline();
+    pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+    QRhiVertexInputLayout inputLayout;
+    inputLayout.setBindings({ { 3 * sizeof(float) } }); // position stream only
+    inputLayout.setAttributes({ { 0, 0, QRhiVertexInputAttribute::Float3, 0 } });
+    pipeline->setVertexInputLayout(inputLayout);
+    pipeline->setShaderResourceBindings(m_depthPrepassSrb);
+    pipeline->setRenderPassDescriptor(m_drawTool->getRenderPassDescriptor().get());
+    pipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
+    pipeline->setDepthTest(true);
+    pipeline->setDepthWrite(true);
+    pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
+    QRhiGraphicsPipeline::TargetBlend noColor;
+    noColor.colorWrite = QRhiGraphicsPipeline::ColorMask();
+    pipeline->setTargetBlends({ noColor });
+    if (!pipeline->build())
+    {
+        msg_error("RHIModel") << "Problem while building depth pre-pass pipeline";
+        delete pipeline;
+        return false;
+    }
+
+    m_depthPrepassPipeline = pipeline;
+    m_drawTool->addSharedPipeline("RHIDepthPrepass", m_depthPrepassPipeline);
+    return true;
+}
+
+void RHIModel::initPipelineVariants(bool depthPrepass)
+{
+    // pipelines of the weighted blended transparency, once it is enabled
+    if (QRhiRenderPassDescriptor* transparencyRpDesc = m_drawTool->getTransparencyRenderPassDescriptor())
+    {
+        for (auto& renderGroup : m_renderGroups)
+            renderGroup->initTransparencyPipelines(m_drawTool->getRHI(), transparencyRpDesc, m_drawTool);
+        for (auto& wireframeGroup : m_wireframeGroups)
+            wireframeGroup->initTransparencyPipelines(m_drawTool->getRHI(), transparencyRpDesc, m_drawTool);
+    }
+
+    // and of the depth pre-pass (not for the wireframe, nor for the quantized positions)
+    if (depthPrepass && !m_bQuantizedVertices && initDepthPrepass())
+    {
+        for (auto& renderGroup : m_renderGroups)
+            renderGroup->initDepthPrepassPipeline(m_drawTool->getRHI(), m_drawTool);
+    }
+}
+
 bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc)
 {
     // I suppose it would be better to get the visualParams given as params but it is only in update/draw steps
@@ -527,6 +1187,7 @@ bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpD
         msg_error("RHIModel") << "Can only works with RHIViewer as gui; DrawToolRHI not detected.";
         return false;
     }
+    m_drawTool = rhiDrawTool;
 
     //if (!initRHIResources(rhi, rpDesc))
     //{
@@ -539,57 +1200,95 @@ bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpD
     const VecTexCoord& vtexcoords = this->getVtexcoords();
 
     // Create Buffers
-    m_vertexPositionBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, 0); // set size later (when we know it)
-    m_indexTriangleBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::IndexBuffer, 0); // set size later (when we know it)
-    m_cameraUniformBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, utils::MATRIX4_SIZE + utils::VEC3_SIZE);
+    // vertices and indices are allocated in the buffers of the draw tool (when we know their size)
+    m_bBaseVertex = rhi->isFeatureSupported(QRhi::BaseVertex);
+    m_cameraUniformBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, QuantizedCameraUniform::paddedSize);
     
     std::vector<QRhiShaderResourceBinding> globalBindings;
     const QRhiShaderResourceBinding::StageFlags commonVisibility = QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage;
     globalBindings.push_back({
-                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, utils::MATRIX4_SIZE + utils::VEC3_SIZE)
+                         QRhiShaderResourceBinding::uniformBuffer(0, commonVisibility, m_cameraUniformBuffer, 0, QuantizedCameraUniform::paddedSize)
         }
     );
 
+    // the vertex format is fixed with the pipelines
+    m_bQuantizedVertices = d_quantizeVertices.getValue();
+    if (m_bQuantizedVertices && !RHIShaderVariants::load("phong.vert", RHIShaderVariants::QUANTIZED).isValid())
+    {
+        msg_warning() << "Quantized vertex shader not found (compiled with SOFARHI_ENABLE_QUANTIZED_VERTICES?), vertices are uploaded as floats.";
+        m_bQuantizedVertices = false;
+    }
+
+    // shaded with the lights of the scene if it has some, by a light at the camera otherwise
+    std::vector<RHILight*> lights;
+    this->getContext()->getRootContext()->get<RHILight>(&lights, sofa::core::objectmodel::BaseContext::SearchDown);
+    bool useLights = !lights.empty();
+    if (useLights && !RHIShaderVariants::load("phong.frag", RHIShaderVariants::LIGHTS).isValid())
+    {
+        msg_warning() << "Lights shader not found, the model is lit from the camera.";
+        useLights = false;
+    }
+    // shadows of the lights casting them (the shadow maps are created by the first model receiving them)
+    const bool shadowLights = std::any_of(lights.begin(), lights.end(), [](const RHILight* light) { return light->d_shadowsEnabled.getValue(); });
+    bool useShadows = useLights && shadowLights && rhiDrawTool->initShadowMaps() != nullptr;
+    if (useShadows && !RHIShaderVariants::load("phong.frag", RHIShaderVariants::LIGHTS | RHIShaderVariants::SHADOWS).isValid())
+    {
+        msg_warning() << "Shadows shader not found (compiled with SOFARHI_ENABLE_SHADOWS?), the model receives no shadows.";
+        useShadows = false;
+    }
+
+    // GPU-ready data of a previous run (the hash covers the data of the model and the options changing the uploads)
+    if (!d_meshCache.getValue().empty())
+    {
+        m_meshCacheHash = computeMeshCacheHash();
+        m_meshCache = std::make_unique<RHIMeshCache>(d_meshCache.getValue(), m_meshCacheHash);
+        if (m_meshCache->isValid())
+        {
+            m_meshCacheTracker.trackData(m_positions);
+            m_meshCacheTracker.trackData(m_vnormals);
+            m_meshCacheTracker.trackData(m_vtexcoords);
+            msg_info() << "Mesh cache read from " << d_meshCache.getValue();
+        }
+        else
+        {
+            m_meshCache.reset();
+            m_bWriteMeshCache = true;
+        }
+    }
+
     // Create groups and their respective renderings
+    const auto addGroup = [this](const RHIGroup& rhiGroup, bool isTextured)
+    {
+        if (isTextured)
+            m_renderGroups.emplace_back(std::make_shared<RHIDiffuseTexturedPhongRendering>(rhiGroup, d_mipmaps.getValue()));
+        else
+            m_renderGroups.emplace_back(std::make_shared<RHIPhongRendering>(rhiGroup));
+
+        m_wireframeGroups.emplace_back(std::make_shared<RHIWireframeRendering>(rhiGroup));
+    };
     const auto& groups = this->groups.getValue();
     const auto& triangles = this->getTriangles();
     const auto& quads = this->getQuads();
 
     //Split group with different primitives (into other groups)
-    if (groups.size() == 0)
+    if (m_meshCache)
+    {
+        const auto& cached = m_meshCache->getContent();
+        for (quint32 i = 0; i < cached.groupNumber; i++)
+        {
+            const RHIMeshCache::Group& group = cached.groups[i];
+            addGroup(RHIGroup(group.firstTriangle, group.triangleNumber, group.materialID), group.textured != 0);
+        }
+    }
+    else if (groups.size() == 0)
     {
         FaceGroup defaultGroup;
         bool isTextured = this->texturename.isSet() || !this->texturename.getValue().empty();
 
         if (triangles.size() > 0)
-        {
-            utils::BufferInfo bufferInfo;
-            bufferInfo.buffer = m_indexTriangleBuffer;
-            bufferInfo.offset = 0;
-            bufferInfo.size = sofa::Size(triangles.size());
-
-            if(isTextured)
-                m_renderGroups.emplace_back(std::make_shared<RHIDiffuseTexturedPhongRendering>(RHIGroup(bufferInfo, defaultGroup.materialId)));
-            else
-                m_renderGroups.emplace_back(std::make_shared<RHIPhongRendering>(RHIGroup(bufferInfo, defaultGroup.materialId)));
-
-            m_wireframeGroups.emplace_back(std::make_shared<RHIWireframeRendering>(RHIGroup(bufferInfo, defaultGroup.materialId)));
-
-        }
+            addGroup(RHIGroup(0, sofa::Size(triangles.size()), defaultGroup.materialId), isTextured);
         if (quads.size() > 0)
-        {
-            utils::BufferInfo bufferInfo;
-            bufferInfo.buffer = m_indexTriangleBuffer;
-            bufferInfo.offset = sofa::Size(triangles.size() * sizeof(triangles[0]));
-            bufferInfo.size = sofa::Size(quads.size() * 2); //2 triangles for each quad
-
-            if (isTextured)
-                m_renderGroups.emplace_back(std::make_shared<RHIDiffuseTexturedPhongRendering>(RHIGroup(bufferInfo, defaultGroup.materialId)));
-            else
-                m_renderGroups.emplace_back(std::make_shared<RHIPhongRendering>(RHIGroup(bufferInfo, defaultGroup.materialId)));
-
-            m_wireframeGroups.emplace_back(std::make_shared<RHIWireframeRendering>(RHIGroup(bufferInfo, defaultGroup.materialId)));
-        }
+            addGroup(RHIGroup(sofa::Size(triangles.size()), sofa::Size(quads.size() * 2), defaultGroup.materialId), isTextured); //2 triangles for each quad
     }
     else
     {
@@ -600,33 +1299,9 @@ bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpD
             bool isTextured = loaderMaterial.useTexture && !loaderMaterial.textureFilename.empty();
 
             if (group.nbt > 0)
-            {
-                utils::BufferInfo bufferInfo;
-                bufferInfo.buffer = m_indexTriangleBuffer;
-                bufferInfo.offset = group.tri0 * sizeof(triangles[0]);
-                bufferInfo.size = group.nbt;
-
-                if (isTextured)
-                    m_renderGroups.emplace_back(std::make_shared<RHIDiffuseTexturedPhongRendering>(RHIGroup(bufferInfo, group.materialId)));
-                else
-                    m_renderGroups.emplace_back(std::make_shared<RHIPhongRendering>(RHIGroup(bufferInfo, group.materialId)));
-
-                m_wireframeGroups.emplace_back(std::make_shared<RHIWireframeRendering>(RHIGroup(bufferInfo, group.materialId)));
-            }
+                addGroup(RHIGroup(group.tri0, group.nbt, group.materialId), isTextured);
             if (group.nbq > 0)
-            {
-                utils::BufferInfo bufferInfo;
-                bufferInfo.buffer = m_indexTriangleBuffer;
-                bufferInfo.offset = int(triangles.size() * sizeof(triangles[0])) +  (2*group.quad0) * sizeof(triangles[0]); //2 triangles for each quad
-                bufferInfo.size = group.nbq * 2;
-
-                if (isTextured)
-                    m_renderGroups.emplace_back(std::make_shared<RHIDiffuseTexturedPhongRendering>(RHIGroup(bufferInfo, group.materialId)));
-                else
-                    m_renderGroups.emplace_back(std::make_shared<RHIPhongRendering>(RHIGroup(bufferInfo, group.materialId)));
-
-                m_wireframeGroups.emplace_back(std::make_shared<RHIWireframeRendering>(RHIGroup(bufferInfo, group.materialId)));
-            }
+                addGroup(RHIGroup(sofa::Size(triangles.size()) + 2 * group.quad0, group.nbq * 2, group.materialId), isTextured); //2 triangles for each quad
         }
     }
 
@@ -640,7 +1315,10 @@ bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpD
             loaderMaterial = materials[materialID];
         }
 
-        renderGroup->initRHIResources(rhi, rpDesc, globalBindings, loaderMaterial);
+        renderGroup->setQuantizedVertices(m_bQuantizedVertices);
+        renderGroup->setLights(useLights);
+        renderGroup->setShadows(useShadows);
+        renderGroup->initRHIResources(rhi, rpDesc, m_drawTool, globalBindings, loaderMaterial);
     }
 
     for(auto & wireframeGroup : m_wireframeGroups)
@@ -652,7 +1330,10 @@ bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpD
             const auto& materials = this->materials.getValue();
             loaderMaterial = materials[materialID];
         }
-        wireframeGroup->initRHIResources(rhi, rpDesc, globalBindings, loaderMaterial);
+        wireframeGroup->setQuantizedVertices(m_bQuantizedVertices);
+        wireframeGroup->setLights(useLights);
+        wireframeGroup->setShadows(useShadows);
+        wireframeGroup->initRHIResources(rhi, rpDesc, m_drawTool, globalBindings, loaderMaterial);
     }
 
     // SOFA gives a projection matrix for OpenGL system
@@ -667,9 +1348,18 @@ bool RHIModel::initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpD
     return true;
 }
 
+void RHIModel::warmUpGraphicResources()
+{
+    if (m_drawTool == nullptr)
+        return;
+
+    // the depth pre-pass can be enabled at runtime
+    initPipelineVariants(true);
+}
+
 void RHIModel::updateGraphicResources(QRhiResourceUpdateBatch* batch)
 {
-    if (m_vertexPositionBuffer == nullptr)
+    if (m_drawTool == nullptr)
     {
         return;
     }
@@ -677,20 +1367,64 @@ void RHIModel::updateGraphicResources(QRhiResourceUpdateBatch* batch)
     if (batch == nullptr)
         return;
 
-    //will be updated all the time (camera, light and no step)
-    updateCameraUniformBuffer(batch);
+    utils::TraceScope traceScope("RHIModel::updateGraphicResources");
+    traceScope.setLabel(this->getName());
+    m_uploadedBytes = 0;
 
-    //Update Buffers (on demand)
-    if(m_needUpdatePositions) // true when a new step is done
+    // the order of the indices and of the vertices changes with the topology
+    const bool optimizationChanged = m_optimizeIndicesTracker.hasChanged(d_optimizeIndices);
+    if (m_needUpdateTopology || optimizationChanged)
     {
-        updateVertexBuffer(batch, m_needUpdateTopology); // update all if topology changes
-        m_needUpdatePositions = false;
+        m_bIndexOptimizationValid = false;
+        updateIndexOptimization();
     }
-    if (m_needUpdateTopology) // true when the topology has changed
+
+    //Update Buffers (on demand)
+    bool updateVertices = m_needUpdatePositions || m_needUpdateTopology || optimizationChanged; // true when a new step is done
+    bool updateTextureCoords = m_needUpdateTopology || optimizationChanged || m_textureCoordsTracker.hasChanged(m_vtexcoords); // rarely changed alone
+    bool updateIndices = m_needUpdateTopology || optimizationChanged; // true when the topology has changed
+
+    // a new range (size change or compacted page) has to be filled entirely
+    const quint32 indexNumber = quint32(this->getTriangles().size() + 2 * this->getQuads().size()) * 3;
+    if (reallocate(m_drawTool->getVertexArena(m_bQuantizedVertices), m_vertexAllocation, quint32(this->getVertices().size())))
+        updateVertices = updateTextureCoords = true;
+    const auto indexFormat = DrawToolRHI::getIndexFormat(this->getVertices().size());
+    if (indexFormat != m_indexFormat)
     {
+        m_drawTool->getIndexArena(m_indexFormat)->free(m_indexAllocation);
+        m_indexFormat = indexFormat;
+    }
+    if (reallocate(m_drawTool->getIndexArena(m_indexFormat), m_indexAllocation, indexNumber))
+        updateIndices = true;
+
+    if (updateVertices && !m_vertexAllocation.isNull())
+        updateVertexBuffer(batch);
+    if (updateTextureCoords && !m_vertexAllocation.isNull())
+        updateTextureCoordsBuffer(batch);
+    if (updateIndices && !m_indexAllocation.isNull())
         updateIndexBuffer(batch);
-        m_needUpdateTopology = false;
+    updateShadowCasting(updateIndices, m_needUpdatePositions);
+    m_needUpdatePositions = false;
+    m_needUpdateTopology = false;
+    m_textureCoordsTracker.clean();
+    m_optimizeIndicesTracker.clean();
+
+    // the mesh cache is only for the first upload
+    if (m_meshCache)
+    {
+        m_meshCache.reset();
     }
+    else if (m_bWriteMeshCache)
+    {
+        writeMeshCache();
+        m_bWriteMeshCache = false;
+    }
+
+    //will be updated all the time (camera, light and no step), after the positions for their dequantization
+    updateCameraUniformBuffer(batch);
+
+    // unless they have been built by the warm-up
+    initPipelineVariants(m_drawTool->hasDepthPrepass());
 
     if (m_needUpdateMaterial)
     {
@@ -718,168 +1452,424 @@ void RHIModel::updateGraphicResources(QRhiResourceUpdateBatch* batch)
             }
             wireframeGroup->updateRHIResources(batch, loaderMaterial);
         }
+        m_uploadedBytes += sofa::Size(m_renderGroups.size() + m_wireframeGroups.size()) * MaterialUniform::paddedSize;
 
         m_needUpdateMaterial = false;
     }
+
+    traceScope.addArg("bytesUploaded", m_uploadedBytes);
+    if (m_drawTool)
+        m_drawTool->getFrameStatistics().modelUploadedBytes += m_uploadedBytes;
 }
 
-void RHIModel::updateGraphicCommands(QRhiCommandBuffer* cb, const QRhiViewport& viewport)
+void RHIModel::updateShadowCasting(bool topologyChanged, bool newStep)
 {
-    auto vparams = sofa::core::visual::VisualParams::defaultInstance();
+    const RHIShadowMaps* shadowMaps = m_drawTool->getShadowMaps();
+    const bool castingShadows = shadowMaps != nullptr && d_castShadows.getValue() && !m_bQuantizedVertices
+        && d_componentState.getValue() == sofa::core::objectmodel::ComponentState::Valid
+        && sofa::core::visual::VisualParams::defaultInstance()->displayFlags().getShowVisual();
 
-    if (d_componentState.getValue() != sofa::core::objectmodel::ComponentState::Valid)
+    bool invalidate = castingShadows != m_bCastingShadows;
+    if (castingShadows && !invalidate)
     {
-        return;
+        if (m_bGpuPositions)
+        {
+            // written by the compute pass, at each step
+            invalidate = topologyChanged || newStep;
+        }
+        else if (topologyChanged || m_shadowCasterTracker.hasChanged(m_positions))
+        {
+            // the positions are often written at each step, even if they have not moved
+            const VecCoord& vertices = this->getVertices();
+            invalidate = topologyChanged || vertices.size() != m_shadowCasterPositions.size()
+                || !std::equal(vertices.begin(), vertices.end(), m_shadowCasterPositions.begin());
+        }
     }
-    if (!vparams->displayFlags().getShowVisual())
+    m_shadowCasterTracker.clean();
+
+    if (invalidate)
     {
-        return;
+        m_drawTool->invalidateShadowMaps();
+        if (castingShadows && !m_bGpuPositions)
+            m_shadowCasterPositions = this->getVertices();
     }
-    if (m_vertexPositionBuffer == nullptr)
+    if (!castingShadows)
+        m_shadowCasterPositions.clear();
+    m_bCastingShadows = castingShadows;
+}
+
+void RHIModel::updateGraphicCommands(QRhiCommandBuffer* /*cb*/, const QRhiViewport& viewport)
+{
+    auto vparams = sofa::core::visual::VisualParams::defaultInstance();
+
+    if (d_componentState.getValue() != sofa::core::objectmodel::ComponentState::Valid
+        || !vparams->displayFlags().getShowVisual()
+        || m_drawTool == nullptr
+        || !m_drawTool->getVertexArena(m_bQuantizedVertices)->isValid(m_vertexAllocation)
+        || !m_drawTool->getIndexArena(m_indexFormat)->isValid(m_indexAllocation))
     {
+        if (m_drawTool)
+            m_drawTool->getFrameStatistics().culledModels++;
         return;
     }
 
+    utils::TraceScope traceScope("RHIModel::updateGraphicCommands");
+    traceScope.setLabel(this->getName());
+
+    // with the base vertex feature, the models of a page share the same bindings (only the draw calls differ)
+    // otherwise, or if a stream comes from the compute buffers (starting at the first vertex of the model), the bindings are offset
+    const RHIBufferArena* vertexArena = m_drawTool->getVertexArena(m_bQuantizedVertices);
+    const bool baseVertex = m_bBaseVertex && !m_bGpuPositions && !m_bGpuNormals;
+    const auto arenaInput = [&](std::size_t stream)
+    {
+        return QRhiCommandBuffer::VertexInput{ vertexArena->getBuffer(m_vertexAllocation, stream), baseVertex ? quint32(0) : vertexArena->getByteOffset(m_vertexAllocation, stream) };
+    };
     const QRhiCommandBuffer::VertexInput vbindings[] = {
-        { m_vertexPositionBuffer, quint32(0) },
-        { m_vertexPositionBuffer, quint32(m_positionsBufferSize) },
-        { m_vertexPositionBuffer, quint32(m_positionsBufferSize + m_normalsBufferSize) }
+        m_bGpuPositions ? QRhiCommandBuffer::VertexInput{ m_computePositionBuffer, quint32(0) } : arenaInput(DrawToolRHI::POSITION_STREAM),
+        m_bGpuNormals ? QRhiCommandBuffer::VertexInput{ m_computeNormalBuffer, quint32(0) } : arenaInput(DrawToolRHI::NORMAL_STREAM),
+        arenaInput(DrawToolRHI::TEXCOORD_STREAM)
     };
 
+    RHIDrawInput drawInput;
+    drawInput.vertexBindings = vbindings;
+    drawInput.indexBuffer = m_drawTool->getIndexArena(m_indexFormat)->getBuffer(m_indexAllocation, 0);
+    drawInput.indexFormat = m_indexFormat;
+    drawInput.firstIndex = m_indexAllocation.first;
+    drawInput.vertexOffset = baseVertex ? qint32(m_vertexAllocation.first) : 0;
+
+    // distance from the camera to the center of the bounding box, to sort the draws
+    float depth = 0.0f;
+    const auto& bbox = this->f_bbox.getValue();
+    if (bbox.isValid())
+    {
+        double modelviewMatrix[16];
+        vparams->getModelViewMatrix(modelviewMatrix);
+        const auto center = (bbox.minBBox() + bbox.maxBBox()) * 0.5;
+        depth = float(-(modelviewMatrix[2] * center[0] + modelviewMatrix[6] * center[1] + modelviewMatrix[10] * center[2] + modelviewMatrix[14]));
+    }
+
+    // recorded by the draw queue of the draw tool (statistics included), submitted after all the models
+    RHIDrawQueue& drawQueue = m_drawTool->getDrawQueue();
+    RHIDrawPasses passes;
+    passes.transparency = m_drawTool->getTransparencyRenderPassDescriptor() != nullptr;
+    int drawCount = 0;
     if (vparams->displayFlags().getShowWireFrame())
     {
         for (auto& wireGroup : m_wireframeGroups)
         {
-            wireGroup->updateRHICommands(cb, viewport, vbindings);
+            wireGroup->addDrawPacket(drawQueue, viewport, drawInput, depth, passes);
         }
+        drawCount = int(m_wireframeGroups.size());
     }
     else
     {
+        if (m_drawTool->hasDepthPrepass() && !m_bQuantizedVertices)
+        {
+            passes.depthPrepassPipeline = m_depthPrepassPipeline;
+            passes.depthPrepassSrb = m_depthPrepassSrb;
+        }
         for (auto& renderGroup : m_renderGroups)
         {
-            renderGroup->updateRHICommands(cb, viewport, vbindings);
+            renderGroup->addDrawPacket(drawQueue, viewport, drawInput, depth, passes);
         }
+        drawCount = int(m_renderGroups.size());
     }
 
+    // only when the shadow maps are rendered again in this frame
+    const RHIShadowMaps* shadowMaps = m_drawTool->getShadowMaps();
+    if (m_bCastingShadows && shadowMaps != nullptr && shadowMaps->needsUpdate())
+    {
+        for (auto& renderGroup : m_renderGroups)
+        {
+            for (int map = 0; map < shadowMaps->getMapCount(); map++)
+                renderGroup->addShadowPacket(drawQueue, drawInput, *shadowMaps, map);
+        }
+    }
+
+    traceScope.addArg("drawCount", drawCount);
 }
 
-void RHIModel::updateStorageBuffer(QRhiResourceUpdateBatch* batch)
+namespace
 {
-    const auto& vertices = this->getVertices();
-    const auto& triangles = this->getTriangles();
+// local_size_x of the compute shaders
+constexpr quint32 COMPUTE_LOCAL_GROUP_SIZE = 256;
 
-    std::vector<sofa::type::Vec3f> verticesFromTriangles;
-    verticesFromTriangles.reserve(triangles.size() * 3);
-    for (const auto& t : triangles)
+// storage buffers cannot be empty, and are rebuilt when their size changes
+void resizeComputeBuffer(QRhiBuffer* buffer, int size)
+{
+    size = std::max(size, 4);
+    if (buffer->size() != size)
     {
-        for (int i = 0; i < 3; i++)
+        buffer->setSize(size);
+        if (!buffer->build())
         {
-            verticesFromTriangles.push_back({ float(vertices[t[i]][0]), float(vertices[t[i]][1]), float(vertices[t[i]][2]) });
+            msg_error("RHIModel") << "Problem while building compute buffer";
         }
     }
-    const int verticesFromTrianglesSize = int(verticesFromTriangles.size()) * 3 * sizeof(float);
-    const int normalsSize = int(vertices.size()) * 3 * sizeof(float);
+}
+} // namespace
+
+sofa::Size RHIModel::updateComputeTopologyBuffers(QRhiResourceUpdateBatch* batch)
+{
+    const auto& vertices = this->getVertices();
+    const auto& triangles = this->getTriangles();
+    const auto& quads = this->getQuads();
 
-    if (m_storageBuffer->size() == 0)
+    // same triangles as the index buffer (quads split in two)
+    std::vector<quint32> indices;
+    indices.reserve((triangles.size() + quads.size() * 2) * 3);
+    for (const auto& t : triangles)
     {
-        m_storageBuffer->setSize(verticesFromTrianglesSize);
-        batch->uploadStaticBuffer(m_storageBuffer, 0, verticesFromTrianglesSize, verticesFromTriangles.data());
+        indices.insert(indices.end(), { quint32(t[0]), quint32(t[1]), quint32(t[2]) });
+    }
+    for (const auto& q : quads)
+    {
+        indices.insert(indices.end(), { quint32(q[0]), quint32(q[1]), quint32(q[2]) });
+        indices.insert(indices.end(), { quint32(q[2]), quint32(q[3]), quint32(q[0]) });
+    }
 
-        if (!m_storageBuffer->build())
-        {
-            msg_error() << "Problem while building storage buffer";
-        }
+    m_computeVertexNumber = quint32(vertices.size());
+    m_computeTriangleNumber = quint32(indices.size() / 3);
+
+    // CSR adjacency vertex -> triangles
+    std::vector<quint32> adjacencyOffsets(m_computeVertexNumber + 1, 0);
+    for (const auto index : indices)
+    {
+        if (index < m_computeVertexNumber)
+            adjacencyOffsets[index + 1]++;
     }
-    else
+    for (std::size_t i = 1; i < adjacencyOffsets.size(); i++)
+    {
+        adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+    }
+    std::vector<quint32> adjacency(adjacencyOffsets.back());
+    std::vector<quint32> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); i++)
     {
-        //assert that the size is good, etc
-        batch->uploadStaticBuffer(m_storageBuffer, 0, verticesFromTrianglesSize, verticesFromTriangles.data());
+        if (indices[i] < m_computeVertexNumber)
+            adjacency[cursors[indices[i]]++] = quint32(i / 3);
     }
 
-    //set size for the resulting normals
-    if(m_computeNormalBuffer->size() == 0)
+    const int indicesSize = int(indices.size() * sizeof(quint32));
+    const int adjacencyOffsetsSize = int(adjacencyOffsets.size() * sizeof(quint32));
+    const int adjacencySize = int(adjacency.size() * sizeof(quint32));
+
+    resizeComputeBuffer(m_computeTriangleBuffer, indicesSize);
+    resizeComputeBuffer(m_computeAdjacencyOffsetBuffer, adjacencyOffsetsSize);
+    resizeComputeBuffer(m_computeAdjacencyBuffer, adjacencySize);
+    // written by the compute shaders only
+    resizeComputeBuffer(m_computeFaceNormalBuffer, int(m_computeTriangleNumber * 3 * sizeof(float)));
+    resizeComputeBuffer(m_computeNormalBuffer, int(m_computeVertexNumber * 3 * sizeof(float)));
+    resizeComputeBuffer(m_computePositionBuffer, int(m_computeVertexNumber * 3 * sizeof(float)));
+
+    if (indicesSize > 0)
+        batch->uploadStaticBuffer(m_computeTriangleBuffer, 0, indicesSize, indices.data());
+    batch->uploadStaticBuffer(m_computeAdjacencyOffsetBuffer, 0, adjacencyOffsetsSize, adjacencyOffsets.data());
+    if (adjacencySize > 0)
+        batch->uploadStaticBuffer(m_computeAdjacencyBuffer, 0, adjacencySize, adjacency.data());
+
+    ComputeNormalsUniform counts;
+    counts.set<ComputeNormalsUniform::TRIANGLE_COUNT>(quint32(m_computeTriangleNumber));
+    counts.set<ComputeNormalsUniform::VERTEX_COUNT>(quint32(m_computeVertexNumber));
+    counts.update(batch, m_computeUniformBuffer);
+
+    return sofa::Size(indicesSize + adjacencyOffsetsSize + adjacencySize + ComputeNormalsUniform::paddedSize);
+}
+
+sofa::Size RHIModel::updateComputePositionBuffer(QRhiResourceUpdateBatch* batch)
+{
+    const auto& vertices = this->getVertices();
+
+    m_computePositions.resize(vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); i++)
     {
-        m_computeNormalBuffer->setSize(normalsSize);
-        if (!m_computeNormalBuffer->build())
-        {
-            msg_error() << "Problem while building compute normal buffer";
-        }
+        m_computePositions[i] = sofa::type::Vec3f(float(vertices[i][0]), float(vertices[i][1]), float(vertices[i][2]));
     }
 
+    const int positionsSize = int(m_computePositions.size() * sizeof(m_computePositions[0]));
+    resizeComputeBuffer(m_computePositionBuffer, positionsSize);
+    if (positionsSize > 0)
+        batch->uploadStaticBuffer(m_computePositionBuffer, 0, positionsSize, m_computePositions.data());
+
+    return sofa::Size(positionsSize);
+}
+
+void RHIModel::setGpuNormals(bool enable)
+{
+    if (enable == m_bGpuNormals)
+        return;
+
+    if (!enable)
+        setGpuPositions(false);
+
+    m_bGpuNormals = enable;
+    // the CPU does not need to compute the normals anymore (or again)
+    m_updateNormals.setValue(!enable);
+    if (!enable)
+        computeNormals();
+
+    // the layout of the vertex buffer changes (with or without normals)
+    m_needUpdatePositions = true;
+    m_needUpdateTopology = true;
 }
 
 bool RHIModel::initComputeResources(QRhiPtr rhi)
 {
-    m_storageBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, 4); // cannot be empty at creation
-    if (!m_storageBuffer->build())
+    // the quantized normals are encoded by the CPU
+    if (!d_gpuNormals.getValue() || !m_updateNormals.getValue() || d_quantizeVertices.getValue())
+        return false;
+
+    const QShader faceNormalShader = RHIShaderVariants::load("compute_face_normals.comp", RHIShaderVariants::NONE);
+    const QShader vertexNormalShader = RHIShaderVariants::load("compute_vertex_normals.comp", RHIShaderVariants::NONE);
+    if (!faceNormalShader.isValid() || !vertexNormalShader.isValid())
     {
-        msg_error() << "Problem while building storage buffer";
+        msg_warning() << "Compute shaders for the normals are not available, normals will be computed by the CPU.";
+        return false;
     }
-    m_computeNormalBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer | QRhiBuffer::VertexBuffer, 4); // cannot be empty at creation
-    if (!m_computeNormalBuffer->build())
+    layout::matchesShader<ComputeNormalsUniform>(faceNormalShader, 0, "compute_face_normals.comp");
+    layout::matchesShader<ComputeNormalsUniform>(vertexNormalShader, 0, "compute_vertex_normals.comp");
+
+    // storage buffers cannot be Dynamic
+    m_computeUniformBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, ComputeNormalsUniform::paddedSize);
+    m_computePositionBuffer = rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::StorageBuffer | QRhiBuffer::VertexBuffer, 4); // cannot be empty at creation
+    m_computeTriangleBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, 4);
+    m_computeFaceNormalBuffer = rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::StorageBuffer, 4);
+    m_computeAdjacencyOffsetBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, 4);
+    m_computeAdjacencyBuffer = rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::StorageBuffer, 4);
+    m_computeNormalBuffer = rhi->newBuffer(QRhiBuffer::Static, QRhiBuffer::StorageBuffer | QRhiBuffer::VertexBuffer, 4);
+
+    for (auto* buffer : { m_computeUniformBuffer, m_computePositionBuffer, m_computeTriangleBuffer, m_computeFaceNormalBuffer,
+                          m_computeAdjacencyOffsetBuffer, m_computeAdjacencyBuffer, m_computeNormalBuffer })
     {
-        msg_error() << "Problem while building compute normal buffer";
+        if (!buffer->build())
+        {
+            msg_error() << "Problem while building compute buffers";
+            return false;
+        }
     }
-    //m_computeUniformBuffer = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, COMPUTE_UBUF_SIZE);
-    //m_computeUniformBuffer.computeUniBuf->build();
-
-    //ComputeUBuf ud;
-    //ud.step = d.step;
-    //ud.count = DATA_COUNT;
-    //d.initialUpdates->updateDynamicBuffer(d.computeUniBuf, 0, COMPUTE_UBUF_SIZE, &ud);
 
-    m_computeBindings = rhi->newShaderResourceBindings();
-    m_computeBindings->setBindings({
-                                      QRhiShaderResourceBinding::bufferLoadStore(0, QRhiShaderResourceBinding::ComputeStage, m_storageBuffer),
-                                      QRhiShaderResourceBinding::bufferLoadStore(1, QRhiShaderResourceBinding::ComputeStage, m_computeNormalBuffer),
-                                       //QRhiShaderResourceBinding::uniformBuffer(1, QRhiShaderResourceBinding::ComputeStage, m_computeUniformBuffer)
-        });
-    if (!m_computeBindings->build())
+    m_computeFaceNormalBindings = rhi->newShaderResourceBindings();
+    m_computeFaceNormalBindings->setBindings({
+        QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::ComputeStage, m_computeUniformBuffer),
+        QRhiShaderResourceBinding::bufferLoad(1, QRhiShaderResourceBinding::ComputeStage, m_computePositionBuffer),
+        QRhiShaderResourceBinding::bufferLoad(2, QRhiShaderResourceBinding::ComputeStage, m_computeTriangleBuffer),
+        QRhiShaderResourceBinding::bufferStore(3, QRhiShaderResourceBinding::ComputeStage, m_computeFaceNormalBuffer)
+    });
+    m_computeVertexNormalBindings = rhi->newShaderResourceBindings();
+    m_computeVertexNormalBindings->setBindings({
+        QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::ComputeStage, m_computeUniformBuffer),
+        QRhiShaderResourceBinding::bufferLoad(1, QRhiShaderResourceBinding::ComputeStage, m_computeFaceNormalBuffer),
+        QRhiShaderResourceBinding::bufferLoad(2, QRhiShaderResourceBinding::ComputeStage, m_computeAdjacencyOffsetBuffer),
+        QRhiShaderResourceBinding::bufferLoad(3, QRhiShaderResourceBinding::ComputeStage, m_computeAdjacencyBuffer),
+        QRhiShaderResourceBinding::bufferStore(4, QRhiShaderResourceBinding::ComputeStage, m_computeNormalBuffer)
+    });
+    if (!m_computeFaceNormalBindings->build() || !m_computeVertexNormalBindings->build())
     {
         msg_error() << "Problem while building compute bindings";
         return false;
     }
 
-    QShader cs = utils::loadShader(":/computeshaders/gl/compute_normals.comp.qsb");
-    if (!cs.isValid())
+    m_computeFaceNormalPipeline = rhi->newComputePipeline();
+    m_computeFaceNormalPipeline->setShaderResourceBindings(m_computeFaceNormalBindings);
+    m_computeFaceNormalPipeline->setShaderStage({ QRhiShaderStage::Compute, faceNormalShader });
+    m_computeVertexNormalPipeline = rhi->newComputePipeline();
+    m_computeVertexNormalPipeline->setShaderResourceBindings(m_computeVertexNormalBindings);
+    m_computeVertexNormalPipeline->setShaderStage({ QRhiShaderStage::Compute, vertexNormalShader });
+    if (!m_computeFaceNormalPipeline->build() || !m_computeVertexNormalPipeline->build())
     {
-        msg_error("RHIModel") << "Problem while cs shader";
-        return false;
-    }
-    m_computePipeline = rhi->newComputePipeline();
-    m_computePipeline->setShaderResourceBindings(m_computeBindings);
-    m_computePipeline->setShaderStage({ QRhiShaderStage::Compute, cs });
-    if (!m_computePipeline->build())
-    {
-        msg_error() << "Problem while building compute pipeline";
+        msg_error() << "Problem while building compute pipelines";
         return false;
     }
 
+    setGpuNormals(true);
+
     return true;
 }
+
 void RHIModel::updateComputeResources(QRhiResourceUpdateBatch* batch)
 {
-    if (m_storageBuffer == nullptr || m_computeNormalBuffer == nullptr)
+    if (m_computeFaceNormalPipeline == nullptr || m_computeVertexNormalPipeline == nullptr)
         return;
 
     if (batch == nullptr)
         return;
 
+    setGpuNormals(d_gpuNormals.getValue());
+    if (!m_bGpuNormals)
+        return;
+
+    utils::TraceScope traceScope("RHIModel::updateComputeResources");
+    traceScope.setLabel(this->getName());
+
     //Update Buffers (on demand)
-    if (m_needUpdatePositions || m_needUpdateTopology) // true when a new step is done
+    sofa::Size uploadedBytes = 0;
+    if (m_needUpdateTopology || m_computeVertexNumber != this->getVertices().size()) // true when the topology has changed
     {
-        //will be updated all the time (camera, light and no step)
-        updateStorageBuffer(batch);
+        uploadedBytes += updateComputeTopologyBuffers(batch);
+        m_needDispatchNormals = true;
+    }
+    if (m_needUpdatePositions && !m_bGpuPositions) // true when a new step is done
+    {
+        uploadedBytes += updateComputePositionBuffer(batch);
+        m_needDispatchNormals = true;
     }
 
+    traceScope.addArg("bytesUploaded", uploadedBytes);
+    if (m_drawTool)
+        m_drawTool->getFrameStatistics().modelUploadedBytes += uploadedBytes;
 }
-void RHIModel::updateComputeCommands(QRhiCommandBuffer* cb) 
+
+void RHIModel::updateComputeCommands(QRhiCommandBuffer* cb)
 {
-    const int sizeLocalGroup = 256;
+    // the normals are kept in m_computeNormalBuffer until the next step
+    // with GPU positions, the source dispatches the normals after its positions
+    if (!m_bGpuNormals || !m_needDispatchNormals || m_bGpuPositions)
+        return;
+
+    dispatchNormals(cb);
+    m_needDispatchNormals = false;
+}
+
+void RHIModel::dispatchNormals(QRhiCommandBuffer* cb)
+{
+    if (!m_bGpuNormals)
+        return;
+
+    utils::TraceScope traceScope("RHIModel::dispatchNormals");
+    traceScope.setLabel(this->getName());
+
     ////Create commands
-    cb->setComputePipeline(m_computePipeline);
-    cb->setShaderResources();
-    cb->dispatch(m_computeNormalBuffer->size() / sizeLocalGroup, 1, 1);
+    if (m_computeTriangleNumber > 0)
+    {
+        cb->setComputePipeline(m_computeFaceNormalPipeline);
+        cb->setShaderResources();
+        cb->dispatch(int((m_computeTriangleNumber + COMPUTE_LOCAL_GROUP_SIZE - 1) / COMPUTE_LOCAL_GROUP_SIZE), 1, 1);
+    }
+    // QRhi tracks the storage buffers written by the previous dispatch and inserts the barrier
+    if (m_computeVertexNumber > 0)
+    {
+        cb->setComputePipeline(m_computeVertexNormalPipeline);
+        cb->setShaderResources();
+        cb->dispatch(int((m_computeVertexNumber + COMPUTE_LOCAL_GROUP_SIZE - 1) / COMPUTE_LOCAL_GROUP_SIZE), 1, 1);
+    }
+}
+
+void RHIModel::setGpuPositions(bool enable)
+{
+    if (enable == m_bGpuPositions)
+        return;
+
+    if (enable && !m_bGpuNormals)
+    {
+        msg_error() << "Positions can only be computed on the GPU with the normals (see gpuNormals).";
+        return;
+    }
+
+    m_bGpuPositions = enable;
+
+    // the layout of the vertex buffer changes (with or without positions)
+    m_needUpdatePositions = true;
+    m_needUpdateTopology = true;
 }
 
 SOFA_DECL_CLASS(RHIModel)
@@ -5,32 +5,61 @@
 #include <SofaRHI/RHIGraphicModel.h>
 #include <SofaRHI/RHIComputeModel.h>
 #include <SofaRHI/RHIUtils.h>
+#include <SofaRHI/RHIShaderVariants.h>
+#include <SofaRHI/RHIBufferArena.h>
+#include <SofaRHI/RHIDrawQueue.h>
+#include <SofaRHI/RHIShadowMaps.h>
+#include <SofaRHI/RHITextureCache.h>
+#include <SofaRHI/RHIMeshCache.h>
 #include <SofaBaseVisual/VisualModelImpl.h>
 #include <sofa/core/DataTracker.h>
 
 #include <QtGui/private/qrhi_p.h>
 #include <QFile>
 
-class QImage;
-
 namespace sofa::rhi
 {
 
+class DrawToolRHI;
+
+/// Where a RHIModel is in the shared vertex/index buffers (see DrawToolRHI::getVertexArena())
+struct RHIDrawInput
+{
+    const QRhiCommandBuffer::VertexInput* vertexBindings = nullptr; // positions, normals, texture coordinates
+    QRhiBuffer* indexBuffer = nullptr;
+    QRhiCommandBuffer::IndexFormat indexFormat = QRhiCommandBuffer::IndexUInt32;
+    quint32 firstIndex = 0; // of the model in the index buffer
+    qint32 vertexOffset = 0; // of the model in the vertex buffers, if they are bound at their beginning
+};
+
+/// Passes in which the groups are drawn, in addition to the main pass
+struct RHIDrawPasses
+{
+    bool transparency = false; // weighted blended transparency (see DrawToolRHI::getTransparencyRenderPassDescriptor())
+    // position-only pipeline and bindings of the model for the depth pre-pass, null if disabled
+    QRhiGraphicsPipeline* depthPrepassPipeline = nullptr;
+    QRhiShaderResourceBindings* depthPrepassSrb = nullptr;
+};
+
 class RHIGroup
 {
 public:
     using FaceGroup = sofa::component::visualmodel::VisualModelImpl::FaceGroup;
 
-    RHIGroup(const utils::BufferInfo& bufferInfo, int materialID);
+    // triangles of the model, quads being split in two triangles after the triangles
+    RHIGroup(sofa::Size firstTriangle, sofa::Size triangleNumber, int materialID);
 
     //bool initRHI(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc) override;
     //void updateRHIResources(QRhiResourceUpdateBatch* batch) override;
-    void addDrawCommand(QRhiCommandBuffer* cb, const QRhiCommandBuffer::VertexInput* vbindings);
+    RHIDrawQueue::DrawPacket createDrawPacket(const RHIDrawInput& input) const;
 
     int getMaterialID() const { return m_materialID; }
+    sofa::Size getFirstTriangle() const { return m_firstTriangle; }
+    sofa::Size getTriangleNumber() const { return m_triangleNumber; }
 private:
     int m_materialID;
-    const utils::BufferInfo m_bufferInfo;
+    sofa::Size m_firstTriangle;
+    sofa::Size m_triangleNumber;
 };
 
 class RHIRendering
@@ -46,22 +75,51 @@ public:
         : m_rhigroup(group)
     {}
 
-    virtual bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) = 0;
+    virtual bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) = 0;
     virtual void updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial) = 0;
-    void updateRHICommands(QRhiCommandBuffer* cb, const QRhiViewport& viewport, const QRhiCommandBuffer::VertexInput* vbindings)
-    {
-        //Create commands
-        cb->setGraphicsPipeline(m_pipeline);
-        cb->setShaderResources();
-        cb->setViewport(viewport);
-
-        m_rhigroup.addDrawCommand(cb, vbindings);
-    }
+    /// Variants of the pipeline for the weighted blended transparency passes (once, when they are first needed)
+    bool initTransparencyPipelines(QRhiPtr rhi, QRhiRenderPassDescriptor* rpDesc, DrawToolRHI* drawTool);
+    /// Variant of the pipeline testing the depth with Equal, without writing it, for the main pass after the depth pre-pass
+    bool initDepthPrepassPipeline(QRhiPtr rhi, DrawToolRHI* drawTool);
+    /// With the transparency passes, opaque groups are also drawn in the depth of the transparency target,
+    /// and transparent groups are only drawn in its accumulation.
+    /// With the depth pre-pass, opaque groups are drawn first with the positions only, then shaded with the Equal pipeline
+    void addDrawPacket(RHIDrawQueue& queue, const QRhiViewport& viewport, const RHIDrawInput& input, float depth, const RHIDrawPasses& passes);
+    /// Opaque groups are drawn in the shadow maps (positions only), when they have been invalidated
+    void addShadowPacket(RHIDrawQueue& queue, const RHIDrawInput& input, const RHIShadowMaps& shadowMaps, int map);
 
     int getMaterialID() const { return m_rhigroup.getMaterialID(); }
+    sofa::Size getFirstTriangle() const { return m_rhigroup.getFirstTriangle(); }
+    sofa::Size getTriangleNumber() const { return m_rhigroup.getTriangleNumber(); }
+    /// Read the quantized vertex streams (see RHIVertexQuantization), before initRHIResources()
+    void setQuantizedVertices(bool quantized) { m_bQuantizedVertices = quantized; }
+    /// Shade with the lights of the scene (see DrawToolRHI::updateLights()) instead of the camera, before initRHIResources()
+    void setLights(bool lights) { m_bLights = lights; }
+    /// Shade with the shadow maps of the lights (see RHIShadowMaps), with the lights, before initRHIResources()
+    void setShadows(bool shadows) { m_bShadows = shadows; }
 protected:
+    virtual std::string getRenderingName() const = 0;
+    virtual RHIShaderVariants::Features getAccumulationFragmentFeatures() const = 0;
+    /// Name of the shared pipeline, depending on the vertex streams
+    std::string getPipelineName() const;
+    QShader loadVertexShader() const;
+    /// phong.frag with these features, and the lights and the shadows if enabled
+    QShader loadFragmentShader(RHIShaderVariants::Features features) const;
+    /// After the bindings of the rendering
+    void addLightBinding(std::vector<QRhiShaderResourceBinding>& bindings, DrawToolRHI* drawTool) const;
+    QRhiVertexInputLayout getVertexInputLayout() const;
+
     RHIGroup m_rhigroup;
-    QRhiGraphicsPipeline* m_pipeline = nullptr;
+    bool m_bTransparent = false; // set with the material
+    bool m_bQuantizedVertices = false;
+    bool m_bLights = false;
+    bool m_bShadows = false;
+    QRhiGraphicsPipeline* m_pipeline = nullptr; // shared (see DrawToolRHI::getSharedPipeline())
+    QRhiGraphicsPipeline* m_transparencyDepthPipeline = nullptr; // shared
+    QRhiGraphicsPipeline* m_transparencyAccumulationPipeline = nullptr; // shared
+    bool m_bHasInitTransparency = false;
+    QRhiGraphicsPipeline* m_depthEqualPipeline = nullptr; // shared
+    bool m_bHasInitDepthPrepass = false;
     QRhiShaderResourceBindings* m_srb = nullptr;
     //Uniform buffers
     QRhiBuffer* m_materialBuffer = nullptr;
@@ -74,28 +132,33 @@ public:
         : RHIRendering(group)
     {}
 
-    bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) override;
+    bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) override;
     void updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial) override;
+
+protected:
+    std::string getRenderingName() const override { return "RHIPhongRendering"; }
+    RHIShaderVariants::Features getAccumulationFragmentFeatures() const override { return RHIShaderVariants::NONE; }
 };
 
 class RHIDiffuseTexturedPhongRendering : public RHIRendering
 {
 public:
-    RHIDiffuseTexturedPhongRendering(const RHIGroup& group)
+    RHIDiffuseTexturedPhongRendering(const RHIGroup& group, bool mipmap)
         : RHIRendering(group)
+        , m_bMipMap(mipmap)
     {}
 
-    bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) override;
+    bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) override;
     void updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial) override;
 
+protected:
+    std::string getRenderingName() const override { return "RHIDiffuseTexturedPhongRendering"; }
+    RHIShaderVariants::Features getAccumulationFragmentFeatures() const override { return RHIShaderVariants::DIFFUSE_TEXTURE; }
+
 private:
-    //TODO: parameter or anything
-    bool m_bMipMap = false;
-    bool m_bAutoGenMipMap = false;
+    bool m_bMipMap = true;
 
-    QImage m_diffuseImage;
-    QRhiTexture* m_diffuseTexture = nullptr;
-    QRhiSampler* m_diffuseSampler = nullptr;
+    RHITextureCache::TexturePtr m_diffuseTexture; // shared with the groups using the same image
 };
 
 class RHIWireframeRendering : public RHIRendering
@@ -105,9 +168,13 @@ public:
         : RHIRendering(group)
     {}
 
-    bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) override;
+    bool initRHIResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc, DrawToolRHI* drawTool, std::vector<QRhiShaderResourceBinding> globalBindings, const LoaderMaterial& loaderMaterial) override;
     void updateRHIResources(QRhiResourceUpdateBatch* batch, const LoaderMaterial& loaderMaterial) override;
 
+protected:
+    std::string getRenderingName() const override { return "RHIWireframeRendering"; }
+    RHIShaderVariants::Features getAccumulationFragmentFeatures() const override { return RHIShaderVariants::NONE; }
+
 private:
 };
 
@@ -123,6 +190,7 @@ public:
 
     // VisualModel API
     void init() override;
+    void cleanup() override;
     void initVisual() override;
     void updateVisual() override;
     void handleTopologyChange() override; 
@@ -131,50 +199,124 @@ public:
     bool initGraphicResources(QRhiPtr rhi, QRhiRenderPassDescriptorPtr rpDesc) override;
     void updateGraphicResources(QRhiResourceUpdateBatch* batch) override;
     void updateGraphicCommands(QRhiCommandBuffer* cb, const QRhiViewport& viewport) override;
+    void warmUpGraphicResources() override;
 
     // RHIComputeModel API
     bool initComputeResources(QRhiPtr rhi) override;
     void updateComputeResources(QRhiResourceUpdateBatch* batch) override;
     void updateComputeCommands(QRhiCommandBuffer* cb) override;
 
+    /// GPU positions: the positions are written in getComputePositionBuffer() by another compute model (e.g a mapping),
+    /// which has to call dispatchNormals() once they are computed. Needs the GPU normals.
+    bool hasGpuNormals() const { return m_bGpuNormals; }
+    void setGpuPositions(bool enable);
+    bool hasGpuPositions() const { return m_bGpuPositions; }
+    QRhiBuffer* getComputePositionBuffer() { return m_computePositionBuffer; } // 3 floats per vertex
+    /// The vertices (getVertices(), the ones of the buffers) are the positions (m_positions), unless the loader has duplicated
+    /// them at the seams of the texture coordinates or normals: then each vertex is the position of its index in m_vertPosIdx
+    bool hasDuplicatedVertices() const { return !m_vertices2.getValue().empty(); }
+    const decltype(m_vertPosIdx)& getVertexPositionIndices() const { return m_vertPosIdx; }
+    void dispatchNormals(QRhiCommandBuffer* cb);
+
+    Data<bool> d_gpuNormals; ///< Compute the vertex normals with compute shaders (if available) instead of the CPU
+    Data<bool> d_optimizeIndices; ///< Reorder the triangles (vertex cache, overdraw) and the vertices (fetch) when the topology changes
+    Data<bool> d_mipmaps; ///< Sample the textures with mipmaps (generated when they are loaded)
+    Data<bool> d_quantizeVertices; ///< 16-bit positions in the bounding box and octahedral normals in the vertex buffers (CPU normals only)
+    Data<std::string> d_meshCache; ///< File of the GPU-ready data of the model (see RHIMeshCache), read at init if the data have not changed, written otherwise
+    Data<bool> d_castShadows; ///< Draw the opaque groups in the shadow maps of the lights (not with the quantized vertices)
+
 private:
     void internalDraw(const sofa::core::visual::VisualParams* vparams, bool transparent) override;
 
     void updateBuffers() override;
 
-    void updateVertexBuffer(QRhiResourceUpdateBatch* batch, bool updateGroupInfo = false);
+    void updateVertexBuffer(QRhiResourceUpdateBatch* batch);
+    void updateTextureCoordsBuffer(QRhiResourceUpdateBatch* batch);
     void updateIndexBuffer(QRhiResourceUpdateBatch* batch);
     void updateCameraUniformBuffer(QRhiResourceUpdateBatch* batch);
+    void updateIndexOptimization();
+    bool initDepthPrepass();
+    // pipelines of the transparency passes (if enabled) and of the depth pre-pass, when they are first needed
+    void initPipelineVariants(bool depthPrepass);
+    // invalidate the shadow maps if the model has started or stopped casting shadows, or if it has moved while casting them
+    void updateShadowCasting(bool topologyChanged, bool newStep);
+    QByteArray computeMeshCacheHash() const;
+    void writeMeshCache();
     //void updateMaterialUniformBuffer(QRhiResourceUpdateBatch* batch);
     
     //Uniform buffers
-    QRhiBuffer* m_cameraUniformBuffer = nullptr;
-    //Dynamic buffers
-    QRhiBuffer* m_vertexPositionBuffer = nullptr;
-    QRhiBuffer* m_indexTriangleBuffer = nullptr;
-    QRhiBuffer* m_indexEdgeBuffer = nullptr;
+    QRhiBuffer* m_cameraUniformBuffer = nullptr; // with the dequantization of the positions
+    // Depth pre-pass: positions only, with the camera (pipeline shared by all the models)
+    QRhiShaderResourceBindings* m_depthPrepassSrb = nullptr;
+    QRhiGraphicsPipeline* m_depthPrepassPipeline = nullptr;
+    bool m_bHasInitDepthPrepass = false;
+    //Ranges in the vertex (positions, normals, texture coordinates) and index buffers shared by all the models
+    RHIBufferArena::Allocation m_vertexAllocation;
+    RHIBufferArena::Allocation m_indexAllocation;
+    QRhiCommandBuffer::IndexFormat m_indexFormat = QRhiCommandBuffer::IndexUInt32; // 16 bits if the model has few vertices
+    bool m_bBaseVertex = false; // vertex offset in the draw calls instead of in the bindings
+    // Quantized vertex streams (set at init): positions relative to the bounding box of the last upload
+    bool m_bQuantizedVertices = false;
+    sofa::type::Vec3f m_dequantizationOffset;
+    sofa::type::Vec3f m_dequantizationScale{ 1.0f, 1.0f, 1.0f };
 
     QMatrix4x4 m_correctionMatrix;
 
     int m_triangleNumber = 0;
     int m_quadTriangleNumber = 0;
-    quint32 m_positionsBufferSize = 0, m_normalsBufferSize = 0, m_textureCoordsBufferSize = 0;
+
+    sofa::Size m_uploadedBytes = 0; // uploaded during the current frame (for profiling)
+    DrawToolRHI* m_drawTool = nullptr; // to report the frame statistics
 
     bool m_needUpdatePositions = true;
     bool m_needUpdateTopology = true;
     bool m_needUpdateMaterial = true;
+    sofa::core::DataTracker m_textureCoordsTracker;
+    sofa::core::DataTracker m_optimizeIndicesTracker;
+
+    // Reordered indices of the triangles then of the quads (per group), computed again when the topology changes
+    bool m_bIndexOptimizationValid = false;
+    std::vector<quint32> m_optimizedIndices;
+    std::vector<quint32> m_vertexRemap; // uploaded vertex -> vertex of the model, empty if not remapped
+
+    // Mesh cache: mapped until the first upload (the streams are only used if the positions and normals have not changed since init)
+    std::unique_ptr<RHIMeshCache> m_meshCache;
+    QByteArray m_meshCacheHash;
+    bool m_bWriteMeshCache = false; // after the first upload
+    sofa::core::DataTracker m_meshCacheTracker;
+
+    // Shadow maps: the positions last drawn in them, compared when the positions have been written
+    bool m_bCastingShadows = false;
+    sofa::core::DataTracker m_shadowCasterTracker;
+    VecCoord m_shadowCasterPositions;
 
     std::vector<std::shared_ptr<RHIRendering> > m_renderGroups;
     std::vector<std::shared_ptr<RHIWireframeRendering> > m_wireframeGroups;
 
     //Compute
-    QRhiBuffer* m_storageBuffer = nullptr;
-    QRhiBuffer* m_computeNormalBuffer = nullptr;
+    // GPU normals: face normals then, for each vertex, the sum of the normals of its triangles (CSR adjacency)
+    bool m_bGpuNormals = false; // compute resources are ready and used for the rendering
+    bool m_bGpuPositions = false;
+    bool m_needDispatchNormals = false;
+    quint32 m_computeTriangleNumber = 0;
+    quint32 m_computeVertexNumber = 0;
     QRhiBuffer* m_computeUniformBuffer = nullptr;
-    QRhiShaderResourceBindings* m_computeBindings = nullptr;
-    QRhiComputePipeline* m_computePipeline = nullptr;
-
-    void updateStorageBuffer(QRhiResourceUpdateBatch* batch);
+    QRhiBuffer* m_computePositionBuffer = nullptr;
+    QRhiBuffer* m_computeTriangleBuffer = nullptr;
+    QRhiBuffer* m_computeFaceNormalBuffer = nullptr;
+    QRhiBuffer* m_computeAdjacencyOffsetBuffer = nullptr;
+    QRhiBuffer* m_computeAdjacencyBuffer = nullptr;
+    QRhiBuffer* m_computeNormalBuffer = nullptr; // also the normal vertex stream
+    QRhiShaderResourceBindings* m_computeFaceNormalBindings = nullptr;
+    QRhiShaderResourceBindings* m_computeVertexNormalBindings = nullptr;
+    QRhiComputePipeline* m_computeFaceNormalPipeline = nullptr;
+    QRhiComputePipeline* m_computeVertexNormalPipeline = nullptr;
+    type::vector<sofa::type::Vec3f> m_computePositions;
+
+    // return the uploaded bytes
+    sofa::Size updateComputePositionBuffer(QRhiResourceUpdateBatch* batch);
+    sofa::Size updateComputeTopologyBuffers(QRhiResourceUpdateBatch* batch);
+    void setGpuNormals(bool enable);
 };
 
 } // namespace sofa::rhi
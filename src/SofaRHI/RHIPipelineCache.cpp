@@ -0,0 +1,59 @@
+#include <SofaRHI/RHIPipelineCache.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace sofa::rhi
+{
+
+QString RHIPipelineCache::getFilePath(QRhi* rhi, const std::string& directory)
+{
+    QString backendName;
+    switch (rhi->backend())
+    {
+    case QRhi::Vulkan: backendName = QStringLiteral("vulkan"); break;
+    case QRhi::OpenGLES2: backendName = QStringLiteral("opengl"); break;
+    case QRhi::D3D11: backendName = QStringLiteral("d3d11"); break;
+    case QRhi::Metal: backendName = QStringLiteral("metal"); break;
+    default: backendName = QStringLiteral("null"); break;
+    }
+    return QDir(QString::fromStdString(directory)).filePath(backendName + QStringLiteral(".rhipipelines"));
+}
+
+bool RHIPipelineCache::load(QRhi* rhi, const std::string& directory)
+{
+    if (rhi == nullptr || directory.empty())
+        return false;
+
+    QFile file(getFilePath(rhi, directory));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray data = file.readAll();
+    if (data.isEmpty())
+        return false;
+
+    rhi->setPipelineCacheData(data);
+    return true;
+}
+
+// the cache is only an optimization: the errors are ignored, the pipelines will be compiled again
+bool RHIPipelineCache::save(QRhi* rhi, const std::string& directory)
+{
+    if (rhi == nullptr || directory.empty())
+        return false;
+
+    const QByteArray data = rhi->pipelineCacheData();
+    if (data.isEmpty())
+        return false;
+
+    const QString path = getFilePath(rhi, directory);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+        return false;
+    return file.commit();
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <QtGui/private/qrhi_p.h>
+
+#include <string>
+
+namespace sofa::rhi
+{
+
+/// Pipeline cache of the backend (QRhi::pipelineCacheData(), e.g the VkPipelineCache with Vulkan) kept between runs,
+/// in a file per backend of a directory (see RHIVisualManagerLoop::d_pipelineCacheDirectory).
+/// The QRhi has to be created with QRhi::EnablePipelineCacheDataSave; the data are validated by the backend itself
+/// (driver, device), and ignored if the backend does not implement it.
+class SOFA_SOFARHI_API RHIPipelineCache
+{
+public:
+    /// Before building the pipelines; false if there is no cache for this backend
+    static bool load(QRhi* rhi, const std::string& directory);
+    /// Once the pipelines are built (again at exit for the ones built later); false if nothing was written
+    static bool save(QRhi* rhi, const std::string& directory);
+
+private:
+    static QString getFilePath(QRhi* rhi, const std::string& directory);
+};
+
+} // namespace sofa::rhi
@@ -0,0 +1,32 @@
+#include <SofaRHI/RHIShaderVariants.h>
+#include <SofaRHI/RHIUtils.h>
+
+namespace sofa::rhi
+{
+
+const std::vector<RHIShaderVariants::Variant>& RHIShaderVariants::getVariants()
+{
+    static const std::vector<Variant> variants = {
+#include "RHIShaderVariantTable.inl"
+    };
+    return variants;
+}
+
+std::string RHIShaderVariants::getResource(const std::string& source, Features features)
+{
+    for (const Variant& variant : getVariants())
+    {
+        if (variant.features == features && source == variant.source)
+            return variant.resource;
+    }
+    return {};
+}
+
+QShader RHIShaderVariants::load(const std::string& source, Features features)
+{
+    // the callers report the missing shaders (some are optional, e.g the variants of the disabled CMake options)
+    const std::string resource = getResource(source, features);
+    return resource.empty() ? QShader() : utils::loadShader(resource);
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <QtGui/private/qshader_p.h>
+
+#include <string>
+#include <vector>
+
+namespace sofa::rhi
+{
+
+/// Shaders compiled from the permutations of their sources (see rhi/shadervariants.cmake, which generates the table):
+/// a variant is a source compiled with the defines of its features.
+class SOFA_SOFARHI_API RHIShaderVariants
+{
+public:
+    // as the defines of the shaders
+    enum Feature : unsigned
+    {
+        NONE = 0,
+        DIFFUSE_TEXTURE = 1 << 0,
+        VERTEX_COLOR = 1 << 1,
+        INSTANCED = 1 << 2,
+        QUANTIZED = 1 << 3,
+        OIT = 1 << 4,
+        LIGHTS = 1 << 5,
+        SHADOWS = 1 << 6,
+    };
+    using Features = unsigned;
+
+    struct Variant
+    {
+        const char* source; // file name, e.g phong.vert
+        Features features;
+        const char* resource;
+    };
+
+    /// The variants of the enabled CMake options
+    static const std::vector<Variant>& getVariants();
+    /// Empty if there is no such variant
+    static std::string getResource(const std::string& source, Features features);
+    /// Memoized (see utils::loadShader), invalid if there is no such variant or if it was not compiled
+    static QShader load(const std::string& source, Features features);
+};
+
+} // namespace sofa::rhi
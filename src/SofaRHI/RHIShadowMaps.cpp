@@ -0,0 +1,193 @@
+#include <SofaRHI/RHIShadowMaps.h>
+#include <SofaRHI/RHIShaderVariants.h>
+#include <SofaRHI/RHIUniformBlocks.h>
+#include <SofaRHI/RHITracer.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+#include <algorithm>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// maps per row and column of the texture
+constexpr int GRID_SIZE = 2;
+static_assert(GRID_SIZE * GRID_SIZE == MAX_SHADOW_MAPS);
+constexpr int TEXTURE_SIZE = GRID_SIZE * RHIShadowMaps::MAP_SIZE;
+} // namespace
+
+RHIShadowMaps::RHIShadowMaps(QRhiPtr rhi)
+    : m_rhi(rhi)
+{
+    if (!createResources())
+    {
+        delete m_pipeline;
+        m_pipeline = nullptr;
+    }
+}
+
+RHIShadowMaps::~RHIShadowMaps()
+{
+    delete m_pipeline;
+    for (QRhiShaderResourceBindings* srb : m_srbs)
+        delete srb;
+    delete m_matrixBuffer;
+    delete m_sampler;
+    delete m_rpDesc;
+    delete m_renderTarget;
+    delete m_texture;
+}
+
+bool RHIShadowMaps::createResources()
+{
+    const QShader vs = RHIShaderVariants::load("simple_matrix.vert", RHIShaderVariants::NONE);
+    const QShader fs = RHIShaderVariants::load("shadow.frag", RHIShaderVariants::NONE);
+    if (!vs.isValid() || !fs.isValid())
+    {
+        msg_warning("RHIShadowMaps") << "Shadow shaders not found (compiled with SOFARHI_ENABLE_SHADOWS?), shadows are disabled";
+        return false;
+    }
+
+    QRhiTexture::Format format = QRhiTexture::D32F;
+    if (!m_rhi->isTextureFormatSupported(format))
+        format = QRhiTexture::D16;
+    if (!m_rhi->isTextureFormatSupported(format))
+    {
+        msg_warning("RHIShadowMaps") << "Depth textures are not supported, shadows are disabled";
+        return false;
+    }
+
+    m_texture = m_rhi->newTexture(format, QSize(TEXTURE_SIZE, TEXTURE_SIZE), 1, QRhiTexture::RenderTarget);
+    if (!m_texture->build())
+    {
+        msg_error("RHIShadowMaps") << "Problem while building shadow map texture";
+        return false;
+    }
+
+    QRhiTextureRenderTargetDescription description;
+    description.setDepthTexture(m_texture);
+    m_renderTarget = m_rhi->newTextureRenderTarget(description);
+    m_rpDesc = m_renderTarget->newCompatibleRenderPassDescriptor();
+    m_renderTarget->setRenderPassDescriptor(m_rpDesc);
+    if (!m_renderTarget->build())
+    {
+        msg_error("RHIShadowMaps") << "Problem while building shadow map render target";
+        return false;
+    }
+
+    // linear filtering of the comparisons: 2x2 percentage-closer filtering
+    m_sampler = m_rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None, QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge);
+    m_sampler->setTextureCompareOp(QRhiSampler::LessOrEqual);
+    if (!m_sampler->build())
+    {
+        msg_error("RHIShadowMaps") << "Problem while building shadow map sampler";
+        return false;
+    }
+
+    m_matrixStride = m_rhi->ubufAligned(int(MatrixUniform::paddedSize));
+    m_matrixBuffer = m_rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, MAX_SHADOW_MAPS * m_matrixStride);
+    if (!m_matrixBuffer->build())
+    {
+        msg_error("RHIShadowMaps") << "Problem while building shadow matrix buffer";
+        return false;
+    }
+    for (int map = 0; map < MAX_SHADOW_MAPS; map++)
+    {
+        QRhiShaderResourceBindings* srb = m_rhi->newShaderResourceBindings();
+        srb->setBindings({
+            QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::VertexStage, m_matrixBuffer, map * m_matrixStride, MatrixUniform::paddedSize)
+        });
+        m_srbs.push_back(srb);
+        if (!srb->build())
+        {
+            msg_error("RHIShadowMaps") << "Problem while building shadow map srb";
+            return false;
+        }
+    }
+    layout::matchesShader<MatrixUniform>(vs, 0, "simple_matrix.vert");
+
+    // positions only, no color target
+    m_pipeline = m_rhi->newGraphicsPipeline();
+    m_pipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+    QRhiVertexInputLayout inputLayout;
+    inputLayout.setBindings({ { 3 * sizeof(float) } });
+    inputLayout.setAttributes({ { 0, 0, QRhiVertexInputAttribute::Float3, 0 } });
+    m_pipeline->setVertexInputLayout(inputLayout);
+    m_pipeline->setShaderResourceBindings(m_srbs.front());
+    m_pipeline->setRenderPassDescriptor(m_rpDesc);
+    m_pipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
+    m_pipeline->setDepthTest(true);
+    m_pipeline->setDepthWrite(true);
+    m_pipeline->setDepthOp(QRhiGraphicsPipeline::Less);
+    if (!m_pipeline->build())
+    {
+        msg_error("RHIShadowMaps") << "Problem while building shadow map pipeline";
+        return false;
+    }
+
+    return true;
+}
+
+void RHIShadowMaps::setMatrices(const std::vector<QMatrix4x4>& matrices, QRhiResourceUpdateBatch* batch)
+{
+    if (matrices == m_matrices)
+        return;
+
+    m_matrices.assign(matrices.begin(), matrices.begin() + std::min(matrices.size(), std::size_t(MAX_SHADOW_MAPS)));
+    m_bDirty = true;
+
+    // in the clip space of the backend for the rendering
+    const QMatrix4x4 correctionMatrix = m_rhi->clipSpaceCorrMatrix();
+    for (std::size_t map = 0; map < m_matrices.size(); map++)
+    {
+        const QMatrix4x4 matrix = correctionMatrix * m_matrices[map];
+        MatrixUniform matrixUniform;
+        matrixUniform.setData<MatrixUniform::MATRIX>(matrix.constData());
+        matrixUniform.update(batch, m_matrixBuffer, int(map) * m_matrixStride);
+    }
+}
+
+QRhiViewport RHIShadowMaps::getViewport(int map) const
+{
+    // from the bottom left of the texture
+    return QRhiViewport(float(map % GRID_SIZE * MAP_SIZE), float(map / GRID_SIZE * MAP_SIZE), float(MAP_SIZE), float(MAP_SIZE));
+}
+
+QMatrix4x4 RHIShadowMaps::getTextureMatrix(int map) const
+{
+    // clip space to [0, 1] (depth as written by every backend), the first row of the texture being the bottom of the
+    // map if y is up in the framebuffers, its top otherwise
+    const float ySign = m_rhi->isYUpInFramebuffer() ? 0.5f : -0.5f;
+    const QMatrix4x4 biasMatrix(0.5f, 0.0f, 0.0f, 0.5f,
+                                0.0f, ySign, 0.0f, 0.5f,
+                                0.0f, 0.0f, 0.5f, 0.5f,
+                                0.0f, 0.0f, 0.0f, 1.0f);
+    return biasMatrix * m_matrices[std::size_t(map)];
+}
+
+std::array<float, 4> RHIShadowMaps::getTextureRect(int map) const
+{
+    const QRhiViewport viewport = getViewport(map);
+    const auto rect = viewport.viewport();
+    const float y = m_rhi->isYUpInFramebuffer() ? rect[1] : float(TEXTURE_SIZE) - rect[1] - rect[3];
+    return { rect[0] / float(TEXTURE_SIZE), y / float(TEXTURE_SIZE), rect[2] / float(TEXTURE_SIZE), rect[3] / float(TEXTURE_SIZE) };
+}
+
+bool RHIShadowMaps::render(QRhiCommandBuffer* cb, QRhiResourceUpdateBatch* updates, RHIDrawQueue& queue, utils::FrameStatistics& frameStatistics)
+{
+    if (!isValid() || !needsUpdate())
+        return false;
+
+    SOFARHI_TRACE_SCOPE("RHIShadowMaps::render");
+
+    cb->beginPass(m_renderTarget, QColor(0, 0, 0, 0), { 1.0f, 0 }, updates);
+    queue.submit(cb, RHIDrawQueue::Pass::SHADOW, frameStatistics);
+    cb->endPass();
+
+    m_bDirty = false;
+    return true;
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+#include <SofaRHI/RHIUtils.h>
+#include <SofaRHI/RHIDrawQueue.h>
+
+#include <QtGui/private/qrhi_p.h>
+
+#include <array>
+#include <vector>
+
+namespace sofa::rhi
+{
+
+/// Shadow maps of the lights casting shadows (directional and spot lights), the 2x2 maps of one depth texture.
+/// They are cached: rendered again only when they have been invalidated, i.e when the matrices of the lights have changed
+/// or when a shadow caster has changed, appeared or disappeared (see invalidate()), and sampled as they are otherwise.
+/// The casters (opaque groups of the RHIModels, positions only) are drawn in the SHADOW pass of the draw queue.
+class SOFA_SOFARHI_API RHIShadowMaps
+{
+public:
+    static constexpr int MAP_SIZE = 1024;
+
+    RHIShadowMaps(QRhiPtr rhi);
+    ~RHIShadowMaps();
+
+    /// False if the backend cannot render into depth textures or if the shaders are missing
+    bool isValid() const { return m_pipeline != nullptr; }
+
+    /// Depth texture of the maps, and its comparison sampler (sampler2DShadow)
+    QRhiTexture* getTexture() const { return m_texture; }
+    QRhiSampler* getSampler() const { return m_sampler; }
+
+    /// View-projection matrices of the lights (OpenGL clip space) for this frame, one per map;
+    /// the maps are invalidated if they differ from the previous ones
+    void setMatrices(const std::vector<QMatrix4x4>& matrices, QRhiResourceUpdateBatch* batch);
+    void invalidate() { m_bDirty = true; }
+    bool needsUpdate() const { return m_bDirty && !m_matrices.empty(); }
+
+    int getMapCount() const { return int(m_matrices.size()); }
+    QRhiGraphicsPipeline* getPipeline() const { return m_pipeline; }
+    QRhiShaderResourceBindings* getShaderResourceBindings(int map) const { return m_srbs[std::size_t(map)]; }
+    QRhiViewport getViewport(int map) const;
+    /// From world space to the texture coordinates of the map (in [0, 1]) and its depth
+    QMatrix4x4 getTextureMatrix(int map) const;
+    /// Area of the map in the texture (offset, scale)
+    std::array<float, 4> getTextureRect(int map) const;
+
+    /// Render the maps with the SHADOW pass of the queue if they need it, before the other passes.
+    /// Return true if the pass has been recorded (and has consumed the updates)
+    bool render(QRhiCommandBuffer* cb, QRhiResourceUpdateBatch* updates, RHIDrawQueue& queue, utils::FrameStatistics& frameStatistics);
+
+private:
+    bool createResources();
+
+    QRhiPtr m_rhi;
+    std::vector<QMatrix4x4> m_matrices;
+    bool m_bDirty = true;
+
+    QRhiTexture* m_texture = nullptr;
+    QRhiTextureRenderTarget* m_renderTarget = nullptr;
+    QRhiRenderPassDescriptor* m_rpDesc = nullptr;
+    QRhiSampler* m_sampler = nullptr;
+    QRhiBuffer* m_matrixBuffer = nullptr; // a MatrixUniform per map
+    int m_matrixStride = 0;
+    std::vector<QRhiShaderResourceBindings*> m_srbs;
+    QRhiGraphicsPipeline* m_pipeline = nullptr; // shared by the maps
+};
+
+} // namespace sofa::rhi
@@ -0,0 +1,311 @@
+#include <SofaRHI/RHIStressScene.h>
+#include <SofaRHI/RHIModel.h>
+
+#include <sofa/core/ObjectFactory.h>
+#include <sofa/core/visual/VisualParams.h>
+#include <sofa/helper/accessor.h>
+#include <sofa/simulation/AnimateEndEvent.h>
+#include <sofa/simulation/Node.h>
+#include <sofa/type/Material.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+
+constexpr double PI{ 3.14159265358979323846 };
+
+// Position of the index-th generated object on a cubic lattice
+sofa::type::Vec3d latticePosition(unsigned int index, unsigned int totalNumber, SReal spacing)
+{
+    const unsigned int side = std::max(1u, static_cast<unsigned int>(std::ceil(std::cbrt(double(totalNumber)))));
+    return { spacing * (index % side), spacing * ((index / side) % side), spacing * (index / (side * side)) };
+}
+
+sofa::type::RGBAColor materialColor(unsigned int index, unsigned int number)
+{
+    // spread the hue along the materials
+    const float h = float(index) / float(std::max(1u, number)) * 6.0f;
+    const float x = 1.0f - std::abs(std::fmod(h, 2.0f) - 1.0f);
+    switch (static_cast<int>(h))
+    {
+    case 0: return { 1.0f, x, 0.0f, 1.0f };
+    case 1: return { x, 1.0f, 0.0f, 1.0f };
+    case 2: return { 0.0f, 1.0f, x, 1.0f };
+    case 3: return { 0.0f, x, 1.0f, 1.0f };
+    case 4: return { x, 0.0f, 1.0f, 1.0f };
+    default: return { 1.0f, 0.0f, x, 1.0f };
+    }
+}
+
+// UV sphere of radius 1 with about nbVertices vertices
+void generateSphere(RHIModel* model, unsigned int nbVertices, const sofa::type::Vec3d& center, unsigned int nbMaterials, bool textured, const std::string& textureFilename)
+{
+    const unsigned int side = std::max(3u, static_cast<unsigned int>(std::ceil(std::sqrt(double(nbVertices)))));
+
+    auto positions = sofa::helper::getWriteOnlyAccessor(model->m_positions);
+    auto texcoords = sofa::helper::getWriteOnlyAccessor(model->m_vtexcoords);
+    auto triangles = sofa::helper::getWriteOnlyAccessor(model->m_triangles);
+    positions.resize(side * side);
+    texcoords.resize(side * side);
+    triangles.clear();
+
+    for (unsigned int j = 0; j < side; j++)
+    {
+        const double v = double(j) / double(side - 1);
+        const double theta = v * PI;
+        for (unsigned int i = 0; i < side; i++)
+        {
+            const double u = double(i) / double(side - 1);
+            const double phi = u * 2.0 * PI;
+            const sofa::type::Vec3d p(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            positions[j * side + i] = RHIModel::Coord(center[0] + p[0], center[1] + p[1], center[2] + p[2]);
+            texcoords[j * side + i] = RHIModel::TexCoord(float(u), float(v));
+        }
+    }
+    for (unsigned int j = 0; j < side - 1; j++)
+    {
+        for (unsigned int i = 0; i < side - 1; i++)
+        {
+            const sofa::Index v0 = j * side + i;
+            const sofa::Index v1 = v0 + 1;
+            const sofa::Index v2 = v0 + side;
+            const sofa::Index v3 = v2 + 1;
+            triangles.push_back({ v0, v2, v3 });
+            triangles.push_back({ v0, v3, v1 });
+        }
+    }
+
+    // one group (and material) for each slice of triangles
+    nbMaterials = std::max(1u, nbMaterials);
+    auto materials = sofa::helper::getWriteOnlyAccessor(model->materials);
+    auto groups = sofa::helper::getWriteOnlyAccessor(model->groups);
+    materials.clear();
+    groups.clear();
+
+    const int nbTriangles = int(triangles.size());
+    const int trianglesPerGroup = (nbTriangles + int(nbMaterials) - 1) / int(nbMaterials);
+    for (unsigned int m = 0; m < nbMaterials; m++)
+    {
+        sofa::type::Material material;
+        material.name = "stressMaterial" + std::to_string(m);
+        material.diffuse = materialColor(m, nbMaterials);
+        material.ambient = sofa::type::RGBAColor(material.diffuse.r() * 0.2f, material.diffuse.g() * 0.2f, material.diffuse.b() * 0.2f, 1.0f);
+        material.specular = sofa::type::RGBAColor(0.5f, 0.5f, 0.5f, 1.0f);
+        material.shininess = 45.0f;
+        material.useTexture = textured;
+        material.textureFilename = textureFilename;
+        materials.push_back(material);
+
+        RHIModel::FaceGroup group;
+        group.tri0 = int(m) * trianglesPerGroup;
+        group.nbt = std::max(0, std::min(trianglesPerGroup, nbTriangles - group.tri0));
+        group.quad0 = 0;
+        group.nbq = 0;
+        group.materialName = material.name;
+        group.groupName = "stressGroup" + std::to_string(m);
+        group.materialId = int(m);
+        if (group.nbt > 0)
+            groups.push_back(group);
+    }
+}
+
+} // namespace
+
+///// RHIStressSceneGenerator
+
+int RHIStressSceneGeneratorClass = core::RegisterObject("Generate a synthetic scene (RHIModels and DrawTool components) to benchmark the rendering")
+    .add< RHIStressSceneGenerator >()
+;
+
+RHIStressSceneGenerator::RHIStressSceneGenerator()
+    : d_nbModels(initData(&d_nbModels, 10u, "nbModels", "Number of RHIModels"))
+    , d_nbVertices(initData(&d_nbVertices, 1000u, "nbVertices", "Number of vertices of each RHIModel (approximately)"))
+    , d_textured(initData(&d_textured, false, "textured", "Texture the RHIModels"))
+    , d_textureFilename(initData(&d_textureFilename, std::string("textures/SOFA_logo.bmp"), "textureFilename", "Texture applied to the RHIModels if textured"))
+    , d_nbMaterials(initData(&d_nbMaterials, 1u, "nbMaterials", "Number of materials (and thus of groups) of each RHIModel"))
+    , d_deforming(initData(&d_deforming, true, "deforming", "Deform the RHIModels at each time step (otherwise they are static)"))
+    , d_nbDebugDrawers(initData(&d_nbDebugDrawers, 0u, "nbDebugDrawers", "Number of components drawing with the DrawTool"))
+    , d_nbDebugPrimitives(initData(&d_nbDebugPrimitives, 1000u, "nbDebugPrimitives", "Number of primitives of each type drawn by each debug component"))
+    , d_spacing(initData(&d_spacing, 3.0, "spacing", "Distance between two generated objects"))
+{
+}
+
+void RHIStressSceneGenerator::parse(sofa::core::objectmodel::BaseObjectDescription* arg)
+{
+    Inherit1::parse(arg);
+
+    // generate now, so the generated components are initialized with the rest of the scene
+    generate();
+}
+
+void RHIStressSceneGenerator::generate()
+{
+    if (m_bHasGenerated)
+        return;
+
+    simulation::Node* node = dynamic_cast<simulation::Node*>(this->getContext());
+    if (!node)
+    {
+        msg_error() << "Needs to be in a Node to generate the scene.";
+        return;
+    }
+    m_bHasGenerated = true;
+
+    const unsigned int nbModels = d_nbModels.getValue();
+    const unsigned int nbDebugDrawers = d_nbDebugDrawers.getValue();
+    const unsigned int totalNumber = nbModels + nbDebugDrawers;
+    const SReal spacing = d_spacing.getValue();
+
+    for (unsigned int i = 0; i < nbModels; i++)
+    {
+        const std::string suffix = std::to_string(i);
+        auto child = node->createChild("StressModel" + suffix);
+
+        auto model = sofa::core::objectmodel::New<RHIModel>();
+        model->setName("model" + suffix);
+        generateSphere(model.get(), d_nbVertices.getValue(), latticePosition(i, totalNumber, spacing),
+            d_nbMaterials.getValue(), d_textured.getValue(), d_textureFilename.getValue());
+        child->addObject(model);
+
+        if (d_deforming.getValue())
+        {
+            auto deformer = sofa::core::objectmodel::New<RHIStressDeformer>();
+            deformer->setName("deformer" + suffix);
+            deformer->l_model.set(model.get());
+            child->addObject(deformer);
+        }
+    }
+
+    for (unsigned int k = 0; k < nbDebugDrawers; k++)
+    {
+        const std::string suffix = std::to_string(k);
+        auto child = node->createChild("StressDebug" + suffix);
+
+        auto drawer = sofa::core::objectmodel::New<RHIStressDebugDrawer>();
+        drawer->setName("debugDrawer" + suffix);
+        drawer->d_nbPrimitives.setValue(d_nbDebugPrimitives.getValue());
+        drawer->d_center.setValue(latticePosition(nbModels + k, totalNumber, spacing));
+        drawer->d_size.setValue(2.0);
+        drawer->d_seed.setValue(k);
+        child->addObject(drawer);
+    }
+
+    msg_info() << "Generated " << nbModels << " RHIModels of " << d_nbVertices.getValue() << " vertices and "
+               << nbDebugDrawers << " debug components.";
+}
+
+///// RHIStressDeformer
+
+int RHIStressDeformerClass = core::RegisterObject("Deform a RHIModel with a wave at each time step (for benchmarking)")
+    .add< RHIStressDeformer >()
+;
+
+RHIStressDeformer::RHIStressDeformer()
+    : d_amplitude(initData(&d_amplitude, 0.1, "amplitude", "Amplitude of the deformation (relative to the size of the model)"))
+    , d_frequency(initData(&d_frequency, 2.0, "frequency", "Frequency of the deformation (Hz)"))
+    , l_model(initLink("model", "RHIModel to deform"))
+{
+    this->f_listening.setValue(true);
+}
+
+void RHIStressDeformer::init()
+{
+    if (!l_model)
+    {
+        msg_error() << "No RHIModel to deform.";
+        d_componentState.setValue(sofa::core::objectmodel::ComponentState::Invalid);
+        return;
+    }
+
+    const auto& positions = l_model->m_positions.getValue();
+    m_restPositions.resize(positions.size());
+    for (std::size_t i = 0; i < positions.size(); i++)
+        m_restPositions[i] = sofa::type::Vec3d(positions[i][0], positions[i][1], positions[i][2]);
+
+    d_componentState.setValue(sofa::core::objectmodel::ComponentState::Valid);
+}
+
+void RHIStressDeformer::handleEvent(sofa::core::objectmodel::Event* event)
+{
+    if (!sofa::simulation::AnimateEndEvent::checkEventType(event))
+        return;
+    if (d_componentState.getValue() != sofa::core::objectmodel::ComponentState::Valid)
+        return;
+
+    m_time += static_cast<sofa::simulation::AnimateEndEvent*>(event)->getDt();
+
+    sofa::type::Vec3d center;
+    for (const auto& p : m_restPositions)
+        center += p;
+    if (!m_restPositions.empty())
+        center /= SReal(m_restPositions.size());
+
+    const SReal amplitude = d_amplitude.getValue();
+    const SReal omega = 2.0 * PI * d_frequency.getValue();
+
+    auto positions = sofa::helper::getWriteAccessor(l_model->m_positions);
+    for (std::size_t i = 0; i < m_restPositions.size() && i < positions.size(); i++)
+    {
+        const auto& rest = m_restPositions[i];
+        const SReal scale = 1.0 + amplitude * std::sin(omega * m_time + 4.0 * (rest[1] - center[1]));
+        const auto p = center + (rest - center) * scale;
+        positions[i] = RHIModel::Coord(p[0], p[1], p[2]);
+    }
+
+    // as a mapping would do
+    l_model->modified = true;
+}
+
+///// RHIStressDebugDrawer
+
+int RHIStressDebugDrawerClass = core::RegisterObject("Draw many random primitives with the DrawTool (for benchmarking)")
+    .add< RHIStressDebugDrawer >()
+;
+
+RHIStressDebugDrawer::RHIStressDebugDrawer()
+    : d_nbPrimitives(initData(&d_nbPrimitives, 1000u, "nbPrimitives", "Number of primitives of each type (points, lines, spheres)"))
+    , d_center(initData(&d_center, sofa::type::Vec3d(), "center", "Center of the drawn primitives"))
+    , d_size(initData(&d_size, 1.0, "size", "Size of the region where the primitives are drawn"))
+    , d_seed(initData(&d_seed, 0u, "seed", "Seed of the random positions"))
+{
+}
+
+void RHIStressDebugDrawer::init()
+{
+    std::mt19937 generator(d_seed.getValue());
+    const SReal halfSize = d_size.getValue() * 0.5;
+    std::uniform_real_distribution<SReal> distribution(-halfSize, halfSize);
+    const auto& center = d_center.getValue();
+
+    const auto randomPoint = [&]()
+    {
+        return sofa::type::Vector3(center[0] + distribution(generator), center[1] + distribution(generator), center[2] + distribution(generator));
+    };
+
+    const std::size_t n = d_nbPrimitives.getValue();
+    m_points.resize(n);
+    m_linePoints.resize(2 * n);
+    m_sphereCenters.resize(n);
+    std::generate(m_points.begin(), m_points.end(), randomPoint);
+    std::generate(m_linePoints.begin(), m_linePoints.end(), randomPoint);
+    std::generate(m_sphereCenters.begin(), m_sphereCenters.end(), randomPoint);
+}
+
+void RHIStressDebugDrawer::draw(const sofa::core::visual::VisualParams* vparams)
+{
+    if (m_points.empty())
+        return;
+
+    auto drawTool = vparams->drawTool();
+    drawTool->drawPoints(m_points, 2.0f, sofa::type::RGBAColor::red());
+    drawTool->drawLines(m_linePoints, 1.0f, sofa::type::RGBAColor::green());
+    drawTool->drawSpheres(m_sphereCenters, float(d_size.getValue() * 0.01), sofa::type::RGBAColor::blue());
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <sofa/core/objectmodel/BaseObject.h>
+#include <sofa/core/objectmodel/Link.h>
+#include <sofa/type/Vec.h>
+
+namespace sofa::rhi
+{
+
+class RHIModel;
+
+/// Populate the scene with synthetic content to measure how the rendering scales:
+/// nbModels RHIModels (spheres of about nbVertices vertices, textured or not, with nbMaterials materials, deforming or not)
+/// and nbDebugDrawers components drawing with the DrawTool.
+/// Everything is generated when the component is parsed, i.e before the initialization of the scene
+class SOFA_SOFARHI_API RHIStressSceneGenerator : public sofa::core::objectmodel::BaseObject
+{
+public:
+    SOFA_CLASS(RHIStressSceneGenerator, sofa::core::objectmodel::BaseObject);
+
+    void parse(sofa::core::objectmodel::BaseObjectDescription* arg) override;
+
+    /// Create the nodes and components as children of the current node (already done in parse())
+    void generate();
+
+    Data<unsigned int> d_nbModels; ///< Number of RHIModels
+    Data<unsigned int> d_nbVertices; ///< Number of vertices of each RHIModel
+    Data<bool> d_textured; ///< Texture the RHIModels
+    Data<std::string> d_textureFilename; ///< Texture used if textured
+    Data<unsigned int> d_nbMaterials; ///< Number of materials (and groups) of each RHIModel
+    Data<bool> d_deforming; ///< Deform the RHIModels at each time step
+    Data<unsigned int> d_nbDebugDrawers; ///< Number of DrawTool-heavy components
+    Data<unsigned int> d_nbDebugPrimitives; ///< Number of primitives drawn by each debug component
+    Data<SReal> d_spacing; ///< Distance between two generated objects
+
+protected:
+    RHIStressSceneGenerator();
+    ~RHIStressSceneGenerator() override = default;
+
+    bool m_bHasGenerated = false;
+};
+
+/// Deform a RHIModel with a time-dependent wave, at the end of each animation step
+class SOFA_SOFARHI_API RHIStressDeformer : public sofa::core::objectmodel::BaseObject
+{
+public:
+    SOFA_CLASS(RHIStressDeformer, sofa::core::objectmodel::BaseObject);
+
+    void init() override;
+    void handleEvent(sofa::core::objectmodel::Event* event) override;
+
+    Data<SReal> d_amplitude; ///< Amplitude of the deformation (relative to the size of the model)
+    Data<SReal> d_frequency; ///< Frequency of the deformation
+
+    SingleLink<RHIStressDeformer, RHIModel, BaseLink::FLAG_STOREPATH | BaseLink::FLAG_STRONGLINK> l_model;
+
+protected:
+    RHIStressDeformer();
+    ~RHIStressDeformer() override = default;
+
+    std::vector<sofa::type::Vec3d> m_restPositions;
+    SReal m_time = 0.0;
+};
+
+/// Draw random primitives with the DrawTool each frame, like the debug drawing of the usual components
+class SOFA_SOFARHI_API RHIStressDebugDrawer : public sofa::core::objectmodel::BaseObject
+{
+public:
+    SOFA_CLASS(RHIStressDebugDrawer, sofa::core::objectmodel::BaseObject);
+
+    void init() override;
+    void draw(const sofa::core::visual::VisualParams* vparams) override;
+
+    Data<unsigned int> d_nbPrimitives; ///< Number of primitives of each type
+    Data<sofa::type::Vec3d> d_center; ///< Center of the drawn primitives
+    Data<SReal> d_size; ///< Size of the region where primitives are drawn
+    Data<unsigned int> d_seed; ///< Seed of the random positions
+
+protected:
+    RHIStressDebugDrawer();
+    ~RHIStressDebugDrawer() override = default;
+
+    std::vector<sofa::type::Vector3> m_points;
+    std::vector<sofa::type::Vector3> m_linePoints;
+    std::vector<sofa::type::Vector3> m_sphereCenters;
+};
+
+} // namespace sofa::rhi
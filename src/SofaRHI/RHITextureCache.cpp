@@ -0,0 +1,265 @@
+#include <SofaRHI/RHITextureCache.h>
+#include <SofaRHI/RHITracer.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace sofa::rhi
+{
+
+namespace
+{
+// Files of the disk cache, close to KTX: header, table of the levels, then the RGBA8 levels (rows without padding, 16-byte aligned).
+// In the layout of the machine: the cache is not meant to be shared.
+struct DiskCacheHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 levelCount;
+    qint64 sourceModified; // ms since epoch
+    qint64 sourceSize;
+};
+struct DiskCacheLevel
+{
+    quint32 width;
+    quint32 height;
+    quint64 offset;
+};
+constexpr char DISK_CACHE_MAGIC[8] = { 'S', 'R', 'H', 'I', 'T', 'E', 'X', '\0' };
+constexpr quint32 DISK_CACHE_VERSION = 1;
+constexpr quint64 DISK_CACHE_ALIGNMENT = 16;
+
+quint64 alignDiskCacheOffset(quint64 offset)
+{
+    return (offset + DISK_CACHE_ALIGNMENT - 1) / DISK_CACHE_ALIGNMENT * DISK_CACHE_ALIGNMENT;
+}
+
+QString getDiskCachePath(const std::string& directory, const std::string& path, bool mipmap)
+{
+    const QByteArray hash = QCryptographicHash::hash(QByteArray::fromStdString(path), QCryptographicHash::Sha1).toHex();
+    return QDir(QString::fromStdString(directory)).filePath(QString::fromLatin1(hash) + (mipmap ? QStringLiteral("_mip.rhitex") : QStringLiteral(".rhitex")));
+}
+
+// the levels point into the mapping, unmapped with the last of them
+void releaseMapping(void* file)
+{
+    delete static_cast<std::shared_ptr<QFile>*>(file);
+}
+
+std::vector<QImage> readDiskCache(const QString& cachePath, const QFileInfo& source)
+{
+    auto file = std::make_shared<QFile>(cachePath);
+    if (!file->open(QIODevice::ReadOnly) || file->size() < qint64(sizeof(DiskCacheHeader)))
+        return {};
+    const quint64 fileSize = quint64(file->size());
+    const uchar* data = file->map(0, file->size());
+    if (data == nullptr)
+        return {};
+
+    DiskCacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, DISK_CACHE_MAGIC, sizeof(DISK_CACHE_MAGIC)) != 0 || header.version != DISK_CACHE_VERSION
+        || header.sourceModified != source.lastModified().toMSecsSinceEpoch() || header.sourceSize != source.size()
+        || header.levelCount == 0 || sizeof(header) + header.levelCount * sizeof(DiskCacheLevel) > fileSize)
+        return {};
+
+    std::vector<QImage> levels;
+    for (quint32 i = 0; i < header.levelCount; i++)
+    {
+        DiskCacheLevel level;
+        std::memcpy(&level, data + sizeof(header) + i * sizeof(DiskCacheLevel), sizeof(level));
+        if (level.width == 0 || level.height == 0 || level.offset + quint64(level.width) * level.height * 4 > fileSize)
+            return {};
+        levels.emplace_back(data + level.offset, int(level.width), int(level.height), int(level.width * 4), QImage::Format_RGBA8888,
+            &releaseMapping, new std::shared_ptr<QFile>(file));
+    }
+    return levels;
+}
+
+// the cache is only an optimization: the errors are ignored, the image will be decoded again
+void writeDiskCache(const QString& cachePath, const QFileInfo& source, const std::vector<QImage>& levels)
+{
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    DiskCacheHeader header;
+    std::memcpy(header.magic, DISK_CACHE_MAGIC, sizeof(DISK_CACHE_MAGIC));
+    header.version = DISK_CACHE_VERSION;
+    header.levelCount = quint32(levels.size());
+    header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+    header.sourceSize = source.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    quint64 offset = alignDiskCacheOffset(sizeof(header) + levels.size() * sizeof(DiskCacheLevel));
+    for (const QImage& image : levels)
+    {
+        const DiskCacheLevel level = { quint32(image.width()), quint32(image.height()), offset };
+        file.write(reinterpret_cast<const char*>(&level), sizeof(level));
+        offset = alignDiskCacheOffset(offset + quint64(image.width()) * image.height() * 4);
+    }
+
+    const char padding[DISK_CACHE_ALIGNMENT] = {};
+    for (const QImage& image : levels)
+    {
+        file.write(padding, qint64(alignDiskCacheOffset(quint64(file.pos())) - quint64(file.pos())));
+        for (int y = 0; y < image.height(); y++)
+        {
+            file.write(reinterpret_cast<const char*>(image.constScanLine(y)), qint64(image.width()) * 4);
+        }
+    }
+
+    file.commit();
+}
+} // namespace
+
+RHITextureCache::Texture::~Texture()
+{
+    delete m_sampler;
+    delete m_texture;
+}
+
+RHITextureCache::RHITextureCache(QRhiPtr rhi)
+    : m_rhi(rhi)
+{
+}
+
+RHITextureCache::TexturePtr RHITextureCache::acquire(const std::string& path, const SamplerSettings& samplerSettings)
+{
+    const auto key = std::make_pair(path, samplerSettings);
+    if (TexturePtr texture = m_textures[key].lock())
+        return texture;
+
+    auto texture = std::make_shared<Texture>();
+    texture->m_path = path;
+    texture->m_texture = m_rhi->newTexture(QRhiTexture::RGBA8, QSize(1, 1));
+    if (!texture->m_texture->build())
+    {
+        msg_error("RHITextureCache") << "Problem while building texture for " << path;
+        return nullptr;
+    }
+    texture->m_sampler = m_rhi->newSampler(samplerSettings.filter, samplerSettings.filter, samplerSettings.mipmap ? QRhiSampler::Linear : QRhiSampler::None,
+        samplerSettings.addressMode, samplerSettings.addressMode);
+    if (!texture->m_sampler->build())
+    {
+        msg_error("RHITextureCache") << "Problem while building sampler for " << path;
+        return nullptr;
+    }
+
+    // the GPU cannot always generate the mipmaps of non power of two textures (e.g OpenGL ES 2),
+    // and they are stored in the disk cache
+    texture->m_bGpuMipmaps = samplerSettings.mipmap && m_diskCacheDirectory.empty() && m_rhi->isFeatureSupported(QRhi::NPOTTextureRepeat);
+    texture->m_decoding = std::async(std::launch::async, &RHITextureCache::decode, path, samplerSettings.mipmap && !texture->m_bGpuMipmaps, m_diskCacheDirectory);
+
+    m_textures[key] = texture;
+    return texture;
+}
+
+void RHITextureCache::update(QRhiResourceUpdateBatch* batch)
+{
+    if (batch == nullptr)
+        return;
+
+    SOFARHI_TRACE_SCOPE("RHITextureCache::update");
+
+    for (auto it = m_textures.begin(); it != m_textures.end();)
+    {
+        const TexturePtr texture = it->second.lock();
+        if (!texture)
+        {
+            it = m_textures.erase(it);
+            continue;
+        }
+        const bool mipmap = it->first.second.mipmap;
+        ++it;
+
+        const bool decoded = texture->m_decoding.valid() && texture->m_decoding.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        if (!decoded)
+        {
+            if (!texture->m_bPlaceholderUploaded)
+            {
+                QImage placeholder(1, 1, QImage::Format_RGBA8888);
+                placeholder.fill(Qt::white);
+                batch->uploadTexture(texture->m_texture, placeholder);
+                texture->m_bPlaceholderUploaded = true;
+            }
+            continue;
+        }
+
+        const std::vector<QImage> levels = texture->m_decoding.get();
+        if (levels.empty())
+        {
+            msg_error("RHITextureCache") << "Problem while reading image " << texture->m_path;
+            continue;
+        }
+
+        // same object, built again with the size of the image
+        QRhiTexture::Flags flags;
+        if (mipmap)
+            flags |= QRhiTexture::MipMapped;
+        if (texture->m_bGpuMipmaps)
+            flags |= QRhiTexture::UsedWithGenerateMips;
+        texture->m_texture->setPixelSize(levels.front().size());
+        texture->m_texture->setFlags(flags);
+        if (!texture->m_texture->build())
+        {
+            msg_error("RHITextureCache") << "Problem while building texture for " << texture->m_path;
+            continue;
+        }
+
+        QVector<QRhiTextureUploadEntry> entries;
+        for (int level = 0; level < int(levels.size()); level++)
+        {
+            entries.append(QRhiTextureUploadEntry(0, level, QRhiTextureSubresourceUploadDescription(levels[level])));
+        }
+        QRhiTextureUploadDescription description;
+        description.setEntries(entries.cbegin(), entries.cend());
+        batch->uploadTexture(texture->m_texture, description);
+        if (texture->m_bGpuMipmaps)
+            batch->generateMips(texture->m_texture);
+    }
+}
+
+std::vector<QImage> RHITextureCache::decode(const std::string& path, bool cpuMipmaps, const std::string& diskCacheDirectory)
+{
+    const QFileInfo source(QString::fromStdString(path));
+    QString cachePath;
+    if (!diskCacheDirectory.empty())
+    {
+        cachePath = getDiskCachePath(diskCacheDirectory, path, cpuMipmaps);
+        std::vector<QImage> cachedLevels = readDiskCache(cachePath, source);
+        if (!cachedLevels.empty())
+            return cachedLevels;
+    }
+
+    std::vector<QImage> levels;
+
+    QImage image = QImage(QString::fromStdString(path)).convertToFormat(QImage::Format_RGBA8888);
+    if (image.isNull())
+        return levels;
+    levels.push_back(image.mirrored(false, true)); // seems texcoord are upside down
+
+    // down to 1x1, each level from the previous one
+    while (cpuMipmaps && (levels.back().width() > 1 || levels.back().height() > 1))
+    {
+        const QImage& previous = levels.back();
+        levels.push_back(previous.scaled(std::max(previous.width() / 2, 1), std::max(previous.height() / 2, 1), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+
+    if (!cachePath.isEmpty())
+        writeDiskCache(cachePath, source, levels);
+
+    return levels;
+}
+
+} // namespace sofa::rhi
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <QImage>
+#include <QtGui/private/qrhi_p.h>
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace sofa::rhi
+{
+
+/// Textures of image files shared by all the RHIModels (see DrawToolRHI::getTextureCache()), keyed by resolved path and sampler settings.
+/// The images are decoded (and their mipmaps generated, if the GPU cannot) by worker threads: a texture is a white 1x1 placeholder
+/// until update() uploads its image. It is released with its last user.
+/// With a disk cache directory, the decoded levels (all the mipmaps, generated by the CPU) are written in a file per image, memory-mapped
+/// by the next runs as long as the image file keeps its modification time and size.
+class SOFA_SOFARHI_API RHITextureCache
+{
+public:
+    using QRhiPtr = std::shared_ptr<QRhi>;
+
+    struct SamplerSettings
+    {
+        bool mipmap = true;
+        QRhiSampler::Filter filter = QRhiSampler::Linear;
+        QRhiSampler::AddressMode addressMode = QRhiSampler::ClampToEdge;
+
+        bool operator<(const SamplerSettings& other) const
+        {
+            return std::tie(mipmap, filter, addressMode) < std::tie(other.mipmap, other.filter, other.addressMode);
+        }
+    };
+
+    class Texture
+    {
+    public:
+        ~Texture();
+
+        // the same objects once the image is uploaded (the bindings using them do not have to be built again)
+        QRhiTexture* getTexture() const { return m_texture; }
+        QRhiSampler* getSampler() const { return m_sampler; }
+
+    private:
+        friend class RHITextureCache;
+
+        std::string m_path;
+        QRhiTexture* m_texture = nullptr;
+        QRhiSampler* m_sampler = nullptr;
+        std::future<std::vector<QImage> > m_decoding; // mip levels, only the first one if the GPU generates them
+        bool m_bGpuMipmaps = false;
+        bool m_bPlaceholderUploaded = false;
+    };
+    using TexturePtr = std::shared_ptr<Texture>;
+
+    explicit RHITextureCache(QRhiPtr rhi);
+
+    /// Empty to disable the disk cache (for the textures acquired afterwards)
+    void setDiskCacheDirectory(const std::string& directory) { m_diskCacheDirectory = directory; }
+    const std::string& getDiskCacheDirectory() const { return m_diskCacheDirectory; }
+
+    /// Start decoding the image (path resolved by the caller) if no texture shares it yet; null if the resources cannot be built
+    TexturePtr acquire(const std::string& path, const SamplerSettings& samplerSettings);
+    /// Upload the placeholders and the images decoded since the last call, forget the released textures (once per frame)
+    void update(QRhiResourceUpdateBatch* batch);
+
+private:
+    // on a worker thread
+    static std::vector<QImage> decode(const std::string& path, bool cpuMipmaps, const std::string& diskCacheDirectory);
+
+    QRhiPtr m_rhi;
+    std::string m_diskCacheDirectory;
+    std::map<std::pair<std::string, SamplerSettings>, std::weak_ptr<Texture> > m_textures;
+};
+
+} // namespace sofa::rhi
@@ -0,0 +1,161 @@
+#include <SofaRHI/RHITracer.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+#include <chrono>
+#include <fstream>
+
+namespace sofa::rhi::utils
+{
+
+namespace
+{
+
+std::string escapeJSON(const std::string& str)
+{
+    std::string res;
+    res.reserve(str.size());
+    for (const char c : str)
+    {
+        switch (c)
+        {
+        case '"': res += "\\\""; break;
+        case '\\': res += "\\\\"; break;
+        case '\n': res += "\\n"; break;
+        case '\t': res += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) >= 0x20)
+                res += c;
+            break;
+        }
+    }
+    return res;
+}
+
+} // namespace
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer s_tracer;
+    return s_tracer;
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+#if SOFARHI_ENABLE_TRACING
+    m_enabled.store(enabled, std::memory_order_relaxed);
+#else
+    if (enabled)
+    {
+        msg_warning("RHITracer") << "SofaRHI has been compiled without SOFARHI_ENABLE_TRACING, no event will be recorded.";
+    }
+#endif // SOFARHI_ENABLE_TRACING
+}
+
+void Tracer::setFilename(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_filename = filename;
+}
+
+void Tracer::addEvent(Event&& event)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_events.size() >= MAXIMUM_EVENT_NUMBER)
+    {
+        if (!m_bHasWarnedOverflow)
+        {
+            msg_warning("RHITracer") << "Too many events recorded (" << MAXIMUM_EVENT_NUMBER << "), the next ones will be dropped until the next flush.";
+            m_bHasWarnedOverflow = true;
+        }
+        return;
+    }
+    m_events.emplace_back(std::move(event));
+}
+
+bool Tracer::hasEvents()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_events.empty();
+}
+
+bool Tracer::flush()
+{
+    std::vector<Event> events;
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        events.swap(m_events);
+        filename = m_filename;
+        m_bHasWarnedOverflow = false;
+    }
+
+    std::ofstream out(filename, std::ios::out | std::ios::trunc);
+    if (!out.is_open())
+    {
+        msg_error("RHITracer") << "Could not open " << filename << " to write the trace.";
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& event : events)
+    {
+        if (!first)
+            out << ",";
+        first = false;
+
+        out << "\n{\"name\":\"" << event.name;
+        if (!event.label.empty())
+            out << " " << escapeJSON(event.label);
+        out << "\",\"cat\":\"" << event.category
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadID
+            << ",\"ts\":" << event.begin
+            << ",\"dur\":" << event.duration;
+        if (!event.args.empty())
+            out << ",\"args\":{" << event.args << "}";
+        out << "}";
+    }
+    out << "\n]}\n";
+
+    msg_info("RHITracer") << events.size() << " events written in " << filename;
+
+    return true;
+}
+
+std::int64_t Tracer::now()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::uint32_t Tracer::currentThreadID()
+{
+    static std::atomic<std::uint32_t> s_counter{ 0 };
+    thread_local const std::uint32_t threadID = ++s_counter;
+    return threadID;
+}
+
+#if SOFARHI_ENABLE_TRACING
+void TraceScope::addArg(const char* key, std::int64_t value)
+{
+    if (!m_bActive)
+        return;
+
+    if (!m_event.args.empty())
+        m_event.args += ",";
+    m_event.args += "\"" + std::string(key) + "\":" + std::to_string(value);
+}
+
+void TraceScope::addArg(const char* key, const std::string& value)
+{
+    if (!m_bActive)
+        return;
+
+    if (!m_event.args.empty())
+        m_event.args += ",";
+    m_event.args += "\"" + std::string(key) + "\":\"" + escapeJSON(value) + "\"";
+}
+#endif // SOFARHI_ENABLE_TRACING
+
+} // namespace sofa::rhi::utils
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sofa::rhi::utils
+{
+
+/// Records timed events and writes them in the Chrome trace format
+/// (loadable in chrome://tracing or https://ui.perfetto.dev)
+/// Recording is compiled in with SOFARHI_ENABLE_TRACING and activated at runtime with setEnabled()
+class SOFA_SOFARHI_API Tracer
+{
+public:
+    struct Event
+    {
+        const char* name;
+        const char* category;
+        std::string label; // optional, appended to name (e.g the name of the model)
+        std::int64_t begin; // in microseconds
+        std::int64_t duration; // in microseconds
+        std::uint32_t threadID;
+        std::string args; // already formatted as json members
+    };
+
+    static Tracer& getInstance();
+
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled);
+
+    void setFilename(const std::string& filename);
+    const std::string& getFilename() const { return m_filename; }
+
+    void addEvent(Event&& event);
+    bool hasEvents();
+
+    /// Write all the recorded events in the trace file, and clear them
+    bool flush();
+
+    static std::int64_t now();
+    static std::uint32_t currentThreadID();
+
+private:
+    Tracer() = default;
+
+    std::atomic<bool> m_enabled{ false };
+    std::mutex m_mutex;
+    std::vector<Event> m_events;
+    std::string m_filename{ "rhi_trace.json" };
+    bool m_bHasWarnedOverflow = false;
+
+    static constexpr std::size_t MAXIMUM_EVENT_NUMBER{ 1 << 22 };
+};
+
+/// RAII helper recording the lifetime of a scope as one event
+class SOFA_SOFARHI_API TraceScope
+{
+public:
+#if SOFARHI_ENABLE_TRACING
+    TraceScope(const char* name, const char* category = "rhi")
+    {
+        if (Tracer::getInstance().isEnabled())
+        {
+            m_bActive = true;
+            m_event.name = name;
+            m_event.category = category;
+            m_event.begin = Tracer::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_bActive)
+        {
+            m_event.duration = Tracer::now() - m_event.begin;
+            m_event.threadID = Tracer::currentThreadID();
+            Tracer::getInstance().addEvent(std::move(m_event));
+        }
+    }
+
+    bool isActive() const { return m_bActive; }
+    void setLabel(const std::string& label) { if (m_bActive) m_event.label = label; }
+    void addArg(const char* key, std::int64_t value);
+    void addArg(const char* key, const std::string& value);
+
+private:
+    bool m_bActive = false;
+    Tracer::Event m_event{};
+#else
+    TraceScope(const char*, const char* = "rhi") {}
+
+    bool isActive() const { return false; }
+    void setLabel(const std::string&) {}
+    void addArg(const char*, std::int64_t) {}
+    void addArg(const char*, const std::string&) {}
+#endif // SOFARHI_ENABLE_TRACING
+};
+
+} // namespace sofa::rhi::utils
+
+#define SOFARHI_TRACE_CONCAT_IMPL(a, b) a##b
+#define SOFARHI_TRACE_CONCAT(a, b) SOFARHI_TRACE_CONCAT_IMPL(a, b)
+
+/// Trace the current scope with an anonymous TraceScope
+#define SOFARHI_TRACE_SCOPE(name) \
+    sofa::rhi::utils::TraceScope SOFARHI_TRACE_CONCAT(sofarhi_trace_scope_, __LINE__)(name)
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <SofaRHI/RHIUniformLayout.h>
+
+namespace sofa::rhi
+{
+
+/// Uniform blocks of the shaders (see RHIUniformLayout.h), members in the order of the GLSL declaration
+
+// mvp matrix only (simple_matrix.vert)
+struct MatrixUniform : layout::Block<layout::Packing::STD140, layout::Mat4>
+{
+    enum { MATRIX };
+    static constexpr std::array<const char*, memberCount> names = { "matrix" };
+};
+
+// phong.vert, phong.frag, simple_color.vert
+struct CameraUniform : layout::Block<layout::Packing::STD140, layout::Mat4, layout::Vec3>
+{
+    enum { MVP_MATRIX, CAMERA_POSITION };
+    static constexpr std::array<const char*, memberCount> names = { "mvp_matrix", "camera_position" };
+};
+static_assert(CameraUniform::offsets[CameraUniform::CAMERA_POSITION] == 64 && CameraUniform::size == 76);
+
+// phong.vert with QUANTIZED: the camera then the offset and scale of the positions (see RHIVertexQuantization)
+struct QuantizedCameraUniform : layout::Block<layout::Packing::STD140, layout::Mat4, layout::Vec3, layout::Vec4, layout::Vec4>
+{
+    enum { MVP_MATRIX, CAMERA_POSITION, DEQUANTIZATION_OFFSET, DEQUANTIZATION_SCALE };
+    static constexpr std::array<const char*, memberCount> names = { "mvp_matrix", "camera_position", "dequantization_offset", "dequantization_scale" };
+};
+static_assert(QuantizedCameraUniform::offsets[QuantizedCameraUniform::DEQUANTIZATION_OFFSET] == 80 && QuantizedCameraUniform::size == 112);
+
+// phong.frag (not with VERTEX_COLOR); only the x of shininess is read
+struct MaterialUniform : layout::Block<layout::Packing::STD140, layout::Vec4, layout::Vec4, layout::Vec4, layout::Vec4>
+{
+    enum { AMBIENT, DIFFUSE, SPECULAR, SHININESS };
+    static constexpr std::array<const char*, memberCount> names = { "ambient", "diffuse", "specular", "shininess" };
+};
+static_assert(MaterialUniform::size == 64);
+
+// phong.frag with LIGHTS: the lights of the scene (see RHILight), and a mask per tile of the viewport of the lights
+// which may shade it (bit i for the light i), 4 tiles per uvec4; then the shadows (read with SHADOWS): map of each
+// light (-1: none) and darkness, then the texture matrix and area of each map (see RHIShadowMaps)
+constexpr std::size_t MAX_LIGHTS = 32;
+constexpr std::size_t LIGHT_TILE_COLUMNS = 16;
+constexpr std::size_t LIGHT_TILE_ROWS = 9;
+constexpr std::size_t LIGHT_TILE_COUNT = LIGHT_TILE_COLUMNS * LIGHT_TILE_ROWS;
+constexpr std::size_t MAX_SHADOW_MAPS = 4;
+static_assert(LIGHT_TILE_COUNT % 4 == 0);
+struct LightUniform : layout::Block<layout::Packing::STD140, layout::UVec4, layout::Vec4,
+    layout::Array<layout::Vec4, MAX_LIGHTS>, layout::Array<layout::Vec4, MAX_LIGHTS>, layout::Array<layout::Vec4, MAX_LIGHTS>, layout::Array<layout::Vec4, MAX_LIGHTS>,
+    layout::Array<layout::UVec4, LIGHT_TILE_COUNT / 4>,
+    layout::Array<layout::Vec4, MAX_LIGHTS>, layout::Array<layout::Mat4, MAX_SHADOW_MAPS>, layout::Array<layout::Vec4, MAX_SHADOW_MAPS> >
+{
+    enum { LIGHT_INFO, VIEWPORT, LIGHT_POSITION, LIGHT_COLOR, LIGHT_SPOT, LIGHT_ATTENUATION, TILE_MASKS, LIGHT_SHADOW, SHADOW_MATRIX, SHADOW_RECT };
+    static constexpr std::array<const char*, memberCount> names = { "light_info", "viewport", "light_position", "light_color", "light_spot", "light_attenuation", "tile_masks",
+        "light_shadow", "shadow_matrix", "shadow_rect" };
+};
+static_assert(LightUniform::offsets[LightUniform::TILE_MASKS] == 32 + 4 * MAX_LIGHTS * 16 && LightUniform::size <= 16384);
+
+// compute_face_normals.comp, compute_vertex_normals.comp
+struct ComputeNormalsUniform : layout::Block<layout::Packing::STD140, layout::UInt, layout::UInt>
+{
+    enum { TRIANGLE_COUNT, VERTEX_COUNT };
+    static constexpr std::array<const char*, memberCount> names = { "triangleCount", "vertexCount" };
+};
+static_assert(ComputeNormalsUniform::paddedSize == 16);
+
+// barycentric_mapping.comp
+struct BarycentricMappingUniform : layout::Block<layout::Packing::STD140, layout::UInt>
+{
+    enum { VERTEX_COUNT };
+    static constexpr std::array<const char*, memberCount> names = { "vertexCount" };
+};
+
+} // namespace sofa::rhi
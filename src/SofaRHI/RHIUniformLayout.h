@@ -0,0 +1,229 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+#include <QtGui/private/qrhi_p.h>
+#include <QtGui/private/qshader_p.h>
+
+#include <array>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+/// Layouts of the GLSL blocks computed at compile time from the types of their members (see RHIUniformBlocks.h):
+/// a Block holds the bytes of the whole block, written member by member then uploaded in one call, and
+/// matchesShader() compares it with the reflection data of the shaders.
+namespace sofa::rhi::layout
+{
+
+enum class Packing
+{
+    STD140, // uniform blocks
+    STD430, // storage blocks
+};
+
+// GLSL types of the members
+struct Float;
+struct Int;
+struct UInt;
+struct Vec2;
+struct Vec3;
+struct Vec4;
+struct UVec4;
+struct Mat4; // column-major
+template<typename T, std::size_t N>
+struct Array;
+
+constexpr sofa::Size roundUp(sofa::Size value, sofa::Size alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+template<QShaderDescription::VariableType Type, sofa::Size Size, sofa::Size Alignment>
+struct BasicTraits
+{
+    static constexpr QShaderDescription::VariableType type = Type;
+    static constexpr sofa::Size size = Size;
+    static constexpr sofa::Size alignment = Alignment;
+    static constexpr sofa::Size stride = Size;
+    static constexpr std::size_t count = 0; // not an array
+};
+
+template<typename T, Packing P>
+struct Traits;
+template<Packing P> struct Traits<Float, P> : BasicTraits<QShaderDescription::Float, 4, 4> {};
+template<Packing P> struct Traits<Int, P> : BasicTraits<QShaderDescription::Int, 4, 4> {};
+template<Packing P> struct Traits<UInt, P> : BasicTraits<QShaderDescription::Uint, 4, 4> {};
+template<Packing P> struct Traits<Vec2, P> : BasicTraits<QShaderDescription::Vec2, 8, 8> {};
+template<Packing P> struct Traits<Vec3, P> : BasicTraits<QShaderDescription::Vec3, 12, 16> {};
+template<Packing P> struct Traits<Vec4, P> : BasicTraits<QShaderDescription::Vec4, 16, 16> {};
+template<Packing P> struct Traits<UVec4, P> : BasicTraits<QShaderDescription::Uvec4, 16, 16> {};
+template<Packing P> struct Traits<Mat4, P> : BasicTraits<QShaderDescription::Mat4, 64, 16> {};
+
+template<typename T, std::size_t N, Packing P>
+struct Traits<Array<T, N>, P>
+{
+    static_assert(N > 0 && Traits<T, P>::count == 0, "arrays of arrays are not supported");
+    using Element = T;
+    static constexpr QShaderDescription::VariableType type = Traits<T, P>::type;
+    // std140 rounds the alignment (then the stride) of the elements up to the one of a vec4
+    static constexpr sofa::Size alignment = P == Packing::STD140 ? roundUp(Traits<T, P>::alignment, 16) : Traits<T, P>::alignment;
+    static constexpr sofa::Size stride = roundUp(Traits<T, P>::size, alignment);
+    static constexpr sofa::Size size = stride * sofa::Size(N);
+    static constexpr std::size_t count = N;
+};
+
+/// Offsets of the members, then the end of the last one
+template<Packing P, typename... Members>
+constexpr std::array<sofa::Size, sizeof...(Members) + 1> computeOffsets()
+{
+    constexpr sofa::Size sizes[] = { Traits<Members, P>::size... };
+    constexpr sofa::Size alignments[] = { Traits<Members, P>::alignment... };
+    std::array<sofa::Size, sizeof...(Members) + 1> offsets{};
+    sofa::Size offset = 0;
+    for (std::size_t i = 0; i < sizeof...(Members); i++)
+    {
+        offset = roundUp(offset, alignments[i]);
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+    offsets[sizeof...(Members)] = offset;
+    return offsets;
+}
+
+template<Packing P, typename... Members>
+constexpr sofa::Size computeAlignment()
+{
+    sofa::Size alignment = P == Packing::STD140 ? 16 : 4;
+    for (sofa::Size memberAlignment : { Traits<Members, P>::alignment... })
+        alignment = memberAlignment > alignment ? memberAlignment : alignment;
+    return alignment;
+}
+
+/// Block with these members, in the order of the shader; a derived class gives their names (static names array)
+/// and usually an enum of their indices
+template<Packing P, typename... Members>
+class Block
+{
+public:
+    static_assert(sizeof...(Members) > 0, "empty blocks are not allowed in GLSL");
+
+    static constexpr Packing packing = P;
+    static constexpr std::size_t memberCount = sizeof...(Members);
+    template<std::size_t I>
+    using Member = Traits<std::tuple_element_t<I, std::tuple<Members...> >, P>;
+
+    static constexpr std::array<sofa::Size, memberCount + 1> offsets = computeOffsets<P, Members...>();
+    /// End of the last member (the size reflected from the shaders)
+    static constexpr sofa::Size size = offsets[memberCount];
+    /// Size of the buffers, rounded up to the alignment of the block
+    static constexpr sofa::Size paddedSize = roundUp(size, computeAlignment<P, Members...>());
+
+    /// Value with the size of the member (e.g a type::Vec3f for a Vec3)
+    template<std::size_t I, typename T>
+    void set(const T& value)
+    {
+        static_assert(Member<I>::count == 0, "use setElement() for the arrays");
+        static_assert(std::is_trivially_copyable<T>::value && sizeof(T) == Member<I>::size, "the value does not have the size of the member");
+        std::memcpy(m_data.data() + offsets[I], &value, sizeof(T));
+    }
+
+    /// Size of the member read from data (e.g QMatrix4x4::constData() for a Mat4)
+    template<std::size_t I>
+    void setData(const void* data)
+    {
+        static_assert(Member<I>::count == 0, "use setElement() for the arrays");
+        std::memcpy(m_data.data() + offsets[I], data, Member<I>::size);
+    }
+
+    template<std::size_t I, typename T>
+    void setElement(std::size_t index, const T& value)
+    {
+        static_assert(Member<I>::count > 0, "not an array");
+        static_assert(std::is_trivially_copyable<T>::value && sizeof(T) == Traits<typename Member<I>::Element, P>::size, "the value does not have the size of the elements");
+        std::memcpy(m_data.data() + offsets[I] + index * Member<I>::stride, &value, sizeof(T));
+    }
+
+    const char* data() const { return m_data.data(); }
+
+    /// Whole block in one call (a dynamic buffer of at least paddedSize bytes)
+    void update(QRhiResourceUpdateBatch* batch, QRhiBuffer* buffer, int offset = 0) const
+    {
+        batch->updateDynamicBuffer(buffer, offset, int(paddedSize), m_data.data());
+    }
+
+private:
+    std::array<char, paddedSize> m_data{}; // padding stays zeroed
+};
+
+namespace internal
+{
+template<typename TBlock, std::size_t... I>
+bool matchesMembers(const QVector<QShaderDescription::BlockVariable>& members, const std::string& shaderName, std::index_sequence<I...>)
+{
+    bool match = true;
+    const auto checkMember = [&](std::size_t index, QShaderDescription::VariableType type, sofa::Size offset, std::size_t count, sofa::Size stride)
+    {
+        const QShaderDescription::BlockVariable& member = members[int(index)];
+        const bool isArray = !member.arrayDims.isEmpty();
+        if (member.name != QLatin1String(TBlock::names[index]) || member.type != type || sofa::Size(member.offset) != offset
+            || isArray != (count > 0) || (isArray && (std::size_t(member.arrayDims.front()) != count || sofa::Size(member.arrayStride) != stride)))
+        {
+            msg_error("RHIUniformLayout") << shaderName << ": member " << index << " is " << member.name.toStdString() << " at offset " << member.offset
+                << ", expected " << TBlock::names[index] << " at offset " << offset << " (or different type or array)";
+            match = false;
+        }
+    };
+    (checkMember(I, TBlock::template Member<I>::type, TBlock::offsets[I], TBlock::template Member<I>::count, TBlock::template Member<I>::stride), ...);
+    return match;
+}
+} // namespace internal
+
+/// Same members (names, types, offsets, array strides) as the block at this binding of the shader; the differences are logged
+template<typename TBlock>
+bool matchesShader(const QShader& shader, int binding, const std::string& shaderName)
+{
+    static_assert(std::tuple_size<decltype(TBlock::names)>::value == TBlock::memberCount, "one name per member");
+
+    const QShaderDescription description = shader.description();
+    QVector<QShaderDescription::BlockVariable> members;
+    bool found = false;
+    if constexpr (TBlock::packing == Packing::STD140)
+    {
+        for (const QShaderDescription::UniformBlock& block : description.uniformBlocks())
+        {
+            if (block.binding == binding)
+            {
+                members = block.members;
+                found = true;
+            }
+        }
+    }
+    else
+    {
+        for (const QShaderDescription::StorageBlock& block : description.storageBlocks())
+        {
+            if (block.binding == binding)
+            {
+                members = block.members;
+                found = true;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        msg_error("RHIUniformLayout") << shaderName << ": no block at the binding " << binding;
+        return false;
+    }
+    if (std::size_t(members.size()) != TBlock::memberCount)
+    {
+        msg_error("RHIUniformLayout") << shaderName << ": " << members.size() << " members at the binding " << binding << ", expected " << TBlock::memberCount;
+        return false;
+    }
+    return internal::matchesMembers<TBlock>(members, shaderName, std::make_index_sequence<TBlock::memberCount>());
+}
+
+} // namespace sofa::rhi::layout
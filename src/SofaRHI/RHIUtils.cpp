@@ -2,17 +2,31 @@
 
 #include <QFile>
 
+#include <map>
+#include <mutex>
+
 namespace sofa::rhi::utils
 {
 
 QShader loadShader(const std::string& name)
 {
+    // the shaders are in the resources: a missing one stays missing
+    static std::mutex mutex;
+    static std::map<std::string, QShader> shaders;
+
+    const std::lock_guard<std::mutex> lock(mutex);
+    const auto it = shaders.find(name);
+    if (it != shaders.end())
+        return it->second;
+
+    QShader shader;
     QFile f(QString::fromUtf8(name.c_str()));
     if (f.open(QIODevice::ReadOnly)) {
         const QByteArray contents = f.readAll();
-        return QShader::fromSerialized(contents);
+        shader = QShader::fromSerialized(contents);
     }
-    return QShader();
+    shaders.emplace(name, shader);
+    return shader;
 }
 
 
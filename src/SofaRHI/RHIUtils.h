@@ -35,28 +35,46 @@ namespace sofa::rhi::utils
         sofa::Size size;
     };
 
-    //as defined in the shader files
-    struct PhongMaterial
+    struct GroupInfo
     {
-        std::array<float, 4> ambient;
-        std::array<float, 4> diffuse;
-        std::array<float, 4> specular;
-        std::array<float, 4> shininess;// 3 padding of float;
+        uint8_t materialID;
     };
 
-    struct GroupInfo
+    // GPU durations in milliseconds (resolved a few frames after being recorded)
+    struct GpuTimings
     {
-        uint8_t materialID;
+        bool valid{ false };
+        bool perPass{ false }; // false if only the frame time is available
+        double computePass{ 0.0 };
+        double models{ 0.0 }; // RHIModels in the render pass
+        double drawTool{ 0.0 }; // DrawToolRHI commands in the render pass
+        double renderPass{ 0.0 };
+        double frame{ 0.0 };
+    };
+
+    // Rendering counters of one frame (reset at each DrawToolRHI::beginFrame())
+    struct FrameStatistics
+    {
+        sofa::Size drawCalls{ 0 };
+        sofa::Size pipelineBinds{ 0 };
+        sofa::Size triangles{ 0 };
+        sofa::Size modelUploadedBytes{ 0 }; // by RHIModels
+        sofa::Size drawToolUploadedBytes{ 0 }; // by DrawToolRHI (i.e all the other components)
+        sofa::Size visitedModels{ 0 };
+        sofa::Size culledModels{ 0 }; // visited but not drawn (hidden, invalid...)
+        // maximum usage of the DrawToolRHI buffers since the beginning
+        sofa::Size drawToolVertexBufferHighWaterMark{ 0 };
+        sofa::Size drawToolIndexBufferHighWaterMark{ 0 };
+        sofa::Size drawToolInstanceBufferHighWaterMark{ 0 };
+        GpuTimings gpuTimings; // set by the viewer, if GPU profiling is enabled
     };
 
-    //Definitions
-    constexpr sofa::Size MATRIX4_SIZE{ 64 };
-    constexpr sofa::Size VEC3_SIZE{ 12 };
-    constexpr sofa::Size PHONG_MATERIAL_SIZE = sizeof(PhongMaterial);
+    //Definitions (the layouts of the uniform blocks are in RHIUniformBlocks.h)
     constexpr sofa::Size MAXIMUM_MATERIAL_NUMBER{ 9 }; //
     constexpr sofa::Size GROUPINFO_SIZE = sizeof(GroupInfo);
 
     //Helper functions
+    // deserialized once per name (QShader is implicitly shared), thread-safe
     QShader loadShader(const std::string& name);
 
     template<typename TVector3>
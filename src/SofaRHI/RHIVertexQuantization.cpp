@@ -0,0 +1,197 @@
+#include <SofaRHI/RHIVertexQuantization.h>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFARHI_QUANTIZATION_SSE2 1
+#include <emmintrin.h>
+#else
+#define SOFARHI_QUANTIZATION_SSE2 0
+#endif
+
+namespace sofa::rhi
+{
+
+namespace
+{
+constexpr float QUANTIZATION_MAX = 65535.0f;
+
+quint32 quantizeUnit(float value)
+{
+    return quint32(std::min(std::max(value, 0.0f), 1.0f) * QUANTIZATION_MAX + 0.5f);
+}
+
+void encodeNormal(const sofa::type::Vec3f& n, RHIVertexQuantization::Normal& output)
+{
+    const float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+    float u = 0.0f;
+    float v = 0.0f;
+    if (l1 > 0.0f)
+    {
+        u = n[0] / l1;
+        v = n[1] / l1;
+        // the lower half of the octahedron is folded over the upper one
+        if (n[2] < 0.0f)
+        {
+            const float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            const float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = foldedU;
+            v = foldedV;
+        }
+    }
+
+    const quint32 qu = quantizeUnit(u * 0.5f + 0.5f);
+    const quint32 qv = quantizeUnit(v * 0.5f + 0.5f);
+    output.high[0] = quint8(qu >> 8);
+    output.high[1] = quint8(qv >> 8);
+    output.low[0] = quint8(qu & 0xFF);
+    output.low[1] = quint8(qv & 0xFF);
+}
+} // namespace
+
+void RHIVertexQuantization::computeDequantization(const sofa::type::Vec3f* positions, std::size_t count, sofa::type::Vec3f& offset, sofa::type::Vec3f& scale)
+{
+    if (count == 0)
+    {
+        offset = sofa::type::Vec3f(0.0f, 0.0f, 0.0f);
+        scale = sofa::type::Vec3f(1.0f, 1.0f, 1.0f);
+        return;
+    }
+
+    float minimum[4];
+    float maximum[4];
+#if SOFARHI_QUANTIZATION_SSE2
+    __m128 vmin = _mm_setr_ps(positions[0][0], positions[0][1], positions[0][2], 0.0f);
+    __m128 vmax = vmin;
+    for (std::size_t i = 1; i < count; i++)
+    {
+        const __m128 p = _mm_setr_ps(positions[i][0], positions[i][1], positions[i][2], 0.0f);
+        vmin = _mm_min_ps(vmin, p);
+        vmax = _mm_max_ps(vmax, p);
+    }
+    _mm_storeu_ps(minimum, vmin);
+    _mm_storeu_ps(maximum, vmax);
+#else
+    for (int axis = 0; axis < 3; axis++)
+    {
+        minimum[axis] = maximum[axis] = positions[0][axis];
+    }
+    for (std::size_t i = 1; i < count; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            minimum[axis] = std::min(minimum[axis], positions[i][axis]);
+            maximum[axis] = std::max(maximum[axis], positions[i][axis]);
+        }
+    }
+#endif
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        offset[axis] = minimum[axis];
+        const float extent = maximum[axis] - minimum[axis];
+        scale[axis] = extent > 0.0f ? extent : 1.0f; // flat along this axis
+    }
+}
+
+void RHIVertexQuantization::quantizePositions(const sofa::type::Vec3f* positions, std::size_t count, const sofa::type::Vec3f& offset, const sofa::type::Vec3f& scale, Position* output)
+{
+    static_assert(sizeof(Position) == 8, "Position has to be read as two UNormByte4 attributes");
+
+#if SOFARHI_QUANTIZATION_SSE2
+    const __m128 voffset = _mm_setr_ps(offset[0], offset[1], offset[2], 0.0f);
+    const __m128 vfactor = _mm_setr_ps(QUANTIZATION_MAX / scale[0], QUANTIZATION_MAX / scale[1], QUANTIZATION_MAX / scale[2], 0.0f);
+    const __m128 vhalf = _mm_set1_ps(0.5f);
+    const __m128 vzero = _mm_setzero_ps();
+    const __m128 vmax = _mm_set1_ps(QUANTIZATION_MAX);
+    const __m128i lowMask = _mm_set1_epi32(0xFF);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const __m128 p = _mm_setr_ps(positions[i][0], positions[i][1], positions[i][2], 0.0f);
+        __m128 q = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(p, voffset), vfactor), vhalf);
+        q = _mm_min_ps(_mm_max_ps(q, vzero), vmax);
+        const __m128i qi = _mm_cvttps_epi32(q);
+        // (high x y z 0, low x y z 0) as 16-bit then as bytes: the 8 first bytes are the Position
+        const __m128i words = _mm_packs_epi32(_mm_srli_epi32(qi, 8), _mm_and_si128(qi, lowMask));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&output[i]), _mm_packus_epi16(words, words));
+    }
+#else
+    for (std::size_t i = 0; i < count; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const quint32 q = quantizeUnit((positions[i][axis] - offset[axis]) / scale[axis]);
+            output[i].high[axis] = quint8(q >> 8);
+            output[i].low[axis] = quint8(q & 0xFF);
+        }
+        output[i].high[3] = 0;
+        output[i].low[3] = 0;
+    }
+#endif
+}
+
+void RHIVertexQuantization::encodeNormals(const sofa::type::Vec3f* normals, std::size_t count, Normal* output)
+{
+    static_assert(sizeof(Normal) == 4, "Normal has to be read as one UNormByte4 attribute");
+
+    std::size_t i = 0;
+#if SOFARHI_QUANTIZATION_SSE2
+    // 4 normals at a time, one coordinate per register
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 quantizationMax = _mm_set1_ps(QUANTIZATION_MAX);
+    const __m128i lowMask = _mm_set1_epi32(0xFF);
+    for (; i + 4 <= count; i += 4)
+    {
+        const sofa::type::Vec3f* n = normals + i;
+        const __m128 x = _mm_setr_ps(n[0][0], n[1][0], n[2][0], n[3][0]);
+        const __m128 y = _mm_setr_ps(n[0][1], n[1][1], n[2][1], n[3][1]);
+        const __m128 z = _mm_setr_ps(n[0][2], n[1][2], n[2][2], n[3][2]);
+
+        const __m128 l1 = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, x), _mm_andnot_ps(signMask, y)), _mm_andnot_ps(signMask, z));
+        const __m128 nonNull = _mm_cmpgt_ps(l1, zero);
+        // divided as the scalar path (not multiplied by 1 / l1) for the same rounding, 0 for null normals
+        const __m128 divisor = _mm_or_ps(l1, _mm_andnot_ps(nonNull, one));
+        const __m128 u = _mm_and_ps(nonNull, _mm_div_ps(x, divisor));
+        const __m128 v = _mm_and_ps(nonNull, _mm_div_ps(y, divisor));
+
+        // the lower half of the octahedron is folded over the upper one
+        const __m128 lower = _mm_cmplt_ps(z, zero);
+        // +1 for -0.0 too, as the scalar path and the shader
+        const __m128 positiveU = _mm_cmpge_ps(u, zero);
+        const __m128 positiveV = _mm_cmpge_ps(v, zero);
+        const __m128 signU = _mm_or_ps(_mm_and_ps(positiveU, one), _mm_andnot_ps(positiveU, minusOne));
+        const __m128 signV = _mm_or_ps(_mm_and_ps(positiveV, one), _mm_andnot_ps(positiveV, minusOne));
+        const __m128 foldedU = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, v)), signU);
+        const __m128 foldedV = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(signMask, u)), signV);
+        const __m128 octU = _mm_or_ps(_mm_and_ps(lower, foldedU), _mm_andnot_ps(lower, u));
+        const __m128 octV = _mm_or_ps(_mm_and_ps(lower, foldedV), _mm_andnot_ps(lower, v));
+
+        const auto quantize = [&](const __m128 value)
+        {
+            const __m128 unit = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(value, half), half), zero), one);
+            return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(unit, quantizationMax), half));
+        };
+        const __m128i qu = quantize(octU);
+        const __m128i qv = quantize(octV);
+
+        // bytes of each normal: high u, high v, low u, low v
+        __m128i packed = _mm_srli_epi32(qu, 8);
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_srli_epi32(qv, 8), 8));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(qu, lowMask), 16));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(qv, lowMask), 24));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        encodeNormal(normals[i], output[i]);
+    }
+}
+
+} // namespace sofa::rhi
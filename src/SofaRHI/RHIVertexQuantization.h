@@ -0,0 +1,39 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+
+#include <sofa/type/Vec.h>
+
+#include <QtGlobal>
+
+namespace sofa::rhi
+{
+
+/// Compact vertex streams of the RHIModels (see RHIModel::d_quantizeVertices): 8 bytes per position and 4 bytes per normal
+/// instead of 12 each. Qt RHI has no 16-bit vertex format, so the 16-bit values are split in bytes read with UNormByte4 attributes
+/// and put back together in the vertex shader (phong.vert with QUANTIZED). Encoded with SSE2 when available.
+class SOFA_SOFARHI_API RHIVertexQuantization
+{
+public:
+    /// 16-bit unsigned position in the bounding box: high bytes (x, y, z, 0) then low bytes (x, y, z, 0)
+    struct Position
+    {
+        quint8 high[4];
+        quint8 low[4];
+    };
+
+    /// Octahedral encoding of a unit vector on 2x16 bits: high bytes (u, v) then low bytes (u, v)
+    struct Normal
+    {
+        quint8 high[2];
+        quint8 low[2];
+    };
+
+    /// Dequantized position = offset + scale * q, q in [0, 1] per axis (bounding box of the positions)
+    static void computeDequantization(const sofa::type::Vec3f* positions, std::size_t count, sofa::type::Vec3f& offset, sofa::type::Vec3f& scale);
+    static void quantizePositions(const sofa::type::Vec3f* positions, std::size_t count, const sofa::type::Vec3f& offset, const sofa::type::Vec3f& scale, Position* output);
+    /// Normals do not need to be normalized (null ones are encoded as (0, 0, 1))
+    static void encodeNormals(const sofa::type::Vec3f* normals, std::size_t count, Normal* output);
+};
+
+} // namespace sofa::rhi
@@ -2,6 +2,7 @@
 
 #include <SofaRHI/RHIGraphicVisitor.h>
 #include <SofaRHI/RHIComputeVisitor.h>
+#include <SofaRHI/RHILight.h>
 
 #include <sofa/core/ObjectFactory.h>
 #include <sofa/core/visual/VisualParams.h>
@@ -13,6 +14,9 @@
 #include <sofa/simulation/PropagateEventVisitor.h>
 
 #include <sofa/helper/AdvancedTimer.h>
+#include <SofaRHI/RHITracer.h>
+
+#include <cstdlib>
 
 namespace sofa::rhi
 {
@@ -23,20 +27,108 @@ int RHIVisualManagerLoopClass = core::RegisterObject("Visual Loop Manager for th
 
 RHIVisualManagerLoop::RHIVisualManagerLoop(simulation::Node* _gnode)
     : Inherit()
+    , d_drawCalls(initData(&d_drawCalls, sofa::Size(0), "drawCalls", "Number of draw calls during the last frame"))
+    , d_pipelineBinds(initData(&d_pipelineBinds, sofa::Size(0), "pipelineBinds", "Number of graphics pipelines bound during the last frame"))
+    , d_triangles(initData(&d_triangles, sofa::Size(0), "triangles", "Number of triangles submitted during the last frame"))
+    , d_modelUploadedBytes(initData(&d_modelUploadedBytes, sofa::Size(0), "modelUploadedBytes", "Bytes uploaded to the GPU by the RHIModels during the last frame"))
+    , d_drawToolUploadedBytes(initData(&d_drawToolUploadedBytes, sofa::Size(0), "drawToolUploadedBytes", "Bytes uploaded to the GPU by the DrawToolRHI during the last frame"))
+    , d_visitedModels(initData(&d_visitedModels, sofa::Size(0), "visitedModels", "Number of RHI graphic models visited during the last frame"))
+    , d_culledModels(initData(&d_culledModels, sofa::Size(0), "culledModels", "Number of RHI graphic models visited but not drawn (hidden, invalid) during the last frame"))
+    , d_drawToolVertexBufferHighWaterMark(initData(&d_drawToolVertexBufferHighWaterMark, sofa::Size(0), "drawToolVertexBufferHighWaterMark", "Maximum number of bytes used in the vertex buffer of the DrawToolRHI"))
+    , d_drawToolIndexBufferHighWaterMark(initData(&d_drawToolIndexBufferHighWaterMark, sofa::Size(0), "drawToolIndexBufferHighWaterMark", "Maximum number of bytes used in the index buffer of the DrawToolRHI"))
+    , d_drawToolInstanceBufferHighWaterMark(initData(&d_drawToolInstanceBufferHighWaterMark, sofa::Size(0), "drawToolInstanceBufferHighWaterMark", "Maximum number of bytes used in the instance buffer of the DrawToolRHI"))
+    , d_gpuTimings(initData(&d_gpuTimings, false, "gpuTimings", "Measure the GPU time spent in each pass (per pass with OpenGL, whole frame only with the other graphics APIs)"))
+    , d_showStatistics(initData(&d_showStatistics, false, "showStatistics", "Display the statistics (and GPU timings if enabled) on top of the viewer"))
+    , d_gpuComputePassTime(initData(&d_gpuComputePassTime, 0.0, "gpuComputePassTime", "GPU time of the compute pass (ms)"))
+    , d_gpuModelsTime(initData(&d_gpuModelsTime, 0.0, "gpuModelsTime", "GPU time of the RHIModels draws (ms)"))
+    , d_gpuDrawToolTime(initData(&d_gpuDrawToolTime, 0.0, "gpuDrawToolTime", "GPU time of the DrawToolRHI draws (ms)"))
+    , d_gpuRenderPassTime(initData(&d_gpuRenderPassTime, 0.0, "gpuRenderPassTime", "GPU time of the render pass (ms)"))
+    , d_gpuFrameTime(initData(&d_gpuFrameTime, 0.0, "gpuFrameTime", "GPU time of the frame (ms)"))
+    , d_warmUpTime(initData(&d_warmUpTime, 0.0, "warmUpTime", "Time spent by the viewer building the RHI resources and pipelines after the scene was loaded, instead of during the first frames (ms)"))
+    , d_orderIndependentTransparency(initData(&d_orderIndependentTransparency, false, "orderIndependentTransparency", "Render the transparent RHIModels in one unsorted pass with weighted blended order-independent transparency (needs the CMake option SOFARHI_ENABLE_OIT)"))
+    , d_depthPrepass(initData(&d_depthPrepass, false, "depthPrepass", "Draw the depth of the opaque RHIModels first (positions only), then shade them with an Equal depth test, so that each pixel is shaded once"))
+    , d_textureCacheDirectory(initData(&d_textureCacheDirectory, std::string(""), "textureCacheDirectory", "Directory where the decoded and mipmapped textures are written, then memory-mapped by the next runs instead of decoding the images again (disabled if empty)"))
+    , d_pipelineCacheDirectory(initData(&d_pipelineCacheDirectory, std::string(""), "pipelineCacheDirectory", "Directory where the viewer writes the pipeline cache of the backend (e.g Vulkan pipeline cache), read by the next runs to skip the compilation of the pipelines (disabled if empty)"))
+    , d_trace(initData(&d_trace, false, "trace", "Record the RHI frame activity (steps, visitors, models) and write it as a Chrome trace (chrome://tracing or Perfetto)"))
+    , d_traceFilename(initData(&d_traceFilename, std::string("rhi_trace.json"), "traceFilename", "File where the trace is written when tracing stops"))
     , gRoot(_gnode)
 {
     //assert(gRoot);
+
+    for (auto* data : { &d_drawCalls, &d_pipelineBinds, &d_triangles, &d_modelUploadedBytes, &d_drawToolUploadedBytes,
+                        &d_visitedModels, &d_culledModels,
+                        &d_drawToolVertexBufferHighWaterMark, &d_drawToolIndexBufferHighWaterMark, &d_drawToolInstanceBufferHighWaterMark })
+    {
+        data->setReadOnly(true);
+        data->setGroup("Statistics");
+    }
+    for (auto* data : { &d_gpuComputePassTime, &d_gpuModelsTime, &d_gpuDrawToolTime, &d_gpuRenderPassTime, &d_gpuFrameTime, &d_warmUpTime })
+    {
+        data->setReadOnly(true);
+        data->setGroup("Statistics");
+    }
+    d_gpuTimings.setGroup("Statistics");
+    d_showStatistics.setGroup("Statistics");
 }
 
 RHIVisualManagerLoop::~RHIVisualManagerLoop()
 {
-
+    auto& tracer = utils::Tracer::getInstance();
+    if (tracer.isEnabled())
+    {
+        tracer.setEnabled(false);
+        tracer.flush();
+    }
 }
 
 void RHIVisualManagerLoop::init()
 {
     if (!gRoot)
         gRoot = dynamic_cast<simulation::Node*>(this->getContext());
+
+    // Tracing can also be enabled without editing the scene (e.g with rhi_offscreen)
+    // SOFARHI_TRACE=1 or SOFARHI_TRACE=<filename>
+    if (const char* traceEnv = std::getenv("SOFARHI_TRACE"))
+    {
+        const std::string traceValue(traceEnv);
+        if (!traceValue.empty() && traceValue != "0")
+        {
+            d_trace.setValue(true);
+            if (traceValue != "1")
+                d_traceFilename.setValue(traceValue);
+        }
+    }
+
+    updateTracer();
+
+    // SOFARHI_TEXTURE_CACHE=<directory>
+    if (const char* textureCacheEnv = std::getenv("SOFARHI_TEXTURE_CACHE"))
+        d_textureCacheDirectory.setValue(textureCacheEnv);
+
+    // SOFARHI_PIPELINE_CACHE=<directory>
+    if (const char* pipelineCacheEnv = std::getenv("SOFARHI_PIPELINE_CACHE"))
+        d_pipelineCacheDirectory.setValue(pipelineCacheEnv);
+}
+
+void RHIVisualManagerLoop::updateTracer()
+{
+    // only on changes: without SOFARHI_ENABLE_TRACING the tracer stays disabled (and warns when enabled)
+    const bool trace = d_trace.getValue();
+    if (trace == m_bTraceRequested)
+        return;
+    m_bTraceRequested = trace;
+
+    auto& tracer = utils::Tracer::getInstance();
+    if (trace)
+    {
+        tracer.setFilename(d_traceFilename.getValue());
+        tracer.setEnabled(true);
+    }
+    else if (tracer.isEnabled())
+    {
+        tracer.setEnabled(false);
+        tracer.flush();
+    }
 }
 
 
@@ -45,27 +137,47 @@ void RHIVisualManagerLoop::initStep(sofa::core::ExecParams* params)
 {
     if (!gRoot) return;
 
-    gRoot->execute<sofa::simulation::VisualInitVisitor>(params);
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::initStep");
+
+    {
+        SOFARHI_TRACE_SCOPE("VisualInitVisitor");
+        gRoot->execute<sofa::simulation::VisualInitVisitor>(params);
+    }
 
     //I DONT UNDERSTAND WHY THERE IS NO VISUALPARAMS IN A VISUAL INITIALIZATION !111!!!
     auto vparams = sofa::core::visual::VisualParams::defaultInstance();
 
-    RHIGraphicInitResourcesVisitor initVisitor(vparams);
-    gRoot->execute(&initVisitor);
+    // before the RHIModels acquire their textures
+    if (DrawToolRHI* rhiDrawTool = dynamic_cast<DrawToolRHI*>(vparams->drawTool()))
+        rhiDrawTool->getTextureCache()->setDiskCacheDirectory(d_textureCacheDirectory.getValue());
+
+    {
+        SOFARHI_TRACE_SCOPE("RHIGraphicInitResourcesVisitor");
+        RHIGraphicInitResourcesVisitor initVisitor(vparams);
+        gRoot->execute(&initVisitor);
+    }
 
     // Do a visual update now as it is not done in load() anymore
     /// \todo Separate this into another method?
-    gRoot->execute<sofa::simulation::VisualUpdateVisitor>(params);
+    {
+        SOFARHI_TRACE_SCOPE("VisualUpdateVisitor");
+        gRoot->execute<sofa::simulation::VisualUpdateVisitor>(params);
+    }
 }
 
 void RHIVisualManagerLoop::updateStep(sofa::core::ExecParams* params)
 {
     if (!gRoot) return;
 
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::updateStep");
+
 #ifdef SOFA_DUMP_VISITOR_INFO
     simulation::Visitor::printNode("UpdateVisual");
 #endif
-    gRoot->execute<sofa::simulation::VisualUpdateVisitor>(params);
+    {
+        SOFARHI_TRACE_SCOPE("VisualUpdateVisitor");
+        gRoot->execute<sofa::simulation::VisualUpdateVisitor>(params);
+    }
 
 #ifdef SOFA_DUMP_VISITOR_INFO
     simulation::Visitor::printCloseNode("UpdateVisual");
@@ -76,21 +188,59 @@ void RHIVisualManagerLoop::updateRHIResourcesStep(sofa::core::visual::VisualPara
 {
     if (!gRoot) return;
 
+    // once per frame, so take this opportunity to check the tracing state
+    updateTracer();
+
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::updateRHIResourcesStep");
+
 #ifdef SOFA_DUMP_VISITOR_INFO
     simulation::Visitor::printNode("UpdateRHIResources");
 #endif
 
-    RHIGraphicUpdateResourcesVisitor updateVisitor(vparams);
-    gRoot->execute(&updateVisitor);
+    // with the view of the frame
+    if (DrawToolRHI* rhiDrawTool = dynamic_cast<DrawToolRHI*>(vparams->drawTool()))
+    {
+        SOFARHI_TRACE_SCOPE("updateLights");
+        std::vector<RHILight*> lights;
+        gRoot->getTreeObjects<RHILight>(&lights);
+        std::vector<RHILight::Description> descriptions;
+        descriptions.reserve(lights.size());
+        for (const RHILight* light : lights)
+            descriptions.push_back(light->getDescription());
+        rhiDrawTool->updateLights(descriptions, vparams->sceneBBox());
+    }
+
+    {
+        SOFARHI_TRACE_SCOPE("RHIGraphicUpdateResourcesVisitor");
+        RHIGraphicUpdateResourcesVisitor updateVisitor(vparams);
+        gRoot->execute(&updateVisitor);
+    }
+
+    // after the RHIModels have acquired their textures, and before their draws
+    if (DrawToolRHI* rhiDrawTool = dynamic_cast<DrawToolRHI*>(vparams->drawTool()))
+        rhiDrawTool->getTextureCache()->update(rhiDrawTool->getResourceUpdateBatch());
 
 #ifdef SOFA_DUMP_VISITOR_INFO
     simulation::Visitor::printCloseNode("UpdateRHIResources");
 #endif
 }
 
+void RHIVisualManagerLoop::warmUpStep(sofa::core::visual::VisualParams* vparams)
+{
+    if (!gRoot) return;
+
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::warmUpStep");
+
+    RHIGraphicWarmUpResourcesVisitor warmUpVisitor(vparams);
+    gRoot->execute(&warmUpVisitor);
+}
+
 void RHIVisualManagerLoop::updateContextStep(sofa::core::visual::VisualParams* vparams)
 {
     if (!gRoot) return;
+
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::updateContextStep");
+
     //dont really understand what does that do ??
     //(from the original DefaultVisualManagerLoop
     simulation::UpdateVisualContextVisitor vis(vparams);
@@ -100,17 +250,52 @@ void RHIVisualManagerLoop::updateContextStep(sofa::core::visual::VisualParams* v
 void RHIVisualManagerLoop::drawStep(sofa::core::visual::VisualParams* vparams)
 {
     if ( !gRoot ) return;
-    
+
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::drawStep");
+
     vparams->pass() = sofa::core::visual::VisualParams::Std;
 
     // RHI
+    SOFARHI_TRACE_SCOPE("RHIGraphicUpdateCommandsVisitor");
+    // the RHIModels only record their draws, submitted sorted by the viewer (DrawToolRHI::submitDrawQueue()) in the passes
     RHIGraphicUpdateCommandsVisitor act ( vparams );
     act.setTags(this->getTags());
     gRoot->execute ( &act );
 }
 
+void RHIVisualManagerLoop::updateStatisticsStep(sofa::core::visual::VisualParams* vparams)
+{
+    DrawToolRHI* rhiDrawTool = dynamic_cast<DrawToolRHI*>(vparams->drawTool());
+    if (!rhiDrawTool) return;
+
+    const auto& frameStatistics = rhiDrawTool->getFrameStatistics();
+
+    d_drawCalls.setValue(frameStatistics.drawCalls);
+    d_pipelineBinds.setValue(frameStatistics.pipelineBinds);
+    d_triangles.setValue(frameStatistics.triangles);
+    d_modelUploadedBytes.setValue(frameStatistics.modelUploadedBytes);
+    d_drawToolUploadedBytes.setValue(frameStatistics.drawToolUploadedBytes);
+    d_visitedModels.setValue(frameStatistics.visitedModels);
+    d_culledModels.setValue(frameStatistics.culledModels);
+    d_drawToolVertexBufferHighWaterMark.setValue(frameStatistics.drawToolVertexBufferHighWaterMark);
+    d_drawToolIndexBufferHighWaterMark.setValue(frameStatistics.drawToolIndexBufferHighWaterMark);
+    d_drawToolInstanceBufferHighWaterMark.setValue(frameStatistics.drawToolInstanceBufferHighWaterMark);
+
+    const auto& gpuTimings = frameStatistics.gpuTimings;
+    if (gpuTimings.valid)
+    {
+        d_gpuComputePassTime.setValue(gpuTimings.computePass);
+        d_gpuModelsTime.setValue(gpuTimings.models);
+        d_gpuDrawToolTime.setValue(gpuTimings.drawTool);
+        d_gpuRenderPassTime.setValue(gpuTimings.renderPass);
+        d_gpuFrameTime.setValue(gpuTimings.frame);
+    }
+}
+
 void RHIVisualManagerLoop::computeBBoxStep(sofa::core::visual::VisualParams* vparams, SReal* minBBox, SReal* maxBBox, bool init)
 {
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::computeBBoxStep");
+
     simulation::VisualComputeBBoxVisitor act(vparams);
     if ( gRoot )
         gRoot->execute ( act );
@@ -139,6 +324,8 @@ void RHIVisualManagerLoop::initComputeCommandsStep(sofa::core::visual::VisualPar
 {
     if (!gRoot) return;
 
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::initComputeCommandsStep");
+
     RHIComputeInitResourcesVisitor compInitVisitor(vparams);
     gRoot->execute(&compInitVisitor);
 }
@@ -147,6 +334,8 @@ void RHIVisualManagerLoop::updateComputeResourcesStep(sofa::core::visual::Visual
 {
     if (!gRoot) return;
 
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::updateComputeResourcesStep");
+
     RHIComputeUpdateResourcesVisitor compUpdateResVisitor(vparams);
     gRoot->execute(&compUpdateResVisitor);
 }
@@ -154,6 +343,8 @@ void RHIVisualManagerLoop::updateComputeCommandsStep(sofa::core::visual::VisualP
 {
     if (!gRoot) return;
 
+    SOFARHI_TRACE_SCOPE("RHIVisualManagerLoop::updateComputeCommandsStep");
+
     RHIComputeUpdateCommandsVisitor compUpdateComVisitor(vparams);
     gRoot->execute(&compUpdateComVisitor);
 }
@@ -33,7 +33,7 @@ public:
     /// (aka update resources)
     void updateContextStep(sofa::core::visual::VisualParams* vparams) override;
 
-    /// Render the scene (aka update command buffers)
+    /// Render the scene (aka record the draws of the RHIModels, before the passes)
     void drawStep(sofa::core::visual::VisualParams* vparams) override;
 
     /// Compute the bounding box of the scene. If init is set to "true", then minBBox and maxBBox will be initialised to a default value
@@ -51,7 +51,46 @@ public:
     // Update RHI Compute commands for RHIComputeModels
     void updateComputeCommandsStep(sofa::core::visual::VisualParams* vparams);
 
+    // Build the pipeline variants of the RHIGraphicModels after their initialization (by the viewers, at load)
+    void warmUpStep(sofa::core::visual::VisualParams* vparams);
+
+    // Publish the rendering counters of the last frame (to call after DrawToolRHI::endFrame())
+    void updateStatisticsStep(sofa::core::visual::VisualParams* vparams);
+
+    // Statistics (read-only, updated each frame)
+    Data<sofa::Size> d_drawCalls; ///< Number of draw calls
+    Data<sofa::Size> d_pipelineBinds; ///< Number of graphics pipelines bound
+    Data<sofa::Size> d_triangles; ///< Number of triangles submitted
+    Data<sofa::Size> d_modelUploadedBytes; ///< Bytes uploaded by the RHIModels
+    Data<sofa::Size> d_drawToolUploadedBytes; ///< Bytes uploaded by the DrawToolRHI
+    Data<sofa::Size> d_visitedModels; ///< Number of RHIGraphicModels visited
+    Data<sofa::Size> d_culledModels; ///< Number of RHIGraphicModels visited but not drawn
+    Data<sofa::Size> d_drawToolVertexBufferHighWaterMark; ///< Maximum bytes used in the DrawToolRHI vertex buffer
+    Data<sofa::Size> d_drawToolIndexBufferHighWaterMark; ///< Maximum bytes used in the DrawToolRHI index buffer
+    Data<sofa::Size> d_drawToolInstanceBufferHighWaterMark; ///< Maximum bytes used in the DrawToolRHI instance buffer
+    Data<bool> d_gpuTimings; ///< Measure the GPU time spent in each pass
+    Data<bool> d_showStatistics; ///< Display the statistics in the viewer
+    Data<double> d_gpuComputePassTime; ///< GPU time of the compute pass (ms)
+    Data<double> d_gpuModelsTime; ///< GPU time of the RHIModels draws (ms)
+    Data<double> d_gpuDrawToolTime; ///< GPU time of the DrawToolRHI draws (ms)
+    Data<double> d_gpuRenderPassTime; ///< GPU time of the render pass (ms)
+    Data<double> d_gpuFrameTime; ///< GPU time of the frame (ms)
+    Data<double> d_warmUpTime; ///< Time spent building the resources and pipelines at load (ms)
+
+    // Rendering
+    Data<bool> d_orderIndependentTransparency; ///< Weighted blended order-independent transparency for the transparent RHIModels
+    Data<bool> d_depthPrepass; ///< Depth-only pre-pass of the opaque RHIModels before shading them
+    Data<std::string> d_textureCacheDirectory; ///< Directory of the decoded textures kept between runs (disabled if empty)
+    Data<std::string> d_pipelineCacheDirectory; ///< Directory of the pipeline cache of the backend kept between runs (disabled if empty)
+
+    // Tracing
+    Data<bool> d_trace; ///< Record RHI frame activity and write it as a Chrome trace (chrome://tracing or Perfetto)
+    Data<std::string> d_traceFilename; ///< File where the trace is written
+
 protected:
+    // Start or stop the tracer when d_trace changes (flush the events when stopping)
+    void updateTracer();
+    bool m_bTraceRequested = false; // last value of d_trace applied to the tracer
 
     simulation::Node* gRoot;
 };
@@ -0,0 +1,180 @@
+#include <SofaRHI/RHIWeightedBlendedOIT.h>
+#include <SofaRHI/RHIShaderVariants.h>
+
+#include <sofa/helper/logging/Messaging.h>
+
+namespace sofa::rhi
+{
+
+RHIWeightedBlendedOIT::RHIWeightedBlendedOIT(QRhiPtr rhi)
+    : m_rhi(rhi)
+{
+}
+
+RHIWeightedBlendedOIT::~RHIWeightedBlendedOIT()
+{
+    delete m_compositePipeline;
+    delete m_compositeSrb;
+    delete m_sampler;
+    delete m_rpDesc;
+    delete m_renderTarget;
+    delete m_depthStencil;
+    delete m_coverageTexture;
+    delete m_accumulationTexture;
+}
+
+bool RHIWeightedBlendedOIT::resize(const QSize& size, QRhiRenderPassDescriptor* outputRpDesc)
+{
+    if (m_bFailed)
+        return false;
+
+    if (size != m_size)
+    {
+        if (!createResources(size))
+        {
+            m_bFailed = true;
+            return false;
+        }
+        m_size = size;
+    }
+
+    if (outputRpDesc != m_outputRpDesc)
+    {
+        if (!createCompositePipeline(outputRpDesc))
+        {
+            m_bFailed = true;
+            return false;
+        }
+        m_outputRpDesc = outputRpDesc;
+    }
+
+    return true;
+}
+
+bool RHIWeightedBlendedOIT::createResources(const QSize& size)
+{
+    if (m_renderTarget == nullptr)
+    {
+        if (!m_rhi->isTextureFormatSupported(QRhiTexture::RGBA16F))
+        {
+            msg_warning("RHIWeightedBlendedOIT") << "Half float textures are not supported, order-independent transparency is disabled";
+            return false;
+        }
+        const QRhiTexture::Format coverageFormat = m_rhi->isTextureFormatSupported(QRhiTexture::R8) ? QRhiTexture::R8 : QRhiTexture::RGBA8;
+
+        m_accumulationTexture = m_rhi->newTexture(QRhiTexture::RGBA16F, size, 1, QRhiTexture::RenderTarget);
+        m_coverageTexture = m_rhi->newTexture(coverageFormat, size, 1, QRhiTexture::RenderTarget);
+        m_depthStencil = m_rhi->newRenderBuffer(QRhiRenderBuffer::DepthStencil, size, 1);
+
+        QRhiTextureRenderTargetDescription description({ QRhiColorAttachment(m_accumulationTexture), QRhiColorAttachment(m_coverageTexture) });
+        description.setDepthStencilBuffer(m_depthStencil);
+        m_renderTarget = m_rhi->newTextureRenderTarget(description);
+        m_rpDesc = m_renderTarget->newCompatibleRenderPassDescriptor();
+        m_renderTarget->setRenderPassDescriptor(m_rpDesc);
+    }
+    else
+    {
+        m_accumulationTexture->setPixelSize(size);
+        m_coverageTexture->setPixelSize(size);
+        m_depthStencil->setPixelSize(size);
+    }
+
+    if (!m_accumulationTexture->build() || !m_coverageTexture->build() || !m_depthStencil->build())
+    {
+        msg_error("RHIWeightedBlendedOIT") << "Problem while building the accumulation targets";
+        return false;
+    }
+    if (!m_renderTarget->build())
+    {
+        msg_error("RHIWeightedBlendedOIT") << "Problem while building the accumulation render target";
+        return false;
+    }
+
+    // the textures have been rebuilt
+    if (m_compositeSrb && !m_compositeSrb->build())
+    {
+        msg_error("RHIWeightedBlendedOIT") << "Problem while building composite srb";
+        return false;
+    }
+
+    return true;
+}
+
+bool RHIWeightedBlendedOIT::createCompositePipeline(QRhiRenderPassDescriptor* outputRpDesc)
+{
+    const QShader vs = RHIShaderVariants::load("oit_composite.vert", RHIShaderVariants::NONE);
+    const QShader fs = RHIShaderVariants::load("oit_composite.frag", RHIShaderVariants::NONE);
+    if (!vs.isValid() || !fs.isValid())
+    {
+        msg_warning("RHIWeightedBlendedOIT") << "Composite shaders not found (compiled with SOFARHI_ENABLE_OIT?), order-independent transparency is disabled";
+        return false;
+    }
+
+    if (m_compositeSrb == nullptr)
+    {
+        // only fetched (texelFetch)
+        m_sampler = m_rhi->newSampler(QRhiSampler::Nearest, QRhiSampler::Nearest, QRhiSampler::None, QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge);
+        if (!m_sampler->build())
+        {
+            msg_error("RHIWeightedBlendedOIT") << "Problem while building sampler";
+            return false;
+        }
+
+        m_compositeSrb = m_rhi->newShaderResourceBindings();
+        m_compositeSrb->setBindings({
+            QRhiShaderResourceBinding::sampledTexture(0, QRhiShaderResourceBinding::FragmentStage, m_accumulationTexture, m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(1, QRhiShaderResourceBinding::FragmentStage, m_coverageTexture, m_sampler)
+        });
+        if (!m_compositeSrb->build())
+        {
+            msg_error("RHIWeightedBlendedOIT") << "Problem while building composite srb";
+            return false;
+        }
+    }
+
+    delete m_compositePipeline;
+    m_compositePipeline = m_rhi->newGraphicsPipeline();
+    m_compositePipeline->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+    m_compositePipeline->setVertexInputLayout(QRhiVertexInputLayout());
+    m_compositePipeline->setShaderResourceBindings(m_compositeSrb);
+    m_compositePipeline->setRenderPassDescriptor(outputRpDesc);
+    m_compositePipeline->setTopology(QRhiGraphicsPipeline::Topology::Triangles);
+    m_compositePipeline->setDepthTest(false);
+    m_compositePipeline->setDepthWrite(false);
+    QRhiGraphicsPipeline::TargetBlend alphaBlend;
+    alphaBlend.enable = true;
+    alphaBlend.srcColor = QRhiGraphicsPipeline::SrcAlpha;
+    alphaBlend.dstColor = QRhiGraphicsPipeline::OneMinusSrcAlpha;
+    alphaBlend.srcAlpha = QRhiGraphicsPipeline::One;
+    alphaBlend.dstAlpha = QRhiGraphicsPipeline::OneMinusSrcAlpha;
+    m_compositePipeline->setTargetBlends({ alphaBlend });
+
+    if (!m_compositePipeline->build())
+    {
+        msg_error("RHIWeightedBlendedOIT") << "Problem while building composite pipeline";
+        return false;
+    }
+
+    return true;
+}
+
+void RHIWeightedBlendedOIT::beginPass(QRhiCommandBuffer* cb, QRhiResourceUpdateBatch* updates)
+{
+    // both targets start at 0 (no color, no coverage), QRhi clears all the color attachments with the same color
+    cb->beginPass(m_renderTarget, QColor(0, 0, 0, 0), { 1.0f, 0 }, updates);
+}
+
+void RHIWeightedBlendedOIT::endPass(QRhiCommandBuffer* cb)
+{
+    cb->endPass();
+}
+
+void RHIWeightedBlendedOIT::composite(QRhiCommandBuffer* cb, const QRhiViewport& viewport)
+{
+    cb->setGraphicsPipeline(m_compositePipeline);
+    cb->setShaderResources(m_compositeSrb);
+    cb->setViewport(viewport);
+    cb->draw(3);
+}
+
+} // namespace sofa::rhi
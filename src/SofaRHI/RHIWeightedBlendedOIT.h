@@ -0,0 +1,55 @@
+#pragma once
+
+#include <SofaRHI/config.h>
+#include <SofaRHI/RHIUtils.h>
+
+#include <QtGui/private/qrhi_p.h>
+
+namespace sofa::rhi
+{
+
+/// Weighted blended order-independent transparency (McGuire and Bavoil, 2013).
+/// The transparent draws are accumulated in one unsorted pass, after the depth of the opaque draws:
+/// premultiplied color and alpha weighted by the depth in a RGBA16F target, and the coverage (1 - product of the (1 - alpha)) in a R8 target.
+/// The result is then blended over the opaque image, at the end of the main pass.
+class SOFA_SOFARHI_API RHIWeightedBlendedOIT
+{
+public:
+    RHIWeightedBlendedOIT(QRhiPtr rhi);
+    ~RHIWeightedBlendedOIT();
+
+    /// (Re)create the targets if needed; the composite pipeline is built for the render pass descriptor of the main pass.
+    /// Return false if the backend cannot render into the targets or if the shaders are missing
+    bool resize(const QSize& size, QRhiRenderPassDescriptor* outputRpDesc);
+
+    /// The pipelines of the accumulation pass (depth of the opaque draws, then transparent draws) are built with this one
+    QRhiRenderPassDescriptor* getRenderPassDescriptor() const { return m_rpDesc; }
+
+    /// Accumulation pass, to record before the main pass
+    void beginPass(QRhiCommandBuffer* cb, QRhiResourceUpdateBatch* updates);
+    void endPass(QRhiCommandBuffer* cb);
+
+    /// Blend the accumulated transparency over the current target (in the main pass, after the opaque draws)
+    void composite(QRhiCommandBuffer* cb, const QRhiViewport& viewport);
+
+private:
+    bool createResources(const QSize& size);
+    bool createCompositePipeline(QRhiRenderPassDescriptor* outputRpDesc);
+
+    QRhiPtr m_rhi;
+    bool m_bFailed = false;
+    QSize m_size;
+    QRhiRenderPassDescriptor* m_outputRpDesc = nullptr;
+
+    QRhiTexture* m_accumulationTexture = nullptr;
+    QRhiTexture* m_coverageTexture = nullptr;
+    QRhiRenderBuffer* m_depthStencil = nullptr;
+    QRhiTextureRenderTarget* m_renderTarget = nullptr;
+    QRhiRenderPassDescriptor* m_rpDesc = nullptr;
+
+    QRhiSampler* m_sampler = nullptr;
+    QRhiShaderResourceBindings* m_compositeSrb = nullptr;
+    QRhiGraphicsPipeline* m_compositePipeline = nullptr;
+};
+
+} // namespace sofa::rhi
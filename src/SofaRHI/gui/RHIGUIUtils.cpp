@@ -3,6 +3,12 @@
 #include <sofa/helper/system/PluginManager.h>
 #include <sofa/core/ObjectFactory.h>
 
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+
 namespace sofa::rhi::gui
 {
 
@@ -42,6 +48,60 @@ std::vector<std::string> RHIGUIUtils::GetSupportedAPIs()
     return supportedAPIs;
 }
 
+std::string RHIGUIUtils::SelectGraphicsAPI(const std::string& defaultKey)
+{
+    // SOFARHI_GRAPHICS_API=<ogl|vlk|d3d|mtl>
+    const char* apiEnv = std::getenv("SOFARHI_GRAPHICS_API");
+    if (!apiEnv || std::string(apiEnv).empty())
+        return defaultKey;
+
+    const std::vector<std::string> supportedAPIs = GetSupportedAPIs();
+    if (std::find(supportedAPIs.begin(), supportedAPIs.end(), apiEnv) == supportedAPIs.end())
+    {
+        msg_warning("RHIGUI") << "Unsupported graphics API " << apiEnv << " (SOFARHI_GRAPHICS_API), falling back to " << defaultKey;
+        return defaultKey;
+    }
+    return apiEnv;
+}
+
+#if VIEWER_USE_VULKAN
+namespace
+{
+QVulkanInstance* s_vulkanInstance = nullptr;
+
+void destroyVulkanInstance()
+{
+    delete s_vulkanInstance;
+    s_vulkanInstance = nullptr;
+}
+} // namespace
+
+QVulkanInstance* RHIGUIUtils::GetVulkanInstance()
+{
+    static bool s_bHasTried = false;
+    if (s_bHasTried)
+        return s_vulkanInstance;
+    s_bHasTried = true;
+
+    auto instance = std::make_unique<QVulkanInstance>();
+    // SOFARHI_VULKAN_VALIDATION=1
+    const char* validationEnv = std::getenv("SOFARHI_VULKAN_VALIDATION");
+    if (validationEnv && std::string(validationEnv) != "0")
+        instance->setLayers({ "VK_LAYER_KHRONOS_validation" });
+    instance->setExtensions(QRhiVulkanInitParams::preferredInstanceExtensions());
+    if (!instance->create())
+    {
+        msg_warning("RHIGUI") << "Failed to create the Vulkan instance (VkResult " << int(instance->errorCode()) << ")";
+        return nullptr;
+    }
+
+    // before the platform integration is destroyed
+    s_vulkanInstance = instance.release();
+    qAddPostRoutine(destroyVulkanInstance);
+    return s_vulkanInstance;
+}
+#endif // VIEWER_USE_VULKAN
+
 
 void RHIGUIUtils::DisablePluginComponents(const std::vector<std::string>& pluginNameList)
 {
@@ -77,4 +137,14 @@ void RHIGUIUtils::ReplaceVisualModelAliases(const std::vector<std::string>& alia
     }
 }
 
+void RHIGUIUtils::ReplaceLightAliases(const std::map<std::string, std::string>& aliases)
+{
+    for (const auto& [alias, lightClass] : aliases)
+    {
+        sofa::core::ObjectFactory::ClassEntry::SPtr classEntry;
+        sofa::core::ObjectFactory::AddAlias(alias, lightClass, true,
+            &classEntry);
+    }
+}
+
 } // namespace sofa::rhi::gui
\ No newline at end of file
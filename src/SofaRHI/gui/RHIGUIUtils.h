@@ -1,5 +1,7 @@
 #pragma once
 
+#include <SofaRHI/config.h>
+
 #include <QtGui/private/qrhinull_p.h>
 #include <QtGui/private/qshader_p.h>
 #if QT_CONFIG(opengl)
@@ -41,9 +43,21 @@ struct RHIGUIUtils
 
     static std::vector<std::string> GetSupportedAPIs();
 
+    // key of MapGraphicsAPI given by SOFARHI_GRAPHICS_API if it is supported, defaultKey otherwise
+    static std::string SelectGraphicsAPI(const std::string& defaultKey);
+
+#if VIEWER_USE_VULKAN
+    // created at the first call and kept until the application quits (the windows and the QRhi use it until their destruction),
+    // nullptr if Vulkan is not available
+    static QVulkanInstance* GetVulkanInstance();
+#endif // VIEWER_USE_VULKAN
+
     static void DisablePluginComponents(const std::vector<std::string>& pluginNameList);
 
     static void ReplaceVisualModelAliases(const std::vector<std::string>& aliases);
+
+    // light of SofaOpenglVisual -> RHILight with the same data
+    static void ReplaceLightAliases(const std::map<std::string, std::string>& aliases);
 };
 
 } // namespace sofa::rhi::gui
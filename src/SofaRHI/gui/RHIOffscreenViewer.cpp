@@ -2,6 +2,8 @@
 
 #include <SofaRHI/gui/RHIGUIUtils.h>
 #include <SofaRHI/RHIVisualManagerLoop.h>
+#include <SofaRHI/RHITracer.h>
+#include <SofaRHI/RHIPipelineCache.h>
 
 #include <sofa/helper/system/FileRepository.h>
 #include <sofa/helper/system/FileSystem.h>
@@ -16,6 +18,7 @@
 #include <sofa/gui/GUIManager.h>
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QOffscreenSurface>
 
@@ -93,27 +96,19 @@ RHIOffscreenViewer::RHIOffscreenViewer()
 #ifdef Q_OS_LINUX
     s_keyGgraphicsAPI = "ogl";
 #endif // Q_OS_WIN
+    s_keyGgraphicsAPI = RHIGUIUtils::SelectGraphicsAPI(s_keyGgraphicsAPI);
 
     const QRhi::Implementation graphicsAPI = sofa::rhi::gui::RHIGUIUtils::MapGraphicsAPI[s_keyGgraphicsAPI].first;
 
     //// RHI Setup
-    QRhiInitParams* initParams = nullptr;
+    const QRhi::Flags rhiFlags = QRhi::EnableProfiling | QRhi::EnablePipelineCacheDataSave;
 
-    if(graphicsAPI == QRhi::OpenGLES2)
-    {
-        QScopedPointer<QOffscreenSurface> offscreenSurface;
-        offscreenSurface.reset(QRhiGles2InitParams::newFallbackSurface());
-        QRhiGles2InitParams oglInitParams;
-        oglInitParams.fallbackSurface = offscreenSurface.data();
-        m_rhi.reset(QRhi::create(graphicsAPI, &oglInitParams));
-        msg_info("RHIViewer") << "Will use OpenGLES2";
-    }
 #ifdef Q_OS_WIN
     if (graphicsAPI == QRhi::D3D11)
     {
         QRhiD3D11InitParams d3dInitParams;
         //d3dInitParams.enableDebugLayer = true;
-        m_rhi.reset(QRhi::create(graphicsAPI, &d3dInitParams));
+        m_rhi.reset(QRhi::create(graphicsAPI, &d3dInitParams, rhiFlags));
         msg_info("RHIViewer") << "Will use D3D11";
     }
 #endif // Q_OS_WIN
@@ -121,32 +116,47 @@ RHIOffscreenViewer::RHIOffscreenViewer()
     if (graphicsAPI == QRhi::Metal)
     {
         QRhiMetalInitParams mtlInitParams;
-        m_rhi.reset(QRhi::create(graphicsAPI, &mtlInitParams));
+        m_rhi.reset(QRhi::create(graphicsAPI, &mtlInitParams, rhiFlags));
         msg_info("RHIViewer") << "Will use Metal";
     }
 #endif // Q_OS_DARWIN
 #if VIEWER_USE_VULKAN
     if (graphicsAPI == QRhi::Vulkan)
     {
-        //// Vulkan setup.
-        //QVulkanInstance inst;
-        //inst.create();
-        //m_window->setSurfaceType(QSurface::VulkanSurface);
-        //QRhiVulkanInitParams vulkanInitParams;
-        //vulkanInitParams.inst = m_window->vulkanInstance();
-        //vulkanInitParams.window = m_window;
-        //m_window->setVulkanInstance(&inst);
-        //msg_info("RHIViewer") << "Will use Vulkan";
+        // no window: offscreen frames only
+        if (QVulkanInstance* vulkanInstance = RHIGUIUtils::GetVulkanInstance())
+        {
+            QRhiVulkanInitParams vulkanInitParams;
+            vulkanInitParams.inst = vulkanInstance;
+            m_rhi.reset(QRhi::create(graphicsAPI, &vulkanInitParams, rhiFlags));
+            if (m_rhi)
+                msg_info("RHIViewer") << "Will use Vulkan";
+        }
     }
 #endif // VIEWER_USE_VULKAN
 
     if (!m_rhi)
     {
-        msg_fatal("RHIViewer") << "Not implemented yet";
+        if (graphicsAPI != QRhi::OpenGLES2)
+            msg_warning("RHIViewer") << "Could not create the " << RHIGUIUtils::MapGraphicsAPI[s_keyGgraphicsAPI].second << " backend, falling back to OpenGL";
+
+        QScopedPointer<QOffscreenSurface> offscreenSurface;
+        offscreenSurface.reset(QRhiGles2InitParams::newFallbackSurface());
+        QRhiGles2InitParams oglInitParams;
+        oglInitParams.fallbackSurface = offscreenSurface.data();
+        m_rhi.reset(QRhi::create(QRhi::OpenGLES2, &oglInitParams, rhiFlags));
+        msg_info("RHIViewer") << "Will use OpenGLES2";
+    }
+
+    if (!m_rhi)
+    {
+        msg_fatal("RHIViewer") << "Could not create any RHI backend";
         qFatal("Failed to create RHI backend, quitting.");
         //exit
     }
 
+    m_gpuProfiler = std::make_unique<RHIGpuProfiler>(m_rhi);
+
     // as a parameter
     const int outputWidth = 1280;
     const int outputHeight = 720;
@@ -181,6 +191,9 @@ RHIOffscreenViewer::RHIOffscreenViewer()
     ///// And replace all VisualModel/OglModel with RHIModel
     RHIGUIUtils::ReplaceVisualModelAliases({ "VisualModel", "OglModel" });
 
+    ///// And the lights with the RHI ones
+    RHIGUIUtils::ReplaceLightAliases({ { "DirectionalLight", "RHIDirectionalLight" }, { "PositionalLight", "RHIPositionalLight" }, { "SpotLight", "RHISpotLight" } });
+
 
     m_groot = nullptr;
 }
@@ -238,30 +251,41 @@ void RHIOffscreenViewer::drawScene()
 
     if (!m_groot) return;
 
+    SOFARHI_TRACE_SCOPE("RHIOffscreenViewer::drawScene");
+
     QRhiCommandBuffer* cb;
 
     if (m_rhi->beginOffscreenFrame(&cb) != QRhi::FrameOpSuccess)
         return;
 
+    m_gpuProfiler->setEnabled(m_rhiloop->d_gpuTimings.getValue());
+    m_gpuProfiler->beginFrame();
+
     QRhiResourceUpdateBatch* updates;
     updates = (m_rhi->nextResourceUpdateBatch());
 
     m_drawTool->beginFrame(m_vparams, updates, cb, m_offscreenViewport);
 
-#ifdef ENABLE_RHI_COMPUTE
+#if SOFARHI_ENABLE_COMPUTE
     // Optional Compute Stage
-    // test if compute shader is available blabla
-    if (!m_bHasInitTexture)
+    if (m_rhi->isFeatureSupported(QRhi::Compute))
     {
-        m_rhiloop->initComputeCommandsStep(m_vparams);
-    }
+        if (!m_bHasInitTexture)
+        {
+            m_rhiloop->initComputeCommandsStep(m_vparams);
+        }
 
-    m_rhiloop->updateComputeResourcesStep(m_vparams); // will call Visitor for updating RHI Compute resources for RHIComputeModels
-    cb->beginComputePass(updates);
-    m_rhiloop->updateComputeCommandsStep(m_vparams); // will call Visitor for updating RHI Compute commands for RHIComputeModels
+        m_rhiloop->updateComputeResourcesStep(m_vparams); // will call Visitor for updating RHI Compute resources for RHIComputeModels
+        cb->beginComputePass(updates);
+        m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::COMPUTE_BEGIN);
+        m_rhiloop->updateComputeCommandsStep(m_vparams); // will call Visitor for updating RHI Compute commands for RHIComputeModels
 
-    cb->endComputePass();
-#endif // ENABLE_RHI_COMPUTE
+        m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::COMPUTE_END);
+        cb->endComputePass();
+        updates = m_rhi->nextResourceUpdateBatch(); // the previous one has been consumed by the compute pass
+        m_drawTool->setResourceUpdateBatch(updates);
+    }
+#endif // SOFARHI_ENABLE_COMPUTE
 
     // Rendering Stage
     if (!m_bHasInitTexture) // "initTexture" is the super old function for initVisual
@@ -270,15 +294,45 @@ void RHIOffscreenViewer::drawScene()
         m_bHasInitTexture = true;
     }
 
+    // before the resources: the RHIModels create the pipelines of the transparency passes
+    const bool transparencyPasses = updateTransparency(m_offscreenTexture->pixelSize());
+
+    m_drawTool->setDepthPrepass(m_rhiloop->d_depthPrepass.getValue());
+
     //getSimulation()->updateVisual(groot.get()); 
     m_rhiloop->updateRHIResourcesStep(m_vparams); // will call Visitor for updating RHI resources for RHIGraphicModels and Other BaseObjects
 
+    getSimulation()->draw(m_vparams, m_groot.get()); // will call Visitor for recording the draws of the RHIModels (only)
+
+    // only if a shadow caster or a light has changed, the maps are sampled as they are otherwise
+    if (m_drawTool->renderShadowMaps(cb, updates))
+    {
+        updates = m_rhi->nextResourceUpdateBatch(); // the previous one has been consumed by the shadow pass
+        m_drawTool->setResourceUpdateBatch(updates);
+    }
+
+    if (transparencyPasses)
+    {
+        m_transparency->beginPass(cb, updates);
+        m_drawTool->submitDrawQueue(RHIDrawQueue::Pass::TRANSPARENCY_DEPTH);
+        m_drawTool->submitDrawQueue(RHIDrawQueue::Pass::TRANSPARENCY_ACCUMULATION);
+        m_transparency->endPass(cb);
+        updates = nullptr; // consumed by the transparency pass
+    }
+
     cb->beginPass(m_offscreenTextureRenderTarget, Qt::gray, { 1.0f, 0 }, updates);
+    m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::RENDER_BEGIN);
+    m_drawTool->submitDrawQueue(RHIDrawQueue::Pass::DEPTH_PREPASS); // empty without the depth pre-pass
     
-    getSimulation()->draw(m_vparams, m_groot.get()); // will call Visitor for updating RHI commands for RHIModels (only)
+    m_drawTool->submitDrawQueue(); // commands for the RHIModels
+    m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::MODELS_END);
 
     m_drawTool->executeCommands(); // will execute commands for Other BaseObjects
 
+    if (transparencyPasses)
+        m_transparency->composite(cb, m_offscreenViewport);
+    m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::RENDER_END);
+
     updates = (m_rhi->nextResourceUpdateBatch());
     QRhiReadbackDescription rb(m_offscreenTexture);
     QRhiReadbackResult rbResult;
@@ -288,6 +342,8 @@ void RHIOffscreenViewer::drawScene()
     cb->endPass(updates);
 
     m_drawTool->endFrame();
+    m_drawTool->getFrameStatistics().gpuTimings = m_gpuProfiler->getTimings();
+    m_rhiloop->updateStatisticsStep(m_vparams);
 
     m_rhi->endOffscreenFrame();
 
@@ -312,6 +368,28 @@ void RHIOffscreenViewer::drawScene()
 
 }
 
+bool RHIOffscreenViewer::updateTransparency(const QSize& outputSize)
+{
+#if SOFARHI_ENABLE_OIT
+    if (m_rhiloop->d_orderIndependentTransparency.getValue())
+    {
+        if (!m_transparency)
+            m_transparency = std::make_unique<RHIWeightedBlendedOIT>(m_rhi);
+
+        if (m_transparency->resize(outputSize, m_rpDesc.get()))
+        {
+            m_drawTool->setTransparencyRenderPassDescriptor(m_transparency->getRenderPassDescriptor());
+            return true;
+        }
+    }
+#else
+    SOFA_UNUSED(outputSize);
+#endif // SOFARHI_ENABLE_OIT
+
+    m_drawTool->setTransparencyRenderPassDescriptor(nullptr);
+    return false;
+}
+
 void RHIOffscreenViewer::checkScene()
 {
     sofa::core::visual::VisualLoop::SPtr vloop;
@@ -334,6 +412,10 @@ void RHIOffscreenViewer::checkScene()
             m_groot->addObject(m_rhiloop);
             m_rhiloop->init();
         }
+        else
+        {
+            m_rhiloop = sofa::core::objectmodel::SPtr_dynamic_cast<RHIVisualManagerLoop>(vloop);
+        }
     }
 }
 
@@ -390,6 +472,8 @@ int RHIOffscreenViewer::mainLoop()
             m_currentIterations++;
         }
 
+        // with the pipelines built since the warm-up
+        RHIPipelineCache::save(m_rhi.get(), m_pipelineCacheDirectory);
     }
     return 0;
 }
@@ -436,6 +520,43 @@ void RHIOffscreenViewer::setScene(sofa::simulation::Node::SPtr groot, const char
     m_currentCamera->setBoundingBox(groot->f_bbox.getValue().minBBox(), groot->f_bbox.getValue().maxBBox());
 
     resetScene();
+
+    warmUp();
+}
+
+void RHIOffscreenViewer::warmUp()
+{
+    using sofa::simulation::getSimulation;
+
+    if (!m_groot || !m_rhiloop || m_bHasInitTexture) return;
+
+    SOFARHI_TRACE_SCOPE("RHIOffscreenViewer::warmUp");
+    QElapsedTimer timer;
+    timer.start();
+
+    // pipelines compiled by the previous runs
+    m_pipelineCacheDirectory = m_rhiloop->d_pipelineCacheDirectory.getValue();
+    if (RHIPipelineCache::load(m_rhi.get(), m_pipelineCacheDirectory))
+        msg_info("RHIOffscreenViewer") << "Pipeline cache read from " << m_pipelineCacheDirectory;
+
+    // what the first frame would do (the resources are created outside of a frame, nothing is uploaded)
+    m_drawTool->initRHI();
+#if SOFARHI_ENABLE_COMPUTE
+    if (m_rhi->isFeatureSupported(QRhi::Compute))
+        m_rhiloop->initComputeCommandsStep(m_vparams);
+#endif // SOFARHI_ENABLE_COMPUTE
+    getSimulation()->initTextures(m_groot.get());
+    m_bHasInitTexture = true;
+
+    // then the variants of the pipelines built when first needed
+    updateTransparency(m_offscreenTexture->pixelSize());
+    m_rhiloop->warmUpStep(m_vparams);
+
+    const double warmUpTime = double(timer.nsecsElapsed()) / 1e6;
+    m_rhiloop->d_warmUpTime.setValue(warmUpTime);
+    msg_info("RHIOffscreenViewer") << "Warm-up: " << warmUpTime << " ms (" << m_drawTool->getSharedPipelineCount() << " shared pipelines)";
+
+    RHIPipelineCache::save(m_rhi.get(), m_pipelineCacheDirectory);
 }
 
 void RHIOffscreenViewer::resetScene()
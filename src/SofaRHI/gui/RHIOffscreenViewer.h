@@ -1,6 +1,8 @@
 #pragma once
 
 #include <SofaRHI/DrawToolRHI.h>
+#include <SofaRHI/RHIGpuProfiler.h>
+#include <SofaRHI/RHIWeightedBlendedOIT.h>
 #include <SofaRHI/RHIVisualManagerLoop.h>
 
 #include <sofa/gui/BaseGUI.h>
@@ -46,6 +48,10 @@ private:
     void resetView();
     void checkScene();
     void drawScene();
+    bool updateTransparency(const QSize& outputSize);
+    // build the resources and pipelines of the scene at load instead of in the first frames
+    void warmUp();
+    std::string m_pipelineCacheDirectory; // of the current scene (see RHIPipelineCache)
 
     //Application
     static const int DEFAULT_NUMBER_OF_ITERATIONS;
@@ -66,6 +72,8 @@ private:
     DrawToolRHI* m_drawTool;
     std::shared_ptr<QRhi> m_rhi;
     std::shared_ptr<QRhiRenderPassDescriptor> m_rpDesc;
+    std::unique_ptr<RHIGpuProfiler> m_gpuProfiler;
+    std::unique_ptr<RHIWeightedBlendedOIT> m_transparency; // created when enabled
 
     bool m_bHasInitTexture = false;
 
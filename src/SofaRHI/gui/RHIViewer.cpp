@@ -2,6 +2,8 @@
 
 #include <SofaRHI/gui/RHIGUIUtils.h>
 #include <SofaRHI/RHIVisualManagerLoop.h>
+#include <SofaRHI/RHITracer.h>
+#include <SofaRHI/RHIPipelineCache.h>
 
 #include <sofa/helper/system/FileRepository.h>
 #include <sofa/core/objectmodel/KeypressedEvent.h>
@@ -17,6 +19,8 @@
 #include <sofa/helper/system/FileSystem.h>
 
 #include <QSurfaceFormat>
+#include <QLabel>
+#include <QElapsedTimer>
 
 #include <cxxopts.hpp>
 
@@ -80,26 +84,19 @@ RHIViewer::RHIViewer(QWidget* parent, const char* name, const unsigned int nbMSA
 #ifdef Q_OS_LINUX
     s_keyGgraphicsAPI = "ogl";
 #endif // Q_OS_WIN
+    s_keyGgraphicsAPI = RHIGUIUtils::SelectGraphicsAPI(s_keyGgraphicsAPI);
 
     const QRhi::Implementation graphicsAPI = sofa::rhi::gui::RHIGUIUtils::MapGraphicsAPI[s_keyGgraphicsAPI].first;
 
     //// RHI Setup
-    QRhiInitParams* initParams = nullptr;
+    const QRhi::Flags rhiFlags = QRhi::EnableProfiling | QRhi::EnablePipelineCacheDataSave;
 
-    if(graphicsAPI == QRhi::OpenGLES2)
-    {
-        m_window->setFormat(QRhiGles2InitParams::adjustedFormat());
-        QRhiGles2InitParams oglInitParams;
-        oglInitParams.fallbackSurface = QRhiGles2InitParams::newFallbackSurface();
-        m_rhi.reset(QRhi::create(graphicsAPI, &oglInitParams));
-        msg_info("RHIViewer") << "Will use OpenGLES2";
-    }
 #ifdef Q_OS_WIN
     if (graphicsAPI == QRhi::D3D11)
     {
         m_window->setSurfaceType(QSurface::OpenGLSurface);
         QRhiD3D11InitParams d3dInitParams;
-        m_rhi.reset(QRhi::create(graphicsAPI, &d3dInitParams));
+        m_rhi.reset(QRhi::create(graphicsAPI, &d3dInitParams, rhiFlags));
         msg_info("RHIViewer") << "Will use D3D11";
     }
 #endif // Q_OS_WIN
@@ -108,33 +105,60 @@ RHIViewer::RHIViewer(QWidget* parent, const char* name, const unsigned int nbMSA
     {
         m_window->setSurfaceType(QSurface::MetalSurface);
         QRhiMetalInitParams mtlInitParams;
-        m_rhi.reset(QRhi::create(graphicsAPI, &mtlInitParams));
+        m_rhi.reset(QRhi::create(graphicsAPI, &mtlInitParams, rhiFlags));
         msg_info("RHIViewer") << "Will use Metal";
     }
 #endif // Q_OS_DARWIN
 #if VIEWER_USE_VULKAN
     if (graphicsAPI == QRhi::Vulkan)
     {
-        // Vulkan setup.
-        QVulkanInstance inst;
-        inst.create();
-        m_window->setSurfaceType(QSurface::VulkanSurface);
-        QRhiVulkanInitParams vulkanInitParams;
-        vulkanInitParams.inst = m_window->vulkanInstance();
-        vulkanInitParams.window = m_window;
-        m_window->setVulkanInstance(&inst);
-        msg_info("RHIViewer") << "Will use Vulkan";
+        // the instance has to outlive the window and the QRhi, and be set before the window is created
+        if (QVulkanInstance* vulkanInstance = RHIGUIUtils::GetVulkanInstance())
+        {
+            m_window->setSurfaceType(QSurface::VulkanSurface);
+            m_window->setVulkanInstance(vulkanInstance);
+            // the surface is needed by the render pass descriptor of the swap chain (color format, samples),
+            // which the DrawTool, the RHIModels and the warm-up build their pipelines with
+            m_window->create();
+            QRhiVulkanInitParams vulkanInitParams;
+            vulkanInitParams.inst = vulkanInstance;
+            vulkanInitParams.window = m_window;
+            m_rhi.reset(QRhi::create(graphicsAPI, &vulkanInitParams, rhiFlags));
+            if (m_rhi)
+                msg_info("RHIViewer") << "Will use Vulkan (" << m_rhi->resourceLimit(QRhi::FramesInFlight) << " frames in flight)";
+        }
     }
 #endif // VIEWER_USE_VULKAN
 
     if (!m_rhi)
     {
-        msg_fatal("RHIViewer") << "Not implemented yet";
+        if (graphicsAPI != QRhi::OpenGLES2)
+            msg_warning("RHIViewer") << "Could not create the " << RHIGUIUtils::MapGraphicsAPI[s_keyGgraphicsAPI].second << " backend, falling back to OpenGL";
+
+        if (m_window->handle())
+            m_window->destroy(); // created as a Vulkan window
+        m_window->setSurfaceType(QSurface::OpenGLSurface);
+        m_window->setFormat(QRhiGles2InitParams::adjustedFormat());
+        QRhiGles2InitParams oglInitParams;
+        oglInitParams.fallbackSurface = QRhiGles2InitParams::newFallbackSurface();
+        m_rhi.reset(QRhi::create(QRhi::OpenGLES2, &oglInitParams, rhiFlags));
+        msg_info("RHIViewer") << "Will use OpenGLES2";
+    }
+
+    if (!m_rhi)
+    {
+        msg_fatal("RHIViewer") << "Could not create any RHI backend";
         qFatal("Failed to create RHI backend, quitting.");
         //exit
     }
 
     m_container = createWindowContainer(m_window, this);
+
+    m_statisticsLabel = new QLabel(this);
+    m_statisticsLabel->setTextFormat(Qt::PlainText);
+    m_statisticsLabel->hide();
+
+    m_gpuProfiler = std::make_unique<RHIGpuProfiler>(m_rhi);
     
     m_ds = m_rhi->newRenderBuffer(QRhiRenderBuffer::DepthStencil,
         QSize(), // no need to set the size yet
@@ -148,7 +172,9 @@ RHIViewer::RHIViewer(QWidget* parent, const char* name, const unsigned int nbMSA
     //m_swapChain->setFlags(QRhiSwapChain::UsedAsTransferSource);
     m_rpDesc.reset(m_swapChain->newCompatibleRenderPassDescriptor());
     m_swapChain->setRenderPassDescriptor(m_rpDesc.get());
-    m_swapChain->buildOrResize();
+    // a Vulkan swap chain needs the size of the exposed window: it is built at the first exposure
+    if (m_rhi->backend() != QRhi::Vulkan)
+        m_swapChain->buildOrResize();
 
     /////
     m_backend.reset(new RHIBackend(this));
@@ -165,6 +191,9 @@ RHIViewer::RHIViewer(QWidget* parent, const char* name, const unsigned int nbMSA
     ///// And replace all VisualModel/OglModel with RHIModel
     RHIGUIUtils::ReplaceVisualModelAliases({"VisualModel", "OglModel"});
 
+    ///// And the lights with the RHI ones
+    RHIGUIUtils::ReplaceLightAliases({ { "DirectionalLight", "RHIDirectionalLight" }, { "PositionalLight", "RHIPositionalLight" }, { "SpotLight", "RHISpotLight" } });
+
     groot = nullptr;
     initTexturesDone = false;
 
@@ -746,7 +775,14 @@ void RHIViewer::wait()
 
 void RHIViewer::resizeView(QSize size)
 {
-    m_container->resize(size);
+    // the statistics are displayed in a strip above the rendering
+    int statisticsHeight = 0;
+    if (m_statisticsLabel->isVisible())
+    {
+        statisticsHeight = m_statisticsLabel->sizeHint().height();
+        m_statisticsLabel->setGeometry(0, 0, size.width(), statisticsHeight);
+    }
+    m_container->setGeometry(0, statisticsHeight, size.width(), size.height() - statisticsHeight);
     //m_defaultCamera->lens()->setPerspectiveProjection(45.f, float(size.width()) / float(size.height()), 0.01f, 1000.f);
 
 }
@@ -825,13 +861,15 @@ void RHIViewer::resizeSwapChain()
     m_ds->setPixelSize(outputSize);
     m_ds->build(); // == m_ds->release(); m_ds->build();
 
-    m_swapChain->buildOrResize();
-
+    m_bHasSwapChain = m_swapChain->buildOrResize();
 }
 
 void RHIViewer::drawScene()
 {
-    if (!groot) return;
+    // nothing to present to before the first exposure (and no Vulkan surface)
+    if (!groot || !m_window->isExposed()) return;
+
+    SOFARHI_TRACE_SCOPE("RHIViewer::drawScene");
 
     if (m_swapChain->currentPixelSize() != m_swapChain->surfacePixelSize() || m_newlyExposed)
     {
@@ -851,6 +889,9 @@ void RHIViewer::drawScene()
         return;
     }
 
+    m_gpuProfiler->setEnabled(m_rhiloop->d_gpuTimings.getValue());
+    m_gpuProfiler->beginFrame();
+
     QRhiCommandBuffer* cb = m_swapChain->currentFrameCommandBuffer();
     QRhiResourceUpdateBatch* updates;
     updates = (m_rhi->nextResourceUpdateBatch());
@@ -861,20 +902,26 @@ void RHIViewer::drawScene()
 
     m_drawTool->beginFrame(m_vparams, updates, cb, viewport);
 
-#ifdef ENABLE_RHI_COMPUTE
+#if SOFARHI_ENABLE_COMPUTE
     // Optional Compute Stage
-    // test if compute shader is available blabla
-    if (!m_bHasInitTexture)
+    if (m_rhi->isFeatureSupported(QRhi::Compute))
     {
-        m_rhiloop->initComputeCommandsStep(m_vparams);
-    }
+        if (!m_bHasInitTexture)
+        {
+            m_rhiloop->initComputeCommandsStep(m_vparams);
+        }
 
-    m_rhiloop->updateComputeResourcesStep(m_vparams); // will call Visitor for updating RHI Compute resources for RHIComputeModels
-    cb->beginComputePass(updates);
-    m_rhiloop->updateComputeCommandsStep(m_vparams); // will call Visitor for updating RHI Compute commands for RHIComputeModels
+        m_rhiloop->updateComputeResourcesStep(m_vparams); // will call Visitor for updating RHI Compute resources for RHIComputeModels
+        cb->beginComputePass(updates);
+        m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::COMPUTE_BEGIN);
+        m_rhiloop->updateComputeCommandsStep(m_vparams); // will call Visitor for updating RHI Compute commands for RHIComputeModels
 
-    cb->endComputePass();
-#endif // ENABLE_RHI_COMPUTE
+        m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::COMPUTE_END);
+        cb->endComputePass();
+        updates = m_rhi->nextResourceUpdateBatch(); // the previous one has been consumed by the compute pass
+        m_drawTool->setResourceUpdateBatch(updates);
+    }
+#endif // SOFARHI_ENABLE_COMPUTE
 
     // Rendering Stage
     if (!m_bHasInitTexture) // "initTexture" is the super old function for initVisual
@@ -883,10 +930,35 @@ void RHIViewer::drawScene()
         m_bHasInitTexture = true;
     }
 
+    // before the resources: the RHIModels create the pipelines of the transparency passes
+    const bool transparencyPasses = updateTransparency(outputSize);
+
+    m_drawTool->setDepthPrepass(m_rhiloop->d_depthPrepass.getValue());
+
     //getSimulation()->updateVisual(groot.get()); 
     m_rhiloop->updateRHIResourcesStep(m_vparams); // will call Visitor for updating RHI resources for RHIGraphicModels and Other BaseObjects
 
+    getSimulation()->draw(m_vparams, groot.get()); // will call Visitor for recording the draws of the RHIModels (only)
+
+    // only if a shadow caster or a light has changed, the maps are sampled as they are otherwise
+    if (m_drawTool->renderShadowMaps(cb, updates))
+    {
+        updates = m_rhi->nextResourceUpdateBatch(); // the previous one has been consumed by the shadow pass
+        m_drawTool->setResourceUpdateBatch(updates);
+    }
+
+    if (transparencyPasses)
+    {
+        m_transparency->beginPass(cb, updates);
+        m_drawTool->submitDrawQueue(RHIDrawQueue::Pass::TRANSPARENCY_DEPTH);
+        m_drawTool->submitDrawQueue(RHIDrawQueue::Pass::TRANSPARENCY_ACCUMULATION);
+        m_transparency->endPass(cb);
+        updates = nullptr; // consumed by the transparency pass
+    }
+
     cb->beginPass(rt, Qt::gray, { 1.0f, 0 }, updates);
+    m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::RENDER_BEGIN);
+    m_drawTool->submitDrawQueue(RHIDrawQueue::Pass::DEPTH_PREPASS); // empty without the depth pre-pass
 
     if (m_bShowAxis)
     {
@@ -902,13 +974,21 @@ void RHIViewer::drawScene()
 
     }
     
-    getSimulation()->draw(m_vparams, groot.get()); // will call Visitor for updating RHI commands for RHIModels (only)
+    m_drawTool->submitDrawQueue(); // commands for the RHIModels
+    m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::MODELS_END);
 
     m_drawTool->executeCommands(); // will execute commands for Other BaseObjects
 
+    if (transparencyPasses)
+        m_transparency->composite(cb, viewport);
+
+    m_gpuProfiler->mark(cb, RHIGpuProfiler::Marker::RENDER_END);
     cb->endPass();
 
     m_drawTool->endFrame();
+    m_drawTool->getFrameStatistics().gpuTimings = m_gpuProfiler->getTimings();
+    m_rhiloop->updateStatisticsStep(m_vparams);
+    updateStatisticsOverlay();
 
     m_rhi->endFrame(m_swapChain);
         
@@ -920,6 +1000,69 @@ void RHIViewer::drawScene()
     emit( redrawn() );
 }
 
+bool RHIViewer::updateTransparency(const QSize& outputSize)
+{
+#if SOFARHI_ENABLE_OIT
+    if (m_rhiloop->d_orderIndependentTransparency.getValue())
+    {
+        if (!m_transparency)
+            m_transparency = std::make_unique<RHIWeightedBlendedOIT>(m_rhi);
+
+        if (m_transparency->resize(outputSize, m_rpDesc.get()))
+        {
+            m_drawTool->setTransparencyRenderPassDescriptor(m_transparency->getRenderPassDescriptor());
+            return true;
+        }
+    }
+#else
+    SOFA_UNUSED(outputSize);
+#endif // SOFARHI_ENABLE_OIT
+
+    m_drawTool->setTransparencyRenderPassDescriptor(nullptr);
+    return false;
+}
+
+void RHIViewer::updateStatisticsOverlay()
+{
+    const bool showStatistics = m_rhiloop->d_showStatistics.getValue();
+    if (showStatistics != m_statisticsLabel->isVisible())
+    {
+        m_statisticsLabel->setVisible(showStatistics);
+        resizeView(this->size());
+    }
+    if (!showStatistics)
+        return;
+
+    const auto& frameStatistics = m_drawTool->getFrameStatistics();
+    const auto& gpuTimings = frameStatistics.gpuTimings;
+
+    QString text = QString("draws: %1 | pipelines: %2 | triangles: %3 | upload: %4 KB (models) %5 KB (drawtool) | models: %6 (%7 culled)")
+        .arg(frameStatistics.drawCalls)
+        .arg(frameStatistics.pipelineBinds)
+        .arg(frameStatistics.triangles)
+        .arg(frameStatistics.modelUploadedBytes / 1024)
+        .arg(frameStatistics.drawToolUploadedBytes / 1024)
+        .arg(frameStatistics.visitedModels)
+        .arg(frameStatistics.culledModels);
+
+    if (m_gpuProfiler->isEnabled())
+    {
+        if (!gpuTimings.valid)
+            text += "\nGPU: not available";
+        else if (gpuTimings.perPass)
+            text += QString("\nGPU (ms): frame %1 | compute %2 | render %3 (models %4, drawtool %5)")
+                .arg(gpuTimings.frame, 0, 'f', 3)
+                .arg(gpuTimings.computePass, 0, 'f', 3)
+                .arg(gpuTimings.renderPass, 0, 'f', 3)
+                .arg(gpuTimings.models, 0, 'f', 3)
+                .arg(gpuTimings.drawTool, 0, 'f', 3);
+        else
+            text += QString("\nGPU (ms): frame %1").arg(gpuTimings.frame, 0, 'f', 3);
+    }
+
+    m_statisticsLabel->setText(text);
+}
+
 bool RHIViewer::load()
 {
 
@@ -947,14 +1090,63 @@ bool RHIViewer::load()
                 groot->addObject(m_rhiloop);
                 m_rhiloop->init();
             }
+            else
+            {
+                m_rhiloop = sofa::core::objectmodel::SPtr_dynamic_cast<RHIVisualManagerLoop>(vloop);
+            }
         }
+
+        // unless a frame has already been drawn
+        warmUp();
     }
 
     return res;
 }
 
+void RHIViewer::warmUp()
+{
+    using sofa::simulation::getSimulation;
+
+    if (!groot || m_bHasInitTexture) return;
+
+    SOFARHI_TRACE_SCOPE("RHIViewer::warmUp");
+    QElapsedTimer timer;
+    timer.start();
+
+    // pipelines compiled by the previous runs
+    m_pipelineCacheDirectory = m_rhiloop->d_pipelineCacheDirectory.getValue();
+    if (RHIPipelineCache::load(m_rhi.get(), m_pipelineCacheDirectory))
+        msg_info("RHIViewer") << "Pipeline cache read from " << m_pipelineCacheDirectory;
+
+    // what the first frame would do (the resources are created outside of a frame, nothing is uploaded)
+    m_drawTool->initRHI();
+#if SOFARHI_ENABLE_COMPUTE
+    if (m_rhi->isFeatureSupported(QRhi::Compute))
+        m_rhiloop->initComputeCommandsStep(m_vparams);
+#endif // SOFARHI_ENABLE_COMPUTE
+    getSimulation()->initTextures(groot.get());
+    m_bHasInitTexture = true;
+
+    // then the variants of the pipelines built when first needed (the surface may not have its size yet)
+    QSize outputSize = m_swapChain->surfacePixelSize();
+    if (outputSize.isEmpty())
+        outputSize = m_container->size() * m_container->devicePixelRatioF();
+    if (!outputSize.isEmpty())
+        updateTransparency(outputSize);
+    m_rhiloop->warmUpStep(m_vparams);
+
+    const double warmUpTime = double(timer.nsecsElapsed()) / 1e6;
+    m_rhiloop->d_warmUpTime.setValue(warmUpTime);
+    msg_info("RHIViewer") << "Warm-up: " << warmUpTime << " ms (" << m_drawTool->getSharedPipelineCount() << " shared pipelines)";
+
+    RHIPipelineCache::save(m_rhi.get(), m_pipelineCacheDirectory);
+}
+
 bool RHIViewer::unload()
 {
+    // with the pipelines built since the warm-up
+    RHIPipelineCache::save(m_rhi.get(), m_pipelineCacheDirectory);
+
     return SofaViewer::unload();
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <SofaRHI/DrawToolRHI.h>
+#include <SofaRHI/RHIGpuProfiler.h>
+#include <SofaRHI/RHIWeightedBlendedOIT.h>
 #include <SofaRHI/gui/RHIBackend.h>
 #include <SofaRHI/RHIVisualManagerLoop.h>
 
@@ -16,6 +18,8 @@
 #include <QtGui/private/qrhi_p.h>
 #include <QtGui/private/qrhinull_p.h>
 
+class QLabel;
+
 namespace sofa::rhi::gui
 {
 
@@ -131,6 +135,11 @@ private:
     bool m_notExposed { false };
     bool m_newlyExposed { false };
     void resizeSwapChain(); 
+    void updateStatisticsOverlay();
+    bool updateTransparency(const QSize& outputSize);
+    // build the resources and pipelines of the scene at load instead of in the first frames
+    void warmUp();
+    std::string m_pipelineCacheDirectory; // of the current scene (see RHIPipelineCache)
     RHIVisualManagerLoop::SPtr m_rhiloop;
     core::visual::VisualParams* m_vparams;
     DrawToolRHI* m_drawTool;
@@ -156,6 +165,9 @@ private:
 
     QWindow* m_window;
     QWidget* m_container;
+    QLabel* m_statisticsLabel = nullptr; // above the container (widgets cannot be drawn over a QWindow)
+    std::unique_ptr<RHIGpuProfiler> m_gpuProfiler;
+    std::unique_ptr<RHIWeightedBlendedOIT> m_transparency; // created when enabled
 
     bool m_bhasInit = false;
     bool m_bHasInitTexture = false;
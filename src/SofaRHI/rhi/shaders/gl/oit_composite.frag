@@ -0,0 +1,25 @@
+#version 440
+
+layout(location = 0) out vec4 frag_color;
+
+layout(binding = 0) uniform sampler2D u_accumulation;
+layout(binding = 1) uniform sampler2D u_coverage;
+
+void main()
+{
+	// same origin for the framebuffer and the textures rendered into, whatever the API
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+
+	// 1 - product of the (1 - alpha)
+	float coverage = texelFetch(u_coverage, texel, 0).r;
+	if(coverage < 0.00001)
+		discard;
+
+	vec4 accumulation = texelFetch(u_accumulation, texel, 0);
+	// avoid overflow of the accumulated color
+	if(isinf(max(max(abs(accumulation.r), abs(accumulation.g)), abs(accumulation.b))))
+		accumulation.rgb = vec3(accumulation.a);
+
+	// blended (source alpha) over the opaque image
+	frag_color = vec4(accumulation.rgb / max(accumulation.a, 0.00001), coverage);
+}
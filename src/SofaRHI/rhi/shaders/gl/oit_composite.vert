@@ -0,0 +1,13 @@
+#version 440
+
+out gl_PerVertex 
+{ 
+	vec4 gl_Position;
+};
+
+// fullscreen triangle, no vertex input
+void main()
+{
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,42 +1,176 @@
 #version 440
 
+// Permutations (see rhi/shadervariants.cmake):
+//  DIFFUSE_TEXTURE: the diffuse color from the texture instead of the material
+//  VERTEX_COLOR: the color of the vertices with a fixed material (DrawToolRHI)
+//  OIT: accumulation and coverage of the weighted blended order-independent transparency instead of the color
+//  LIGHTS: lit by the lights of the scene (LightUniform of DrawToolRHI) instead of a light at the camera
+//  SHADOWS: with LIGHTS, shadowed with the shadow maps of the lights (RHIShadowMaps)
+
 layout(location = 0) in vec3 out_world_position;
 layout(location = 1) in vec3 out_normal;
+#ifdef VERTEX_COLOR
+layout(location = 2) in vec4 out_color;
+#else
 layout(location = 2) in vec2 out_uv;
-layout(location = 3) in flat int out_materialID;
+#endif
 
+#ifdef OIT
+layout(location = 0) out vec4 frag_accumulation;
+layout(location = 1) out vec4 frag_coverage;
+#else
 layout(location = 0) out vec4 frag_color;
+#endif
 
-layout(std140, binding = 0) uniform CameraUniform 
+layout(std140, binding = 0) uniform CameraUniform
 {
     mat4 mvp_matrix;
     vec3 camera_position;
 } u_camerabuf;
 
-layout(std140, binding = 1) uniform MaterialUniform 
+#ifndef VERTEX_COLOR
+layout(std140, binding = 1) uniform MaterialUniform
 {
     vec4 ambient;
     vec4 diffuse;
     vec4 specular;
     vec4 shininess;
 } u_materialbuf;
+#endif
 
-void main()
+#ifdef DIFFUSE_TEXTURE
+layout(binding = 2) uniform sampler2D u_diffuseTexture;
+#endif
+
+#ifdef LIGHTS
+#define MAX_LIGHTS 32
+#define LIGHT_TILE_COUNT 144
+#define MAX_SHADOW_MAPS 4
+layout(std140, binding = 3) uniform LightUniform
+{
+    uvec4 light_info; // count, tile columns, tile rows, y up in the framebuffer
+    vec4 viewport; // x, y, width, height
+    vec4 light_position[MAX_LIGHTS]; // w = 0: direction towards a directional light
+    vec4 light_color[MAX_LIGHTS];
+    vec4 light_spot[MAX_LIGHTS]; // direction, cosine of the cutoff (-1: not a spot)
+    vec4 light_attenuation[MAX_LIGHTS]; // linear attenuation, spot exponent, range (0: infinite)
+    uvec4 tile_masks[LIGHT_TILE_COUNT / 4]; // bit i: the light i may shade the tile, tiles from the bottom left
+    vec4 light_shadow[MAX_LIGHTS]; // shadow map (-1: none), darkness
+    mat4 shadow_matrix[MAX_SHADOW_MAPS]; // world space -> texture coordinates and depth in the map
+    vec4 shadow_rect[MAX_SHADOW_MAPS]; // offset, scale of the map in the texture
+} u_lightbuf;
+
+#ifdef SHADOWS
+layout(binding = 4) uniform sampler2DShadow u_shadowMap;
+
+// 1 if lit, down to 1 - darkness in the shadow
+float shadowAttenuation(int i, vec3 norm, vec3 light_dir)
+{
+    vec4 shadow = u_lightbuf.light_shadow[i];
+    if (shadow.x < 0.0)
+        return 1.0;
+    int map = int(shadow.x);
+    vec4 p = u_lightbuf.shadow_matrix[map] * vec4(out_world_position, 1.0);
+    if (p.w <= 0.0)
+        return 1.0;
+    p.xyz /= p.w;
+    if (any(lessThan(p.xyz, vec3(0.0))) || any(greaterThan(p.xyz, vec3(1.0))))
+        return 1.0;
+    // against the acne of the surfaces facing away from the light
+    float bias = max(0.005 * (1.0 - dot(norm, light_dir)), 0.0005);
+    vec4 rect = u_lightbuf.shadow_rect[map];
+    float lit = texture(u_shadowMap, vec3(rect.xy + p.xy * rect.zw, p.z - bias));
+    return 1.0 - shadow.y * (1.0 - lit);
+}
+#endif
+
+// lights which may shade the tile of the fragment
+uint tileMask()
+{
+    vec2 uv = (gl_FragCoord.xy - u_lightbuf.viewport.xy) / u_lightbuf.viewport.zw;
+    if (u_lightbuf.light_info.w == 0u)
+        uv.y = 1.0 - uv.y;
+    uvec2 size = u_lightbuf.light_info.yz;
+    uvec2 tile = min(uvec2(max(uv, vec2(0.0)) * vec2(size)), size - uvec2(1u));
+    uint index = tile.y * size.x + tile.x;
+    return u_lightbuf.tile_masks[index / 4u][index % 4u];
+}
+
+vec3 shadeLight(int i, vec3 norm, vec3 view_dir, vec3 diffuse_color, vec3 specular_color, float shininess)
 {
+    vec4 position = u_lightbuf.light_position[i];
+    vec3 light_dir = position.xyz;
+    float attenuation = 1.0;
+    if (position.w != 0.0)
+    {
+        vec3 to_light = position.xyz - out_world_position;
+        float light_distance = length(to_light);
+        light_dir = to_light / max(light_distance, 1e-6);
+        vec4 light_attenuation = u_lightbuf.light_attenuation[i];
+        attenuation = 1.0 / (1.0 + light_attenuation.x * light_distance);
+        // down to 0 at the range, where the tiles stop
+        if (light_attenuation.z > 0.0)
+            attenuation = max(attenuation - 1.0 / 256.0, 0.0) * (256.0 / 255.0);
+        vec4 spot = u_lightbuf.light_spot[i];
+        if (spot.w > -1.0)
+        {
+            float spot_cos = dot(-light_dir, spot.xyz);
+            attenuation *= spot_cos < spot.w ? 0.0 : pow(spot_cos, light_attenuation.y);
+        }
+    }
+#ifdef SHADOWS
+    if (attenuation > 0.0)
+        attenuation *= shadowAttenuation(i, norm, light_dir);
+#endif
+    vec3 radiance = u_lightbuf.light_color[i].xyz * attenuation;
+
+    float diff = max(dot(norm, light_dir), 0.0);
+    vec3 reflect_dir = reflect(-light_dir, norm);
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), shininess);
+    return radiance * (diffuse_color * diff + specular_color * spec);
+}
+#endif
 
+void main()
+{
+#ifdef VERTEX_COLOR
+	vec4 diffusePart = out_color;
+	vec3 ambient_color = 0.1 * diffusePart.xyz;
+	vec3 specular_color = diffusePart.xyz;
+	float shininess = 32.0;
+#else
+#ifdef DIFFUSE_TEXTURE
+	vec4 diffusePart = texture(u_diffuseTexture, out_uv);
+#else
 	vec4 diffusePart = u_materialbuf.diffuse;
+#endif
 	if(diffusePart.a < 0.0001) // cheap full transparency
 		discard;
+	vec3 ambient_color = u_materialbuf.ambient.xyz;
+	vec3 specular_color = u_materialbuf.specular.xyz;
+	float shininess = u_materialbuf.shininess[0];
+#endif
 
+#ifdef LIGHTS
+	vec3 norm = normalize(out_normal);
+	vec3 view_dir = normalize(u_camerabuf.camera_position - out_world_position);
+	vec3 res_color = ambient_color;
+	// only the lights of the tile
+	uint mask = tileMask();
+	for (int i = 0; mask != 0u; i++, mask >>= 1)
+	{
+		if ((mask & 1u) != 0u)
+			res_color += shadeLight(i, norm, view_dir, diffusePart.xyz, specular_color, shininess);
+	}
+#else
 	// needed as uniform
-	vec3 light_pos = u_camerabuf.camera_position; //vec3(0.0, 30.0, 100.0);
+	vec3 light_pos = u_camerabuf.camera_position;
 	vec3 light_color = vec3(1.0, 1.0, 1.0);
-	float shininess = u_materialbuf.shininess[0];
 
 	// Ambient
-    vec3 ambient = u_materialbuf.ambient.xyz * light_color;//ambient_strength * light_color;
+	vec3 ambient = ambient_color * light_color;
 
-    // Diffuse
+	// Diffuse
 	vec3 norm = normalize(out_normal);
 	vec3 light_dir = normalize(light_pos - out_world_position);
 	float diff = max(dot(norm, light_dir), 0.0);
@@ -44,11 +178,20 @@ void main()
 
 	// Spec
 	vec3 view_dir = normalize(u_camerabuf.camera_position - out_world_position);
-	vec3 reflect_dir = reflect(-light_dir, norm);  
+	vec3 reflect_dir = reflect(-light_dir, norm);
 	float spec = pow(max(dot(view_dir, reflect_dir), 0.0), shininess);
-	vec3 specular = u_materialbuf.specular.xyz * spec * light_color;  
+	vec3 specular = specular_color * spec * light_color;
+
+	vec3 res_color = ambient + diffuse + specular;
+#endif
+#ifdef OIT
+	float alpha = diffusePart.a;
 
-    vec3 res_color = ambient + diffuse + specular;
+	// depth weight (McGuire and Bavoil, equation 10)
+	float weight = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+	frag_accumulation = vec4(res_color * alpha, alpha) * weight;
+	frag_coverage = vec4(alpha);
+#else
 	frag_color = vec4(res_color, diffusePart.a);
-    //frag_color = vec4(u_materialbuf.specular.xyz, 1.0) ;
-}
\ No newline at end of file
+#endif
+}
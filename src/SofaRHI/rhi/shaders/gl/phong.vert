@@ -1,28 +1,93 @@
 #version 440
 
+// Permutations (see rhi/shadervariants.cmake):
+//  VERTEX_COLOR: a color per vertex instead of texture coordinates
+//  INSTANCED: a translation per instance
+//  QUANTIZED: 16-bit positions relative to the bounding box and octahedral normals (see RHIVertexQuantization)
+
+#if defined(QUANTIZED) && defined(INSTANCED)
+#error "QUANTIZED and INSTANCED both use the location 3"
+#endif
+
+#ifdef QUANTIZED
+// 16-bit values split in high and low bytes (no 16-bit vertex format in Qt RHI)
+layout(location = 0) in vec4 position_high;
+layout(location = 3) in vec4 position_low;
+layout(location = 1) in vec4 normal_octahedral; // high u, high v, low u, low v
+#else
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec3 normal;
+#endif
+#ifdef VERTEX_COLOR
+layout(location = 2) in vec4 color;
+#else
 layout(location = 2) in vec2 uv;
+#endif
+#ifdef INSTANCED
+layout(location = 3) in vec4 instanceTranslation; // TODO as a transform matrix later
+#endif
 
 layout(location = 0) out vec3 out_world_position;
 layout(location = 1) out vec3 out_normal;
+#ifdef VERTEX_COLOR
+layout(location = 2) out vec4 out_color;
+#else
 layout(location = 2) out vec2 out_uv;
+#endif
 
-layout(std140, binding = 0) uniform CameraUniform 
+layout(std140, binding = 0) uniform CameraUniform
 {
     mat4 mvp_matrix;
     vec3 camera_position;
+#ifdef QUANTIZED
+    vec4 dequantization_offset;
+    vec4 dequantization_scale;
+#endif
 } u_camerabuf;
 
-out gl_PerVertex 
-{ 
+out gl_PerVertex
+{
 	vec4 gl_Position;
 };
 
+#ifdef QUANTIZED
+vec2 unpack16(vec2 high, vec2 low)
+{
+    return (high * 65280.0 + low * 255.0) / 65535.0;
+}
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#endif
+
 void main()
 {
+#ifdef QUANTIZED
+    vec3 q = vec3(unpack16(position_high.xy, position_low.xy), (position_high.z * 65280.0 + position_low.z * 255.0) / 65535.0);
+    vec4 position = vec4(u_camerabuf.dequantization_offset.xyz + q * u_camerabuf.dequantization_scale.xyz, 1.0);
+    vec3 normal = decodeOctahedral(unpack16(normal_octahedral.xy, normal_octahedral.zw) * 2.0 - 1.0);
+#endif
+
+#ifdef INSTANCED
+    mat4 instanceMatrix = mat4(1, 0, 0, 0,
+                               0, 1, 0, 0,
+                               0, 0, 1, 0,
+                               instanceTranslation.x, instanceTranslation.y, instanceTranslation.z, 1);
+    gl_Position = u_camerabuf.mvp_matrix * instanceMatrix * position;
+#else
     gl_Position = u_camerabuf.mvp_matrix * position;
+#endif
     out_world_position = position.xyz;
     out_normal = normal;
+#ifdef VERTEX_COLOR
+    out_color = color;
+#else
     out_uv = uv;
+#endif
 }
@@ -0,0 +1,7 @@
+#version 440
+
+// Shadow maps (RHIShadowMaps): depth only, with simple_matrix.vert
+
+void main()
+{
+}
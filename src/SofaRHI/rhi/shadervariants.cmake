@@ -0,0 +1,148 @@
+# Shaders of SofaRHI: each variant is a source compiled by qsb with the defines of its features, in the resources as
+# :/<variant>.qsb, and in the table of RHIShaderVariants (source file name + features -> resource).
+#   sofarhi_add_shader_variant(<variant> <source> [FEATURES <define>...] [OPTION <CMake options compiling it (all of them)>...]
+#                              [GLSL <GLSL versions, if the default ones are too old for the features>])
+# The features are the ones of RHIShaderVariants::Feature (a new one has to be added there and in SOFARHI_SHADER_FEATURES).
+# SOFARHI_COMPILE_SHADERS needs qsb. Without it, the .qsb files of the source tree are used instead (the missing ones are listed,
+# and not loaded at runtime): the SofaRHI_update_shaders target copies the compiled variants there, to be committed.
+
+set(SOFARHI_SHADER_FEATURES DIFFUSE_TEXTURE VERTEX_COLOR INSTANCED QUANTIZED OIT LIGHTS SHADOWS)
+
+function(sofarhi_add_shader_variant variant source)
+    cmake_parse_arguments(VARIANT "" "GLSL" "FEATURES;OPTION" ${ARGN})
+    foreach(option ${VARIANT_OPTION})
+        if(NOT ${option})
+            return()
+        endif()
+    endforeach()
+    foreach(feature ${VARIANT_FEATURES})
+        if(NOT feature IN_LIST SOFARHI_SHADER_FEATURES)
+            message(FATAL_ERROR "Shader variant ${variant}: unknown feature ${feature}")
+        endif()
+    endforeach()
+    set_property(GLOBAL APPEND PROPERTY SOFARHI_SHADER_VARIANTS ${variant})
+    set_property(GLOBAL PROPERTY SOFARHI_SHADER_VARIANT_SOURCE_${variant} ${source})
+    set_property(GLOBAL PROPERTY SOFARHI_SHADER_VARIANT_FEATURES_${variant} ${VARIANT_FEATURES})
+    set_property(GLOBAL PROPERTY SOFARHI_SHADER_VARIANT_GLSL_${variant} "${VARIANT_GLSL}")
+endfunction()
+
+sofarhi_add_shader_variant(shaders/gl/simple.vert shaders/gl/simple.vert)
+sofarhi_add_shader_variant(shaders/gl/simple_matrix.vert shaders/gl/simple_matrix.vert)
+sofarhi_add_shader_variant(shaders/gl/simple.frag shaders/gl/simple.frag)
+sofarhi_add_shader_variant(shaders/gl/simple_color.vert shaders/gl/simple_color.vert)
+sofarhi_add_shader_variant(shaders/gl/simple_color.frag shaders/gl/simple_color.frag)
+
+sofarhi_add_shader_variant(shaders/gl/phong.vert shaders/gl/phong.vert)
+sofarhi_add_shader_variant(shaders/gl/phong_color.vert shaders/gl/phong.vert FEATURES VERTEX_COLOR)
+sofarhi_add_shader_variant(shaders/gl/phong_color_instanced.vert shaders/gl/phong.vert FEATURES VERTEX_COLOR INSTANCED)
+sofarhi_add_shader_variant(shaders/gl/phong_quantized.vert shaders/gl/phong.vert FEATURES QUANTIZED OPTION SOFARHI_ENABLE_QUANTIZED_VERTICES)
+
+sofarhi_add_shader_variant(shaders/gl/phong.frag shaders/gl/phong.frag)
+sofarhi_add_shader_variant(shaders/gl/phong_color.frag shaders/gl/phong.frag FEATURES VERTEX_COLOR)
+sofarhi_add_shader_variant(shaders/gl/phong_diffuse_texture.frag shaders/gl/phong.frag FEATURES DIFFUSE_TEXTURE)
+sofarhi_add_shader_variant(shaders/gl/phong_oit.frag shaders/gl/phong.frag FEATURES OIT OPTION SOFARHI_ENABLE_OIT)
+sofarhi_add_shader_variant(shaders/gl/phong_diffuse_texture_oit.frag shaders/gl/phong.frag FEATURES DIFFUSE_TEXTURE OIT OPTION SOFARHI_ENABLE_OIT)
+# the light masks need the integer operations of GLSL 1.30 (ES 3.00)
+sofarhi_add_shader_variant(shaders/gl/phong_lights.frag shaders/gl/phong.frag FEATURES LIGHTS GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/phong_diffuse_texture_lights.frag shaders/gl/phong.frag FEATURES DIFFUSE_TEXTURE LIGHTS GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/phong_oit_lights.frag shaders/gl/phong.frag FEATURES OIT LIGHTS OPTION SOFARHI_ENABLE_OIT GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/phong_diffuse_texture_oit_lights.frag shaders/gl/phong.frag FEATURES DIFFUSE_TEXTURE OIT LIGHTS OPTION SOFARHI_ENABLE_OIT GLSL "150,300 es")
+# sampler2DShadow also needs GLSL 1.30 (ES 3.00)
+sofarhi_add_shader_variant(shaders/gl/phong_lights_shadows.frag shaders/gl/phong.frag FEATURES LIGHTS SHADOWS OPTION SOFARHI_ENABLE_SHADOWS GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/phong_diffuse_texture_lights_shadows.frag shaders/gl/phong.frag FEATURES DIFFUSE_TEXTURE LIGHTS SHADOWS OPTION SOFARHI_ENABLE_SHADOWS GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/phong_oit_lights_shadows.frag shaders/gl/phong.frag FEATURES OIT LIGHTS SHADOWS OPTION SOFARHI_ENABLE_OIT SOFARHI_ENABLE_SHADOWS GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/phong_diffuse_texture_oit_lights_shadows.frag shaders/gl/phong.frag FEATURES DIFFUSE_TEXTURE OIT LIGHTS SHADOWS OPTION SOFARHI_ENABLE_OIT SOFARHI_ENABLE_SHADOWS GLSL "150,300 es")
+sofarhi_add_shader_variant(shaders/gl/shadow.frag shaders/gl/shadow.frag OPTION SOFARHI_ENABLE_SHADOWS)
+sofarhi_add_shader_variant(shaders/gl/oit_composite.vert shaders/gl/oit_composite.vert OPTION SOFARHI_ENABLE_OIT)
+sofarhi_add_shader_variant(shaders/gl/oit_composite.frag shaders/gl/oit_composite.frag OPTION SOFARHI_ENABLE_OIT)
+
+sofarhi_add_shader_variant(computeshaders/gl/compute_face_normals.comp computeshaders/gl/compute_face_normals.comp OPTION SOFARHI_ENABLE_COMPUTE)
+sofarhi_add_shader_variant(computeshaders/gl/compute_vertex_normals.comp computeshaders/gl/compute_vertex_normals.comp OPTION SOFARHI_ENABLE_COMPUTE)
+sofarhi_add_shader_variant(computeshaders/gl/barycentric_mapping.comp computeshaders/gl/barycentric_mapping.comp OPTION SOFARHI_ENABLE_COMPUTE)
+
+# Compile the variants with qsb (with SOFARHI_COMPILE_SHADERS) into the build directory, and generate:
+#  - a qrc of the variants, whose rcc output is appended to <resource_files_var> (qt5_add_resources knows
+#    the qrc depends on the compiled variants, unlike AUTORCC)
+#  - RHIShaderVariantTable.inl, the table of RHIShaderVariants
+function(sofarhi_generate_shaders resource_files_var)
+    set(rhi_dir ${CMAKE_CURRENT_SOURCE_DIR}/${SOFARHI_SRC_DIR}/rhi)
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/rhi)
+    get_property(variants GLOBAL PROPERTY SOFARHI_SHADER_VARIANTS)
+
+    # the .qsb files of the source tree are not regenerated by the build: they lag behind the sources and lack variants
+    set(compile_shaders ${SOFARHI_COMPILE_SHADERS})
+    if(compile_shaders AND NOT SOFARHI_QSB_EXECUTABLE)
+        message(FATAL_ERROR "qsb not found: set SOFARHI_QSB_EXECUTABLE, or disable SOFARHI_COMPILE_SHADERS to use the shaders of the source tree")
+    endif()
+
+    set(table "")
+    set(qrc "<RCC>\n    <qresource prefix=\"/\">\n")
+    set(missing "")
+    set(outputs "")
+    set(update_commands "")
+    foreach(variant ${variants})
+        get_property(source GLOBAL PROPERTY SOFARHI_SHADER_VARIANT_SOURCE_${variant})
+        get_property(features GLOBAL PROPERTY SOFARHI_SHADER_VARIANT_FEATURES_${variant})
+        get_property(glsl GLOBAL PROPERTY SOFARHI_SHADER_VARIANT_GLSL_${variant})
+
+        get_filename_component(source_name ${source} NAME)
+        set(feature_mask "RHIShaderVariants::NONE")
+        if(features)
+            string(REPLACE ";" " | RHIShaderVariants::" feature_mask "RHIShaderVariants::${features}")
+        endif()
+        string(APPEND table "    { \"${source_name}\", ${feature_mask}, \":/${variant}.qsb\" },\n")
+
+        if(compile_shaders)
+            if(source MATCHES "\\.comp$")
+                set(qsb_args --glsl "430,310 es" --hlsl 50 --msl 12)
+            else()
+                set(qsb_args --glsl "150,120,100 es" -c --hlsl 50 --msl 12)
+            endif()
+            if(glsl)
+                list(REMOVE_AT qsb_args 1)
+                list(INSERT qsb_args 1 ${glsl})
+            endif()
+            foreach(feature ${features})
+                list(APPEND qsb_args -D ${feature})
+            endforeach()
+            set(output ${output_dir}/${variant}.qsb)
+            get_filename_component(output_variant_dir ${output} DIRECTORY)
+            add_custom_command(
+                OUTPUT ${output}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${output_variant_dir}
+                COMMAND ${SOFARHI_QSB_EXECUTABLE} ${qsb_args} -o ${output} ${rhi_dir}/${source}
+                DEPENDS ${rhi_dir}/${source}
+                COMMENT "Compiling shader ${variant}"
+                VERBATIM
+                )
+            string(APPEND qrc "        <file>${variant}.qsb</file>\n")
+            list(APPEND outputs ${output})
+            list(APPEND update_commands COMMAND ${CMAKE_COMMAND} -E copy_if_different ${output} ${rhi_dir}/${variant}.qsb)
+        elseif(EXISTS ${rhi_dir}/${variant}.qsb)
+            string(APPEND qrc "        <file alias=\"${variant}.qsb\">${rhi_dir}/${variant}.qsb</file>\n")
+        else()
+            list(APPEND missing ${variant})
+        endif()
+    endforeach()
+    string(APPEND qrc "    </qresource>\n</RCC>\n")
+
+    # written only if changed, to keep the generated files from triggering rebuilds
+    file(WRITE ${output_dir}/RHIShaderVariantTable.inl.tmp "// Generated from ${SOFARHI_SRC_DIR}/rhi/shadervariants.cmake\n${table}")
+    configure_file(${output_dir}/RHIShaderVariantTable.inl.tmp ${CMAKE_CURRENT_BINARY_DIR}/RHIShaderVariantTable.inl COPYONLY)
+
+    file(WRITE ${output_dir}/shadervariants.qrc.tmp "${qrc}")
+    configure_file(${output_dir}/shadervariants.qrc.tmp ${output_dir}/shadervariants.qrc COPYONLY)
+    qt5_add_resources(shader_resources ${output_dir}/shadervariants.qrc)
+    if(compile_shaders)
+        add_custom_target(SofaRHI_update_shaders
+            ${update_commands}
+            DEPENDS ${outputs}
+            COMMENT "Copying the compiled shader variants into ${SOFARHI_SRC_DIR}/rhi"
+            VERBATIM
+            )
+    endif()
+    set(${resource_files_var} ${${resource_files_var}} ${shader_resources} PARENT_SCOPE)
+    if(missing)
+        message(WARNING "Shaders not compiled in the source tree (not loaded at runtime, see SOFARHI_COMPILE_SHADERS and SofaRHI_update_shaders): ${missing}")
+    endif()
+endfunction()